@@ -218,6 +218,15 @@ mbedtls_ecp_keypair;
 #define MBEDTLS_ECP_FIXED_POINT_OPTIM  1   /**< Enable fixed-point speed-up */
 #endif /* MBEDTLS_ECP_FIXED_POINT_OPTIM */
 
+#if defined(MBEDTLS_ECP_COMB_CACHE) && !defined(MBEDTLS_ECP_COMB_CACHE_SIZE)
+/*
+ * Number of fixed points whose precomputed tables are kept with
+ * MBEDTLS_ECP_COMB_CACHE: the generator and, for instance, a peer's static
+ * public key. Each table of a 256-bit curve takes about 2 KB.
+ */
+#define MBEDTLS_ECP_COMB_CACHE_SIZE    2   /**< Number of cached fixed points */
+#endif /* MBEDTLS_ECP_COMB_CACHE_SIZE */
+
 /* \} name SECTION: Module settings */
 
 /*
@@ -546,6 +555,33 @@ int mbedtls_ecp_muladd( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
              const mbedtls_mpi *m, const mbedtls_ecp_point *P,
              const mbedtls_mpi *n, const mbedtls_ecp_point *Q );
 
+#if defined(MBEDTLS_ECP_COMB_CACHE)
+/**
+ * \brief           Precompute the table used to multiply a fixed point, and
+ *                  keep it for all the groups with the same id. Multiplying
+ *                  the point afterwards, in any group of the same curve,
+ *                  skips the precomputation.
+ *                  The generator is added automatically on first use.
+ *                  (Not thread-safe)
+ *
+ * \param grp       ECP group
+ * \param P         Point that will be multiplied repeatedly, e.g. a peer's
+ *                  static public key
+ *
+ * \return          0 if successful or if the point was already cached,
+ *                  MBEDTLS_ERR_ECP_BUFFER_TOO_SMALL if the cache is full,
+ *                  MBEDTLS_ERR_ECP_INVALID_KEY if P is not a valid pubkey,
+ *                  MBEDTLS_ERR_ECP_ALLOC_FAILED if memory allocation failed
+ */
+int mbedtls_ecp_comb_cache_add( mbedtls_ecp_group *grp, const mbedtls_ecp_point *P );
+
+/**
+ * \brief           Release the tables kept by mbedtls_ecp_comb_cache_add()
+ *                  and for the generators of the groups used.
+ */
+void mbedtls_ecp_comb_cache_free( void );
+#endif /* MBEDTLS_ECP_COMB_CACHE */
+
 /**
  * \brief           Check that a point is a valid public key on this curve
  *
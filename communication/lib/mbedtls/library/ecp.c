@@ -1302,6 +1302,164 @@ cleanup:
     return( ret );
 }
 
+#if defined(MBEDTLS_ECP_COMB_CACHE)
+/*
+ * Comb tables of fixed points, shared by all the groups with the same id:
+ * the generator of each curve in use, and the points registered with
+ * mbedtls_ecp_comb_cache_add(). The tables are kept until
+ * mbedtls_ecp_comb_cache_free() so that each new group (one per ECDH context
+ * or parsed key) doesn't compute them again.
+ *
+ * Not thread-safe: all handshakes are expected to run in the same thread.
+ */
+typedef struct
+{
+    mbedtls_ecp_group_id id;    /*!< group of the point, or MBEDTLS_ECP_DP_NONE if unused */
+    unsigned char w;            /*!< window size of the table                   */
+    unsigned char T_size;       /*!< number of points in the table              */
+    mbedtls_ecp_point P;        /*!< the point                                  */
+    mbedtls_ecp_point *T;       /*!< the precomputed points                     */
+}
+ecp_comb_cache_entry;
+
+static ecp_comb_cache_entry ecp_comb_cache[MBEDTLS_ECP_COMB_CACHE_SIZE];
+
+static int ecp_point_eq( const mbedtls_ecp_point *P, const mbedtls_ecp_point *Q )
+{
+    return( mbedtls_mpi_cmp_mpi( &P->X, &Q->X ) == 0 &&
+            mbedtls_mpi_cmp_mpi( &P->Y, &Q->Y ) == 0 &&
+            mbedtls_mpi_cmp_mpi( &P->Z, &Q->Z ) == 0 );
+}
+
+static ecp_comb_cache_entry *ecp_comb_cache_find( const mbedtls_ecp_group *grp,
+                                                  const mbedtls_ecp_point *P )
+{
+    size_t i;
+
+    if( grp->id == MBEDTLS_ECP_DP_NONE )
+        return( NULL );
+
+    for( i = 0; i < MBEDTLS_ECP_COMB_CACHE_SIZE; i++ )
+    {
+        if( ecp_comb_cache[i].id == grp->id && ecp_point_eq( &ecp_comb_cache[i].P, P ) )
+            return( &ecp_comb_cache[i] );
+    }
+
+    return( NULL );
+}
+
+/*
+ * Window size of the table of a point that is multiplied repeatedly:
+ * one more than for a single multiplication, as for the generator.
+ */
+static unsigned char ecp_comb_fixed_window( const mbedtls_ecp_group *grp )
+{
+    unsigned char w = ( grp->nbits >= 384 ? 5 : 4 ) + 1;
+
+    if( w > MBEDTLS_ECP_WINDOW_SIZE )
+        w = MBEDTLS_ECP_WINDOW_SIZE;
+    if( w >= grp->nbits )
+        w = 2;
+
+    return( w );
+}
+
+/*
+ * Compute and store the table of P, unless it's already cached
+ */
+static int ecp_comb_cache_insert( mbedtls_ecp_group *grp, const mbedtls_ecp_point *P,
+                                  ecp_comb_cache_entry **entry )
+{
+    int ret;
+    size_t i, d;
+    unsigned char w, T_size;
+    ecp_comb_cache_entry *slot = NULL;
+    mbedtls_ecp_point *T;
+
+    if( ( *entry = ecp_comb_cache_find( grp, P ) ) != NULL )
+        return( 0 );
+
+    if( grp->id == MBEDTLS_ECP_DP_NONE )
+        return( MBEDTLS_ERR_ECP_BAD_INPUT_DATA );
+
+    for( i = 0; i < MBEDTLS_ECP_COMB_CACHE_SIZE && slot == NULL; i++ )
+    {
+        if( ecp_comb_cache[i].id == MBEDTLS_ECP_DP_NONE )
+            slot = &ecp_comb_cache[i];
+    }
+    if( slot == NULL )
+        return( MBEDTLS_ERR_ECP_BUFFER_TOO_SMALL );
+
+    w = ecp_comb_fixed_window( grp );
+    T_size = 1U << ( w - 1 );
+    d = ( grp->nbits + w - 1 ) / w;
+
+    T = mbedtls_calloc( T_size, sizeof( mbedtls_ecp_point ) );
+    if( T == NULL )
+        return( MBEDTLS_ERR_ECP_ALLOC_FAILED );
+
+    mbedtls_ecp_point_init( &slot->P );
+    MBEDTLS_MPI_CHK( ecp_precompute_comb( grp, T, P, w, d ) );
+    MBEDTLS_MPI_CHK( mbedtls_ecp_copy( &slot->P, P ) );
+
+    slot->id = grp->id;
+    slot->w = w;
+    slot->T_size = T_size;
+    slot->T = T;
+    *entry = slot;
+
+cleanup:
+    if( ret != 0 )
+    {
+        for( i = 0; i < T_size; i++ )
+            mbedtls_ecp_point_free( &T[i] );
+        mbedtls_free( T );
+        mbedtls_ecp_point_free( &slot->P );
+    }
+
+    return( ret );
+}
+
+/*
+ * Precompute the comb table of a point that is multiplied repeatedly
+ */
+int mbedtls_ecp_comb_cache_add( mbedtls_ecp_group *grp, const mbedtls_ecp_point *P )
+{
+    int ret;
+    ecp_comb_cache_entry *entry;
+
+    if( ecp_get_type( grp ) != ECP_TYPE_SHORT_WEIERSTRASS )
+        return( MBEDTLS_ERR_ECP_BAD_INPUT_DATA );
+
+    if( ( ret = mbedtls_ecp_check_pubkey( grp, P ) ) != 0 )
+        return( ret );
+
+    return( ecp_comb_cache_insert( grp, P, &entry ) );
+}
+
+/*
+ * Release all cached tables
+ */
+void mbedtls_ecp_comb_cache_free( void )
+{
+    size_t i, j;
+
+    for( i = 0; i < MBEDTLS_ECP_COMB_CACHE_SIZE; i++ )
+    {
+        ecp_comb_cache_entry *entry = &ecp_comb_cache[i];
+
+        if( entry->id == MBEDTLS_ECP_DP_NONE )
+            continue;
+
+        for( j = 0; j < entry->T_size; j++ )
+            mbedtls_ecp_point_free( &entry->T[j] );
+        mbedtls_free( entry->T );
+        mbedtls_ecp_point_free( &entry->P );
+        memset( entry, 0, sizeof( ecp_comb_cache_entry ) );
+    }
+}
+#endif /* MBEDTLS_ECP_COMB_CACHE */
+
 /*
  * Multiplication using the comb method,
  * for curves in short Weierstrass form
@@ -1312,11 +1470,14 @@ static int ecp_mul_comb( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
                          void *p_rng )
 {
     int ret;
-    unsigned char w, m_is_odd, p_eq_g, pre_len, i;
+    unsigned char w, m_is_odd, p_eq_g, keep_T, pre_len, i;
     size_t d;
     unsigned char k[COMB_MAX_D + 1];
     mbedtls_ecp_point *T;
     mbedtls_mpi M, mm;
+#if defined(MBEDTLS_ECP_COMB_CACHE)
+    ecp_comb_cache_entry *cached;
+#endif
 
     mbedtls_mpi_init( &M );
     mbedtls_mpi_init( &mm );
@@ -1364,6 +1525,31 @@ static int ecp_mul_comb( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
      * use grp->T if already initialized, or initialize it.
      */
     T = p_eq_g ? grp->T : NULL;
+    keep_T = p_eq_g;
+
+#if defined(MBEDTLS_ECP_COMB_CACHE)
+    /*
+     * Use the shared table of a fixed point if there is one. The generator
+     * table is added to the cache on first use rather than kept in grp.
+     */
+    cached = NULL;
+    if( T == NULL )
+    {
+        /* a full cache only means the table isn't shared */
+        if( p_eq_g && ecp_comb_cache_insert( grp, P, &cached ) != 0 )
+            cached = NULL;
+        else if( ! p_eq_g )
+            cached = ecp_comb_cache_find( grp, P );
+    }
+    if( cached != NULL )
+    {
+        w = cached->w;
+        pre_len = cached->T_size;
+        d = ( grp->nbits + w - 1 ) / w;
+        T = cached->T;
+        keep_T = 1;
+    }
+#endif /* MBEDTLS_ECP_COMB_CACHE */
 
     if( T == NULL )
     {
@@ -1406,7 +1592,7 @@ static int ecp_mul_comb( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
 
 cleanup:
 
-    if( T != NULL && ! p_eq_g )
+    if( T != NULL && ! keep_T )
     {
         for( i = 0; i < pre_len; i++ )
             mbedtls_ecp_point_free( &T[i] );
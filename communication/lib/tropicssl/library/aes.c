@@ -46,6 +46,7 @@
 #include "tropicssl/aes.h"
 #include "tropicssl/padlock.h"
 
+#include <stdint.h>
 #include <string.h>
 
 /*
@@ -336,18 +337,18 @@ static const unsigned long RT3[256] = { RT };
 
 #else
 
-
+/* the tables of mbedtls, which are arrays of uint32_t */
 extern const unsigned char FSb[256];
-extern const unsigned long FT0[256];
-extern const unsigned long FT1[256];
-extern const unsigned long FT2[256];
-extern const unsigned long FT3[256];
+extern const uint32_t FT0[256];
+extern const uint32_t FT1[256];
+extern const uint32_t FT2[256];
+extern const uint32_t FT3[256];
 
 extern const unsigned char RSb[256];
-extern const unsigned long RT0[256];
-extern const unsigned long RT1[256];
-extern const unsigned long RT2[256];
-extern const unsigned long RT3[256];
+extern const uint32_t RT0[256];
+extern const uint32_t RT1[256];
+extern const uint32_t RT2[256];
+extern const uint32_t RT3[256];
 
 
 #endif //!HAL_PLATFORM_CLOUD_UDP
@@ -21,12 +21,15 @@ CPPSRC += $(TARGET_SRC_PATH)/dsakeygen.cpp
 CPPSRC += $(TARGET_SRC_PATH)/eckeygen.cpp
 CPPSRC += $(TARGET_SRC_PATH)/lightssl_message_channel.cpp
 CPPSRC += $(TARGET_SRC_PATH)/dtls_message_channel.cpp
+CPPSRC += $(TARGET_SRC_PATH)/ecdh_key_pool.cpp
+CPPSRC += $(TARGET_SRC_PATH)/protocol_metrics.cpp
 CPPSRC += $(TARGET_SRC_PATH)/dtls_protocol.cpp
 CPPSRC += $(TARGET_SRC_PATH)/lightssl_protocol.cpp
 CPPSRC += $(TARGET_SRC_PATH)/protocol.cpp
 CPPSRC += $(TARGET_SRC_PATH)/messages.cpp
 CPPSRC += $(TARGET_SRC_PATH)/chunked_transfer.cpp
 CPPSRC += $(TARGET_SRC_PATH)/coap_channel.cpp
+CPPSRC += $(TARGET_SRC_PATH)/coap_blockwise.cpp
 CPPSRC += $(TARGET_SRC_PATH)/publisher.cpp
 CPPSRC += $(TARGET_SRC_PATH)/protocol_defs.cpp
 
@@ -20,6 +20,7 @@
 #include "chunked_transfer.h"
 #include "service_debug.h"
 #include "coap.h"
+#include "protocol_metrics.h"
 
 namespace particle { namespace protocol {
 
@@ -207,6 +208,7 @@ ProtocolError ChunkedTransfer::handle_chunk(token_t token, Message& message,
 		else
 		{
 			WARN("chunk crc bad %d: wanted %x got %x", chunk_index, given_crc, crc);
+			ProtocolMetrics::instance().ota_chunk_crc_failures.increment();
 			if (!fast_ota)
 			{
 				response_size = Messages::chunk_received(response.buf(), 0, token, ChunkReceivedCode::BAD, channel.is_unreliable());
@@ -79,4 +79,127 @@ size_t CoAP::option_decode(unsigned char **option)
   return option_length;
 }
 
+namespace {
+
+// Encodes an option delta or length nibble, returns the number of extended bytes
+inline size_t option_nibble(unsigned value, uint8_t* nibble, uint8_t* ext)
+{
+  if (value < 13)
+  {
+    *nibble = value;
+    return 0;
+  }
+  if (value < 269)
+  {
+    *nibble = 13;
+    ext[0] = value - 13;
+    return 1;
+  }
+  *nibble = 14;
+  value -= 269;
+  ext[0] = value >> 8;
+  ext[1] = value & 0xff;
+  return 2;
+}
+
+// Decodes an option delta or length nibble, returns false if the value is reserved or truncated
+inline bool decode_nibble(unsigned nibble, const uint8_t*& pos, const uint8_t* end, size_t& value)
+{
+  if (nibble < 13)
+  {
+    value = nibble;
+    return true;
+  }
+  if (nibble == 13 && pos < end)
+  {
+    value = *pos++ + 13;
+    return true;
+  }
+  if (nibble == 14 && end - pos >= 2)
+  {
+    value = (pos[0] << 8 | pos[1]) + 269;
+    pos += 2;
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+size_t CoAP::option(uint8_t* buf, unsigned delta, const uint8_t* value, size_t length)
+{
+  uint8_t delta_nibble, length_nibble;
+  uint8_t* p = buf + 1;
+  p += option_nibble(delta, &delta_nibble, p);
+  p += option_nibble(length, &length_nibble, p);
+  buf[0] = delta_nibble << 4 | length_nibble;
+  memcpy(p, value, length);
+  return p + length - buf;
+}
+
+size_t CoAP::uint_option(uint8_t* buf, unsigned delta, uint32_t value)
+{
+  uint8_t bytes[4];
+  size_t length = 0;
+  for (int shift = 24; shift >= 0; shift -= 8)
+  {
+    if (length || (value >> shift))
+      bytes[length++] = value >> shift;
+  }
+  return option(buf, delta, bytes, length);
+}
+
+const uint8_t* CoAP::find_option(const uint8_t* message, size_t message_length, unsigned option, size_t* length)
+{
+  CoAPOptionIterator it(message, message_length);
+  while (it.next())
+  {
+    if (it.option() == option)
+    {
+      *length = it.size();
+      return it.data();
+    }
+    if (it.option() > option)
+      break;
+  }
+  return nullptr;
+}
+
+uint32_t CoAP::decode_uint(const uint8_t* value, size_t length)
+{
+  uint32_t result = 0;
+  for (size_t i = 0; i < length && i < 4; ++i)
+    result = result << 8 | value[i];
+  return result;
+}
+
+const uint8_t CoAPBlock::MAX_SZX;
+
+CoAPOptionIterator::CoAPOptionIterator(const uint8_t* message, size_t message_length) :
+    pos(message_length >= 4 ? message + 4 + (message[0] & 0x0F) : message + message_length),
+    end(message + message_length),
+    value(nullptr),
+    length(0),
+    number(0)
+{
+}
+
+bool CoAPOptionIterator::next()
+{
+  if (pos >= end || *pos == 0xFF)
+    return false;
+  const uint8_t header = *pos++;
+  size_t delta;
+  if (!decode_nibble(header >> 4, pos, end, delta) || !decode_nibble(header & 0x0F, pos, end, length) ||
+      size_t(end - pos) < length)
+  {
+    pos = end;
+    return false;
+  }
+  number += delta;
+  value = pos;
+  pos += length;
+  return true;
+}
+
 }}
@@ -85,6 +85,18 @@ namespace CoAPCode {
   };
 }
 
+namespace CoAPOption {
+  enum Enum {
+    URI_PATH = 11,
+    MAX_AGE = 14,
+    URI_QUERY = 15,
+    BLOCK2 = 23,
+    BLOCK1 = 27,
+    SIZE2 = 28,
+    SIZE1 = 60
+  };
+}
+
 namespace CoAPType {
   enum Enum {
     CON,
@@ -101,7 +113,7 @@ class CoAP
 
 	static const uint8_t VERSION = 1;
 
-	static inline message_id_t message_id(uint8_t* buf)
+	static inline message_id_t message_id(const uint8_t* buf)
 	{
 		return buf[2]<<8 | buf[3];
 	}
@@ -128,6 +140,93 @@ class CoAP
     static CoAPCode::Enum code(const unsigned char *message);
     static CoAPType::Enum type(const unsigned char *message);
     static size_t option_decode(unsigned char **option);
+
+	/**
+	 * Encodes an option.
+	 * @param delta	The option number minus the number of the previous option in the message.
+	 * @return The number of bytes written, at most 5 + length.
+	 */
+	static size_t option(uint8_t* buf, unsigned delta, const uint8_t* value, size_t length);
+
+	/**
+	 * Encodes an option with an unsigned integer value, using as few bytes as possible.
+	 */
+	static size_t uint_option(uint8_t* buf, unsigned delta, uint32_t value);
+
+	/**
+	 * Retrieves the value of the first option with the given number.
+	 * @return The option value, or nullptr if the message doesn't have the option.
+	 */
+	static const uint8_t* find_option(const uint8_t* message, size_t message_length, unsigned option, size_t* length);
+
+	static uint32_t decode_uint(const uint8_t* value, size_t length);
+};
+
+/**
+ * Iterates over the options of a message.
+ */
+class CoAPOptionIterator
+{
+	const uint8_t* pos;
+	const uint8_t* end;
+	const uint8_t* value;
+	size_t length;
+	unsigned number;
+
+public:
+	CoAPOptionIterator(const uint8_t* message, size_t message_length);
+
+	/**
+	 * Moves to the next option. Returns false at the end of the options or when the
+	 * message is malformed.
+	 */
+	bool next();
+
+	unsigned option() const { return number; }
+	const uint8_t* data() const { return value; }
+	size_t size() const { return length; }
+
+	/**
+	 * Returns the payload, or nullptr if the message doesn't have one. Valid once next() returned false.
+	 */
+	const uint8_t* payload() const { return (pos < end && *pos == 0xFF) ? pos + 1 : nullptr; }
+	size_t payload_size() const { return payload() ? end - pos - 1 : 0; }
+};
+
+/**
+ * The value of a Block1 or Block2 option, see RFC 7959.
+ */
+struct CoAPBlock
+{
+	static const uint8_t MAX_SZX = 6;	// 1024 bytes
+
+	uint32_t num;
+	bool more;
+	uint8_t szx;
+
+	size_t size() const { return size_t(16) << szx; }
+	size_t offset() const { return num * size(); }
+	uint32_t encode() const { return num << 4 | (more ? 0x08 : 0) | szx; }
+
+	static CoAPBlock decode(uint32_t value)
+	{
+		CoAPBlock block;
+		block.num = value >> 4;
+		block.more = value & 0x08;
+		block.szx = value & 0x07;
+		return block;
+	}
+
+	/**
+	 * Returns the size exponent of the largest block that isn't larger than the given size.
+	 */
+	static uint8_t size_exponent(size_t size)
+	{
+		uint8_t szx = 0;
+		while (szx < MAX_SZX && (size_t(32) << szx) <= size)
+			++szx;
+		return szx;
+	}
 };
 
 // this uses version 0 to maintain compatiblity with the original comms lib codes
@@ -0,0 +1,240 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "coap_blockwise.h"
+
+namespace particle { namespace protocol {
+
+namespace {
+
+// Block1 option with a value of up to 3 bytes, and Size1 option with a value of up to 4 bytes
+const size_t MAX_BLOCK_OPTIONS_SIZE = 4 + 6;
+
+inline bool is_success(uint8_t code)
+{
+	// empty acknowledgement or 2.xx response
+	return code == 0 || (code >> 5) == 2;
+}
+
+inline ProtocolError failed(CompletionHandler& handler, ProtocolError error)
+{
+	handler.setError(toSystemError(error));
+	return error;
+}
+
+} // namespace
+
+const uint8_t BlockSender::MAX_WINDOW;
+const uint8_t BlockSender::MAX_RESUME_COUNT;
+
+BlockSender::BlockSender() :
+		buffer(nullptr)
+{
+	reset();
+}
+
+BlockSender::~BlockSender()
+{
+	delete[] buffer;
+}
+
+void BlockSender::reset()
+{
+	delete[] buffer;
+	buffer = nullptr;
+	header_length = 0;
+	size = 0;
+	last_option = 0;
+	block_count = 0;
+	next_block = 0;
+	acked_count = 0;
+	szx = 0;
+	window = 1;
+	slot_count = 0;
+	resume_count = 0;
+}
+
+ProtocolError BlockSender::start(MessageChannel& channel, const uint8_t* header, size_t header_length,
+		const uint8_t* data, size_t size, size_t block_size, uint8_t window, CompletionHandler handler)
+{
+	// only one transfer at a time
+	if (is_active())
+		return failed(handler, BANDWIDTH_EXCEEDED);
+	Message message;
+	ProtocolError error = channel.create(message);
+	if (error)
+		return failed(handler, error);
+	if (message.capacity() < header_length + MAX_BLOCK_OPTIONS_SIZE + 1 + 16)
+		return failed(handler, INSUFFICIENT_STORAGE);
+	const size_t available = message.capacity() - header_length - MAX_BLOCK_OPTIONS_SIZE - 1;
+	const uint8_t szx = CoAPBlock::size_exponent(block_size < available ? block_size : available);
+	const size_t count = (size + (size_t(16) << szx) - 1) >> (szx + 4);
+	if (count > 0xFFFF)
+		return failed(handler, INSUFFICIENT_STORAGE);
+
+	buffer = new uint8_t[header_length + size];
+	if (!buffer)
+		return failed(handler, INSUFFICIENT_STORAGE);
+	memcpy(buffer, header, header_length);
+	memcpy(buffer + header_length, data, size);
+	// the message ID is assigned to each block by the channel
+	buffer[2] = 0;
+	buffer[3] = 0;
+
+	CoAPOptionIterator it(buffer, header_length);
+	while (it.next())
+		last_option = it.option();
+
+	this->header_length = header_length;
+	this->size = size;
+	this->szx = szx;
+	this->block_count = count ? count : 1;
+	this->window = window < 1 ? 1 : (window > MAX_WINDOW ? MAX_WINDOW : window);
+	this->handler = std::move(handler);
+	error = send(channel);
+	if (error)
+		cancel(toSystemError(error));
+	return error;
+}
+
+ProtocolError BlockSender::send_block(MessageChannel& channel, Slot& slot)
+{
+	Message message;
+	ProtocolError error = channel.create(message);
+	if (error)
+		return error;
+
+	CoAPBlock block;
+	block.num = slot.block;
+	block.more = slot.block + 1 < block_count;
+	block.szx = szx;
+	const size_t offset = block.offset();
+	const size_t length = offset + block.size() < size ? block.size() : size - offset;
+
+	uint8_t* buf = message.buf();
+	memcpy(buf, buffer, header_length);
+	size_t len = header_length;
+	len += CoAP::uint_option(buf + len, CoAPOption::BLOCK1 - last_option, block.encode());
+	if (block.num == 0)
+		len += CoAP::uint_option(buf + len, CoAPOption::SIZE1 - CoAPOption::BLOCK1, size);
+	buf[len++] = 0xFF;
+	memcpy(buf + len, buffer + header_length + offset, length);
+	message.set_length(len + length);
+
+	error = channel.send(message);
+	if (!error)
+	{
+		slot.id = message.get_id();
+		slot.sent = true;
+	}
+	return error;
+}
+
+ProtocolError BlockSender::send(MessageChannel& channel)
+{
+	if (!is_active())
+		return NO_ERROR;
+
+	// blocks that were in flight when the session was lost
+	for (uint8_t i = 0; i < slot_count; ++i)
+	{
+		if (!slots[i].sent)
+		{
+			ProtocolError error = send_block(channel, slots[i]);
+			if (error)
+				return error;
+		}
+	}
+
+	while (slot_count < window && next_block < block_count)
+	{
+		// the response to the last block completes the transfer
+		if (next_block + 1 == block_count && (slot_count || acked_count + 1 < block_count))
+			break;
+		Slot& slot = slots[slot_count++];
+		slot.block = next_block++;
+		slot.sent = false;
+		ProtocolError error = send_block(channel, slot);
+		if (error)
+			return error;
+	}
+	return NO_ERROR;
+}
+
+void BlockSender::remove_slot(uint8_t index)
+{
+	for (uint8_t i = index + 1; i < slot_count; ++i)
+		slots[i - 1] = slots[i];
+	--slot_count;
+}
+
+bool BlockSender::acknowledged(message_id_t id, uint8_t code)
+{
+	for (uint8_t i = 0; i < slot_count; ++i)
+	{
+		if (slots[i].sent && slots[i].id == id)
+		{
+			remove_slot(i);
+			if (!is_success(code))
+			{
+				cancel(code == RESPONSE_CODE(4,13) ? SYSTEM_ERROR_TOO_LARGE : SYSTEM_ERROR_PROTOCOL);
+			}
+			else if (++acked_count == block_count)
+			{
+				handler.setResult();
+				reset();
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void BlockSender::resume(bool session_resumed)
+{
+	if (!is_active())
+		return;
+	if (++resume_count > MAX_RESUME_COUNT)
+	{
+		cancel(SYSTEM_ERROR_TIMEOUT);
+		return;
+	}
+	if (session_resumed)
+	{
+		for (uint8_t i = 0; i < slot_count; ++i)
+			slots[i].sent = false;
+	}
+	else
+	{
+		slot_count = 0;
+		next_block = 0;
+		acked_count = 0;
+	}
+}
+
+void BlockSender::cancel(int error)
+{
+	if (is_active())
+	{
+		handler.setError(error);
+		reset();
+	}
+}
+
+}}
@@ -0,0 +1,251 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+#pragma once
+
+#include "coap.h"
+#include "messages.h"
+#include "message_channel.h"
+#include "appender.h"
+#include "completion_handler.h"
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * An appender that stores only the part of the output that falls into one block,
+ * and counts the total length. Used to produce a block of a payload without
+ * buffering the whole payload.
+ */
+class BlockAppender : public Appender
+{
+	uint8_t* buffer;
+	size_t offset;
+	size_t size;
+	size_t total;
+
+public:
+	/**
+	 * @param buffer	Receives the block. May be null when size is 0.
+	 * @param offset	The offset of the block in the payload.
+	 * @param size		The size of the block.
+	 */
+	BlockAppender(uint8_t* buffer, size_t offset, size_t size) :
+			buffer(buffer), offset(offset), size(size), total(0)
+	{
+	}
+
+	bool append(const uint8_t* data, size_t length) override
+	{
+		const size_t start = total;
+		total += length;
+		const size_t end = offset + size;
+		if (start < end && total > offset)
+		{
+			const size_t from = start < offset ? offset - start : 0;
+			const size_t to = (total < end ? total : end) - start;
+			memcpy(buffer + start + from - offset, data + from, to - from);
+		}
+		return true;
+	}
+
+	bool append(const char* data) {
+		return Appender::append(data);
+	}
+	bool append(char c) {
+		return Appender::append(c);
+	}
+
+	size_t total_size() const { return total; }
+
+	/**
+	 * Returns the number of bytes stored in the buffer.
+	 */
+	size_t block_size() const
+	{
+		if (total <= offset)
+			return 0;
+		return total - offset < size ? total - offset : size;
+	}
+};
+
+/**
+ * Space reserved for the header of a response carrying a block: the CONTENT header with
+ * a one-byte token, the Block2 and Size2 options, and the payload marker.
+ */
+const size_t MAX_BLOCK_RESPONSE_HEADER_SIZE = 16;
+
+/**
+ * Retrieves the Block2 option from a request.
+ * @return false if the request doesn't have the option.
+ */
+inline bool requested_block(const Message& request, CoAPBlock& block)
+{
+	size_t length;
+	const uint8_t* value = CoAP::find_option(request.buf(), request.length(), CoAPOption::BLOCK2, &length);
+	if (!value)
+		return false;
+	block = CoAPBlock::decode(CoAP::decode_uint(value, length));
+	return true;
+}
+
+/**
+ * Writes a 2.05 CONTENT response to a request for a payload that may not fit in a single
+ * message. When the payload doesn't fit, or a block was requested, only one block of the
+ * payload is written along with the Block2 option (RFC 7959). The server retrieves the
+ * remaining blocks with further requests.
+ *
+ * @param buf			The response buffer.
+ * @param capacity		The size of the response buffer.
+ * @param requested		The block requested, or nullptr if the request didn't have a Block2 option.
+ * @param max_block_size	The preferred maximum block size.
+ * @param generate		Writes the payload to the Appender passed as the argument. Called at most twice.
+ * @return The length of the response, or 0 if the requested block is past the end of the payload.
+ */
+template<typename GenerateFn>
+size_t block_response(uint8_t* buf, size_t capacity, message_id_t message_id, token_t token,
+		const CoAPBlock* requested, size_t max_block_size, GenerateFn generate)
+{
+	size_t total;
+	if (!requested)
+	{
+		const size_t header = Messages::content(buf, message_id, token);
+		BlockAppender appender(buf + header, 0, capacity - header);
+		generate(appender);
+		total = appender.total_size();
+		if (total <= capacity - header)
+			return header + total;
+	}
+	else
+	{
+		BlockAppender counter(nullptr, 0, 0);
+		generate(counter);
+		total = counter.total_size();
+	}
+
+	const size_t available = capacity - MAX_BLOCK_RESPONSE_HEADER_SIZE;
+	CoAPBlock block;
+	block.szx = CoAPBlock::size_exponent(max_block_size < available ? max_block_size : available);
+	block.num = 0;
+	if (requested)
+	{
+		if (requested->szx < block.szx)
+			block.szx = requested->szx;
+		block.num = requested->offset() / block.size();
+	}
+	if (block.num && block.offset() >= total)
+		return 0;
+	block.more = block.offset() + block.size() < total;
+
+	const size_t header = Messages::block_content(buf, message_id, token, block, total);
+	BlockAppender appender(buf + header, block.offset(), block.size());
+	generate(appender);
+	return header + appender.block_size();
+}
+
+/**
+ * Sends a request payload that doesn't fit in a single message as a sequence of
+ * confirmable Block1 messages (RFC 7959).
+ *
+ * Up to `window` blocks are sent without waiting for their acknowledgements. The last
+ * block is sent once all the other blocks were acknowledged, so that its response
+ * completes the transfer. If the session is lost, the transfer is resumed from the
+ * blocks that weren't acknowledged once the session is re-established.
+ */
+class BlockSender
+{
+public:
+	/**
+	 * The maximum number of blocks sent without waiting for an acknowledgement.
+	 */
+	static const uint8_t MAX_WINDOW = 8;
+
+	/**
+	 * The number of times the transfer is resumed after losing the session before it fails.
+	 */
+	static const uint8_t MAX_RESUME_COUNT = 3;
+
+	BlockSender();
+	~BlockSender();
+
+	/**
+	 * Starts a transfer and sends the first blocks. The header and payload are copied.
+	 *
+	 * @param header		The request up to, not including, the Block1 option. The message ID is assigned by the channel.
+	 * @param block_size	The preferred block size, reduced if needed to fit a block in a message.
+	 * @param window		The number of blocks sent without waiting for an acknowledgement.
+	 * @param handler		Completed when the last block is acknowledged, or when the transfer fails.
+	 */
+	ProtocolError start(MessageChannel& channel, const uint8_t* header, size_t header_length,
+			const uint8_t* data, size_t size, size_t block_size, uint8_t window, CompletionHandler handler);
+
+	/**
+	 * Sends the blocks that fit in the window.
+	 */
+	ProtocolError send(MessageChannel& channel);
+
+	/**
+	 * Handles an acknowledgement or piggybacked response.
+	 * @return true if the message was for a block of this transfer.
+	 */
+	bool acknowledged(message_id_t id, uint8_t code);
+
+	/**
+	 * Notifies the transfer that a new session was established. Blocks that weren't acknowledged
+	 * are sent again, or all of the blocks when the previous session wasn't resumed, since the
+	 * server then no longer has the blocks it received.
+	 */
+	void resume(bool session_resumed);
+
+	/**
+	 * Abandons the transfer and completes the handler with the given error.
+	 */
+	void cancel(int error);
+
+	bool is_active() const { return buffer != nullptr; }
+
+private:
+	struct Slot
+	{
+		uint16_t block;
+		message_id_t id;
+		bool sent;
+	};
+
+	uint8_t* buffer;			// the request header followed by the payload
+	size_t header_length;
+	size_t size;
+	unsigned last_option;		// number of the last option in the header
+	uint16_t block_count;
+	uint16_t next_block;		// the first block that wasn't sent yet
+	uint16_t acked_count;
+	uint8_t szx;
+	uint8_t window;
+	uint8_t slot_count;
+	uint8_t resume_count;
+	Slot slots[MAX_WINDOW];
+	CompletionHandler handler;
+
+	ProtocolError send_block(MessageChannel& channel, Slot& slot);
+	void remove_slot(uint8_t index);
+	void reset();
+};
+
+}}
@@ -20,10 +20,11 @@
 #include "coap_channel.h"
 #include "service_debug.h"
 #include "messages.h"
+#include "protocol_metrics.h"
 
 namespace particle { namespace protocol {
 
-uint16_t CoAPMessage::message_count = 0;
+std::atomic<uint16_t> CoAPMessage::message_count(0);
 
 ProtocolError CoAPMessageStore::send_message(CoAPMessage* msg, Channel& channel)
 {
@@ -40,6 +41,7 @@ bool CoAPMessageStore::retransmit(CoAPMessage* msg, Channel& channel, system_tic
 	bool retransmit = (msg->prepare_retransmit(now));
 	if (retransmit)
 	{
+		ProtocolMetrics::instance().coap_retransmits.increment();
 		send_message(msg, channel);
 	}
 	return retransmit;
@@ -48,6 +50,8 @@ bool CoAPMessageStore::retransmit(CoAPMessage* msg, Channel& channel, system_tic
 void CoAPMessageStore::message_timeout(CoAPMessage& msg, Channel& channel)
 {
 	msg.notify_timeout();
+	if (msg.get_type()==CoAPType::CON)
+		ProtocolMetrics::instance().coap_timeouts.increment();
 	if (msg.is_request())
 		channel.command(MessageChannel::CLOSE);
 }
@@ -120,6 +124,10 @@ ProtocolError CoAPMessageStore::receive(Message& msg, Channel& channel, system_t
 			}
 			channel.command(Channel::DISCARD_SESSION, nullptr);
 		}
+		CoAPMessage* request = from_id(id);
+		// the acknowledgement of a retransmitted message can't be matched to a transmission
+		if (msgtype==CoAPType::ACK && request && request->get_type()==CoAPType::CON && request->get_transmit_count()==1)
+			ProtocolMetrics::instance().ack_rtt.record(time - request->get_sent());
 		DEBUG("recieved ACK for message id=%x", id);
 		if (!clear_message(id)) {		// message didn't exist, means it's already been acknoweldged or is unknown.
 			msg.set_length(0);
@@ -23,6 +23,7 @@
 #include "timer_hal.h"
 #include "stdlib.h"
 #include "service_debug.h"
+#include <atomic>
 
 namespace particle
 {
@@ -110,6 +111,11 @@ private:
 	 */
 	system_tick_t timeout;
 
+	/**
+	 * The time of the first transmission, to measure the round-trip time of the acknowledgement.
+	 */
+	system_tick_t sent;
+
 	/**
 	 * The unique 16-bit ID for this message.
 	 */
@@ -136,7 +142,7 @@ private:
 	 */
 	uint8_t data[0];
 
-	static uint16_t message_count;
+	static std::atomic<uint16_t> message_count;
 
 	/**
 	 * Notification that the message has been delivered to the server.
@@ -162,7 +168,7 @@ public:
 	static const uint8_t NSTART = 1;
 
 
-	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), id(id_), transmit_count(0), delivered(nullptr), data_len(0) {
+	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), sent(0), id(id_), transmit_count(0), delivered(nullptr), data_len(0) {
 		message_count++;
 	}
 
@@ -196,6 +202,8 @@ public:
 	inline message_id_t get_id() const { return id; }
 	inline void removed() { next = nullptr; }
 	inline system_tick_t get_timeout() const { return timeout; }
+	inline system_tick_t get_sent() const { return sent; }
+	inline uint8_t get_transmit_count() const { return transmit_count; }
 
 	inline void set_delivered_handler(std::function<void(Delivery)>* handler) { this->delivered = handler; }
 
@@ -219,6 +227,8 @@ public:
 	{
 		CoAPType::Enum coapType = CoAP::type(get_data());
 		if (coapType==CoAPType::CON) {
+			if (!transmit_count)
+				sent = now;
 			timeout = now + transmit_timeout(transmit_count);
 			transmit_count++;
 			return transmit_count <= MAX_RETRANSMIT+1;
@@ -589,6 +599,13 @@ public:
 		return channel::establish(flags, app_crc);
 	}
 
+	ProtocolError establish_start(uint32_t& flags, uint32_t app_crc) override
+	{
+		server.clear();
+		client.clear();
+		return channel::establish_start(flags, app_crc);
+	}
+
 	/**
 	 * Sends the message reliably. A non-confirmable message
 	 * it is sent once. A confirmable message is sent and resent
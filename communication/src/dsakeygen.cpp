@@ -70,7 +70,9 @@ protected:
     void write_mpi(const mpi* data, int fixedLength = -1) {
         int len = fixedLength == -1 ? mpi_size(data) : fixedLength;
         if (length_ >= len) {
-            mpi_write_binary(data, buffer_, len);
+            // the dummy run measuring the length has no buffer
+            if (buffer_)
+                mpi_write_binary(data, buffer_, len);
             write(nullptr, len);
         }
     }
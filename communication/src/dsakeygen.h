@@ -24,6 +24,9 @@
 #ifndef DSAKEYGEN_H
 #define	DSAKEYGEN_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
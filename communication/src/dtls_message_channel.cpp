@@ -29,6 +29,8 @@ LOG_SOURCE_CATEGORY("comm.dtls")
 #include <stdio.h>
 #include <string.h>
 #include "dtls_session_persist.h"
+#include "ecdh_key_pool.h"
+#include "protocol_metrics.h"
 
 
 #if HAL_PLATFORM_CLOUD_UDP
@@ -154,8 +156,6 @@ uint32_t SessionPersist::application_state_checksum(uint32_t (*calc_crc)(const u
 }
 
 
-SessionPersist sessionPersist;
-
 // mbedtls_ecp_gen_keypair
 // see also gen_key.c and mbedtls_ecp_gen_key
 
@@ -195,6 +195,38 @@ int dtls_rng(void* handle, uint8_t* data, const size_t len_)
 	return 0;
 }
 
+#if defined(MBEDTLS_ECP_COMB_CACHE)
+/**
+ * Precomputes the tables used to multiply the curve generator (ECDHE key generation,
+ * half of the signature verification) and the server's public key (the other half),
+ * so that each handshake doesn't compute them again.
+ */
+static void precompute_fixed_points(const uint8_t* server_public, size_t server_public_len)
+{
+	mbedtls_pk_context server_key;
+	mbedtls_pk_init(&server_key);
+	int ret = mbedtls_pk_parse_public_key(&server_key, server_public, server_public_len);
+	if (!ret && mbedtls_pk_can_do(&server_key, MBEDTLS_PK_ECKEY))
+	{
+		mbedtls_ecp_keypair* key = mbedtls_pk_ec(server_key);
+		ret = mbedtls_ecp_comb_cache_add(&key->grp, &key->grp.G);
+		if (!ret)
+			ret = mbedtls_ecp_comb_cache_add(&key->grp, &key->Q);
+		if (ret == MBEDTLS_ERR_ECP_BUFFER_TOO_SMALL)
+		{
+			// the server key changed, drop the table of the previous one
+			mbedtls_ecp_comb_cache_free();
+			ret = mbedtls_ecp_comb_cache_add(&key->grp, &key->grp.G);
+			if (!ret)
+				ret = mbedtls_ecp_comb_cache_add(&key->grp, &key->Q);
+		}
+	}
+	if (ret)
+		LOG(WARN,"unable to precompute server key tables: -%x", -ret);
+	mbedtls_pk_free(&server_key);
+}
+#endif
+
 ProtocolError DTLSMessageChannel::init(
 		const uint8_t* core_private, size_t core_private_len,
 		const uint8_t* core_public, size_t core_public_len,
@@ -237,6 +269,9 @@ ProtocolError DTLSMessageChannel::init(
 	this->server_public = new uint8_t[server_public_len];
 	memcpy(this->server_public, server_public, server_public_len);
 	this->server_public_len = server_public_len;
+#if defined(MBEDTLS_ECP_COMB_CACHE)
+	precompute_fixed_points(server_public, server_public_len);
+#endif
 	return NO_ERROR;
 }
 
@@ -250,13 +285,17 @@ inline int DTLSMessageChannel::send(const uint8_t* data, size_t len)
 		memcpy(d+len, device_id, DEVICE_ID_LEN);
 		d[len+DEVICE_ID_LEN] = DEVICE_ID_LEN;
 		int result = callbacks.send(d, len+DEVICE_ID_LEN+1, callbacks.tx_context);
+		if (result>0)
+			ProtocolMetrics::instance().bytes_sent.increment(result);
 		// hide the increased length from DTLS
 		if (result==int(len+DEVICE_ID_LEN+1))
 			result = len;
 		return result;
 	}
-	else
-		return callbacks.send(data, len, callbacks.tx_context);
+	int result = callbacks.send(data, len, callbacks.tx_context);
+	if (result>0)
+		ProtocolMetrics::instance().bytes_sent.increment(result);
+	return result;
 }
 
 void DTLSMessageChannel::reset_session()
@@ -269,6 +308,8 @@ void DTLSMessageChannel::reset_session()
 inline int DTLSMessageChannel::recv(uint8_t* data, size_t len)
 {
 	int size = callbacks.receive(data, len, callbacks.tx_context);
+	if (size>0)
+		ProtocolMetrics::instance().bytes_received.increment(size);
 	// ignore 0 and 1 byte UDP packets which are used to keep alive the connection.
 	if (size>=0 && size <=1)
 		size = 0;
@@ -345,7 +386,17 @@ ProtocolError DTLSMessageChannel::setup_context()
 
 ProtocolError DTLSMessageChannel::establish(uint32_t& flags, uint32_t app_state_crc)
 {
-	int ret = 0;
+	ProtocolError error = establish_start(flags, app_state_crc);
+	while (error == HANDSHAKE_IN_PROGRESS)
+	{
+		error = establish_step();
+	}
+	return error;
+}
+
+ProtocolError DTLSMessageChannel::establish_start(uint32_t& flags, uint32_t app_state_crc)
+{
+	establishing = false;
 	// LOG(INFO,"setup context");
 	ProtocolError error = setup_context();
 	if (error) {
@@ -383,28 +434,34 @@ ProtocolError DTLSMessageChannel::establish(uint32_t& flags, uint32_t app_state_
 		if (error)
 			return error;
 	}
-	uint8_t random[64];
+	establishing = true;
+	return HANDSHAKE_IN_PROGRESS;
+}
 
-	do
+ProtocolError DTLSMessageChannel::establish_step()
+{
+	if (!establishing)
+		return INVALID_STATE;
+
+	// each step sends or receives one flight of handshake messages and runs the crypto it needs
+	int ret = mbedtls_ssl_handshake_step(&ssl_context);
+	if (ret == 0)
 	{
-		while (ssl_context.state != MBEDTLS_SSL_HANDSHAKE_OVER)
+		// we've already received the ServerHello, thus
+		// we have the random values for client and server
+		if (ssl_context.state == MBEDTLS_SSL_SERVER_KEY_EXCHANGE)
 		{
-			ret = mbedtls_ssl_handshake_step(&ssl_context);
-
-			if (ret != 0)
-				break;
-
-			// we've already received the ServerHello, thus
-			// we have the random values for client and server
-			if (ssl_context.state == MBEDTLS_SSL_SERVER_KEY_EXCHANGE)
-			{
-				memcpy(random, ssl_context.handshake->randbytes, 64);
-			}
+			memcpy(handshake_random, ssl_context.handshake->randbytes, sizeof(handshake_random));
 		}
+		if (ssl_context.state != MBEDTLS_SSL_HANDSHAKE_OVER)
+			return HANDSHAKE_IN_PROGRESS;
+	}
+	else if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+	{
+		return HANDSHAKE_IN_PROGRESS;
 	}
-	while(ret == MBEDTLS_ERR_SSL_WANT_READ ||
-	      ret == MBEDTLS_ERR_SSL_WANT_WRITE);
 
+	establishing = false;
 	if (ret)
 	{
 		LOG(ERROR,"handshake failed -%x", -ret);
@@ -412,7 +469,9 @@ ProtocolError DTLSMessageChannel::establish(uint32_t& flags, uint32_t app_state_
 	}
 	else
 	{
-		sessionPersist.prepare_save(random, keys_checksum, &ssl_context, 0);
+		sessionPersist.prepare_save(handshake_random, keys_checksum, &ssl_context, 0);
+		const EcdhKeyPool& pool = EcdhKeyPool::instance();
+		LOG(INFO,"ephemeral key pool hits %u, misses %u", (unsigned)pool.hits(), (unsigned)pool.misses());
 	}
 	return ret==0 ? NO_ERROR : IO_ERROR_GENERIC_ESTABLISH;
 }
@@ -509,6 +568,17 @@ bool DTLSMessageChannel::is_unreliable()
 	return true;
 }
 
+void DTLSMessageChannel::precompute_keys()
+{
+	EcdhKeyPool& pool = EcdhKeyPool::instance();
+	if (pool.available() < EcdhKeyPool::CAPACITY)
+	{
+		int ret = pool.fill(MBEDTLS_ECP_DP_SECP256R1, dtls_rng, this);
+		if (ret)
+			LOG(WARN,"unable to generate ephemeral key: -%x", -ret);
+	}
+}
+
 ProtocolError DTLSMessageChannel::command(Command command, void* arg)
 {
 	LOG(INFO,"session cmd (CLS,DIS,MOV,LOD,SAV): %d", command);
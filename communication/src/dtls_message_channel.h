@@ -30,6 +30,7 @@
 #include "mbedtls/pk.h"
 #include "mbedtls/timing.h"
 #include "mbedtls/debug.h"
+#include "dtls_session_persist.h"
 
 namespace particle
 {
@@ -98,6 +99,21 @@ private:
 	bool move_session;
 	const uint8_t* device_id;
 
+	/**
+	 * Set while a handshake started by establish_start() is in progress.
+	 */
+	bool establishing;
+
+	/**
+	 * The client and server random values of the handshake in progress, saved with the session.
+	 */
+	uint8_t handshake_random[64];
+
+	/**
+	 * The state of the session, persisted with the save and restore callbacks.
+	 */
+	SessionPersist sessionPersist;
+
     void init();
     void dispose();
 
@@ -117,7 +133,7 @@ private:
 	void reset_session();
 
  public:
-	DTLSMessageChannel() : coap_state(nullptr), move_session(false) {}
+	DTLSMessageChannel() : coap_state(nullptr), move_session(false), establishing(false) {}
 
 	ProtocolError init(const uint8_t* core_private, size_t core_private_len,
 		const uint8_t* core_public, size_t core_public_len,
@@ -129,6 +145,10 @@ private:
 
 	virtual ProtocolError establish(uint32_t& flags, uint32_t app_crc) override;
 
+	virtual ProtocolError establish_start(uint32_t& flags, uint32_t app_crc) override;
+
+	virtual ProtocolError establish_step() override;
+
 	/**
 	 * Retrieve first the 2 byte length from the stream, which determines
 	 */
@@ -147,6 +167,12 @@ private:
 
 	virtual ProtocolError command(Command cmd, void* arg=nullptr) override;
 
+	/**
+	 * Generates an ephemeral ECDHE key pair for a subsequent handshake, when the pool
+	 * of key pairs isn't full. Intended to be called while the system is otherwise idle.
+	 */
+	void precompute_keys();
+
 };
 
 
@@ -76,6 +76,9 @@ public:
 		case ProtocolCommands::WAKE:
 			wake();
 			break;
+		case ProtocolCommands::PRECOMPUTE_KEYS:
+			channel.precompute_keys();
+			break;
 		}
 	}
 
@@ -42,10 +42,6 @@ typedef struct __attribute__((packed)) SessionPersistDataOpaque
 #include "coap.h"
 #include "spark_protocol_functions.h"	// for SparkCallbacks
 
-#ifdef MBEDTLS_SSL_H
-#include "dtls_message_channel.h"
-#endif
-
 
 namespace particle { namespace protocol {
 
@@ -123,8 +119,9 @@ class __attribute__((packed)) SessionPersist : public SessionPersistOpaque
 {
 public:
 
-	using save_fn_t = decltype(DTLSMessageChannel::Callbacks::save);
-	using restore_fn_t = decltype(DTLSMessageChannel::Callbacks::restore);
+	// the types of DTLSMessageChannel::Callbacks::save and restore
+	using save_fn_t = int (*)(const void* data, size_t length, uint8_t type, void* reserved);
+	using restore_fn_t = int (*)(void* data, size_t max_length, uint8_t type, void* reserved);
 
 private:
 
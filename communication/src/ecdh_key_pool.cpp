@@ -0,0 +1,124 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "ecdh_key_pool.h"
+#include "mbedtls/ecdh.h"
+
+namespace particle { namespace protocol {
+
+const size_t EcdhKeyPool::CAPACITY;
+
+EcdhKeyPool::EcdhKeyPool() :
+		count(0),
+		hit_count(0),
+		miss_count(0)
+{
+	for (size_t i = 0; i < CAPACITY; ++i)
+	{
+		keys[i].id = MBEDTLS_ECP_DP_NONE;
+		mbedtls_mpi_init(&keys[i].d);
+		mbedtls_ecp_point_init(&keys[i].Q);
+	}
+}
+
+EcdhKeyPool::~EcdhKeyPool()
+{
+	clear();
+}
+
+int EcdhKeyPool::fill(mbedtls_ecp_group_id id, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng)
+{
+	if (count == CAPACITY)
+		return 0;
+	KeyPair& key = keys[count];
+	mbedtls_ecp_group grp;
+	mbedtls_ecp_group_init(&grp);
+	int ret = mbedtls_ecp_group_load(&grp, id);
+	if (!ret)
+		ret = mbedtls_ecp_gen_keypair(&grp, &key.d, &key.Q, f_rng, p_rng);
+	mbedtls_ecp_group_free(&grp);
+	if (!ret)
+	{
+		key.id = id;
+		++count;
+	}
+	else
+	{
+		mbedtls_mpi_free(&key.d);
+		mbedtls_ecp_point_free(&key.Q);
+	}
+	return ret;
+}
+
+bool EcdhKeyPool::take(const mbedtls_ecp_group* grp, mbedtls_mpi* d, mbedtls_ecp_point* Q)
+{
+	if (!count || keys[count - 1].id != grp->id)
+	{
+		++miss_count;
+		return false;
+	}
+	KeyPair& key = keys[count - 1];
+	int ret = mbedtls_mpi_copy(d, &key.d);
+	if (!ret)
+		ret = mbedtls_ecp_copy(Q, &key.Q);
+	// the key is used once, whatever the outcome
+	mbedtls_mpi_free(&key.d);
+	mbedtls_ecp_point_free(&key.Q);
+	key.id = MBEDTLS_ECP_DP_NONE;
+	--count;
+	if (ret)
+	{
+		++miss_count;
+		return false;
+	}
+	++hit_count;
+	return true;
+}
+
+void EcdhKeyPool::clear()
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		mbedtls_mpi_free(&keys[i].d);
+		mbedtls_ecp_point_free(&keys[i].Q);
+		keys[i].id = MBEDTLS_ECP_DP_NONE;
+	}
+	count = 0;
+}
+
+EcdhKeyPool& EcdhKeyPool::instance()
+{
+	static EcdhKeyPool pool;
+	return pool;
+}
+
+}}
+
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT)
+/**
+ * Ephemeral keys of the ECDHE key exchange are taken from the pool when available.
+ */
+int mbedtls_ecdh_gen_public(mbedtls_ecp_group *grp, mbedtls_mpi *d, mbedtls_ecp_point *Q,
+		int (*f_rng)(void *, unsigned char *, size_t), void *p_rng)
+{
+	if (particle::protocol::EcdhKeyPool::instance().take(grp, d, Q))
+		return 0;
+	return mbedtls_ecp_gen_keypair(grp, d, Q, f_rng, p_rng);
+}
+#endif
@@ -0,0 +1,87 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+#pragma once
+
+#include "mbedtls/ecp.h"
+#include <stdint.h>
+#include <stddef.h>
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * Ephemeral ECDHE key pairs generated ahead of a DTLS handshake, so that a reconnection
+ * doesn't wait for the key generation. Each key pair is handed out once and then destroyed,
+ * so forward secrecy is preserved.
+ *
+ * mbedTLS obtains its keys through mbedtls_ecdh_gen_public(), which is replaced
+ * (MBEDTLS_ECDH_GEN_PUBLIC_ALT) to take a key from the pool when one is available.
+ *
+ * Not thread-safe: the pool is filled and used by the system thread.
+ */
+class EcdhKeyPool
+{
+public:
+	static const size_t CAPACITY = 2;
+
+	EcdhKeyPool();
+	~EcdhKeyPool();
+
+	/**
+	 * Generates a key pair if the pool isn't full. At most one key pair is generated per call
+	 * so that the caller isn't held up for long.
+	 *
+	 * @return 0 on success or if the pool is full, an mbedTLS error code otherwise.
+	 */
+	int fill(mbedtls_ecp_group_id id, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
+
+	/**
+	 * Moves a key pair for the given group out of the pool.
+	 * @return true if a key pair was available, false otherwise. Both are counted.
+	 */
+	bool take(const mbedtls_ecp_group* grp, mbedtls_mpi* d, mbedtls_ecp_point* Q);
+
+	/**
+	 * Destroys the key pairs in the pool.
+	 */
+	void clear();
+
+	size_t available() const { return count; }
+	uint32_t hits() const { return hit_count; }
+	uint32_t misses() const { return miss_count; }
+
+	static EcdhKeyPool& instance();
+
+private:
+	struct KeyPair
+	{
+		mbedtls_ecp_group_id id;
+		mbedtls_mpi d;
+		mbedtls_ecp_point Q;
+	};
+
+	KeyPair keys[CAPACITY];
+	size_t count;
+	uint32_t hit_count;
+	uint32_t miss_count;
+};
+
+}}
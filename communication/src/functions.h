@@ -33,8 +33,6 @@ namespace protocol
 
 class Functions
 {
-    char function_arg[MAX_FUNCTION_ARG_LENGTH];
-
     ProtocolError function_result(MessageChannel& channel, const void* result, SparkReturnType::Enum, token_t token)
     {
     		Message message;
@@ -72,16 +70,11 @@ public:
 	      query_length += 269;
 	    }
 
-	    bool has_function = false;
-
-	    // allocated memory bounds check
-	    if (MAX_FUNCTION_ARG_LENGTH > query_length)
-	    {
-	        // save a copy of the argument
-	        memcpy(function_arg, queue + q_index + 1, query_length);
-	        function_arg[query_length] = 0; // null terminate string
-	        has_function = true;
-	    }
+	    // the argument is read in place from the received message
+	    char* function_arg = (char*)queue + q_index + 1;
+	    bool has_function = (q_index + 1 + query_length <= message.length() &&
+	            q_index + 1 + query_length < message.capacity() &&
+	            MAX_FUNCTION_ARG_LENGTH >= query_length);
 
 	    Message response;
 	    channel.response(message, response, 16);
@@ -91,11 +84,17 @@ public:
 	    response.set_length(response_length);
 	    ProtocolError error = channel.send(response);
 	    if (error) return error;
+	    if (!has_function) return NO_ERROR;
+
+	    // the response follows the received message, so the terminator may only be
+	    // written once the ACK has been sent
+	    function_arg[query_length] = 0;
 
 	    // call the given user function
 	    auto callback = [=,&channel] (const void* result, SparkReturnType::Enum resultType )
 	    		{ return this->function_result(channel, result, resultType, token); };
-	    call_function(function_key, function_arg, callback, NULL);
+	    FunctionCallInfo info = { sizeof(FunctionCallInfo), query_length };
+	    call_function(function_key, function_arg, callback, &info);
 	    return NO_ERROR;
 	}
 };
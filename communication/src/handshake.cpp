@@ -24,9 +24,134 @@
   */
 #include "handshake.h"
 #include "protocol_selector.h"
+#include "device_keys.h"
 
 #if HAL_PLATFORM_CLOUD_TCP
 
+/**
+ * Keeps the parsed device and server keys between handshakes (about 1.5KB of heap).
+ * Disabled on the Core, which doesn't have the RAM to spare.
+ */
+#ifndef HANDSHAKE_RSA_CONTEXT_CACHE
+#if PLATFORM_ID == 0
+#define HANDSHAKE_RSA_CONTEXT_CACHE 0
+#else
+#define HANDSHAKE_RSA_CONTEXT_CACHE 1
+#endif
+#endif
+
+namespace {
+
+struct rsa_context_cache
+{
+  uint32_t checksum;
+  bool valid;
+  rsa_context rsa;
+};
+
+rsa_context_cache public_key_cache;
+rsa_context_cache private_key_cache;
+
+/**
+ * Determines the length of a DER encoded key from its SEQUENCE header.
+ */
+size_t der_length(const unsigned char *key, size_t max_length)
+{
+  if (key[0] != 0x30 || key[1] != 0x82)
+    return max_length;
+  const size_t length = 4 + (key[2] << 8 | key[3]);
+  return length < max_length ? length : max_length;
+}
+
+// FNV-1a
+uint32_t key_checksum(const unsigned char *key, size_t length)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; ++i)
+  {
+    hash ^= key[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+template<typename InitFn>
+rsa_context* cached_rsa_context(rsa_context_cache& cache, const unsigned char *key,
+                                size_t max_length, InitFn init)
+{
+  const uint32_t checksum = key_checksum(key, der_length(key, max_length));
+  if (!cache.valid || cache.checksum != checksum)
+  {
+    if (cache.valid)
+      rsa_free(&cache.rsa);
+    init(&cache.rsa, key);
+    cache.checksum = checksum;
+    cache.valid = true;
+  }
+  return &cache.rsa;
+}
+
+void free_rsa_context(rsa_context_cache& cache)
+{
+  if (cache.valid)
+  {
+    rsa_free(&cache.rsa);
+    cache.valid = false;
+  }
+}
+
+/**
+ * Holds the RSA context used for a single operation, either cached or parsed
+ * for the operation only.
+ */
+class rsa_key
+{
+  rsa_context* rsa;
+  rsa_context local;
+
+public:
+  rsa_key(const unsigned char *key, bool is_private)
+  {
+#if HANDSHAKE_RSA_CONTEXT_CACHE
+    rsa = is_private ? cached_rsa_context_with_private_key(key) : cached_rsa_context_with_public_key(key);
+#else
+    if (is_private)
+      init_rsa_context_with_private_key(&local, key);
+    else
+      init_rsa_context_with_public_key(&local, key);
+    rsa = &local;
+#endif
+  }
+
+  ~rsa_key()
+  {
+    if (rsa == &local)
+      rsa_free(&local);
+  }
+
+  rsa_context* get() { return rsa; }
+};
+
+} // namespace
+
+rsa_context* cached_rsa_context_with_public_key(const unsigned char *pubkey)
+{
+  return cached_rsa_context(public_key_cache, pubkey, MAX_SERVER_PUBLIC_KEY_LENGTH,
+                            init_rsa_context_with_public_key);
+}
+
+rsa_context* cached_rsa_context_with_private_key(const unsigned char *private_key)
+{
+  return cached_rsa_context(private_key_cache, private_key, MAX_DEVICE_PRIVATE_KEY_LENGTH,
+                            init_rsa_context_with_private_key);
+}
+
+void clear_rsa_context_cache(void)
+{
+  free_rsa_context(public_key_cache);
+  free_rsa_context(private_key_cache);
+}
+
 int ciphertext_from_nonce_and_id(const unsigned char *nonce,
                                  const unsigned char *id,
                                  const unsigned char *pubkey,
@@ -37,26 +162,27 @@ int ciphertext_from_nonce_and_id(const unsigned char *nonce,
   memcpy(plaintext, nonce, 40);
   memcpy(plaintext + 40, id, 12);
 
-  rsa_context rsa;
-  init_rsa_context_with_public_key(&rsa, pubkey);
+  rsa_key rsa(pubkey, false);
+  return rsa_pkcs1_encrypt(rsa.get(), RSA_PUBLIC, 52, plaintext, ciphertext);
+}
 
-  int ret = rsa_pkcs1_encrypt(&rsa, RSA_PUBLIC, 52, plaintext, ciphertext);
-  rsa_free(&rsa);
-  return ret;
+int encrypt_with_public_key(const unsigned char *pubkey,
+                            const unsigned char *plaintext, int length,
+                            unsigned char *ciphertext)
+{
+  rsa_key rsa(pubkey, false);
+  return rsa_pkcs1_encrypt(rsa.get(), RSA_PUBLIC, length, plaintext, ciphertext);
 }
 
 int decipher_aes_credentials(const unsigned char *private_key,
                              const unsigned char *ciphertext,
                              unsigned char *aes_credentials)
 {
-  rsa_context rsa;
-  init_rsa_context_with_private_key(&rsa, private_key);
+  rsa_key rsa(private_key, true);
 
   int len = 128;
-  int ret = rsa_pkcs1_decrypt(&rsa, RSA_PRIVATE, &len, ciphertext,
-                              aes_credentials, 40);
-  rsa_free(&rsa);
-  return ret;
+  return rsa_pkcs1_decrypt(rsa.get(), RSA_PRIVATE, &len, ciphertext,
+                           aes_credentials, 40);
 }
 
 void calculate_ciphertext_hmac(const unsigned char *ciphertext,
@@ -70,13 +196,9 @@ int verify_signature(const unsigned char *signature,
                      const unsigned char *pubkey,
                      const unsigned char *expected_hmac)
 {
-  rsa_context rsa;
-  init_rsa_context_with_public_key(&rsa, pubkey);
-
-  int ret = rsa_pkcs1_verify(&rsa, RSA_PUBLIC, RSA_RAW, 20,
-                             expected_hmac, signature);
-  rsa_free(&rsa);
-  return ret;
+  rsa_key rsa(pubkey, false);
+  return rsa_pkcs1_verify(rsa.get(), RSA_PUBLIC, RSA_RAW, 20,
+                          expected_hmac, signature);
 }
 
 void init_rsa_context_with_public_key(rsa_context *rsa,
@@ -36,6 +36,13 @@ int ciphertext_from_nonce_and_id(const unsigned char *nonce,
                                  const unsigned char *pubkey,
                                  unsigned char *ciphertext);
 
+/**
+ * Encrypts the handshake nonce, device ID and public key with the server public key.
+ */
+int encrypt_with_public_key(const unsigned char *pubkey,
+                            const unsigned char *plaintext, int length,
+                            unsigned char *ciphertext);
+
 int decipher_aes_credentials(const unsigned char *private_key,
                              const unsigned char *ciphertext,
                              unsigned char *aes_credentials);
@@ -54,6 +61,21 @@ void init_rsa_context_with_public_key(rsa_context *rsa,
 void init_rsa_context_with_private_key(rsa_context *rsa,
                                        const unsigned char *private_key);
 
+/**
+ * Retrieves an RSA context for the given key, parsed when the key is first used or
+ * when its content changed. The context is owned by the cache and keeps the Montgomery
+ * constants (R^2 mod N, P and Q) computed by the first operation, so that later
+ * handshakes only pay for the exponentiations. Not thread-safe: used by the system thread.
+ */
+rsa_context* cached_rsa_context_with_public_key(const unsigned char *pubkey);
+
+rsa_context* cached_rsa_context_with_private_key(const unsigned char *private_key);
+
+/**
+ * Frees the cached RSA contexts.
+ */
+void clear_rsa_context_cache(void);
+
 
 void extract_public_rsa_key(uint8_t* device_pubkey, const uint8_t* device_privkey);
 
@@ -12,6 +12,7 @@ LOG_SOURCE_CATEGORY("comm.lightssl")
 #include "tropicssl/rsa.h"
 #include "tropicssl/aes.h"
 #include "lightssl_message_channel.h"
+#include "protocol_metrics.h"
 
 namespace particle
 {
@@ -31,6 +32,10 @@ namespace protocol
 		memcpy(this->device_id, device_id, sizeof(this->device_id));
 		this->callbacks = callbacks;
 		this->counter = counter;
+		// the session key is set by the handshake, until then the schedules are for an all-zero key
+		memset(key, 0, sizeof(key));
+		aes_setkey_enc(&aes_enc, key, 128);
+		aes_setkey_dec(&aes_dec, key, 128);
 	}
 
 	/**
@@ -57,6 +62,8 @@ namespace protocol
 		ProtocolError error = NO_ERROR;
                 // NB: use callbacks.receive() to return immediately, rather than blocking_receive()
 		int bytes_received = callbacks.receive(queue, 2, nullptr);
+		if (bytes_received > 0)
+			ProtocolMetrics::instance().bytes_received.increment(bytes_received);
 		if (2 == bytes_received)
 		{
 			size_t packet_size = queue[0] << 8 | queue[1];
@@ -70,8 +77,7 @@ namespace protocol
 				{
 					unsigned char next_iv[16];
 					memcpy(next_iv, buf, 16);
-					aes_setkey_dec(&aes, key, 128);
-					aes_crypt_cbc(&aes, AES_DECRYPT, packet_size, iv_receive, buf, buf);
+					aes_crypt_cbc(&aes_dec, AES_DECRYPT, packet_size, iv_receive, buf, buf);
 					memcpy(iv_receive, next_iv, 16);
 					message.set_length(packet_size-buf[packet_size-1]);
 				}
@@ -115,6 +121,8 @@ namespace protocol
 		}
 
 		memcpy(key, credentials, 16);
+		aes_setkey_enc(&aes_enc, key, 128);
+		aes_setkey_dec(&aes_dec, key, 128);
 		memcpy(iv_send, credentials + 16, 16);
 		memcpy(iv_receive, credentials + 16, 16);
 		memcpy(salt, credentials + 32, 8);
@@ -142,57 +150,113 @@ namespace protocol
 
 	void LightSSLMessageChannel::encrypt(unsigned char *buf, int length)
 	{
-		aes_setkey_enc(&aes, key, 128);
-		aes_crypt_cbc(&aes, AES_ENCRYPT, length, iv_send, buf, buf);
+		aes_crypt_cbc(&aes_enc, AES_ENCRYPT, length, iv_send, buf, buf);
 		memcpy(iv_send, buf, 16);
 	}
 
-	ProtocolError LightSSLMessageChannel::handshake()
+	ProtocolError LightSSLMessageChannel::establish(uint32_t& flags, uint32_t app_crc)
 	{
-		LOG_CATEGORY("comm.lightssl.handshake");
-		LOG(INFO,"Started, receive nonce");
-		memcpy(queue + 40, device_id, 12);
-		int err = blocking_receive(queue, 40);
-		if (0 > err)
+		ProtocolError error = establish_start(flags, app_crc);
+		while (error == HANDSHAKE_IN_PROGRESS)
 		{
-			LOG(ERROR,"Could not receive nonce: %d", err);
-			return IO_ERROR_LIGHTSSL_HANDSHAKE_NONCE;
+			error = establish_step();
 		}
+		return error;
+	}
 
-		LOG(INFO,"Encrypting nonce");
-		extract_public_rsa_key(queue + 52, core_private_key);
-
-		rsa_context rsa;
-		init_rsa_context_with_public_key(&rsa, server_public_key);
-		const int len = 52 + MAX_DEVICE_PUBLIC_KEY_LENGTH;
-		err = rsa_pkcs1_encrypt(&rsa, RSA_PUBLIC, len, queue, queue + len);
-		rsa_free(&rsa);
+	ProtocolError LightSSLMessageChannel::establish_start(uint32_t& flags, uint32_t app_crc)
+	{
+		LOG_CATEGORY("comm.lightssl.handshake");
+		LOG(INFO,"Started, receive nonce");
+		memcpy(queue + 40, device_id, 12);
+		handshake_state = RECEIVE_NONCE;
+		handshake_received = 0;
+		handshake_millis = callbacks.millis();
+		return HANDSHAKE_IN_PROGRESS;
+	}
 
-		if (err)
+	ProtocolError LightSSLMessageChannel::establish_step()
+	{
+		LOG_CATEGORY("comm.lightssl.handshake");
+		ProtocolError error = NO_ERROR;
+		switch (handshake_state)
+		{
+		case RECEIVE_NONCE:
 		{
-			LOG(ERROR,"RSA encrypt error %d", err);
-			return ENCRYPTION_ERROR;
+			error = handshake_receive(40, IO_ERROR_LIGHTSSL_HANDSHAKE_NONCE);
+			if (error == HANDSHAKE_IN_PROGRESS)
+				return error;
+			if (error)
+				break;
+
+			LOG(INFO,"Encrypting nonce");
+			extract_public_rsa_key(queue + 52, core_private_key);
+
+			const int len = 52 + MAX_DEVICE_PUBLIC_KEY_LENGTH;
+			int err = encrypt_with_public_key(server_public_key, queue, len, queue + len);
+			if (err)
+			{
+				LOG(ERROR,"RSA encrypt error %d", err);
+				error = ENCRYPTION_ERROR;
+				break;
+			}
+
+			LOG(INFO,"Sending encrypted nonce");
+			blocking_send(queue + len, 256);
+			LOG(INFO,"Receive key");
+			handshake_state = RECEIVE_KEY;
+			handshake_received = 0;
+			handshake_millis = callbacks.millis();
+			return HANDSHAKE_IN_PROGRESS;
 		}
+		case RECEIVE_KEY:
+			error = handshake_receive(384, IO_ERROR_LIGHTSSL_HANDSHAKE_RECV_KEY);
+			if (error == HANDSHAKE_IN_PROGRESS)
+				return error;
+			if (error)
+				break;
+			// the key is deciphered in a step of its own, it's the longest of the handshake
+			handshake_state = SET_KEY;
+			return HANDSHAKE_IN_PROGRESS;
+
+		case SET_KEY:
+			LOG(INFO,"Setting key");
+			error = set_key(queue);
+			if (error)
+			{
+				LOG(ERROR,"Could not set key, %d", error);
+				break;
+			}
+			LOG(INFO,"Completed");
+			break;
 
-		LOG(INFO,"Sending encrypted nonce");
-		blocking_send(queue + len, 256);
-		LOG(INFO,"Receive key");
-		err = blocking_receive(queue, 384);
-		if (0 > err)
-		{
-			LOG(ERROR,"Unable to receive key %d", err);
-			return IO_ERROR_LIGHTSSL_HANDSHAKE_RECV_KEY;
+		default:
+			return INVALID_STATE;
 		}
+		handshake_state = HANDSHAKE_IDLE;
+		return error;
+	}
 
-		LOG(INFO,"Setting key");
-		ProtocolError error = set_key(queue);
-		if (error)
+	ProtocolError LightSSLMessageChannel::handshake_receive(int length, ProtocolError error)
+	{
+		int bytes_or_error = callbacks.receive(queue + handshake_received,
+				length - handshake_received, nullptr);
+		if (0 > bytes_or_error)
 		{
-			LOG(ERROR,"Could not set key, %d", error);
+			LOG(ERROR,"Handshake receive error %d", bytes_or_error);
 			return error;
 		}
-
-		LOG(INFO,"Completed");
+		ProtocolMetrics::instance().bytes_received.increment(bytes_or_error);
+		handshake_received += bytes_or_error;
+		if (handshake_received < length)
+		{
+			if (20000 < (callbacks.millis() - handshake_millis))
+			{
+				LOG(ERROR,"Handshake receive timeout");
+				return error;
+			}
+			return HANDSHAKE_IN_PROGRESS;
+		}
 		return NO_ERROR;
 	}
 
@@ -228,6 +292,7 @@ namespace protocol
 				}
 			}
 		}
+		ProtocolMetrics::instance().bytes_sent.increment(byte_count);
 		return byte_count;
 	}
 
@@ -263,6 +328,7 @@ namespace protocol
 				}
 			}
 		}
+		ProtocolMetrics::instance().bytes_received.increment(byte_count);
 		return byte_count;
 	}
 
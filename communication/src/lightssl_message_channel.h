@@ -62,14 +62,30 @@ private:
 	unsigned char iv_send[16];
 	unsigned char iv_receive[16];
 	unsigned char salt[8];
-	aes_context aes;
+	// key schedules, expanded once per session by set_key()
+	aes_context aes_enc;
+	aes_context aes_dec;
 
 	Callbacks callbacks;
 	message_id_t* counter;
 
+	enum HandshakeState
+	{
+		HANDSHAKE_IDLE,
+		RECEIVE_NONCE,
+		RECEIVE_KEY,
+		SET_KEY
+	};
+
+	// handshake in progress, the messages received so far are in the queue
+	uint8_t handshake_state;
+	int handshake_received;
+	system_tick_t handshake_millis;
+
 public:
 
-	LightSSLMessageChannel()
+	LightSSLMessageChannel() :
+			handshake_state(HANDSHAKE_IDLE)
 	{
 	}
 
@@ -79,10 +95,11 @@ public:
 	void init(const uint8_t* core_private, const uint8_t* server_public,
 			const uint8_t* device_id, Callbacks& callbacks, message_id_t* counter);
 
-	virtual ProtocolError establish(uint32_t& flags, uint32_t app_crc) override
-	{
-		return handshake();
-	}
+	virtual ProtocolError establish(uint32_t& flags, uint32_t app_crc) override;
+
+	virtual ProtocolError establish_start(uint32_t& flags, uint32_t app_crc) override;
+
+	virtual ProtocolError establish_step() override;
 
 	/**
 	 * Retrieve first the 2 byte length from the stream, which determines
@@ -110,7 +127,12 @@ protected:
 	size_t wrap(unsigned char *buf, size_t msglen);
 	void encrypt(unsigned char *buf, int length);
 
-	ProtocolError handshake();
+	/**
+	 * Receives what is available of a handshake message of the given length without blocking.
+	 * Returns HANDSHAKE_IN_PROGRESS until the whole message is received, or the given error
+	 * on a receive error or timeout.
+	 */
+	ProtocolError handshake_receive(int length, ProtocolError error);
 
 	// Returns bytes sent or -1 on error
 	int blocking_send(const unsigned char *buf, int length);
@@ -278,6 +278,15 @@
 //#define MBEDTLS_AES_ENCRYPT_ALT
 //#define MBEDTLS_AES_DECRYPT_ALT
 
+/**
+ * \def MBEDTLS_ECDH_GEN_PUBLIC_ALT
+ *
+ * Uncomment this macro to provide your own mbedtls_ecdh_gen_public(), e.g. to
+ * hand out ephemeral ECDH key pairs that were generated ahead of time.
+ * The function must have the same prototype as declared in ecdh.h.
+ */
+#define MBEDTLS_ECDH_GEN_PUBLIC_ALT
+
 /**
  * \def MBEDTLS_ENTROPY_HARDWARE_ALT
  *
@@ -438,6 +447,19 @@
  */
 #define MBEDTLS_ECP_NIST_OPTIM
 
+/**
+ * \def MBEDTLS_ECP_COMB_CACHE
+ *
+ * Keep the tables precomputed for the multiplication of fixed points (the
+ * generator, and points added with mbedtls_ecp_comb_cache_add()) for the
+ * lifetime of the application instead of per group. Speeds up ECDHE key
+ * generation and ECDSA verification in each new handshake, at the cost of
+ * MBEDTLS_ECP_COMB_CACHE_SIZE tables kept in RAM.
+ *
+ * Comment this macro to disable the cache.
+ */
+#define MBEDTLS_ECP_COMB_CACHE
+
 /**
  * \def MBEDTLS_ECDSA_DETERMINISTIC
  *
@@ -2449,6 +2471,7 @@
 //#define MBEDTLS_ECP_MAX_BITS             521 /**< Maximum bit size of groups */
 //#define MBEDTLS_ECP_WINDOW_SIZE            6 /**< Maximum window size used */
 //#define MBEDTLS_ECP_FIXED_POINT_OPTIM      1 /**< Enable fixed-point speed-up */
+//#define MBEDTLS_ECP_COMB_CACHE_SIZE        2 /**< Number of cached fixed points */
 
 /* Entropy options */
 //#define MBEDTLS_ENTROPY_MAX_SOURCES                20 /**< Maximum number of sources supported */
@@ -216,6 +216,26 @@ struct MessageChannel : public Channel
 	 */
 	virtual ProtocolError establish(uint32_t& flags, uint32_t app_state_crc)=0;
 
+	/**
+	 * Starts establishing this channel without blocking. When this returns HANDSHAKE_IN_PROGRESS,
+	 * establish_step() is called until it returns the result of the handshake.
+	 * The default implementation establishes the channel in one go.
+	 */
+	virtual ProtocolError establish_start(uint32_t& flags, uint32_t app_state_crc)
+	{
+		return establish(flags, app_state_crc);
+	}
+
+	/**
+	 * Performs the next step of the handshake started by establish_start(). A step waits for no
+	 * data from the network and runs at most one public key operation.
+	 * @return HANDSHAKE_IN_PROGRESS while more steps are needed, otherwise the result of the handshake.
+	 */
+	virtual ProtocolError establish_step()
+	{
+		return INVALID_STATE;
+	}
+
 	/**
 	 * Retrieves a new message object containing the message buffer.
 	 */
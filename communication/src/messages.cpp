@@ -285,8 +285,8 @@ size_t Messages::separate_response_with_payload(unsigned char *buf, uint16_t mes
 	return len;
 }
 
-size_t Messages::event(uint8_t buf[], uint16_t message_id, const char *event_name,
-             const char *data, int ttl, EventType::Enum event_type, bool confirmable)
+size_t Messages::event_header(uint8_t buf[], uint16_t message_id, const char *event_name,
+             int ttl, EventType::Enum event_type, bool confirmable)
 {
   uint8_t *p = buf;
   *p++ = confirmable ? 0x40 : 0x50; // non-confirmable /confirmable, no token
@@ -307,18 +307,36 @@ size_t Messages::event(uint8_t buf[], uint16_t message_id, const char *event_nam
     *p++ = ttl & 0xff;
   }
 
+  return p - buf;
+}
+
+size_t Messages::event(uint8_t buf[], uint16_t message_id, const char *event_name,
+             const char *data, int ttl, EventType::Enum event_type, bool confirmable,
+             size_t max_data_length)
+{
+  uint8_t *p = buf + event_header(buf, message_id, event_name, ttl, event_type, confirmable);
+
   if (NULL != data)
   {
-    name_data_len = strnlen(data, 255);
+    size_t data_len = strnlen(data, max_data_length);
 
     *p++ = 0xff;
-    memcpy(p, data, name_data_len);
-    p += name_data_len;
+    memcpy(p, data, data_len);
+    p += data_len;
   }
 
   return p - buf;
 }
 
-
+size_t Messages::block_content(uint8_t* buf, message_id_t message_id, token_t token,
+             const CoAPBlock& block, size_t total_size)
+{
+	size_t size = content(buf, message_id, token) - 1; // options go before the payload marker
+	size += CoAP::uint_option(buf + size, CoAPOption::BLOCK2, block.encode());
+	if (block.num == 0)
+		size += CoAP::uint_option(buf + size, CoAPOption::SIZE2 - CoAPOption::BLOCK2, total_size);
+	buf[size++] = 0xFF;
+	return size;
+}
 
 }}
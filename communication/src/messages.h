@@ -85,8 +85,22 @@ public:
 			unsigned char token, unsigned char code, unsigned char* payload,
 			unsigned payload_len, bool confirmable);
 
+	/**
+	 * Writes an event request up to, not including, the payload marker.
+	 */
+	static size_t event_header(uint8_t buf[], uint16_t message_id, const char *event_name,
+	             int ttl, EventType::Enum event_type, bool confirmable);
+
 	static size_t event(uint8_t buf[], uint16_t message_id, const char *event_name,
-	             const char *data, int ttl, EventType::Enum event_type, bool confirmable);
+	             const char *data, int ttl, EventType::Enum event_type, bool confirmable,
+	             size_t max_data_length = 255);
+
+	/**
+	 * Writes a 2.05 CONTENT response carrying one block of the payload, up to and including
+	 * the payload marker. The first block also carries the total size of the payload.
+	 */
+	static size_t block_content(uint8_t* buf, message_id_t message_id, token_t token,
+	             const CoAPBlock& block, size_t total_size);
 
 
     static inline size_t empty_ack(unsigned char *buf,
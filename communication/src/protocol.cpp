@@ -24,6 +24,7 @@ LOG_SOURCE_CATEGORY("comm.protocol")
 #include "chunked_transfer.h"
 #include "subscriptions.h"
 #include "functions.h"
+#include "protocol_metrics.h"
 
 namespace particle { namespace protocol {
 
@@ -50,6 +51,9 @@ ProtocolError Protocol::handle_received_message(Message& message,
 	token_t token = queue[4];
 	message_id_t msg_id = CoAP::message_id(queue);
 	ProtocolError error = NO_ERROR;
+	// acknowledgements and responses to the blocks of a block-wise transfer
+	if (message.get_type()==CoAPType::ACK && block_sender.acknowledged(msg_id, queue[1]))
+		return block_sender.send(channel);
 	//LOG(WARN,"message type %d", message_type);
 	switch (message_type)
 	{
@@ -58,12 +62,15 @@ ProtocolError Protocol::handle_received_message(Message& message,
 		// 4 bytes header, 1 byte token, 2 bytes location path
 		// 2 bytes optional single character location path for describe flags
 		int descriptor_type = DESCRIBE_ALL;
-		if (message.length()>8 && queue[8] <= DESCRIBE_ALL) {
+		const bool has_flags = message.length()>8 && (queue[7] & 0xF0)==0;
+		if (has_flags && queue[8] <= DESCRIBE_ALL) {
 			descriptor_type = queue[8];
-		} else if (message.length() > 8) {
+		} else if (has_flags) {
 			LOG(WARN, "Invalid DESCRIBE flags %02x", queue[8]);
 		}
-		error = send_description(token, msg_id, descriptor_type);
+		CoAPBlock block;
+		error = send_description(token, msg_id, descriptor_type,
+				requested_block(message, block) ? &block : nullptr);
 		break;
 	}
 
@@ -77,7 +84,7 @@ ProtocolError Protocol::handle_received_message(Message& message,
 		variables.decode_variable_request(variable_key, message);
 		return variables.handle_variable_request(variable_key, message,
 				channel, token, msg_id,
-				descriptor.variable_type, descriptor.get_variable);
+				descriptor.variable_type, descriptor.get_variable, block_size);
 	}
 	case CoAPMessageType::SAVE_BEGIN:
 		// fall through
@@ -121,9 +128,8 @@ ProtocolError Protocol::handle_received_message(Message& message,
 		break;
 
 	case CoAPMessageType::PING:
-		message.set_length(
-				Messages::empty_ack(message.buf(), queue[2], queue[3]));
-		error = channel.send(message);
+		// the acknowledgement keeps the ID of the ping, the TCP channel doesn't decode it on receive
+		error = send_empty_ack(message, msg_id);
 		break;
 
 	case CoAPMessageType::EMPTY_ACK:
@@ -249,6 +255,16 @@ uint32_t Protocol::application_state_checksum()
  * Establish a secure connection and send and process the hello message.
  */
 int Protocol::begin()
+{
+	int error = begin_start();
+	while (error == HANDSHAKE_IN_PROGRESS)
+	{
+		error = begin_step();
+	}
+	return error;
+}
+
+int Protocol::begin_start()
 {
 	LOG_CATEGORY("comm.protocol.handshake");
 	LOG(INFO,"Establish secure connection");
@@ -260,14 +276,95 @@ int Protocol::begin()
 	ack_handlers.clear();
 	last_ack_handlers_update = callbacks.millis();
 
+	handshake_state = HANDSHAKE_ESTABLISH;
+	handshake_start_millis = callbacks.millis();
 	uint32_t channel_flags = 0;
-	ProtocolError error = channel.establish(channel_flags, application_state_checksum());
+	ProtocolError error = channel.establish_start(channel_flags, application_state_checksum());
+	if (error == HANDSHAKE_IN_PROGRESS)
+		return error;
+	return handshake_result(channel_established(error, channel_flags));
+}
+
+int Protocol::begin_step()
+{
+	LOG_CATEGORY("comm.protocol.handshake");
+	ProtocolError error = NO_ERROR;
+	switch (handshake_state)
+	{
+	case HANDSHAKE_ESTABLISH:
+		error = channel.establish_step();
+		if (error == HANDSHAKE_IN_PROGRESS)
+			return error;
+		return handshake_result(channel_established(error, 0));
+
+	case HANDSHAKE_HELLO_ACK:
+	case HANDSHAKE_HELLO_RESPONSE:
+	{
+		// the acknowledgement and the response are processed by the event loop
+		CoAPMessageType::Enum msgtype;
+		error = event_loop(msgtype);
+		if (error)
+		{
+			LOG(ERROR,"Handshake: message type=%d, error=%d", (int)msgtype, error);
+			break;
+		}
+		if (handshake_state == HANDSHAKE_HELLO_ACKNOWLEDGED)
+			return handshake_result(hello_sent());
+		if (handshake_state == HANDSHAKE_HELLO_NOT_ACKNOWLEDGED)
+		{
+			LOG(ERROR,"Could not send HELLO message");
+			error = MESSAGE_TIMEOUT;
+			break;
+		}
+		if (handshake_state == HANDSHAKE_HELLO_RESPONSE)
+		{
+			if (msgtype == CoAPMessageType::HELLO)
+				return handshake_result(handshake_completed());
+			if ((callbacks.millis() - handshake_millis) >= 4000)
+			{
+				LOG(ERROR,"Handshake: could not receive HELLO response");
+				error = MESSAGE_TIMEOUT;
+				break;
+			}
+		}
+		// the acknowledgement is timed out by its completion handler
+		return HANDSHAKE_IN_PROGRESS;
+	}
+	default:
+		return INVALID_STATE;
+	}
+	handshake_state = HANDSHAKE_IDLE;
+	return handshake_result(error);
+}
+
+int Protocol::handshake_result(int error)
+{
+	if (error == HANDSHAKE_IN_PROGRESS)
+		return error;
+	ProtocolMetrics& metrics = ProtocolMetrics::instance();
+	if (!error || error == SESSION_RESUMED)
+	{
+		metrics.handshakes.increment();
+		metrics.handshake_duration.record(callbacks.millis() - handshake_start_millis);
+	}
+	else
+		metrics.handshake_failures.increment();
+	return error;
+}
+
+int Protocol::channel_established(ProtocolError error, uint32_t channel_flags)
+{
+	LOG_CATEGORY("comm.protocol.handshake");
+	handshake_state = HANDSHAKE_IDLE;
 	bool session_resumed = (error==SESSION_RESUMED);
 	if (error && !session_resumed) {
 		LOG(ERROR,"handshake failed with code %d", error);
 		return error;
 	}
 
+	// continue a block-wise transfer interrupted by the loss of the previous session
+	block_sender.resume(session_resumed);
+
 	if (session_resumed)
 	{
 		// for now, unconditionally move the session on resumption
@@ -295,17 +392,43 @@ int Protocol::begin()
 		LOG(ERROR,"Could not send HELLO message: %d", error);
 		return error;
 	}
+	if (channel.is_unreliable())
+	{
+		handshake_state = HANDSHAKE_HELLO_ACK;
+		return HANDSHAKE_IN_PROGRESS;
+	}
+	return hello_sent();
+}
 
+int Protocol::hello_sent()
+{
+	LOG_CATEGORY("comm.protocol.handshake");
 	if (flags & REQUIRE_HELLO_RESPONSE) {
 		LOG(INFO,"Receiving HELLO response");
-		error = hello_response();
-		if (error)
-			return error;
+		handshake_state = HANDSHAKE_HELLO_RESPONSE;
+		handshake_millis = callbacks.millis();
+		return HANDSHAKE_IN_PROGRESS;
 	}
+	return handshake_completed();
+}
+
+int Protocol::handshake_completed()
+{
+	LOG_CATEGORY("comm.protocol.handshake");
 	LOG(INFO,"Handshake completed");
+	handshake_state = HANDSHAKE_IDLE;
 	channel.notify_established();
 	flags |= SKIP_SESSION_RESUME_HELLO;
-	return error;
+	return NO_ERROR;
+}
+
+void Protocol::hello_ack_handler(int error, const void* data, void* callback_data, void* reserved)
+{
+	Protocol* protocol = static_cast<Protocol*>(callback_data);
+	if (protocol->handshake_state == HANDSHAKE_HELLO_ACK)
+	{
+		protocol->handshake_state = error ? HANDSHAKE_HELLO_NOT_ACKNOWLEDGED : HANDSHAKE_HELLO_ACKNOWLEDGED;
+	}
 }
 
 /**
@@ -319,17 +442,12 @@ ProtocolError Protocol::hello(bool was_ota_upgrade_successful)
 
 	size_t len = build_hello(message, was_ota_upgrade_successful);
 	message.set_length(len);
-	message.set_confirm_received(true);
 	last_message_millis = callbacks.millis();
-	return channel.send(message);
-}
-
-ProtocolError Protocol::hello_response()
-{
-	ProtocolError error = event_loop(CoAPMessageType::HELLO,  4000); // read the hello message from the server
-	if (error)
+	ProtocolError error = channel.send(message);
+	// the handshake continues once the hello is acknowledged
+	if (!error && channel.is_unreliable() && message.has_id())
 	{
-		LOG(ERROR,"Handshake: could not receive HELLO response %d", error);
+		ack_handlers.addHandler(message.get_id(), CompletionHandler(hello_ack_handler, this), SEND_EVENT_ACK_TIMEOUT);
 	}
 	return error;
 }
@@ -406,15 +524,14 @@ ProtocolError Protocol::event_loop(CoAPMessageType::Enum& message_type)
  * Produces and transmits a describe message.
  * @param desc_flags Flags describing the information to provide. A combination of {@code DESCRIBE_APPLICATION) and {@code DESCRIBE_SYSTEM) flags.
  */
-ProtocolError Protocol::send_description(token_t token, message_id_t msg_id, int desc_flags)
+ProtocolError Protocol::send_description(token_t token, message_id_t msg_id, int desc_flags, const CoAPBlock* block)
 {
 	Message message;
 	channel.create(message);
 	uint8_t* buf = message.buf();
 	message.set_id(msg_id);
-	size_t desc = Messages::description(buf, msg_id, token);
 
-	BufferAppender appender(buf + desc, message.capacity());
+	auto generate = [this, desc_flags](Appender& appender) {
 	appender.append("{");
 	bool has_content = false;
 
@@ -474,7 +591,12 @@ ProtocolError Protocol::send_description(token_t token, message_id_t msg_id, int
 		descriptor.append_system_info(append_instance, &appender, nullptr);
 	}
 	appender.append('}');
-	int msglen = appender.next() - (uint8_t*) buf;
+	};
+	size_t msglen = block_response(buf, message.capacity(), msg_id, token, block, block_size, generate);
+	if (!msglen)
+	{
+		msglen = Messages::coded_ack(buf, token, RESPONSE_CODE(4,2), msg_id >> 8, msg_id & 0xFF);
+	}
 	message.set_length(msglen);
 	LOG(INFO,"Sending %s%s describe message", desc_flags & DESCRIBE_SYSTEM ? "S" : "",
 											  desc_flags & DESCRIBE_APPLICATION ? "A" : "");
@@ -12,6 +12,7 @@
 #include "publisher.h"
 #include "subscriptions.h"
 #include "variables.h"
+#include "coap_blockwise.h"
 #include "hal_platform.h"
 #include "timesyncmanager.h"
 
@@ -120,12 +121,40 @@ class Protocol
 	CompletionHandlerMap<message_id_t> ack_handlers;
 	system_tick_t last_ack_handlers_update;
 
+	/**
+	 * Sends request payloads that don't fit in a single message.
+	 */
+	BlockSender block_sender;
+
+	/**
+	 * The preferred block size and the number of blocks in flight of block-wise transfers.
+	 */
+	uint16_t block_size;
+	uint8_t block_window;
+
 	/**
 	 * The token ID for the next request made.
 	 * If we have a bone-fide CoAP layer this will eventually disappear into that layer, just like message-id has.
 	 */
 	token_t token;
 
+	/**
+	 * The state of a handshake performed in steps by begin_start() and begin_step().
+	 */
+	enum HandshakeState
+	{
+		HANDSHAKE_IDLE,
+		HANDSHAKE_ESTABLISH,
+		HANDSHAKE_HELLO_ACK,			// waiting for the acknowledgement of the hello
+		HANDSHAKE_HELLO_ACKNOWLEDGED,
+		HANDSHAKE_HELLO_NOT_ACKNOWLEDGED,
+		HANDSHAKE_HELLO_RESPONSE		// waiting for the hello from the server
+	};
+
+	uint8_t handshake_state;
+	system_tick_t handshake_millis;
+	system_tick_t handshake_start_millis;
+
 	uint8_t initialized;
 
 	uint8_t flags;
@@ -177,9 +206,25 @@ protected:
 	ProtocolError hello(bool was_ota_upgrade_successful);
 
 	/**
-	 * Send a hello response
+	 * Continues the handshake once the channel is established: sends the hello message
+	 * unless the session was resumed without the need for one.
+	 */
+	int channel_established(ProtocolError error, uint32_t channel_flags);
+
+	/**
+	 * Continues the handshake once the hello message was delivered.
+	 */
+	int hello_sent();
+
+	int handshake_completed();
+
+	/**
+	 * Updates the protocol metrics with the result of a handshake step.
+	 * @return the result given.
 	 */
-	ProtocolError hello_response();
+	int handshake_result(int error);
+
+	static void hello_ack_handler(int error, const void* data, void* callback_data, void* reserved);
 
 	virtual size_t build_hello(Message& message, bool was_ota_upgrade_successful)=0;
 
@@ -207,6 +252,12 @@ protected:
 	 */
 	ProtocolError event_loop_idle()
 	{
+		if (block_sender.is_active())
+		{
+			ProtocolError error = block_sender.send(channel);
+			if (error)
+				return error;
+		}
 		if (chunkedTransfer.is_updating())
 		{
 			return chunkedTransfer.idle(channel);
@@ -230,8 +281,9 @@ protected:
 	/**
 	 * Produces and transmits a describe message.
 	 * @param desc_flags Flags describing the information to provide. A combination of {@code DESCRIBE_APPLICATION) and {@code DESCRIBE_SYSTEM) flags.
+	 * @param block The block of the description requested by the server, or nullptr.
 	 */
-	ProtocolError send_description(token_t token, message_id_t msg_id, int desc_flags);
+	ProtocolError send_description(token_t token, message_id_t msg_id, int desc_flags, const CoAPBlock* block=nullptr);
 
 	/**
 	 * Decodes and dispatches a received message to its handler.
@@ -275,6 +327,9 @@ public:
 			product_firmware_version(PRODUCT_FIRMWARE_VERSION),
 			publisher(this),
 			last_ack_handlers_update(0),
+			block_size(DEFAULT_BLOCK_SIZE),
+			block_window(DEFAULT_BLOCK_WINDOW),
+			handshake_state(HANDSHAKE_IDLE),
 			initialized(false)
 	{
 	}
@@ -304,6 +359,27 @@ public:
 		ack_handlers.addHandler(msg_id, std::move(handler), timeout);
 	}
 
+	void set_block_size(size_t size)
+	{
+		block_size = size;
+	}
+
+	void set_block_window(uint8_t window)
+	{
+		block_window = window;
+	}
+
+	/**
+	 * Sends a request payload block-wise. Only one such transfer is in progress at a time.
+	 * @param header The request up to, not including, the payload marker.
+	 */
+	ProtocolError send_blocks(const uint8_t* header, size_t header_length, const uint8_t* data, size_t size,
+			CompletionHandler handler)
+	{
+		return block_sender.start(channel, header, header_length, data, size, block_size, block_window,
+				std::move(handler));
+	}
+
 	/**
 	 * Determines the checksum of the application state.
 	 * Application state comprises cloud functinos, variables and subscriptions.
@@ -318,6 +394,19 @@ public:
 	 */
 	int begin();
 
+	/**
+	 * Starts the handshake performed by begin() without blocking, abandoning a handshake in progress.
+	 * @return HANDSHAKE_IN_PROGRESS when begin_step() is to be called until it returns
+	 * the result of the handshake, otherwise the result of the handshake.
+	 */
+	int begin_start();
+
+	/**
+	 * Performs the next step of the handshake started by begin_start(). A step doesn't wait
+	 * for data from the network and runs at most one public key operation.
+	 */
+	int begin_step();
+
 	/**
 	 * Wait for a specific message type to be received.
 	 * @param message_type		The type of message wait for
@@ -47,6 +47,8 @@ system_error particle::protocol::toSystemError(ProtocolError error) {
         return SYSTEM_ERROR_LIMIT_EXCEEDED;
     case INSUFFICIENT_STORAGE:
         return SYSTEM_ERROR_TOO_LARGE;
+    case HANDSHAKE_IN_PROGRESS:
+        return SYSTEM_ERROR_BUSY;
     default:
         return SYSTEM_ERROR_PROTOCOL; // Generic protocol error
     }
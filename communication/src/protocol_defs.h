@@ -47,6 +47,7 @@ enum ProtocolError
     /* 23 */ IO_ERROR_LIGHTSSL_RECEIVE,
     /* 24 */ IO_ERROR_LIGHTSSL_HANDSHAKE_NONCE,
     /* 25 */ IO_ERROR_LIGHTSSL_HANDSHAKE_RECV_KEY,
+    /* 26 */ HANDSHAKE_IN_PROGRESS,	// a non-blocking handshake step completed, more steps are needed
 
     /*
      * NOTE: when adding more ProtocolError codes, be sure to update toSystemError() in protocol_defs.cpp
@@ -62,13 +63,22 @@ typedef uint16_t chunk_index_t;
 const chunk_index_t NO_CHUNKS_MISSING = 65535;
 const chunk_index_t MAX_CHUNKS = 65535;
 const size_t MISSED_CHUNKS_TO_SEND = 50;
-const size_t MAX_FUNCTION_ARG_LENGTH = 64;
+// Maximum length of a function argument. The argument is read in place from the received
+// message, so the actual limit also depends on PROTOCOL_BUFFER_SIZE
+const size_t MAX_FUNCTION_ARG_LENGTH = 622;
 const size_t MAX_FUNCTION_KEY_LENGTH = 12;
 const size_t MAX_VARIABLE_KEY_LENGTH = 12;
 const size_t MAX_EVENT_NAME_LENGTH = 64;
 const size_t MAX_EVENT_DATA_LENGTH = 64;
 const size_t MAX_EVENT_TTL_SECONDS = 16777215;
 
+// Maximum size of an event payload, larger payloads are sent block-wise (RFC 7959)
+const size_t MAX_BLOCKWISE_PAYLOAD_SIZE = 4096;
+// Default block size of block-wise transfers, reduced if a block doesn't fit the protocol buffer
+const size_t DEFAULT_BLOCK_SIZE = 512;
+// Default number of blocks sent without waiting for an acknowledgement
+const uint8_t DEFAULT_BLOCK_WINDOW = 4;
+
 // Timeout in milliseconds given to receive an acknowledgement for a published event
 const unsigned SEND_EVENT_ACK_TIMEOUT = 20000;
 
@@ -98,7 +108,9 @@ namespace Connection
 {
 enum Enum
 {
-    PING = 0
+    PING = 0,
+    BLOCK_SIZE = 1,
+    BLOCK_WINDOW = 2
 };
 }
 
@@ -0,0 +1,75 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "protocol_metrics.h"
+
+namespace particle { namespace protocol {
+
+const size_t MetricHistogram::BUCKETS;
+
+const uint32_t ProtocolMetrics::ACK_RTT_BOUNDS[] = { 100, 200, 500, 1000, 2000, 5000, 10000 };
+const uint32_t ProtocolMetrics::HANDSHAKE_DURATION_BOUNDS[] = { 500, 1000, 2000, 5000, 10000, 20000, 40000 };
+
+MetricHistogram::MetricHistogram(const uint32_t* bounds) :
+		bounds(bounds)
+{
+	reset();
+}
+
+void MetricHistogram::record(uint32_t value)
+{
+	size_t bucket = 0;
+	while (bucket < BUCKETS - 1 && value > bounds[bucket])
+		++bucket;
+	counts[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void MetricHistogram::reset()
+{
+	for (size_t i = 0; i < BUCKETS; ++i)
+		counts[i].store(0, std::memory_order_relaxed);
+}
+
+ProtocolMetrics::ProtocolMetrics() :
+		ack_rtt(ACK_RTT_BOUNDS),
+		handshake_duration(HANDSHAKE_DURATION_BOUNDS)
+{
+}
+
+void ProtocolMetrics::reset()
+{
+	coap_retransmits.reset();
+	coap_timeouts.reset();
+	events_rate_limited.reset();
+	ota_chunk_crc_failures.reset();
+	handshakes.reset();
+	handshake_failures.reset();
+	bytes_sent.reset();
+	bytes_received.reset();
+	ack_rtt.reset();
+	handshake_duration.reset();
+}
+
+ProtocolMetrics& ProtocolMetrics::instance()
+{
+	static ProtocolMetrics metrics;
+	return metrics;
+}
+
+}}
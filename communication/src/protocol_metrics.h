@@ -0,0 +1,139 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * A counter incremented without a lock, so that it can be updated from any thread and
+ * read while it is updated. It wraps around at 2^32.
+ */
+class MetricCounter
+{
+public:
+	MetricCounter() : value(0) {}
+
+	MetricCounter(const MetricCounter&) = delete;
+	MetricCounter& operator=(const MetricCounter&) = delete;
+
+	void increment(uint32_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+	uint32_t get() const { return value.load(std::memory_order_relaxed); }
+	void reset() { value.store(0, std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint32_t> value;
+};
+
+/**
+ * A histogram of durations in milliseconds with fixed buckets, updated without a lock.
+ * Bucket i counts the values up to bounds[i], the last bucket the larger values.
+ */
+class MetricHistogram
+{
+public:
+	static const size_t BUCKETS = 8;
+
+	/**
+	 * @param bounds the upper bounds of the first BUCKETS-1 buckets, in increasing order.
+	 */
+	explicit MetricHistogram(const uint32_t* bounds);
+
+	MetricHistogram(const MetricHistogram&) = delete;
+	MetricHistogram& operator=(const MetricHistogram&) = delete;
+
+	void record(uint32_t value);
+
+	uint32_t count(size_t bucket) const
+	{
+		return bucket < BUCKETS ? counts[bucket].load(std::memory_order_relaxed) : 0;
+	}
+
+	uint32_t bound(size_t bucket) const
+	{
+		return bucket < BUCKETS - 1 ? bounds[bucket] : UINT32_MAX;
+	}
+
+	void reset();
+
+private:
+	const uint32_t* bounds;
+	std::atomic<uint32_t> counts[BUCKETS];
+};
+
+/**
+ * The metrics of the cloud protocol, shared by the protocol and its channels. Always on:
+ * an update is a relaxed atomic increment.
+ */
+class ProtocolMetrics
+{
+public:
+	/**
+	 * Upper bounds in milliseconds of the buckets of the histograms.
+	 */
+	static const uint32_t ACK_RTT_BOUNDS[MetricHistogram::BUCKETS - 1];
+	static const uint32_t HANDSHAKE_DURATION_BOUNDS[MetricHistogram::BUCKETS - 1];
+
+	ProtocolMetrics();
+
+	/**
+	 * Confirmable messages sent again after their acknowledgement timed out.
+	 */
+	MetricCounter coap_retransmits;
+	/**
+	 * Confirmable messages never acknowledged.
+	 */
+	MetricCounter coap_timeouts;
+	/**
+	 * Events not sent as they exceeded the publishing rate (BANDWIDTH_EXCEEDED).
+	 */
+	MetricCounter events_rate_limited;
+	MetricCounter ota_chunk_crc_failures;
+	MetricCounter handshakes;
+	MetricCounter handshake_failures;
+	/**
+	 * Bytes passed to and received from the transport by the channel, including the
+	 * handshakes and the encryption overhead.
+	 */
+	MetricCounter bytes_sent;
+	MetricCounter bytes_received;
+
+	/**
+	 * Time from the first transmission of a confirmable message to its acknowledgement.
+	 * Retransmitted messages aren't measured, as the acknowledgement can't be matched to
+	 * a transmission.
+	 */
+	MetricHistogram ack_rtt;
+	/**
+	 * Time from the start of a handshake to its completion.
+	 */
+	MetricHistogram handshake_duration;
+
+	void reset();
+
+	static ProtocolMetrics& instance();
+};
+
+}}
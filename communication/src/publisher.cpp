@@ -22,3 +22,8 @@
 void particle::protocol::Publisher::add_ack_handler(message_id_t msg_id, CompletionHandler handler) {
     protocol->add_ack_handler(msg_id, std::move(handler), SEND_EVENT_ACK_TIMEOUT);
 }
+
+particle::protocol::ProtocolError particle::protocol::Publisher::send_blocks(const uint8_t* header, size_t header_length,
+        const uint8_t* data, size_t size, CompletionHandler handler) {
+    return protocol->send_blocks(header, header_length, data, size, std::move(handler));
+}
@@ -23,6 +23,7 @@
 #include "events.h"
 #include "message_channel.h"
 #include "messages.h"
+#include "protocol_metrics.h"
 
 #include "completion_handler.h"
 
@@ -37,8 +38,13 @@ class Publisher
 {
 public:
 	explicit Publisher(Protocol* protocol) :
-			protocol(protocol)
+			protocol(protocol),
+			lastMinute(0),
+			eventsThisMinute(0),
+			evt_tick_idx(0)
 	{
+		for (system_tick_t& ticks : recent_event_ticks)
+			ticks = (system_tick_t) -1000;
 	}
 
 	inline bool is_system(const char* event_name)
@@ -56,9 +62,6 @@ public:
 	{
 		if (is_system_event)
 		{
-			static uint16_t lastMinute = 0;
-			static uint8_t eventsThisMinute = 0;
-
 			uint16_t currentMinute = uint16_t(millis >> 16);
 			if (currentMinute == lastMinute)
 			{      // == handles millis() overflow
@@ -74,12 +77,6 @@ public:
 		}
 		else
 		{
-			static system_tick_t recent_event_ticks[5] =
-			{ (system_tick_t) -1000, (system_tick_t) -1000,
-					(system_tick_t) -1000, (system_tick_t) -1000,
-					(system_tick_t) -1000 };
-			static int evt_tick_idx = 0;
-
 			system_tick_t now = recent_event_ticks[evt_tick_idx] = millis;
 			evt_tick_idx++;
 			evt_tick_idx %= 5;
@@ -99,7 +96,10 @@ public:
 		bool is_system_event = is_system(event_name);
 		bool rate_limited = is_rate_limited(is_system_event, time);
 		if (rate_limited)
+		{
+			ProtocolMetrics::instance().events_rate_limited.increment();
 			return BANDWIDTH_EXCEEDED;
+		}
 
 		Message message;
 		channel.create(message);
@@ -109,8 +109,21 @@ public:
 		} else if (flags & EventType::WITH_ACK) {
 			confirmable = true;
 		}
-		size_t msglen = Messages::event(message.buf(), 0, event_name, data, ttl,
-				event_type, confirmable);
+		uint8_t* buf = message.buf();
+		size_t msglen = Messages::event_header(buf, 0, event_name, ttl, event_type, confirmable);
+		const size_t data_len = data ? strnlen(data, MAX_BLOCKWISE_PAYLOAD_SIZE) : 0;
+		if (msglen + 1 + data_len > message.capacity())
+		{
+			// the blocks are confirmable, the transfer completes the handler
+			msglen = Messages::event_header(buf, 0, event_name, ttl, event_type, true);
+			return send_blocks(buf, msglen, (const uint8_t*)data, data_len, std::move(handler));
+		}
+		if (data)
+		{
+			buf[msglen++] = 0xFF;
+			memcpy(buf + msglen, data, data_len);
+			msglen += data_len;
+		}
 		message.set_length(msglen);
 		const ProtocolError result = channel.send(message);
 		if (result == NO_ERROR) {
@@ -127,7 +140,15 @@ public:
 private:
 	Protocol* protocol;
 
+	// rate limiting state, kept per protocol instance
+	uint16_t lastMinute;
+	uint8_t eventsThisMinute;
+	system_tick_t recent_event_ticks[5];
+	int evt_tick_idx;
+
 	void add_ack_handler(message_id_t msg_id, CompletionHandler handler);
+	ProtocolError send_blocks(const uint8_t* header, size_t header_length, const uint8_t* data, size_t size,
+			CompletionHandler handler);
 };
 
 }}
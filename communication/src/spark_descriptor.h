@@ -59,6 +59,17 @@ namespace SparkAppStateUpdate {
 	};
 }
 
+/**
+ * Additional information about a function call. Passed as the reserved argument of
+ * SparkDescriptor::call_function() and of the cloud function handler. The argument
+ * points into the receive buffer and is only valid until the call returns.
+ */
+struct FunctionCallInfo
+{
+    size_t size;
+    size_t arg_length;  // Length of the argument, not including the null terminator
+};
+
 struct SparkDescriptor
 {
     typedef std::function<bool(const void*, SparkReturnType::Enum)> FunctionResultCallback;
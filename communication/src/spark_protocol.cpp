@@ -88,6 +88,11 @@ void SparkProtocol::init(const char *id,
   memcpy(core_private_key, keys.core_private, MAX_DEVICE_PRIVATE_KEY_LENGTH);
   memcpy(device_id, id, 12);
 
+  // the session key is set by the handshake, until then the schedules are for an all-zero key
+  memset(key, 0, sizeof(key));
+  aes_setkey_enc(&aes_enc, key, 128);
+  aes_setkey_dec(&aes_dec, key, 128);
+
   // when using this lib in C, constructor is never called
   queue_init();
 
@@ -115,11 +120,8 @@ int SparkProtocol::handshake(void)
   LOG(INFO,"Encrypting handshake nonce");
   extract_public_rsa_key(queue+52, core_private_key);
 
-  rsa_context rsa;
-  init_rsa_context_with_public_key(&rsa, server_public_key);
   const int len = 52+MAX_DEVICE_PUBLIC_KEY_LENGTH;
-  err = rsa_pkcs1_encrypt(&rsa, RSA_PUBLIC, len, queue, queue + len);
-  rsa_free(&rsa);
+  err = encrypt_with_public_key(server_public_key, queue, len, queue + len);
 
   if (err) { LOG(ERROR,"RSA encrypt error %d", err); return err; }
 
@@ -335,8 +337,7 @@ CoAPMessageType::Enum
   unsigned char next_iv[16];
   memcpy(next_iv, buf, 16);
 
-  aes_setkey_dec(&aes, key, 128);
-  aes_crypt_cbc(&aes, AES_DECRYPT, length, iv_receive, buf, buf);
+  aes_crypt_cbc(&aes_dec, AES_DECRYPT, length, iv_receive, buf, buf);
 
   memcpy(iv_receive, next_iv, 16);
 
@@ -1281,16 +1282,11 @@ bool SparkProtocol::handle_function_call(msg& message)
       query_length += 269;
     }
 
-    bool has_function = false;
-
-    // allocated memory bounds check
-    if (MAX_FUNCTION_ARG_LENGTH > query_length)
-    {
-        // save a copy of the argument
-        memcpy(function_arg, queue + q_index + 1, query_length);
-        function_arg[query_length] = 0; // null terminate string
-        has_function = true;
-    }
+    // the argument is read in place from the queue
+    char* function_arg = (char*)queue + q_index + 1;
+    bool has_function = (q_index + 1 + query_length <= message.len &&
+            q_index + 1 + query_length < QUEUE_SIZE &&
+            MAX_FUNCTION_ARG_LENGTH >= query_length);
 
     uint8_t* msg_to_send = message.response;
     // send ACK
@@ -1302,10 +1298,17 @@ bool SparkProtocol::handle_function_call(msg& message)
       // error
       return false;
     }
+    if (!has_function)
+      return true;
+
+    // the response follows the received message, so the terminator may only be
+    // written once the ACK has been sent
+    function_arg[query_length] = 0;
 
     // call the given user function
     auto callback = [=] (const void* result, SparkReturnType::Enum resultType ) { return this->function_result(result, resultType, message.token); };
-    descriptor.call_function(function_key, function_arg, callback, NULL);
+    FunctionCallInfo info = { sizeof(FunctionCallInfo), query_length };
+    descriptor.call_function(function_key, function_arg, callback, &info);
     return true;
 }
 
@@ -1621,8 +1624,7 @@ unsigned char SparkProtocol::next_token()
 
 void SparkProtocol::encrypt(unsigned char *buf, int length)
 {
-  aes_setkey_enc(&aes, key, 128);
-  aes_crypt_cbc(&aes, AES_ENCRYPT, length, iv_send, buf, buf);
+  aes_crypt_cbc(&aes_enc, AES_ENCRYPT, length, iv_send, buf, buf);
   memcpy(iv_send, buf, 16);
 }
 
@@ -1677,6 +1679,8 @@ int SparkProtocol::set_key(const unsigned char *signed_encrypted_credentials)
                             hmac))
   {
     memcpy(key,        credentials,      16);
+    aes_setkey_enc(&aes_enc, key, 128);
+    aes_setkey_dec(&aes_dec, key, 128);
     memcpy(iv_send,    credentials + 16, 16);
     memcpy(iv_receive, credentials + 16, 16);
     memcpy(salt,       credentials + 32,  8);
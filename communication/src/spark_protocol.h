@@ -162,7 +162,8 @@ class SparkProtocol
     char device_id[12];
     unsigned char server_public_key[MAX_SERVER_PUBLIC_KEY_LENGTH];
     unsigned char core_private_key[MAX_DEVICE_PRIVATE_KEY_LENGTH];
-    aes_context aes;
+    aes_context aes_enc;    // key schedules, expanded once per session by set_key()
+    aes_context aes_dec;
 
     FilteringEventHandler event_handlers[5];    // 1 system event listener + 4 application event listeners
     SparkCallbacks callbacks;
@@ -186,7 +187,6 @@ class SparkProtocol
     bool expecting_ping_ack;
     bool initialized;
     uint8_t updating;
-    char function_arg[MAX_FUNCTION_ARG_LENGTH];
 
     size_t wrap(unsigned char *buf, size_t msglen);
     CoAPMessageType::Enum handle_received_message(void);
@@ -22,6 +22,8 @@
 #include "handshake.h"
 #include "debug.h"
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 
 using particle::CompletionHandler;
 
@@ -55,8 +57,18 @@ int decrypt_rsa(const uint8_t* ciphertext, const uint8_t* private_key, uint8_t*
 
 #if HAL_PLATFORM_CLOUD_UDP
 #include "dtls_protocol.h"
+#include "ecdh_key_pool.h"
+
+using particle::protocol::EcdhKeyPool;
 #endif
 
+#include "protocol_metrics.h"
+
+using particle::protocol::ProtocolMetrics;
+
+static_assert(PROTOCOL_METRICS_HISTOGRAM_BUCKETS == particle::protocol::MetricHistogram::BUCKETS,
+        "protocol_metrics histograms should match the registry");
+
 void spark_protocol_communications_handlers(ProtocolFacade* protocol, CommunicationsHandlers* handlers)
 {
     ASSERT_ON_SYSTEM_OR_MAIN_THREAD();
@@ -163,6 +175,14 @@ int spark_protocol_set_connection_property(ProtocolFacade* protocol, unsigned pr
     {
         protocol->set_keepalive(data);
     }
+    else if (property_id == particle::protocol::Connection::BLOCK_SIZE)
+    {
+        protocol->set_block_size(data);
+    }
+    else if (property_id == particle::protocol::Connection::BLOCK_WINDOW)
+    {
+        protocol->set_block_window(data);
+    }
     return 0;
 }
 int spark_protocol_command(ProtocolFacade* protocol, ProtocolCommands::Enum cmd, uint32_t data, void* reserved)
@@ -183,6 +203,57 @@ system_tick_t spark_protocol_time_last_synced(ProtocolFacade* protocol, time_t*
     return protocol->time_last_synced(tm);
 }
 
+int spark_protocol_get_key_pool_stats(ProtocolFacade* protocol, key_pool_stats* stats, void* reserved)
+{
+    (void)protocol;
+    (void)reserved;
+    key_pool_stats result = {};
+    result.size = stats->size;
+#if HAL_PLATFORM_CLOUD_UDP
+    const EcdhKeyPool& pool = EcdhKeyPool::instance();
+    result.available = pool.available();
+    result.capacity = EcdhKeyPool::CAPACITY;
+    result.hits = pool.hits();
+    result.misses = pool.misses();
+#endif
+    // an older caller's struct may be smaller than ours
+    memcpy(stats, &result, std::min<size_t>(stats->size, sizeof(result)));
+    return 0;
+}
+
+int spark_protocol_handshake_step(ProtocolFacade* protocol, bool start, void* reserved)
+{
+    ASSERT_ON_SYSTEM_THREAD();
+    (void)reserved;
+    return start ? protocol->begin_start() : protocol->begin_step();
+}
+
+int spark_protocol_get_metrics(ProtocolFacade* protocol, protocol_metrics* metrics, void* reserved)
+{
+    (void)protocol;
+    (void)reserved;
+    // the counters are atomic, they can be read from any thread
+    const ProtocolMetrics& m = ProtocolMetrics::instance();
+    protocol_metrics result = {};
+    result.size = metrics->size;
+    result.coap_retransmits = m.coap_retransmits.get();
+    result.coap_timeouts = m.coap_timeouts.get();
+    result.events_rate_limited = m.events_rate_limited.get();
+    result.ota_chunk_crc_failures = m.ota_chunk_crc_failures.get();
+    result.handshakes = m.handshakes.get();
+    result.handshake_failures = m.handshake_failures.get();
+    result.bytes_sent = m.bytes_sent.get();
+    result.bytes_received = m.bytes_received.get();
+    for (size_t i = 0; i < PROTOCOL_METRICS_HISTOGRAM_BUCKETS; ++i)
+    {
+        result.ack_rtt[i] = m.ack_rtt.count(i);
+        result.handshake_duration[i] = m.handshake_duration.count(i);
+    }
+    // an older caller's struct may be smaller than ours
+    memcpy(metrics, &result, std::min<size_t>(metrics->size, sizeof(result)));
+    return 0;
+}
+
 #else // !defined(PARTICLE_PROTOCOL)
 
 #include "spark_protocol.h"
@@ -309,4 +380,28 @@ system_tick_t spark_protocol_time_last_synced(SparkProtocol* protocol, time_t* t
     return protocol->time_last_synced(tm);
 }
 
+int spark_protocol_get_key_pool_stats(SparkProtocol* protocol, key_pool_stats* stats, void* reserved)
+{
+    // no ephemeral keys in the legacy protocol
+    key_pool_stats result = {};
+    result.size = stats->size;
+    memcpy(stats, &result, std::min<size_t>(stats->size, sizeof(result)));
+    return 0;
+}
+
+int spark_protocol_handshake_step(SparkProtocol* protocol, bool start, void* reserved)
+{
+    // the legacy protocol performs the whole handshake in one step
+    return spark_protocol_handshake(protocol, reserved);
+}
+
+int spark_protocol_get_metrics(SparkProtocol* protocol, protocol_metrics* metrics, void* reserved)
+{
+    // the legacy protocol isn't instrumented
+    protocol_metrics result = {};
+    result.size = metrics->size;
+    memcpy(metrics, &result, std::min<size_t>(metrics->size, sizeof(result)));
+    return 0;
+}
+
 #endif
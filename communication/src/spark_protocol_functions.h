@@ -186,13 +186,61 @@ system_tick_t spark_protocol_time_last_synced(ProtocolFacade* protocol, time_t*
 namespace ProtocolCommands {
 	enum Enum {
 		SLEEP,
-		WAKE
+		WAKE,
+		PRECOMPUTE_KEYS		// generate an ephemeral key pair for the next handshake while idle
 	};
 };
 
 
 int spark_protocol_command(ProtocolFacade* protocol, ProtocolCommands::Enum cmd, uint32_t data=0, void* reserved=NULL);
 
+/**
+ * Statistics of the pool of ephemeral ECDHE key pairs generated ahead of handshakes.
+ */
+typedef struct {
+    uint16_t size;
+    uint8_t available;  // key pairs ready for use
+    uint8_t capacity;
+    uint32_t hits;      // handshakes that used a key pair from the pool
+    uint32_t misses;    // handshakes that generated their key pair
+} key_pool_stats;
+
+int spark_protocol_get_key_pool_stats(ProtocolFacade* protocol, key_pool_stats* stats, void* reserved=NULL);
+
+#define PROTOCOL_METRICS_HISTOGRAM_BUCKETS 8
+
+/**
+ * Metrics of the cloud protocol since the device started. The histograms count the
+ * durations in milliseconds up to the bucket bounds, the last bucket the longer ones:
+ * ack_rtt: 100, 200, 500, 1000, 2000, 5000, 10000
+ * handshake_duration: 500, 1000, 2000, 5000, 10000, 20000, 40000
+ */
+typedef struct {
+    uint16_t size;
+    uint16_t reserved;
+    uint32_t coap_retransmits;          // confirmable messages sent again
+    uint32_t coap_timeouts;             // confirmable messages never acknowledged
+    uint32_t events_rate_limited;       // events not sent as they exceeded the rate limit
+    uint32_t ota_chunk_crc_failures;
+    uint32_t handshakes;
+    uint32_t handshake_failures;
+    uint32_t bytes_sent;                // bytes passed to the transport, including handshakes
+    uint32_t bytes_received;
+    uint32_t ack_rtt[PROTOCOL_METRICS_HISTOGRAM_BUCKETS];   // messages not retransmitted only
+    uint32_t handshake_duration[PROTOCOL_METRICS_HISTOGRAM_BUCKETS];
+} protocol_metrics;
+
+int spark_protocol_get_metrics(ProtocolFacade* protocol, protocol_metrics* metrics, void* reserved=NULL);
+
+/**
+ * Performs the handshake of spark_protocol_handshake() in steps, so that the caller can run
+ * other work between them. A step doesn't wait for data from the network.
+ * @param start true to start a new handshake, false to perform the next step of the handshake in progress.
+ * @return HANDSHAKE_IN_PROGRESS while more steps are needed, otherwise the result of the handshake
+ * as returned by spark_protocol_handshake().
+ */
+int spark_protocol_handshake_step(ProtocolFacade* protocol, bool start, void* reserved=NULL);
+
 /**
  * Decrypt a buffer using the given public key.
  * @param ciphertext        The ciphertext to decrypt
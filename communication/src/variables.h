@@ -24,6 +24,7 @@
 #include "message_channel.h"
 #include "messages.h"
 #include "spark_descriptor.h"
+#include "coap_blockwise.h"
 
 
 namespace particle
@@ -51,11 +52,20 @@ public:
 		return NO_ERROR;
 	}
 
+	/**
+	 * Sends the value of a variable. String values that don't fit in a single message
+	 * are sent one block at a time, with further blocks requested by the server.
+	 *
+	 * @param max_block_size	The preferred size of the blocks of a string value.
+	 */
 	ProtocolError handle_variable_request(char* variable_key, Message& message, MessageChannel& channel, token_t token, message_id_t message_id,
 		SparkReturnType::Enum (*variable_type)(const char *variable_key),
-		const void *(*get_variable)(const char *variable_key))
+		const void *(*get_variable)(const char *variable_key), size_t max_block_size=DEFAULT_BLOCK_SIZE)
 	{
 		uint8_t* queue = message.buf();
+		// the response is written over the request
+		CoAPBlock block;
+		const bool has_block = requested_block(message, block);
 		message.set_id(message_id);
 		// get variable value according to type using the descriptor
 		SparkReturnType::Enum var_type = variable_type(variable_key);
@@ -74,14 +84,13 @@ public:
 		else if(SparkReturnType::STRING == var_type)
 		{
 			const char *str_val = (const char *)get_variable(variable_key);
-
-			// 2-byte leading length, 16 potential padding bytes
-			int max_length = message.capacity();
-			int str_length = strlen(str_val);
-			if (str_length > max_length) {
-				str_length = max_length;
-			}
-			response = Messages::variable_value(queue, message_id, token, str_val, str_length);
+			const size_t str_length = strnlen(str_val, MAX_BLOCKWISE_PAYLOAD_SIZE);
+			response = block_response(queue, message.capacity(), message_id, token,
+					has_block ? &block : nullptr, max_block_size, [str_val, str_length](Appender& appender) {
+				appender.append((const uint8_t*)str_val, str_length);
+			});
+			if (!response)
+				response = Messages::coded_ack(queue, token, RESPONSE_CODE(4,2), message_id >> 8, message_id & 0xFF);
 		}
 		else if(SparkReturnType::DOUBLE == var_type)
 		{
@@ -50,7 +50,7 @@ SUITE(UserFunctions)
     CHECK(success);
   }
 
-  TEST_FIXTURE(ConstructorFixture, ArgLen64Fails)
+  TEST_FIXTURE(ConstructorFixture, ArgLen64Succeeds)
   {
     uint8_t function_call[82] = {
       0x00, 0x50,
@@ -68,6 +68,6 @@ SUITE(UserFunctions)
     spark_protocol.handshake();
     bytes_received[0] = bytes_sent[0] = 0;
     bool success = spark_protocol.event_loop();
-    CHECK(!success);
+    CHECK(success);
   }
 }
@@ -0,0 +1,147 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "tropicssl/aes.h"
+
+#include "catch.hpp"
+#include "benchmark.h"
+
+#include <random>
+#include <cstring>
+
+namespace {
+
+// Message encryption of the TCP protocol (LightSSLMessageChannel, SparkProtocol): AES-128-CBC
+// with the first ciphertext block of each message as the IV of the next message
+class Session {
+public:
+    Session(const uint8_t* key, const uint8_t* iv, bool keepSchedules) :
+            keepSchedules_(keepSchedules) {
+        memcpy(key_, key, sizeof(key_));
+        memcpy(ivSend_, iv, 16);
+        memcpy(ivReceive_, iv, 16);
+        aes_setkey_enc(&enc_, key_, 128);
+        aes_setkey_dec(&dec_, key_, 128);
+    }
+
+    void encrypt(uint8_t* buf, size_t length) {
+        if (!keepSchedules_) {
+            aes_setkey_enc(&enc_, key_, 128);
+        }
+        aes_crypt_cbc(&enc_, AES_ENCRYPT, length, ivSend_, buf, buf);
+        memcpy(ivSend_, buf, 16);
+    }
+
+    void decrypt(uint8_t* buf, size_t length) {
+        uint8_t nextIv[16];
+        memcpy(nextIv, buf, 16);
+        if (!keepSchedules_) {
+            aes_setkey_dec(&dec_, key_, 128);
+        }
+        aes_crypt_cbc(&dec_, AES_DECRYPT, length, ivReceive_, buf, buf);
+        memcpy(ivReceive_, nextIv, 16);
+    }
+
+private:
+    uint8_t key_[16];
+    uint8_t ivSend_[16];
+    uint8_t ivReceive_[16];
+    aes_context enc_;
+    aes_context dec_;
+    bool keepSchedules_;
+};
+
+void fill(std::mt19937& gen, uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = gen();
+    }
+}
+
+} // namespace
+
+TEST_CASE("AES block cipher") {
+    // FIPS-197, appendix C.1
+    uint8_t key[16], block[16], expected[16];
+    for (size_t i = 0; i < 16; ++i) {
+        key[i] = i;
+        block[i] = i * 0x11;
+    }
+    const uint8_t ciphertext[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+            0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+    memcpy(expected, block, sizeof(block));
+    aes_context ctx;
+    aes_setkey_enc(&ctx, key, 128);
+    aes_crypt_ecb(&ctx, AES_ENCRYPT, block, block);
+    CHECK(memcmp(block, ciphertext, sizeof(block)) == 0);
+    aes_setkey_dec(&ctx, key, 128);
+    aes_crypt_ecb(&ctx, AES_DECRYPT, block, block);
+    CHECK(memcmp(block, expected, sizeof(block)) == 0);
+}
+
+TEST_CASE("AES-CBC with key schedules kept for the session") {
+    std::mt19937 gen(1);
+    uint8_t key[16], iv[16];
+    fill(gen, key, sizeof(key));
+    fill(gen, iv, sizeof(iv));
+    Session kept(key, iv, true);
+    Session expanded(key, iv, false);
+    Session peer(key, iv, true);
+
+    for (size_t size: { 16, 32, 64, 128, 512 }) {
+        uint8_t plaintext[512], a[512], b[512];
+        fill(gen, plaintext, size);
+        memcpy(a, plaintext, size);
+        memcpy(b, plaintext, size);
+        kept.encrypt(a, size);
+        expanded.encrypt(b, size);
+        // same ciphertext as when the key is expanded for each message
+        CHECK(memcmp(a, b, size) == 0);
+        peer.decrypt(a, size);
+        CHECK(memcmp(a, plaintext, size) == 0);
+        // and in the other direction
+        memcpy(b, plaintext, size);
+        peer.encrypt(b, size);
+        kept.decrypt(b, size);
+        CHECK(memcmp(b, plaintext, size) == 0);
+    }
+}
+
+// Throughput of the message encryption and decryption for typical message sizes:
+// a ping, an event, a variable response and a describe block
+TEST_CASE("AES-CBC message throughput benchmark", "[.][benchmark]") {
+    std::mt19937 gen(2);
+    uint8_t key[16], iv[16], buf[512];
+    fill(gen, key, sizeof(key));
+    fill(gen, iv, sizeof(iv));
+    fill(gen, buf, sizeof(buf));
+    const size_t iterations = 20000;
+    for (bool keep: { false, true }) {
+        Session device(key, iv, keep);
+        Session server(key, iv, keep);
+        for (size_t size: { 16, 64, 256, 512 }) {
+            const std::string name = std::string(keep ? "session schedules" : "per-message schedules") +
+                    ", " + std::to_string(size) + " bytes";
+            const double ns = test::benchmark(name, iterations, [&]() {
+                device.encrypt(buf, size);
+                server.decrypt(buf, size);
+            });
+            std::cout << "  " << std::setprecision(1) << (2 * size * 1000.0 / ns) << " MB/s" << std::endl;
+        }
+    }
+}
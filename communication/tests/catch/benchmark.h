@@ -0,0 +1,46 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+namespace test {
+
+/**
+ * Runs a function the given number of times and prints the average time per call.
+ * Benchmark test cases are tagged with [.][benchmark] so that they only run when
+ * selected explicitly, e.g. `runner [benchmark]`
+ */
+template<typename FuncT>
+inline double benchmark(const std::string& name, size_t iterations, FuncT func)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; ++i)
+		func();
+	const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	const double nsPerCall = elapsed.count() / iterations;
+	std::cout << name << ": " << std::fixed << std::setprecision(1) << nsPerCall << " ns" << std::endl;
+	return nsPerCall;
+}
+
+} // namespace test
@@ -0,0 +1,545 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "coap_blockwise.h"
+#include "variables.h"
+
+#include "catch.hpp"
+
+#include <vector>
+#include <string>
+#include <set>
+#include <cstring>
+
+using namespace particle;
+using namespace particle::protocol;
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+// Message channel recording the messages sent. Message IDs are assigned as by CoAPChannel
+class TestChannel : public MessageChannel {
+public:
+    explicit TestChannel(size_t capacity = 640) :
+            buffer_(capacity),
+            nextId_(1) {
+    }
+
+    bool is_unreliable() override {
+        return true;
+    }
+
+    ProtocolError establish(uint32_t& flags, uint32_t app_state_crc) override {
+        return NO_ERROR;
+    }
+
+    ProtocolError create(Message& message, size_t minimum_size = 0) override {
+        message = Message(buffer_.data(), buffer_.size());
+        return NO_ERROR;
+    }
+
+    ProtocolError response(Message& original, Message& response, size_t required) override {
+        return INSUFFICIENT_STORAGE;
+    }
+
+    ProtocolError notify_established() override {
+        return NO_ERROR;
+    }
+
+    ProtocolError receive(Message& message) override {
+        message.set_length(0);
+        return NO_ERROR;
+    }
+
+    ProtocolError send(Message& message) override {
+        uint8_t* buf = message.buf();
+        const message_id_t id = message.has_id() ? message.get_id() : nextId_++;
+        buf[2] = id >> 8;
+        buf[3] = id & 0xFF;
+        message.decode_id();
+        sent.push_back(Bytes(buf, buf + message.length()));
+        return NO_ERROR;
+    }
+
+    ProtocolError command(Command cmd, void* arg = nullptr) override {
+        return NO_ERROR;
+    }
+
+    std::vector<Bytes> sent;
+
+private:
+    Bytes buffer_;
+    message_id_t nextId_;
+};
+
+struct Result {
+    bool done = false;
+    int error = 0;
+
+    CompletionHandler handler() {
+        return CompletionHandler(callback, this);
+    }
+
+    static void callback(int error, const void* data, void* callback_data, void* reserved) {
+        Result* r = (Result*)callback_data;
+        r->done = true;
+        r->error = error;
+    }
+};
+
+std::string payloadOf(const Bytes& msg) {
+    CoAPOptionIterator it(msg.data(), msg.size());
+    while (it.next()) {
+    }
+    return std::string((const char*)it.payload(), it.payload_size());
+}
+
+bool blockOption(const Bytes& msg, unsigned option, CoAPBlock& block) {
+    size_t length = 0;
+    const uint8_t* value = CoAP::find_option(msg.data(), msg.size(), option, &length);
+    if (!value) {
+        return false;
+    }
+    block = CoAPBlock::decode(CoAP::decode_uint(value, length));
+    return true;
+}
+
+std::string testData(size_t size) {
+    std::string s;
+    for (size_t i = 0; i < size; ++i) {
+        s += (char)('a' + (i * 7) % 26);
+    }
+    return s;
+}
+
+// Receives a block-wise request as the cloud would. Blocks are acknowledged with 2.31 CONTINUE
+// and the last one with 2.04 CHANGED
+class Server {
+public:
+    explicit Server(BlockSender& sender) :
+            sender_(sender),
+            total_(0) {
+    }
+
+    // Handles the messages sent by the device since the previous flight. Messages selected by
+    // `drop` are lost. Returns false if there was nothing to handle
+    template<typename DropFn>
+    bool flight(TestChannel& channel, DropFn drop) {
+        std::vector<Bytes> messages;
+        messages.swap(channel.sent);
+        for (const Bytes& msg: messages) {
+            ++messageCount;
+            if (drop(msg)) {
+                continue;
+            }
+            CoAPBlock block;
+            REQUIRE(blockOption(msg, CoAPOption::BLOCK1, block));
+            size_t length = 0;
+            const uint8_t* size1 = CoAP::find_option(msg.data(), msg.size(), CoAPOption::SIZE1, &length);
+            if (size1) {
+                total_ = CoAP::decode_uint(size1, length);
+                data_.assign(total_, '\0');
+            }
+            const std::string payload = payloadOf(msg);
+            REQUIRE((block.offset() + payload.size()) <= data_.size());
+            memcpy(&data_[block.offset()], payload.data(), payload.size());
+            received_.insert(block.num);
+            if (!block.more) {
+                // the last block is only sent once the other blocks were acknowledged
+                CHECK(received_.size() == (total_ + block.size() - 1) / block.size());
+            }
+            const uint8_t code = block.more ? RESPONSE_CODE(2,31) : RESPONSE_CODE(2,4);
+            REQUIRE(sender_.acknowledged(CoAP::message_id(msg.data()), code));
+            sender_.send(channel);
+        }
+        return !messages.empty();
+    }
+
+    bool flight(TestChannel& channel) {
+        return flight(channel, [](const Bytes&) { return false; });
+    }
+
+    // The session was lost and the server no longer has the blocks received
+    void reset() {
+        received_.clear();
+        data_.clear();
+    }
+
+    const std::string& data() const {
+        return data_;
+    }
+
+    unsigned messageCount = 0;
+
+private:
+    BlockSender& sender_;
+    std::set<uint32_t> received_;
+    std::string data_;
+    size_t total_;
+};
+
+size_t eventHeader(uint8_t* buf) {
+    return Messages::event_header(buf, 0, "big_event", 60, EventType::PRIVATE, true);
+}
+
+const char* stringVariable = nullptr;
+
+SparkReturnType::Enum variableType(const char*) {
+    return SparkReturnType::STRING;
+}
+
+const void* variableValue(const char*) {
+    return stringVariable;
+}
+
+} // namespace
+
+TEST_CASE("CoAP options") {
+    SECTION("encodes and decodes option values") {
+        const uint32_t values[] = { 0, 1, 0xFF, 0x100, 0xFFFF, 0x10000, 0xFFFFFF, 0x1000000, 0xFFFFFFFF };
+        for (uint32_t value: values) {
+            uint8_t buf[32] = { 0x40, 0x02, 0x00, 0x01 };
+            size_t len = 4;
+            len += CoAP::uint_option(buf + len, CoAPOption::URI_PATH, 1);
+            len += CoAP::uint_option(buf + len, CoAPOption::SIZE1 - CoAPOption::URI_PATH, value);
+            size_t length = 0;
+            const uint8_t* v = CoAP::find_option(buf, len, CoAPOption::SIZE1, &length);
+            REQUIRE(v != nullptr);
+            CHECK(CoAP::decode_uint(v, length) == value);
+            CHECK(CoAP::find_option(buf, len, CoAPOption::BLOCK1, &length) == nullptr);
+        }
+    }
+
+    SECTION("uses extended deltas and lengths") {
+        uint8_t buf[400] = { 0x40, 0x02, 0x00, 0x01 };
+        const std::string value(300, 'x');
+        size_t len = 4;
+        len += CoAP::option(buf + len, CoAPOption::URI_PATH, (const uint8_t*)"e", 1);
+        len += CoAP::option(buf + len, CoAPOption::SIZE1 - CoAPOption::URI_PATH, (const uint8_t*)value.data(), value.size());
+        len += CoAP::option(buf + len, 300, (const uint8_t*)"abc", 3);
+        buf[len++] = 0xFF;
+        buf[len++] = 'p';
+        CoAPOptionIterator it(buf, len);
+        REQUIRE(it.next());
+        CHECK(it.option() == CoAPOption::URI_PATH);
+        CHECK(it.size() == 1);
+        REQUIRE(it.next());
+        CHECK(it.option() == CoAPOption::SIZE1);
+        CHECK(std::string((const char*)it.data(), it.size()) == value);
+        REQUIRE(it.next());
+        CHECK(it.option() == CoAPOption::SIZE1 + 300);
+        CHECK(it.size() == 3);
+        CHECK_FALSE(it.next());
+        REQUIRE(it.payload() != nullptr);
+        CHECK(it.payload_size() == 1);
+    }
+
+    SECTION("stops at a truncated option") {
+        const uint8_t buf[] = { 0x40, 0x02, 0x00, 0x01, 0xB4, 'a', 'b' };
+        CoAPOptionIterator it(buf, sizeof(buf));
+        CHECK_FALSE(it.next());
+        CHECK(it.payload() == nullptr);
+    }
+
+    SECTION("encodes and decodes block values") {
+        CoAPBlock block;
+        block.num = 1234;
+        block.more = true;
+        block.szx = 5;
+        const CoAPBlock decoded = CoAPBlock::decode(block.encode());
+        CHECK(decoded.num == 1234);
+        CHECK(decoded.more);
+        CHECK(decoded.size() == 512);
+        CHECK(decoded.offset() == 1234 * 512);
+        CHECK(CoAPBlock::size_exponent(15) == 0);
+        CHECK(CoAPBlock::size_exponent(600) == 5);
+        CHECK(CoAPBlock::size_exponent(100000) == CoAPBlock::MAX_SZX);
+    }
+}
+
+TEST_CASE("BlockAppender") {
+    const std::string data = testData(100);
+    for (size_t chunk: { (size_t)1, (size_t)7, (size_t)100 }) {
+        char buf[32] = {};
+        BlockAppender appender((uint8_t*)buf, 32, 32);
+        for (size_t i = 0; i < data.size(); i += chunk) {
+            appender.append((const uint8_t*)data.data() + i, std::min(chunk, data.size() - i));
+        }
+        CHECK(appender.total_size() == 100);
+        CHECK(appender.block_size() == 32);
+        CHECK(std::string(buf, 32) == data.substr(32, 32));
+    }
+}
+
+TEST_CASE("block_response()") {
+    const std::string payload = testData(4096);
+    unsigned generateCount = 0;
+    auto generate = [&](Appender& appender) {
+        ++generateCount;
+        // append in uneven pieces to cross block boundaries
+        for (size_t i = 0; i < payload.size(); i += 100) {
+            appender.append((const uint8_t*)payload.data() + i, std::min((size_t)100, payload.size() - i));
+        }
+    };
+    uint8_t buf[640];
+
+    SECTION("sends a payload that fits in a single response") {
+        const std::string small = "{\"f\":[],\"v\":{}}";
+        const size_t len = block_response(buf, sizeof(buf), 0x1234, 7, nullptr, 512, [&](Appender& a) {
+            a.append(small.c_str());
+        });
+        const Bytes msg(buf, buf + len);
+        CoAPBlock block;
+        CHECK_FALSE(blockOption(msg, CoAPOption::BLOCK2, block));
+        CHECK(payloadOf(msg) == small);
+    }
+
+    SECTION("transfers a 4 KB payload block by block") {
+        std::string received;
+        unsigned roundTrips = 0;
+        CoAPBlock requested;
+        const CoAPBlock* request = nullptr;
+        for (;;) {
+            generateCount = 0;
+            const size_t len = block_response(buf, sizeof(buf), 0x1234, 7, request, 512, generate);
+            REQUIRE(len > 0);
+            CHECK(generateCount <= 2);
+            ++roundTrips;
+            const Bytes msg(buf, buf + len);
+            CoAPBlock block;
+            REQUIRE(blockOption(msg, CoAPOption::BLOCK2, block));
+            CHECK(block.size() == 512);
+            CHECK(block.offset() == received.size());
+            size_t length = 0;
+            const uint8_t* size2 = CoAP::find_option(msg.data(), msg.size(), CoAPOption::SIZE2, &length);
+            CHECK((size2 != nullptr) == (block.num == 0));
+            if (size2) {
+                CHECK(CoAP::decode_uint(size2, length) == payload.size());
+            }
+            received += payloadOf(msg);
+            if (!block.more) {
+                break;
+            }
+            requested = block;
+            ++requested.num;
+            request = &requested;
+        }
+        CHECK(received == payload);
+        CHECK(roundTrips == 8);
+    }
+
+    SECTION("uses a smaller block size requested by the server") {
+        CoAPBlock requested;
+        requested.num = 3;
+        requested.more = false;
+        requested.szx = 4; // 256 bytes
+        const size_t len = block_response(buf, sizeof(buf), 0x1234, 7, &requested, 512, generate);
+        const Bytes msg(buf, buf + len);
+        CoAPBlock block;
+        REQUIRE(blockOption(msg, CoAPOption::BLOCK2, block));
+        CHECK(block.num == 3);
+        CHECK(block.size() == 256);
+        CHECK(payloadOf(msg) == payload.substr(768, 256));
+    }
+
+    SECTION("fails for a block past the end of the payload") {
+        CoAPBlock requested;
+        requested.num = 8;
+        requested.more = false;
+        requested.szx = 5;
+        CHECK(block_response(buf, sizeof(buf), 0x1234, 7, &requested, 512, generate) == 0);
+    }
+}
+
+TEST_CASE("BlockSender") {
+    const std::string payload = testData(4096);
+    TestChannel channel;
+    BlockSender sender;
+    Server server(sender);
+    Result result;
+    uint8_t header[64];
+    const size_t headerLength = eventHeader(header);
+
+    SECTION("sends the blocks in windows") {
+        for (uint8_t window: { (uint8_t)1, (uint8_t)4 }) {
+            Result r;
+            Server s(sender);
+            REQUIRE(sender.start(channel, header, headerLength, (const uint8_t*)payload.data(), payload.size(),
+                    512, window, r.handler()) == NO_ERROR);
+            CHECK(channel.sent.size() == window);
+            unsigned roundTrips = 0;
+            while (s.flight(channel)) {
+                ++roundTrips;
+            }
+            CHECK(r.done);
+            CHECK(r.error == 0);
+            CHECK_FALSE(sender.is_active());
+            CHECK(s.data() == payload);
+            CHECK(s.messageCount == 8);
+            // with a window of 4: blocks 0-3, then 4-6, then the last block
+            CHECK(roundTrips == (window == 1 ? 8 : 3));
+        }
+    }
+
+    SECTION("keeps the request header in each block") {
+        REQUIRE(sender.start(channel, header, headerLength, (const uint8_t*)payload.data(), payload.size(),
+                512, 1, result.handler()) == NO_ERROR);
+        REQUIRE(channel.sent.size() == 1);
+        const Bytes& msg = channel.sent[0];
+        CHECK(CoAP::type(msg.data()) == CoAPType::CON);
+        CHECK(memcmp(msg.data() + 4, header + 4, headerLength - 4) == 0);
+        CHECK(CoAP::message_id(msg.data()) == 1);
+        sender.cancel(SYSTEM_ERROR_ABORTED);
+        CHECK(result.error == SYSTEM_ERROR_ABORTED);
+    }
+
+    SECTION("reduces the block size to fit in a message") {
+        TestChannel small(300);
+        Server s(sender);
+        REQUIRE(sender.start(small, header, headerLength, (const uint8_t*)payload.data(), payload.size(),
+                1024, 4, result.handler()) == NO_ERROR);
+        CoAPBlock block;
+        REQUIRE(blockOption(small.sent[0], CoAPOption::BLOCK1, block));
+        CHECK(block.size() == 256);
+        while (s.flight(small)) {
+        }
+        CHECK(result.done);
+        CHECK(s.data() == payload);
+    }
+
+    SECTION("resends the blocks that were lost when the session is resumed") {
+        REQUIRE(sender.start(channel, header, headerLength, (const uint8_t*)payload.data(), payload.size(),
+                512, 4, result.handler()) == NO_ERROR);
+        bool lost = false;
+        // lose the third message of the first flight
+        server.flight(channel, [&](const Bytes&) {
+            return !lost && server.messageCount == 3 && (lost = true);
+        });
+        while (server.flight(channel)) {
+        }
+        CHECK(sender.is_active());
+        sender.resume(true);
+        REQUIRE(sender.send(channel) == NO_ERROR);
+        CHECK(channel.sent.size() == 1);
+        while (server.flight(channel)) {
+        }
+        CHECK(result.done);
+        CHECK(result.error == 0);
+        CHECK(server.data() == payload);
+        CHECK(server.messageCount == 9);
+    }
+
+    SECTION("restarts the transfer when the session isn't resumed") {
+        REQUIRE(sender.start(channel, header, headerLength, (const uint8_t*)payload.data(), payload.size(),
+                512, 4, result.handler()) == NO_ERROR);
+        server.flight(channel, [&](const Bytes&) {
+            return server.messageCount == 2;
+        });
+        while (server.flight(channel)) {
+        }
+        server.reset();
+        sender.resume(false);
+        REQUIRE(sender.send(channel) == NO_ERROR);
+        while (server.flight(channel)) {
+        }
+        CHECK(result.done);
+        CHECK(result.error == 0);
+        CHECK(server.data() == payload);
+    }
+
+    SECTION("fails after too many interruptions") {
+        REQUIRE(sender.start(channel, header, headerLength, (const uint8_t*)payload.data(), payload.size(),
+                512, 4, result.handler()) == NO_ERROR);
+        for (unsigned i = 0; i < BlockSender::MAX_RESUME_COUNT; ++i) {
+            sender.resume(true);
+            CHECK(sender.is_active());
+        }
+        sender.resume(true);
+        CHECK_FALSE(sender.is_active());
+        CHECK(result.error == SYSTEM_ERROR_TIMEOUT);
+    }
+
+    SECTION("fails when the server rejects a block") {
+        REQUIRE(sender.start(channel, header, headerLength, (const uint8_t*)payload.data(), payload.size(),
+                512, 4, result.handler()) == NO_ERROR);
+        CHECK(sender.acknowledged(CoAP::message_id(channel.sent[0].data()), RESPONSE_CODE(4,13)));
+        CHECK_FALSE(sender.is_active());
+        CHECK(result.error == SYSTEM_ERROR_TOO_LARGE);
+        CHECK_FALSE(sender.acknowledged(CoAP::message_id(channel.sent[1].data()), RESPONSE_CODE(2,31)));
+    }
+
+    SECTION("allows only one transfer at a time") {
+        REQUIRE(sender.start(channel, header, headerLength, (const uint8_t*)payload.data(), payload.size(),
+                512, 4, result.handler()) == NO_ERROR);
+        Result second;
+        CHECK(sender.start(channel, header, headerLength, (const uint8_t*)payload.data(), payload.size(),
+                512, 4, second.handler()) == BANDWIDTH_EXCEEDED);
+        CHECK(second.done);
+        sender.cancel(SYSTEM_ERROR_ABORTED);
+    }
+}
+
+TEST_CASE("Variables::handle_variable_request() with a long string") {
+    const std::string value = testData(2000);
+    stringVariable = value.c_str();
+    TestChannel channel;
+    Variables variables;
+    uint8_t buf[640];
+    std::string received;
+    unsigned requests = 0;
+    uint32_t num = 0;
+    bool more = true;
+    while (more) {
+        // GET /v/str with a Block2 option for every block but the first one
+        size_t len = 0;
+        buf[len++] = 0x41;
+        buf[len++] = 0x01;
+        buf[len++] = 0x00;
+        buf[len++] = 0x10 + requests;
+        buf[len++] = 0x55;
+        len += CoAP::option(buf + len, CoAPOption::URI_PATH, (const uint8_t*)"v", 1);
+        len += CoAP::option(buf + len, 0, (const uint8_t*)"str", 3);
+        if (num) {
+            CoAPBlock block;
+            block.num = num;
+            block.more = false;
+            block.szx = 5;
+            len += CoAP::uint_option(buf + len, CoAPOption::BLOCK2 - CoAPOption::URI_PATH, block.encode());
+        }
+        Message request(buf, sizeof(buf), len);
+        char key[13];
+        variables.decode_variable_request(key, request);
+        CHECK(strcmp(key, "str") == 0);
+        REQUIRE(variables.handle_variable_request(key, request, channel, 0x55, 0x10 + requests,
+                variableType, variableValue, 512) == NO_ERROR);
+        ++requests;
+        REQUIRE(channel.sent.size() == 1);
+        const Bytes msg = channel.sent[0];
+        channel.sent.clear();
+        CoAPBlock block;
+        REQUIRE(blockOption(msg, CoAPOption::BLOCK2, block));
+        CHECK(block.num == num);
+        received += payloadOf(msg);
+        more = block.more;
+        ++num;
+    }
+    CHECK(received == value);
+    CHECK(requests == 4);
+}
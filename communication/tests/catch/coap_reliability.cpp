@@ -864,7 +864,8 @@ SCENARIO("sending a message and re-establishing the connection clears existing m
 			AND_WHEN("the connection is re-established")
 			{
 				When(Method(mock,establish)).Return(NO_ERROR);
-				channel.establish();
+				uint32_t flags = 0;
+				channel.establish(flags, 0);
 				THEN("the message store is cleared")
 				{
 					REQUIRE(channel.client_messages().from_id(0x1234)==nullptr);		// message has been sent and registered
@@ -0,0 +1,87 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "dsakeygen.h"
+
+#include "tropicssl/rsa.h"
+
+#include "catch.hpp"
+
+#include <random>
+#include <cstring>
+
+namespace {
+
+int testRng(void* ctx) {
+    std::mt19937& gen = *static_cast<std::mt19937*>(ctx);
+    return gen();
+}
+
+// Reads a DER encoded INTEGER and returns the number of bytes consumed
+size_t readInteger(const uint8_t* data, mpi* value) {
+    REQUIRE(data[0] == 0x02); // INTEGER
+    size_t offs = 1;
+    size_t len = data[offs++];
+    if (len & 0x80) {
+        const size_t n = len & 0x7f;
+        REQUIRE(n == 1);
+        len = data[offs++];
+    }
+    REQUIRE(mpi_read_binary(value, data + offs, len) == 0);
+    return offs + len;
+}
+
+} // namespace
+
+TEST_CASE("gen_rsa_key()") {
+    std::mt19937 gen(1);
+    uint8_t buf[1024];
+    memset(buf, 0xa5, sizeof(buf));
+
+    SECTION("writes a DER encoded private key") {
+        // The writer first measures the length of the key without a buffer
+        REQUIRE(gen_rsa_key(buf, sizeof(buf), testRng, &gen) == 0);
+        REQUIRE(buf[0] == 0x30); // SEQUENCE
+        REQUIRE(buf[1] == 0x82); // 2 length bytes
+        const size_t len = 4 + ((buf[2] << 8) | buf[3]);
+        REQUIRE(len <= sizeof(buf));
+        // The rest of the buffer is untouched
+        for (size_t i = len; i < sizeof(buf); ++i) {
+            REQUIRE(buf[i] == 0xa5);
+        }
+        rsa_context rsa;
+        rsa_init(&rsa, RSA_PKCS_V15, RSA_RAW, testRng, &gen);
+        mpi version;
+        mpi_init(&version);
+        size_t offs = 4;
+        offs += readInteger(buf + offs, &version);
+        mpi* const parts[] = { &rsa.N, &rsa.E, &rsa.D, &rsa.P, &rsa.Q, &rsa.DP, &rsa.DQ, &rsa.QP };
+        for (mpi* part: parts) {
+            offs += readInteger(buf + offs, part);
+        }
+        CHECK(offs == len);
+        CHECK(mpi_cmp_int(&version, 0) == 0);
+        CHECK(mpi_msb(&rsa.N) == 1024);
+        CHECK(mpi_cmp_int(&rsa.E, 65537) == 0);
+        rsa.len = mpi_size(&rsa.N);
+        CHECK(rsa_check_privkey(&rsa) == 0);
+        mpi_free(&version);
+        rsa_free(&rsa);
+    }
+}
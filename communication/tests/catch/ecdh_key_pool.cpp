@@ -0,0 +1,174 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "ecdh_key_pool.h"
+
+#include "mbedtls/ecdh.h"
+
+#include "catch.hpp"
+#include "benchmark.h"
+
+#include <random>
+
+using particle::protocol::EcdhKeyPool;
+
+namespace {
+
+int testRng(void* ctx, unsigned char* data, size_t size) {
+    std::mt19937& gen = *static_cast<std::mt19937*>(ctx);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = gen();
+    }
+    return 0;
+}
+
+// ECDH context as set up by mbedTLS for the ServerKeyExchange message
+class EcdhContext {
+public:
+    EcdhContext() {
+        mbedtls_ecdh_init(&ctx_);
+        REQUIRE(mbedtls_ecp_group_load(&ctx_.grp, MBEDTLS_ECP_DP_SECP256R1) == 0);
+    }
+
+    ~EcdhContext() {
+        mbedtls_ecdh_free(&ctx_);
+    }
+
+    mbedtls_ecdh_context* get() {
+        return &ctx_;
+    }
+
+    // Checks that the public key matches the private key
+    bool isValidKeyPair() {
+        mbedtls_ecp_point Q;
+        mbedtls_ecp_point_init(&Q);
+        bool ok = mbedtls_ecp_check_privkey(&ctx_.grp, &ctx_.d) == 0 &&
+                mbedtls_ecp_mul(&ctx_.grp, &Q, &ctx_.d, &ctx_.grp.G, nullptr, nullptr) == 0 &&
+                mbedtls_ecp_point_cmp(&Q, &ctx_.Q) == 0;
+        mbedtls_ecp_point_free(&Q);
+        return ok;
+    }
+
+private:
+    mbedtls_ecdh_context ctx_;
+};
+
+} // namespace
+
+TEST_CASE("EcdhKeyPool") {
+    std::mt19937 gen(1);
+    EcdhKeyPool pool;
+
+    SECTION("is empty initially") {
+        CHECK(pool.available() == 0);
+        CHECK(pool.hits() == 0);
+        CHECK(pool.misses() == 0);
+    }
+
+    SECTION("generates one key pair per call until full") {
+        for (size_t i = 0; i < EcdhKeyPool::CAPACITY; ++i) {
+            REQUIRE(pool.fill(MBEDTLS_ECP_DP_SECP256R1, testRng, &gen) == 0);
+            CHECK(pool.available() == i + 1);
+        }
+        CHECK(pool.fill(MBEDTLS_ECP_DP_SECP256R1, testRng, &gen) == 0);
+        CHECK(pool.available() == EcdhKeyPool::CAPACITY);
+    }
+
+    SECTION("hands out valid key pairs, each once") {
+        REQUIRE(pool.fill(MBEDTLS_ECP_DP_SECP256R1, testRng, &gen) == 0);
+        REQUIRE(pool.fill(MBEDTLS_ECP_DP_SECP256R1, testRng, &gen) == 0);
+        EcdhContext a, b, c;
+        REQUIRE(pool.take(&a.get()->grp, &a.get()->d, &a.get()->Q));
+        CHECK(a.isValidKeyPair());
+        REQUIRE(pool.take(&b.get()->grp, &b.get()->d, &b.get()->Q));
+        CHECK(b.isValidKeyPair());
+        CHECK(mbedtls_mpi_cmp_mpi(&a.get()->d, &b.get()->d) != 0);
+        CHECK(pool.available() == 0);
+        CHECK_FALSE(pool.take(&c.get()->grp, &c.get()->d, &c.get()->Q));
+        CHECK(pool.hits() == 2);
+        CHECK(pool.misses() == 1);
+    }
+
+    SECTION("doesn't hand out a key pair for another curve") {
+        REQUIRE(pool.fill(MBEDTLS_ECP_DP_SECP256R1, testRng, &gen) == 0);
+        // only secp256r1 is enabled in the configuration
+        EcdhContext ctx;
+        ctx.get()->grp.id = MBEDTLS_ECP_DP_SECP384R1;
+        CHECK_FALSE(pool.take(&ctx.get()->grp, &ctx.get()->d, &ctx.get()->Q));
+        ctx.get()->grp.id = MBEDTLS_ECP_DP_SECP256R1;
+        CHECK(pool.available() == 1);
+        CHECK(pool.misses() == 1);
+    }
+
+    SECTION("destroys the key pairs when cleared") {
+        REQUIRE(pool.fill(MBEDTLS_ECP_DP_SECP256R1, testRng, &gen) == 0);
+        pool.clear();
+        CHECK(pool.available() == 0);
+        EcdhContext ctx;
+        CHECK_FALSE(pool.take(&ctx.get()->grp, &ctx.get()->d, &ctx.get()->Q));
+    }
+}
+
+TEST_CASE("mbedtls_ecdh_gen_public() uses the pooled key pairs") {
+    std::mt19937 gen(2);
+    EcdhKeyPool& pool = EcdhKeyPool::instance();
+    pool.clear();
+    const uint32_t hits = pool.hits();
+    const uint32_t misses = pool.misses();
+
+    REQUIRE(pool.fill(MBEDTLS_ECP_DP_SECP256R1, testRng, &gen) == 0);
+    EcdhContext a;
+    REQUIRE(mbedtls_ecdh_gen_public(&a.get()->grp, &a.get()->d, &a.get()->Q, testRng, &gen) == 0);
+    CHECK(a.isValidKeyPair());
+    CHECK(pool.hits() == hits + 1);
+    CHECK(pool.available() == 0);
+
+    // generated on demand when the pool is empty
+    EcdhContext b;
+    REQUIRE(mbedtls_ecdh_gen_public(&b.get()->grp, &b.get()->d, &b.get()->Q, testRng, &gen) == 0);
+    CHECK(b.isValidKeyPair());
+    CHECK(pool.misses() == misses + 1);
+
+    // both sides derive the same secret
+    mbedtls_mpi za, zb;
+    mbedtls_mpi_init(&za);
+    mbedtls_mpi_init(&zb);
+    REQUIRE(mbedtls_ecdh_compute_shared(&a.get()->grp, &za, &b.get()->Q, &a.get()->d, testRng, &gen) == 0);
+    REQUIRE(mbedtls_ecdh_compute_shared(&b.get()->grp, &zb, &a.get()->Q, &b.get()->d, testRng, &gen) == 0);
+    CHECK(mbedtls_mpi_cmp_mpi(&za, &zb) == 0);
+    mbedtls_mpi_free(&za);
+    mbedtls_mpi_free(&zb);
+}
+
+// Time spent in the handshake to obtain the ephemeral key, with and without a pooled key pair
+TEST_CASE("ECDHE key pool benchmark", "[.][benchmark]") {
+    std::mt19937 gen(3);
+    EcdhKeyPool& pool = EcdhKeyPool::instance();
+    auto genPublic = [&]() {
+        EcdhContext ctx;
+        REQUIRE(mbedtls_ecdh_gen_public(&ctx.get()->grp, &ctx.get()->d, &ctx.get()->Q, testRng, &gen) == 0);
+    };
+    pool.clear();
+    test::benchmark("ECDHE key in handshake (generated)", 20, genPublic);
+    for (size_t i = 0; i < EcdhKeyPool::CAPACITY; ++i) {
+        REQUIRE(pool.fill(MBEDTLS_ECP_DP_SECP256R1, testRng, &gen) == 0);
+    }
+    test::benchmark("ECDHE key in handshake (pooled)", EcdhKeyPool::CAPACITY, genPublic);
+    pool.clear();
+}
@@ -0,0 +1,235 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "mbedtls/ecp.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+
+#include "catch.hpp"
+#include "benchmark.h"
+
+#include <random>
+#include <cstring>
+
+namespace {
+
+int testRng(void* ctx, unsigned char* data, size_t size) {
+    std::mt19937& gen = *static_cast<std::mt19937*>(ctx);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = gen();
+    }
+    return 0;
+}
+
+// Group loaded for each use, as an ECDH context or a parsed key is in every handshake
+class Group {
+public:
+    Group() {
+        mbedtls_ecp_group_init(&grp_);
+        REQUIRE(mbedtls_ecp_group_load(&grp_, MBEDTLS_ECP_DP_SECP256R1) == 0);
+    }
+
+    ~Group() {
+        mbedtls_ecp_group_free(&grp_);
+    }
+
+    mbedtls_ecp_group* get() {
+        return &grp_;
+    }
+
+private:
+    mbedtls_ecp_group grp_;
+};
+
+class KeyPair {
+public:
+    explicit KeyPair(std::mt19937& gen) {
+        mbedtls_ecp_keypair_init(&key_);
+        REQUIRE(mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, &key_, testRng, &gen) == 0);
+    }
+
+    ~KeyPair() {
+        mbedtls_ecp_keypair_free(&key_);
+    }
+
+    mbedtls_ecp_keypair* get() {
+        return &key_;
+    }
+
+private:
+    mbedtls_ecp_keypair key_;
+};
+
+bool pointsEqual(const mbedtls_ecp_point& p, const mbedtls_ecp_point& q) {
+    return mbedtls_ecp_point_cmp(&p, &q) == 0;
+}
+
+} // namespace
+
+TEST_CASE("ECP comb cache") {
+    std::mt19937 gen(1);
+    mbedtls_ecp_comb_cache_free();
+    KeyPair server(gen);
+    mbedtls_mpi m;
+    mbedtls_mpi_init(&m);
+    REQUIRE(mbedtls_mpi_fill_random(&m, 32, testRng, &gen) == 0);
+    REQUIRE(mbedtls_mpi_mod_mpi(&m, &m, &server.get()->grp.N) == 0);
+
+    // results computed without cached tables
+    mbedtls_ecp_point mG, mQ, R;
+    mbedtls_ecp_point_init(&mG);
+    mbedtls_ecp_point_init(&mQ);
+    mbedtls_ecp_point_init(&R);
+    {
+        Group g;
+        REQUIRE(mbedtls_ecp_mul(g.get(), &mQ, &m, &server.get()->Q, testRng, &gen) == 0);
+    }
+    mbedtls_ecp_comb_cache_free();
+    {
+        Group g;
+        REQUIRE(mbedtls_ecp_mul(g.get(), &mG, &m, &g.get()->G, testRng, &gen) == 0);
+        // the generator table is moved to the cache instead of the group
+        CHECK(g.get()->T == nullptr);
+    }
+
+    SECTION("multiplies the generator with the cached table in any group") {
+        Group g;
+        REQUIRE(mbedtls_ecp_mul(g.get(), &R, &m, &g.get()->G, testRng, &gen) == 0);
+        CHECK(pointsEqual(R, mG));
+        CHECK(g.get()->T == nullptr);
+    }
+
+    SECTION("multiplies a registered point with the cached table") {
+        Group g;
+        REQUIRE(mbedtls_ecp_comb_cache_add(g.get(), &server.get()->Q) == 0);
+        CHECK(mbedtls_ecp_comb_cache_add(g.get(), &server.get()->Q) == 0);
+        Group g2;
+        REQUIRE(mbedtls_ecp_mul(g2.get(), &R, &m, &server.get()->Q, testRng, &gen) == 0);
+        CHECK(pointsEqual(R, mQ));
+    }
+
+    SECTION("fails to register a point when the cache is full") {
+        Group g;
+        REQUIRE(mbedtls_ecp_comb_cache_add(g.get(), &server.get()->Q) == 0);
+        KeyPair other(gen);
+        CHECK(mbedtls_ecp_comb_cache_add(g.get(), &other.get()->Q) == MBEDTLS_ERR_ECP_BUFFER_TOO_SMALL);
+        // points that aren't cached are still multiplied
+        REQUIRE(mbedtls_ecp_mul(g.get(), &R, &m, &other.get()->Q, testRng, &gen) == 0);
+        mbedtls_ecp_comb_cache_free();
+        CHECK(mbedtls_ecp_comb_cache_add(g.get(), &other.get()->Q) == 0);
+    }
+
+    SECTION("rejects an invalid point") {
+        Group g;
+        mbedtls_ecp_point p;
+        mbedtls_ecp_point_init(&p);
+        REQUIRE(mbedtls_ecp_copy(&p, &server.get()->Q) == 0);
+        REQUIRE(mbedtls_mpi_add_int(&p.Y, &p.Y, 1) == 0);
+        CHECK(mbedtls_ecp_comb_cache_add(g.get(), &p) == MBEDTLS_ERR_ECP_INVALID_KEY);
+        mbedtls_ecp_point_free(&p);
+    }
+
+    SECTION("signs and verifies with the cached tables") {
+        KeyPair device(gen);
+        Group g;
+        REQUIRE(mbedtls_ecp_comb_cache_add(g.get(), &device.get()->Q) == 0);
+        unsigned char hash[32];
+        testRng(&gen, hash, sizeof(hash));
+        mbedtls_mpi r, s;
+        mbedtls_mpi_init(&r);
+        mbedtls_mpi_init(&s);
+        REQUIRE(mbedtls_ecdsa_sign(&device.get()->grp, &r, &s, &device.get()->d, hash, sizeof(hash), testRng, &gen) == 0);
+        CHECK(mbedtls_ecdsa_verify(g.get(), hash, sizeof(hash), &device.get()->Q, &r, &s) == 0);
+        hash[0] ^= 1;
+        CHECK(mbedtls_ecdsa_verify(g.get(), hash, sizeof(hash), &device.get()->Q, &r, &s) != 0);
+        mbedtls_mpi_free(&r);
+        mbedtls_mpi_free(&s);
+    }
+
+    mbedtls_ecp_point_free(&mG);
+    mbedtls_ecp_point_free(&mQ);
+    mbedtls_ecp_point_free(&R);
+    mbedtls_mpi_free(&m);
+    mbedtls_ecp_comb_cache_free();
+}
+
+// Crypto steps of a DTLS handshake (ECDHE-ECDSA with secp256r1) as run by DTLSMessageChannel.
+// "cold" runs each step with no cached tables, as in every handshake before the cache,
+// "cached" with the tables of the generator and the server key precomputed at startup
+TEST_CASE("DTLS handshake crypto benchmark", "[.][benchmark]") {
+    std::mt19937 gen(2);
+    KeyPair device(gen);
+    KeyPair server(gen);
+    KeyPair serverEphemeral(gen);
+    unsigned char hash[32];
+    testRng(&gen, hash, sizeof(hash));
+    mbedtls_mpi r, s;
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+    REQUIRE(mbedtls_ecdsa_sign(&server.get()->grp, &r, &s, &server.get()->d, hash, sizeof(hash), testRng, &gen) == 0);
+    const size_t iterations = 20;
+
+    for (bool cached: { false, true }) {
+        const std::string suffix = cached ? " (cached)" : " (cold)";
+        mbedtls_ecp_comb_cache_free();
+        if (cached) {
+            Group g;
+            REQUIRE(mbedtls_ecp_comb_cache_add(g.get(), &g.get()->G) == 0);
+            REQUIRE(mbedtls_ecp_comb_cache_add(g.get(), &server.get()->Q) == 0);
+        }
+        auto prepare = [&]() {
+            if (!cached) {
+                mbedtls_ecp_comb_cache_free();
+            }
+        };
+        test::benchmark("ECDHE key generation" + suffix, iterations, [&]() {
+            prepare();
+            mbedtls_ecdh_context ecdh;
+            mbedtls_ecdh_init(&ecdh);
+            REQUIRE(mbedtls_ecp_group_load(&ecdh.grp, MBEDTLS_ECP_DP_SECP256R1) == 0);
+            REQUIRE(mbedtls_ecdh_gen_public(&ecdh.grp, &ecdh.d, &ecdh.Q, testRng, &gen) == 0);
+            mbedtls_ecdh_free(&ecdh);
+        });
+        test::benchmark("ECDHE shared secret" + suffix, iterations, [&]() {
+            prepare();
+            Group g;
+            mbedtls_mpi z;
+            mbedtls_mpi_init(&z);
+            REQUIRE(mbedtls_ecdh_compute_shared(g.get(), &z, &serverEphemeral.get()->Q, &device.get()->d, testRng, &gen) == 0);
+            mbedtls_mpi_free(&z);
+        });
+        test::benchmark("ECDSA sign with the device key" + suffix, iterations, [&]() {
+            prepare();
+            mbedtls_mpi sr, ss;
+            mbedtls_mpi_init(&sr);
+            mbedtls_mpi_init(&ss);
+            REQUIRE(mbedtls_ecdsa_sign(&device.get()->grp, &sr, &ss, &device.get()->d, hash, sizeof(hash), testRng, &gen) == 0);
+            mbedtls_mpi_free(&sr);
+            mbedtls_mpi_free(&ss);
+        });
+        test::benchmark("ECDSA verify with the server key" + suffix, iterations, [&]() {
+            prepare();
+            Group g;
+            REQUIRE(mbedtls_ecdsa_verify(g.get(), hash, sizeof(hash), &server.get()->Q, &r, &s) == 0);
+        });
+    }
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&s);
+    mbedtls_ecp_comb_cache_free();
+}
@@ -0,0 +1,146 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "functions.h"
+#include "catch.hpp"
+#include "fakeit.hpp"
+#include <string>
+using namespace fakeit;
+
+using namespace particle::protocol;
+
+namespace {
+
+struct FunctionCall
+{
+	int calls = 0;
+	std::string key;
+	std::string arg;
+	size_t arg_length = 0;
+};
+
+FunctionCall last_call;
+
+int call_function(const char* function_key, const char* arg, SparkDescriptor::FunctionResultCallback callback, void* reserved)
+{
+	last_call.calls++;
+	last_call.key = function_key;
+	last_call.arg = arg;
+	last_call.arg_length = ((const FunctionCallInfo*)reserved)->arg_length;
+	return 0;
+}
+
+char arg_char(size_t index)
+{
+	return 'a' + index % 26;
+}
+
+/**
+ * Writes a function call request for the given key with an argument of the given length.
+ */
+size_t function_call(uint8_t* buf, const char* key, size_t arg_length)
+{
+	size_t i = 0;
+	buf[i++] = 0x41;	// CON, token length 1
+	buf[i++] = 0x02;	// POST
+	buf[i++] = 0x12;
+	buf[i++] = 0x34;
+	buf[i++] = 0x01;	// token
+	buf[i++] = 0xB1;	// Uri-Path "f"
+	buf[i++] = 'f';
+	const size_t key_length = strlen(key);
+	buf[i++] = key_length;	// Uri-Path, the function key
+	memcpy(buf + i, key, key_length);
+	i += key_length;
+	// Uri-Query, the argument
+	if (arg_length < 13)
+		buf[i++] = 0x40 | arg_length;
+	else if (arg_length < 269)
+	{
+		buf[i++] = 0x4D;
+		buf[i++] = arg_length - 13;
+	}
+	else
+	{
+		buf[i++] = 0x4E;
+		buf[i++] = (arg_length - 269) >> 8;
+		buf[i++] = (arg_length - 269) & 0xFF;
+	}
+	for (size_t j = 0; j < arg_length; j++)
+		buf[i++] = arg_char(j);
+	return i;
+}
+
+/**
+ * Handles a function call with an argument of the given length.
+ * @return the code of the acknowledgement
+ */
+uint8_t handle_function_call(size_t arg_length)
+{
+	last_call = FunctionCall();
+	Mock<MessageChannel> channel;
+
+	uint8_t response_buf[16];
+	When(Method(channel,response)).Do([&response_buf](Message& original, Message& response, size_t required) {
+		response.set_buffer(response_buf, sizeof(response_buf));
+		return NO_ERROR;
+	});
+	uint8_t ack_code = 0xFF;
+	When(Method(channel,send)).Do([&ack_code](Message& msg) {
+		REQUIRE(CoAP::type(msg.buf())==CoAPType::ACK);
+		ack_code = msg.buf()[1];
+		return NO_ERROR;
+	});
+
+	uint8_t buf[1024];
+	Message message;
+	message.set_buffer(buf, sizeof(buf));
+	message.set_length(function_call(buf, "fn", arg_length));
+
+	Functions functions;
+	REQUIRE(functions.handle_function_call(0x01, 0x1234, message, channel.get(), call_function)==NO_ERROR);
+	Verify(Method(channel,send)).Once();
+	return ack_code;
+}
+
+} // namespace
+
+SCENARIO("function arguments up to the maximum length are passed in full")
+{
+	const size_t lengths[] = { 0, 12, 13, 63, 64, 268, 269, MAX_FUNCTION_ARG_LENGTH };
+	for (size_t length : lengths)
+	{
+		INFO("argument length " << length);
+		REQUIRE(handle_function_call(length)==0);
+		REQUIRE(last_call.calls==1);
+		REQUIRE(last_call.key=="fn");
+		REQUIRE(last_call.arg_length==length);
+		// the argument is null terminated in place
+		REQUIRE(last_call.arg.length()==length);
+		for (size_t i = 0; i < length; i++)
+			REQUIRE(last_call.arg[i]==arg_char(i));
+	}
+}
+
+SCENARIO("a function argument over 622 bytes is refused with 4.00")
+{
+	REQUIRE(MAX_FUNCTION_ARG_LENGTH==622);
+	REQUIRE(handle_function_call(MAX_FUNCTION_ARG_LENGTH + 1)==RESPONSE_CODE(4,00));
+	REQUIRE(last_call.calls==0);
+}
@@ -42,6 +42,10 @@ public:
 		Protocol::init(callbacks, descriptor);
 	}
 
+	virtual void command(ProtocolCommands::Enum command, uint32_t data)
+	{
+	}
+
 };
 
 SCENARIO("default product co-ordinates are set")
@@ -188,6 +192,40 @@ SCENARIO("non-confirmable events are not acknowledged")
 	event_ack(false, false);
 }
 
+SCENARIO("a ping is acknowledged with its message ID over a reliable transport")
+{
+	ProtocolBuilder builder;
+	builder.callbacks.millis = &fake_millis;
+	Mock<MessageChannel> channel;
+	AbstractProtocol p(channel.get());
+	builder.build(p);
+
+	// the message ID isn't decoded on receive, as over TCP
+	Message ping;
+	uint8_t ping_buf[50];
+	ping.set_buffer(ping_buf, sizeof(ping_buf));
+	ping.set_length(Messages::ping(ping_buf, 0x1234));
+
+	When(Method(channel,is_unreliable)).AlwaysReturn(false);
+	When(Method(channel,receive)).Do([&ping](Message& msg) {
+		msg = ping;
+		return NO_ERROR;
+	});
+
+	auto validate_ack = [](Message& msg) {
+		REQUIRE(msg.length()==4);
+		REQUIRE(CoAP::type(msg.buf())==CoAPType::ACK);
+		// the channel writes the ID of the message, and assigns a new one if it has none
+		REQUIRE(msg.has_id());
+		REQUIRE(msg.get_id()==0x1234);
+		return NO_ERROR;
+	};
+	When(Method(channel,send)).Do(validate_ack);
+
+	REQUIRE(p.event_loop());
+	Verify(Method(channel,send)).Once();
+}
+
 void verify_event_type_with_flags(int flags, CoAPType::Enum coapType)
 {
 	bool unreliable = true;
@@ -211,8 +249,8 @@ void verify_event_type_with_flags(int flags, CoAPType::Enum coapType)
 	};
 	When(Method(channel,send)).Do(validate_event);
 
-	Publisher publisher;
-	publisher.send_event(channel.get(),"abc","def", 60, EventType::PUBLIC, flags, 0);
+	Publisher publisher(nullptr);
+	publisher.send_event(channel.get(),"abc","def", 60, EventType::PUBLIC, flags, 0, particle::CompletionHandler());
 
 	Verify(Method(channel,send));
 }
@@ -0,0 +1,138 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "protocol_metrics.h"
+
+#include "catch.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace particle::protocol;
+
+TEST_CASE("MetricCounter") {
+    MetricCounter counter;
+    CHECK(counter.get() == 0);
+
+    SECTION("increments by one or more") {
+        counter.increment();
+        counter.increment(10);
+        CHECK(counter.get() == 11);
+    }
+
+    SECTION("resets to zero") {
+        counter.increment(5);
+        counter.reset();
+        CHECK(counter.get() == 0);
+    }
+
+    SECTION("wraps around") {
+        counter.increment(UINT32_MAX);
+        counter.increment(2);
+        CHECK(counter.get() == 1);
+    }
+
+    SECTION("counts the increments of concurrent threads") {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; i++) {
+            threads.emplace_back([&counter]() {
+                for (int j = 0; j < 10000; j++) {
+                    counter.increment();
+                }
+            });
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        CHECK(counter.get() == 40000);
+    }
+}
+
+TEST_CASE("MetricHistogram") {
+    const uint32_t bounds[MetricHistogram::BUCKETS - 1] = { 10, 20, 30, 40, 50, 60, 70 };
+    MetricHistogram histogram(bounds);
+
+    SECTION("is empty when created") {
+        for (size_t i = 0; i < MetricHistogram::BUCKETS; i++) {
+            CHECK(histogram.count(i) == 0);
+        }
+    }
+
+    SECTION("counts a value in the first bucket whose bound isn't below it") {
+        histogram.record(0);
+        histogram.record(10);
+        histogram.record(11);
+        histogram.record(70);
+        CHECK(histogram.count(0) == 2);
+        CHECK(histogram.count(1) == 1);
+        CHECK(histogram.count(6) == 1);
+        CHECK(histogram.count(7) == 0);
+    }
+
+    SECTION("counts the values above the last bound in the last bucket") {
+        histogram.record(71);
+        histogram.record(UINT32_MAX);
+        CHECK(histogram.count(7) == 2);
+        CHECK(histogram.bound(7) == UINT32_MAX);
+        CHECK(histogram.bound(0) == 10);
+    }
+
+    SECTION("returns 0 for a bucket out of range") {
+        histogram.record(100);
+        CHECK(histogram.count(MetricHistogram::BUCKETS) == 0);
+    }
+
+    SECTION("resets all buckets") {
+        histogram.record(5);
+        histogram.record(500);
+        histogram.reset();
+        CHECK(histogram.count(0) == 0);
+        CHECK(histogram.count(7) == 0);
+    }
+}
+
+TEST_CASE("ProtocolMetrics") {
+    ProtocolMetrics& metrics = ProtocolMetrics::instance();
+    metrics.reset();
+
+    SECTION("is shared by the protocol and its channels") {
+        ProtocolMetrics::instance().coap_retransmits.increment();
+        CHECK(metrics.coap_retransmits.get() == 1);
+        CHECK(&ProtocolMetrics::instance() == &metrics);
+    }
+
+    SECTION("buckets the acknowledgement round trips in milliseconds") {
+        metrics.ack_rtt.record(80);
+        metrics.ack_rtt.record(1500);
+        metrics.ack_rtt.record(30000);
+        CHECK(metrics.ack_rtt.count(0) == 1);
+        CHECK(metrics.ack_rtt.count(4) == 1);
+        CHECK(metrics.ack_rtt.count(7) == 1);
+    }
+
+    SECTION("resets the counters and the histograms") {
+        metrics.bytes_sent.increment(100);
+        metrics.handshakes.increment();
+        metrics.handshake_duration.record(3000);
+        metrics.reset();
+        CHECK(metrics.bytes_sent.get() == 0);
+        CHECK(metrics.handshakes.get() == 0);
+        CHECK(metrics.handshake_duration.count(3) == 0);
+    }
+}
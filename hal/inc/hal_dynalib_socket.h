@@ -55,6 +55,9 @@ DYNALIB_FN(12, hal_socket, socket_handle_invalid, sock_handle_t(void))
 DYNALIB_FN(13, hal_socket, socket_join_multicast, sock_result_t(const HAL_IPAddress*, network_interface_t, socket_multicast_info_t*))
 DYNALIB_FN(14, hal_socket, socket_leave_multicast, sock_result_t(const HAL_IPAddress*, network_interface_t, socket_multicast_info_t*))
 DYNALIB_FN(15, hal_socket, socket_peer, sock_result_t(sock_handle_t, sock_peer_t*, void*))
+DYNALIB_FN(16, hal_socket, socket_sendto_batch, sock_result_t(sock_handle_t, sock_msg_t*, socklen_t, uint32_t, void*))
+DYNALIB_FN(17, hal_socket, socket_receivefrom_batch, sock_result_t(sock_handle_t, sock_msg_t*, socklen_t, uint32_t, void*))
+DYNALIB_FN(18, hal_socket, socket_poll, sock_result_t(sock_poll_t*, socklen_t, system_tick_t, void*))
 
 DYNALIB_END(hal_socket)
 
@@ -77,6 +77,11 @@ DYNALIB_FN(BASE_IDX2 + 0, hal_usart, HAL_USART_BeginConfig, void(HAL_USART_Seria
 DYNALIB_FN(BASE_IDX2 + 1, hal_usart, HAL_USART_Write_NineBitData, uint32_t(HAL_USART_Serial serial, uint16_t data))
 DYNALIB_FN(BASE_IDX2 + 2, hal_usart, HAL_USART_Send_Break, void(HAL_USART_Serial, void*))
 DYNALIB_FN(BASE_IDX2 + 3, hal_usart, HAL_USART_Break_Detected, uint8_t(HAL_USART_Serial))
+DYNALIB_FN(BASE_IDX2 + 4, hal_usart, HAL_USART_Init_Ex, void(HAL_USART_Serial, const HAL_USART_Buffer_Config*, void*))
+DYNALIB_FN(BASE_IDX2 + 5, hal_usart, HAL_USART_Write_Bytes, uint32_t(HAL_USART_Serial, const uint8_t*, uint32_t, bool))
+DYNALIB_FN(BASE_IDX2 + 6, hal_usart, HAL_USART_Read_Bytes, uint32_t(HAL_USART_Serial, uint8_t*, uint32_t))
+DYNALIB_FN(BASE_IDX2 + 7, hal_usart, HAL_USART_Peek_Buffer, uint32_t(HAL_USART_Serial, const uint8_t**))
+DYNALIB_FN(BASE_IDX2 + 8, hal_usart, HAL_USART_Rx_Overrun, uint8_t(HAL_USART_Serial, void*))
 
 
 DYNALIB_END(hal_usart)
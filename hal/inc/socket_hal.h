@@ -128,6 +128,97 @@ typedef struct sock_peer_t {
 } sock_peer_t;
 sock_result_t socket_peer(sock_handle_t sd, sock_peer_t* peer, void* reserved);
 
+/**
+ * Describes a single datagram in a batch passed to socket_sendto_batch() or
+ * socket_receivefrom_batch().
+ */
+typedef struct sock_msg_t {
+    /**
+     * The datagram data, or the buffer that receives it.
+     */
+    void* buffer;
+    /**
+     * The number of bytes to send, or the size of the receive buffer.
+     */
+    socklen_t len;
+    /**
+     * The destination address, or the address of the sender of a received datagram.
+     */
+    sockaddr_t addr;
+    /**
+     * Set to the number of bytes sent or received, or a negative value on error.
+     */
+    sock_result_t result;
+} sock_msg_t;
+
+/**
+ * The number of datagrams moved in one step by the batch functions. The UDP class
+ * passes its packets to the HAL in batches of this size.
+ */
+#define SOCKET_BATCH_SIZE 16
+
+/**
+ * Sends up to `count` datagrams on a UDP socket in one call.
+ *
+ * @param sd        The socket handle.
+ * @param msgs      The datagrams to send. The `result` field of each sent datagram is updated.
+ * @param count     The number of entries in `msgs`.
+ * @param flags     Reserved, must be 0.
+ * @param reserved  Reserved for future use.
+ * @return The number of datagrams sent, which may be less than `count`, or a negative value on error.
+ */
+sock_result_t socket_sendto_batch(sock_handle_t sd, sock_msg_t* msgs, socklen_t count, uint32_t flags, void* reserved);
+
+/**
+ * Receives up to `count` datagrams from a UDP socket in one call. Does not wait
+ * for datagrams to arrive.
+ *
+ * @param sd        The socket handle.
+ * @param msgs      The buffers to receive to. The `result` and `addr` fields of each filled entry are updated.
+ *                  Datagrams that don't fit in the buffer are truncated.
+ * @param count     The number of entries in `msgs`.
+ * @param flags     Reserved, must be 0.
+ * @param reserved  Reserved for future use.
+ * @return The number of datagrams received, which is 0 if none were pending, or a negative value on error.
+ */
+sock_result_t socket_receivefrom_batch(sock_handle_t sd, sock_msg_t* msgs, socklen_t count, uint32_t flags, void* reserved);
+
+static const uint16_t SOCKET_POLL_READ = 0x01;
+static const uint16_t SOCKET_POLL_WRITE = 0x02;
+static const uint16_t SOCKET_POLL_ERROR = 0x04;
+
+/**
+ * Describes a socket passed to socket_poll().
+ */
+typedef struct sock_poll_t {
+    /**
+     * The socket handle.
+     */
+    sock_handle_t sock;
+    /**
+     * The events to wait for, a combination of SOCKET_POLL_READ and SOCKET_POLL_WRITE.
+     */
+    uint16_t events;
+    /**
+     * Set to the events that occurred. SOCKET_POLL_ERROR is set for sockets that are
+     * closed or invalid.
+     */
+    uint16_t revents;
+} sock_poll_t;
+
+/**
+ * Blocks until at least one of the sockets is readable or writable, or the timeout expires.
+ * For a TCP server socket, readable means a client connection is waiting to be accepted.
+ *
+ * @param fds       The sockets to wait on. The `revents` field of each entry is updated.
+ * @param count     The number of entries in `fds`.
+ * @param timeout   The maximum time to wait in milliseconds.
+ * @param reserved  Reserved for future use.
+ * @return The number of sockets with events, 0 if the timeout expired, or a negative system
+ *      error code. SYSTEM_ERROR_NOT_SUPPORTED is returned on platforms that can't wait on sockets.
+ */
+sock_result_t socket_poll(sock_poll_t* fds, socklen_t count, system_tick_t timeout, void* reserved);
+
 //------------ Socket Types ------------
 
 // don't redefine when building GCC target on OSX or linux
@@ -111,6 +111,25 @@ typedef struct Ring_Buffer
   volatile uint16_t tail;
 } Ring_Buffer;
 
+// Buffer configuration flags
+#define HAL_USART_BUFFER_DMA_RX     ((uint16_t)0x0001) // Receive with DMA, using idle-line and half/full buffer events
+#define HAL_USART_BUFFER_DMA_TX     ((uint16_t)0x0002) // Transmit with DMA
+
+/**
+ * Byte buffers used by a USART instead of the fixed-size Ring_Buffer.
+ * Only 7 and 8 data bits are supported with byte buffers. DMA is used where
+ * the platform has a DMA stream for the USART, otherwise the buffers are
+ * filled and drained by the USART interrupt.
+ */
+typedef struct HAL_USART_Buffer_Config {
+  uint16_t size;                // sizeof(HAL_USART_Buffer_Config)
+  uint16_t flags;               // HAL_USART_BUFFER_* flags
+  uint8_t* rx_buffer;
+  uint16_t rx_buffer_size;
+  uint8_t* tx_buffer;
+  uint16_t tx_buffer_size;
+} HAL_USART_Buffer_Config;
+
 typedef enum HAL_USART_Serial {
   HAL_USART_SERIAL1 = 0,    //maps to USART_TX_RX
   HAL_USART_SERIAL2 = 1     //maps to USART_RGBG_RGBB
@@ -146,6 +165,16 @@ void HAL_USART_BeginConfig(HAL_USART_Serial serial, uint32_t baud, uint32_t conf
 uint32_t HAL_USART_Write_NineBitData(HAL_USART_Serial serial, uint16_t data);
 void HAL_USART_Send_Break(HAL_USART_Serial serial, void* reserved);
 uint8_t HAL_USART_Break_Detected(HAL_USART_Serial serial);
+void HAL_USART_Init_Ex(HAL_USART_Serial serial, const HAL_USART_Buffer_Config* config, void* reserved);
+uint32_t HAL_USART_Write_Bytes(HAL_USART_Serial serial, const uint8_t* data, uint32_t size, bool blocking);
+// Reads up to size bytes without waiting, data can be NULL to discard them
+uint32_t HAL_USART_Read_Bytes(HAL_USART_Serial serial, uint8_t* data, uint32_t size);
+// Points data at the received bytes that are stored contiguously and returns their count,
+// or returns 0 if the received data can't be accessed in place
+uint32_t HAL_USART_Peek_Buffer(HAL_USART_Serial serial, const uint8_t** data);
+// Returns 1 if received data was lost since the previous call because the receive buffer
+// or the USART overflowed, and clears the condition. Only detected with byte buffers.
+uint8_t HAL_USART_Rx_Overrun(HAL_USART_Serial serial, void* reserved);
 
 #ifdef __cplusplus
 }
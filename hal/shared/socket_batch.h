@@ -0,0 +1,78 @@
+/**
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef SOCKET_BATCH_H
+#define	SOCKET_BATCH_H
+
+/**
+ * Implements socket_sendto_batch() and socket_receivefrom_batch() over the platform's
+ * socket_sendto() and socket_receivefrom(), for the platforms without a native batch call.
+ * Included once by the socket HAL of each such platform. A HAL whose native batch call
+ * doesn't apply to all its sockets defines SOCKET_BATCH_LOOP_ONLY to get the loops alone.
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "socket_hal.h"
+
+static inline sock_result_t socket_sendto_loop(sock_handle_t sd, sock_msg_t* msgs, socklen_t count)
+{
+    socklen_t sent = 0;
+    for (; sent<count; sent++) {
+        sock_msg_t* msg = &msgs[sent];
+        msg->result = socket_sendto(sd, msg->buffer, msg->len, 0, &msg->addr, sizeof(msg->addr));
+        if (msg->result<0)
+            return sent ? sent : msg->result;
+    }
+    return sent;
+}
+
+static inline sock_result_t socket_receivefrom_loop(sock_handle_t sd, sock_msg_t* msgs, socklen_t count)
+{
+    socklen_t received = 0;
+    for (; received<count; received++) {
+        sock_msg_t* msg = &msgs[received];
+        socklen_t addr_size = sizeof(msg->addr);
+        msg->result = socket_receivefrom(sd, msg->buffer, msg->len, 0, &msg->addr, &addr_size);
+        if (msg->result<=0)
+            return (received || !msg->result) ? received : msg->result;
+    }
+    return received;
+}
+
+#ifndef SOCKET_BATCH_LOOP_ONLY
+
+sock_result_t socket_sendto_batch(sock_handle_t sd, sock_msg_t* msgs, socklen_t count, uint32_t flags, void* reserved)
+{
+    return socket_sendto_loop(sd, msgs, count);
+}
+
+sock_result_t socket_receivefrom_batch(sock_handle_t sd, sock_msg_t* msgs, socklen_t count, uint32_t flags, void* reserved)
+{
+    return socket_receivefrom_loop(sd, msgs, count);
+}
+
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SOCKET_BATCH_H */
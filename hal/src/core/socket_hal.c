@@ -27,6 +27,7 @@
 #include "cc3000_spi.h"
 #include "evnt_handler.h"
 #include "socket.h"
+#include "system_error.h"
 
 const sock_handle_t SOCKET_MAX = (sock_handle_t)8;
 const sock_handle_t SOCKET_INVALID = (sock_handle_t)-1;
@@ -212,3 +213,53 @@ sock_result_t socket_peer(sock_handle_t sd, sock_peer_t* peer, void* reserved)
 {
     return -1;
 }
+
+#include "socket_batch.h"
+
+sock_result_t socket_poll(sock_poll_t* fds, socklen_t count, system_tick_t timeout, void* reserved)
+{
+    _types_fd_set_cc3000 readSet;
+    _types_fd_set_cc3000 writeSet;
+    timeval tv;
+    long maxfd = -1;
+    int errors = 0;
+    socklen_t i;
+
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    for (i=0; i<count; i++) {
+        sock_handle_t sock = fds[i].sock;
+        fds[i].revents = 0;
+        if (!socket_handle_valid(sock)) {
+            fds[i].revents = SOCKET_POLL_ERROR;
+            errors++;
+            continue;
+        }
+        if (fds[i].events & SOCKET_POLL_READ)
+            FD_SET(sock, &readSet);
+        if (fds[i].events & SOCKET_POLL_WRITE)
+            FD_SET(sock, &writeSet);
+        if ((long)sock>maxfd)
+            maxfd = sock;
+    }
+    if (errors || maxfd<0)
+        return errors;
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    int ret = select(maxfd + 1, &readSet, &writeSet, NULL, &tv);
+    if (ret<0)
+        return SYSTEM_ERROR_IO;
+
+    ret = 0;
+    for (i=0; i<count; i++) {
+        sock_handle_t sock = fds[i].sock;
+        if ((fds[i].events & SOCKET_POLL_READ) && FD_ISSET(sock, &readSet))
+            fds[i].revents |= SOCKET_POLL_READ;
+        if ((fds[i].events & SOCKET_POLL_WRITE) && FD_ISSET(sock, &writeSet))
+            fds[i].revents |= SOCKET_POLL_WRITE;
+        if (fds[i].revents)
+            ret++;
+    }
+    return ret;
+}
@@ -535,6 +535,47 @@ uint8_t HAL_USART_Break_Detected(HAL_USART_Serial serial)
   return 0;
 }
 
+void HAL_USART_Init_Ex(HAL_USART_Serial serial, const HAL_USART_Buffer_Config* config, void* reserved)
+{
+  // The Core has too little RAM for large buffers and no DMA support here, so the
+  // default buffers are used and the configuration is ignored
+  static Ring_Buffer rx_buffers[TOTAL_USARTS];
+  static Ring_Buffer tx_buffers[TOTAL_USARTS];
+  HAL_USART_Init(serial, &rx_buffers[serial], &tx_buffers[serial]);
+}
+
+uint32_t HAL_USART_Write_Bytes(HAL_USART_Serial serial, const uint8_t* data, uint32_t size, bool blocking)
+{
+  uint32_t written = 0;
+  while (written < size && (blocking || HAL_USART_Available_Data_For_Write(serial) > 0)) {
+    written += HAL_USART_Write_NineBitData(serial, data[written]);
+  }
+  return written;
+}
+
+uint32_t HAL_USART_Read_Bytes(HAL_USART_Serial serial, uint8_t* data, uint32_t size)
+{
+  uint32_t count = 0;
+  int32_t c;
+  while (count < size && (c = HAL_USART_Read_Data(serial)) >= 0) {
+    if (data)
+      data[count] = c;
+    count++;
+  }
+  return count;
+}
+
+uint32_t HAL_USART_Peek_Buffer(HAL_USART_Serial serial, const uint8_t** data)
+{
+  // Ring_Buffer holds 16-bit characters
+  return 0;
+}
+
+uint8_t HAL_USART_Rx_Overrun(HAL_USART_Serial serial, void* reserved)
+{
+  return 0;
+}
+
 // Shared Interrupt Handler for USART2/Serial1 and USART1/Serial2
 // WARNING: This function MUST remain reentrance compliant -- no local static variables etc.
 static void HAL_USART_Handler(HAL_USART_Serial serial)
@@ -75,12 +75,12 @@ IDX[x] = added IRQ handler
 24 [x] EXTI2_IRQHandler                  // EXTI Line2
 25 [x] EXTI3_IRQHandler                  // EXTI Line3
 26 [x] EXTI4_IRQHandler                  // EXTI Line4
-27 [ ] DMA1_Stream0_IRQHandler           // DMA1 Stream 0
-28 [ ] DMA1_Stream1_IRQHandler           // DMA1 Stream 1
+27 [x] DMA1_Stream0_IRQHandler           // DMA1 Stream 0
+28 [x] DMA1_Stream1_IRQHandler           // DMA1 Stream 1
 29 [x] DMA1_Stream2_IRQHandler           // DMA1 Stream 2
 30 [ ] DMA1_Stream3_IRQHandler           // DMA1 Stream 3
 31 [ ] DMA1_Stream4_IRQHandler           // DMA1 Stream 4
-32 [ ] DMA1_Stream5_IRQHandler           // DMA1 Stream 5
+32 [x] DMA1_Stream5_IRQHandler           // DMA1 Stream 5
 33 [ ] DMA1_Stream6_IRQHandler           // DMA1 Stream 6
 34 [x] ADC_IRQHandler                    // ADC1, ADC2 and ADC3s
 35 [x] CAN1_TX_IRQHandler                // CAN1 TX
@@ -162,7 +162,10 @@ const unsigned EXTI1_IRQHandler_Idx                 = 23;
 const unsigned EXTI2_IRQHandler_Idx                 = 24;
 const unsigned EXTI3_IRQHandler_Idx                 = 25;
 const unsigned EXTI4_IRQHandler_Idx                 = 26;
+const unsigned DMA1_Stream0_IRQHandler_Idx          = 27;
+const unsigned DMA1_Stream1_IRQHandler_Idx          = 28;
 const unsigned DMA1_Stream2_IRQHandler_Idx          = 29;
+const unsigned DMA1_Stream5_IRQHandler_Idx          = 32;
 const unsigned ADC_IRQHandler_Idx                   = 34;
 const unsigned CAN1_TX_IRQHandler_Idx               = 35;
 const unsigned CAN1_RX0_IRQHandler_Idx              = 36;
@@ -293,6 +296,9 @@ void HAL_Core_Setup_override_interrupts(void)
     isrs[DMA1_Stream7_IRQHandler_Idx]       = (uint32_t)DMA1_Stream7_irq;
     isrs[DMA2_Stream5_IRQHandler_Idx]       = (uint32_t)DMA2_Stream5_irq;
     isrs[DMA1_Stream2_IRQHandler_Idx]       = (uint32_t)DMA1_Stream2_irq;
+    isrs[DMA1_Stream0_IRQHandler_Idx]       = (uint32_t)DMA1_Stream0_irq_override;
+    isrs[DMA1_Stream1_IRQHandler_Idx]       = (uint32_t)DMA1_Stream1_irq_override;
+    isrs[DMA1_Stream5_IRQHandler_Idx]       = (uint32_t)DMA1_Stream5_irq_override;
 
     isrs[RTC_Alarm_IRQHandler_Idx]          = (uint32_t)RTC_Alarm_irq;
     SCB->VTOR = (unsigned long)isrs;
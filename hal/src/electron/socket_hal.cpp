@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include "socket_hal.h"
+#include "system_error.h"
 #include "parser.h"
 
 const sock_handle_t SOCKET_MAX = (sock_handle_t)7; // 7 total sockets, handle 0-6
@@ -140,4 +141,11 @@ sock_result_t socket_create_tcp_server(uint16_t port, network_interface_t nif)
     return -1;
 }
 
+#include "socket_batch.h"
+
+sock_result_t socket_poll(sock_poll_t* fds, socklen_t count, system_tick_t timeout, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
 #endif // !defined(HAL_CELLULAR_EXCLUDE)
@@ -42,8 +42,12 @@
 
 #include "eeprom_file.h"
 #include "eeprom_hal.h"
+#include "timer_hal.h"
+#include "simulation.h"
 
 using std::cout;
+using particle::simulation::Scheduler;
+using particle::simulation::Network;
 
 static LoggerOutputLevel log_level = NO_LOG_LEVEL;
 
@@ -133,6 +137,15 @@ extern "C" int main(int argc, char* argv[])
 {
     log_set_callbacks(log_message_callback, log_write_callback, log_enabled_callback, nullptr);
     if (read_device_config(argc, argv)) {
+        // the clock follows the wall clock, since the network bridges to the host network
+        Scheduler scheduler(HAL_Timer_Get_Micro_Seconds());
+        Network network(scheduler, deviceConfig.network_seed);
+        if (deviceConfig.simulate_network) {
+            scheduler.set_realtime(true);
+            scheduler.install();
+            network.set_default_link(deviceConfig.network_link);
+            network.install();
+        }
     		// init the eeprom so that a file of size 0 can be used to trigger the save.
     		HAL_EEPROM_Init();
     		if (exists_file(eeprom_bin)) {
@@ -18,6 +18,7 @@
 
 #include "delay_hal.h"
 #include "timer_hal.h"
+#include "simulation.h"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-variable"
@@ -27,13 +28,35 @@
 
 #pragma GCC diagnostic pop
 
+using particle::simulation::Scheduler;
+
+/**
+ * In simulated time, a delay runs the events due before it ends. A scheduler following
+ * the wall clock sleeps, then runs them.
+ */
 void HAL_Delay_Milliseconds(uint32_t millis)
 {
+    Scheduler* scheduler = Scheduler::installed();
+    if (scheduler && !scheduler->is_realtime())
+    {
+        scheduler->run_for(millis * particle::simulation::MICROS_PER_MILLI);
+        return;
+    }
     boost::this_thread::sleep(boost::posix_time::milliseconds(millis));
+    if (scheduler)
+        scheduler->sync();
 }
 
 void HAL_Delay_Microseconds(uint32_t micros)
 {
+    Scheduler* scheduler = Scheduler::installed();
+    if (scheduler && !scheduler->is_realtime())
+    {
+        scheduler->run_for(micros);
+        return;
+    }
     boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    if (scheduler)
+        scheduler->sync();
 }
 
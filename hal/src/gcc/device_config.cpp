@@ -95,6 +95,12 @@ public:
             ("server_key,sk", po::value<string>(&config.server_key)->default_value("server_key.der"), "the filename containing the server public key")
             ("state,s", po::value<string>(&config.periph_directory)->default_value("state"), "the directory where device state and peripherals is stored")
 			("protocol,p", po::value<ProtocolFactory>(&config.protocol)->default_value(PROTOCOL_LIGHTSSL), "the cloud communication protocol to use")
+            ("simulate_network", po::value<bool>(&config.simulate_network)->default_value(false)->implicit_value(true), "exchange the socket data through a simulated network with the impairment below")
+            ("network_seed", po::value<uint32_t>(&config.network_seed)->default_value(1), "the seed of the simulated network impairment")
+            ("network_loss", po::value<double>(&config.network_loss)->default_value(0), "the percentage of datagrams lost by the simulated network")
+            ("network_latency", po::value<uint32_t>(&config.network_latency)->default_value(0), "the latency of the simulated network in milliseconds, each way")
+            ("network_jitter", po::value<uint32_t>(&config.network_jitter)->default_value(0), "the maximum delay in milliseconds added at random to the latency, reordering the datagrams")
+            ("network_bandwidth", po::value<uint32_t>(&config.network_bandwidth)->default_value(0), "the bandwidth of the simulated network in bytes per second, 0 for unlimited")
 			;
 
         command_line_options.add(program_options).add(device_options);
@@ -203,5 +209,13 @@ void DeviceConfig::read(Configuration& configuration)
     setLoggerLevel(LoggerOutputLevel(NO_LOG_LEVEL-configuration.log_level));
 
     this->protocol = configuration.protocol;
+
+    simulate_network = configuration.simulate_network;
+    network_seed = configuration.network_seed;
+    network_link = particle::simulation::LinkConfig();
+    network_link.loss = configuration.network_loss / 100;
+    network_link.latency = configuration.network_latency * particle::simulation::MICROS_PER_MILLI;
+    network_link.jitter = configuration.network_jitter * particle::simulation::MICROS_PER_MILLI;
+    network_link.bandwidth = configuration.network_bandwidth;
 }
 
@@ -23,6 +23,7 @@
 #include <cstring>
 #include "filesystem.h"
 #include "spark_protocol_functions.h"
+#include "simulation.h"
 
 extern const char* DEVICE_ID;
 extern const char* DEVICE_PRIVATE_KEY;
@@ -53,6 +54,12 @@ struct Configuration
     std::string periph_directory;
     uint16_t log_level = 0;
     ProtocolFactory protocol = PROTOCOL_LIGHTSSL;
+    bool simulate_network = false;
+    uint32_t network_seed = 1;
+    double network_loss = 0;
+    uint32_t network_latency = 0;
+    uint32_t network_jitter = 0;
+    uint32_t network_bandwidth = 0;
 };
 
 
@@ -65,6 +72,13 @@ struct DeviceConfig
     uint8_t device_key[1024];
     uint8_t server_key[1024];
     ProtocolFactory protocol;
+    /**
+     * When set, the sockets exchange their data through a simulated network with
+     * the impairment of network_link.
+     */
+    bool simulate_network;
+    uint32_t network_seed;
+    particle::simulation::LinkConfig network_link;
 
     size_t hex2bin(const std::string& hex, uint8_t* dest, size_t destLen);
 
@@ -0,0 +1,299 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "simulation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace particle { namespace simulation {
+
+Scheduler* Scheduler::current = nullptr;
+
+Scheduler::Scheduler(sim_time_t start) :
+        time(start),
+        next_id(0),
+        realtime(false),
+        realtime_start(0)
+{
+}
+
+Scheduler::~Scheduler()
+{
+    uninstall();
+}
+
+Scheduler::EventId Scheduler::schedule_at(sim_time_t at, Event event)
+{
+    const EventId id = next_id++;
+    events.push(Entry{std::max(at, time), id, std::move(event)});
+    scheduled.insert(id);
+    return id;
+}
+
+bool Scheduler::cancel(EventId id)
+{
+    // the entry is discarded when it reaches the top of the queue
+    return scheduled.erase(id);
+}
+
+/**
+ * Removes the next event from the queue, unless it is due after the given time.
+ */
+bool Scheduler::pop(Entry& entry, sim_time_t until)
+{
+    while (!events.empty())
+    {
+        const Entry& top = events.top();
+        if (!scheduled.count(top.id))
+        {
+            events.pop();
+            continue;
+        }
+        if (top.time > until)
+            return false;
+        // the entries are immutable in the queue, the event is copied out
+        entry = top;
+        events.pop();
+        scheduled.erase(entry.id);
+        return true;
+    }
+    return false;
+}
+
+bool Scheduler::run_one()
+{
+    Entry entry;
+    if (!pop(entry, UINT64_MAX))
+        return false;
+    time = entry.time;
+    entry.event();
+    return true;
+}
+
+size_t Scheduler::run_until(sim_time_t until)
+{
+    size_t count = 0;
+    Entry entry;
+    // the events scheduled by these events run too when they're due
+    while (pop(entry, until))
+    {
+        time = entry.time;
+        entry.event();
+        count++;
+    }
+    if (until > time)
+        time = until;
+    return count;
+}
+
+void Scheduler::set_realtime(bool realtime)
+{
+    this->realtime = realtime;
+    wall_start = std::chrono::steady_clock::now();
+    realtime_start = time;
+}
+
+void Scheduler::sync()
+{
+    if (!realtime)
+        return;
+    const auto elapsed = std::chrono::steady_clock::now() - wall_start;
+    run_until(realtime_start + std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+void Scheduler::install()
+{
+    current = this;
+}
+
+void Scheduler::uninstall()
+{
+    if (current == this)
+        current = nullptr;
+}
+
+Network* Network::current = nullptr;
+
+Network::Network(Scheduler& scheduler, uint32_t seed) :
+        scheduler(scheduler),
+        random(seed)
+{
+}
+
+Network::~Network()
+{
+    uninstall();
+}
+
+Network::Address Network::add_endpoint(Receiver receiver)
+{
+    Address address = 0;
+    while (address < endpoints.size() && endpoints[address].used)
+        address++;
+    if (address == endpoints.size())
+        endpoints.push_back(Endpoint());
+    Endpoint& endpoint = endpoints[address];
+    endpoint.used = true;
+    endpoint.generation++;
+    endpoint.receiver = std::move(receiver);
+    return address;
+}
+
+void Network::remove_endpoint(Address address)
+{
+    if (!exists(address))
+        return;
+    Endpoint& endpoint = endpoints[address];
+    endpoint.used = false;
+    endpoint.receiver = nullptr;
+    endpoint.queue.clear();
+    for (auto it = links.begin(); it != links.end();)
+    {
+        if (it->first.first == address || it->first.second == address)
+            it = links.erase(it);
+        else
+            ++it;
+    }
+}
+
+void Network::set_link(Address from, Address to, const LinkConfig& config)
+{
+    link(from, to).config = config;
+}
+
+Network::Link& Network::link(Address from, Address to)
+{
+    const auto key = std::make_pair(from, to);
+    auto it = links.find(key);
+    if (it == links.end())
+    {
+        it = links.insert(std::make_pair(key, Link())).first;
+        it->second.config = default_config;
+    }
+    return it->second;
+}
+
+double Network::uniform()
+{
+    return random() / 4294967296.0;
+}
+
+bool Network::send(Address from, Address to, const uint8_t* data, size_t size)
+{
+    if (!exists(from) || !exists(to))
+        return false;
+    Link& l = link(from, to);
+    const LinkConfig& config = l.config;
+    l.stats.sent++;
+
+    const sim_time_t now = scheduler.now();
+    sim_time_t start = std::max(now, l.busy_until);
+    sim_time_t serialize = 0;
+    if (config.bandwidth)
+    {
+        if (config.queue_limit)
+        {
+            const uint64_t backlog = (start - now) * config.bandwidth / MICROS_PER_SECOND;
+            if (backlog + size > config.queue_limit)
+            {
+                l.stats.overflowed++;
+                return true;
+            }
+        }
+        serialize = (sim_time_t(size) * MICROS_PER_SECOND + config.bandwidth - 1) / config.bandwidth;
+    }
+    // a packet lost on the wire has still been serialized
+    l.busy_until = start + serialize;
+
+    // the random values are drawn in the same order whatever the outcome, so one packet's
+    // fate doesn't shift the impairment of the following packets
+    const bool lost = uniform() < config.loss;
+    const sim_time_t jitter = config.jitter ? sim_time_t(uniform() * (config.jitter + 1)) : 0;
+    if (lost)
+    {
+        l.stats.lost++;
+        return true;
+    }
+
+    sim_time_t delivery = l.busy_until + config.latency + jitter;
+    if (config.ordered)
+        delivery = std::max(delivery, l.last_delivery);
+    l.last_delivery = delivery;
+
+    auto packet = std::make_shared<Packet>(data, data + size);
+    const unsigned generation = endpoints[to].generation;
+    scheduler.schedule_at(delivery, [this, from, to, generation, packet]() {
+        deliver(from, to, generation, *packet);
+    });
+    return true;
+}
+
+void Network::deliver(Address from, Address to, unsigned generation, Packet& packet)
+{
+    if (!exists(to) || endpoints[to].generation != generation)
+        return; // the endpoint was removed
+    Link& l = link(from, to);
+    l.stats.delivered++;
+    l.stats.bytes_delivered += packet.size();
+    Endpoint& endpoint = endpoints[to];
+    if (endpoint.receiver)
+        endpoint.receiver(from, packet.data(), packet.size());
+    else
+        endpoint.queue.push_back(std::make_pair(from, std::move(packet)));
+}
+
+size_t Network::receive(Address at, uint8_t* buffer, size_t size, Address* from)
+{
+    if (!exists(at) || endpoints[at].queue.empty())
+        return 0;
+    auto& queue = endpoints[at].queue;
+    const Packet& packet = queue.front().second;
+    const size_t count = std::min(size, packet.size());
+    memcpy(buffer, packet.data(), count);
+    if (from)
+        *from = queue.front().first;
+    queue.pop_front();
+    return count;
+}
+
+size_t Network::available(Address at) const
+{
+    return exists(at) ? endpoints[at].queue.size() : 0;
+}
+
+LinkStats Network::stats(Address from, Address to) const
+{
+    auto it = links.find(std::make_pair(from, to));
+    return it != links.end() ? it->second.stats : LinkStats();
+}
+
+void Network::install()
+{
+    current = this;
+}
+
+void Network::uninstall()
+{
+    if (current == this)
+        current = nullptr;
+}
+
+}} // namespace particle::simulation
@@ -0,0 +1,325 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace particle { namespace simulation {
+
+/**
+ * Simulated time, in microseconds.
+ */
+typedef uint64_t sim_time_t;
+
+const sim_time_t MICROS_PER_MILLI = 1000;
+const sim_time_t MICROS_PER_SECOND = 1000000;
+
+/**
+ * A discrete-event scheduler owning a virtual clock. Events run in the order of their
+ * time, and events due at the same time in the order they were scheduled, so a run
+ * is reproducible.
+ *
+ * While a scheduler is installed, the gcc HAL timer functions return its time and
+ * the HAL delay functions run its events instead of sleeping.
+ */
+class Scheduler
+{
+public:
+    typedef std::function<void()> Event;
+    typedef uint64_t EventId;
+
+    explicit Scheduler(sim_time_t start = 0);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    sim_time_t now() const { return time; }
+
+    /**
+     * Schedules an event at the given time, or now when the time has passed.
+     * @return the ID of the event, to cancel it.
+     */
+    EventId schedule_at(sim_time_t at, Event event);
+
+    EventId schedule_after(sim_time_t delay, Event event)
+    {
+        return schedule_at(time + delay, std::move(event));
+    }
+
+    /**
+     * Cancels an event that hasn't run yet.
+     * @return true if the event was pending.
+     */
+    bool cancel(EventId id);
+
+    size_t pending() const { return scheduled.size(); }
+
+    /**
+     * Advances the clock to the next event and runs it.
+     * @return false if no event is pending.
+     */
+    bool run_one();
+
+    /**
+     * Runs the events due up to the given time, then advances the clock to that time.
+     * @return the number of events run.
+     */
+    size_t run_until(sim_time_t until);
+
+    size_t run_for(sim_time_t duration)
+    {
+        return run_until(time + duration);
+    }
+
+    /**
+     * Advances the clock without running the events.
+     */
+    void advance(sim_time_t duration) { time += duration; }
+
+    /**
+     * Makes the clock follow the wall clock from now on, for a device exchanging packets
+     * with real hosts through a simulated network. The HAL timer functions then sync()
+     * the clock before returning it, and the HAL delay functions sleep.
+     */
+    void set_realtime(bool realtime);
+
+    bool is_realtime() const { return realtime; }
+
+    /**
+     * In real time, runs the events due up to the wall-clock time. Does nothing otherwise.
+     */
+    void sync();
+
+    /**
+     * Makes this scheduler the clock of the HAL timer and delay functions.
+     */
+    void install();
+    void uninstall();
+
+    /**
+     * The installed scheduler, or nullptr when the HAL uses the wall clock.
+     */
+    static Scheduler* installed() { return current; }
+
+private:
+    struct Entry
+    {
+        sim_time_t time;
+        EventId id;
+        Event event;
+
+        // the queue is a max-heap, the earliest first and the first scheduled first
+        bool operator<(const Entry& other) const
+        {
+            return time != other.time ? time > other.time : id > other.id;
+        }
+    };
+
+    sim_time_t time;
+    EventId next_id;
+    std::priority_queue<Entry> events;
+    // the IDs of the events in the queue that aren't cancelled
+    std::set<EventId> scheduled;
+    bool realtime;
+    // the wall-clock and simulated times when the clock started following the wall clock
+    std::chrono::steady_clock::time_point wall_start;
+    sim_time_t realtime_start;
+
+    static Scheduler* current;
+
+    bool pop(Entry& entry, sim_time_t until);
+};
+
+/**
+ * Impairment of the packets sent over a simulated link.
+ */
+struct LinkConfig
+{
+    /**
+     * Probability in [0, 1] that a packet is lost.
+     */
+    double loss = 0;
+    /**
+     * Propagation delay of the link.
+     */
+    sim_time_t latency = 0;
+    /**
+     * Maximum random delay added to the latency of each packet, reordering the packets
+     * unless the link is ordered.
+     */
+    sim_time_t jitter = 0;
+    /**
+     * Bytes per second serialized onto the link, 0 for unlimited. The packets sent while
+     * the link is busy wait their turn.
+     */
+    uint32_t bandwidth = 0;
+    /**
+     * Maximum bytes queued on the link, including the packet being serialized, 0 for
+     * unlimited. A packet that doesn't fit is dropped.
+     */
+    size_t queue_limit = 0;
+    /**
+     * Deliver the packets in the order they were sent, as over a stream.
+     */
+    bool ordered = false;
+};
+
+/**
+ * Counters of a simulated link.
+ */
+struct LinkStats
+{
+    unsigned sent = 0;
+    unsigned delivered = 0;
+    unsigned lost = 0;
+    unsigned overflowed = 0;
+    uint64_t bytes_delivered = 0;
+};
+
+/**
+ * An in-memory network of endpoints exchanging packets over impaired links, with the
+ * deliveries scheduled on a Scheduler. The impairments are drawn from a seeded
+ * generator, so a run with the same seed and the same traffic is reproduced exactly.
+ */
+class Network
+{
+public:
+    typedef uint32_t Address;
+    typedef std::vector<uint8_t> Packet;
+    /**
+     * Receives the packets delivered to an endpoint.
+     */
+    typedef std::function<void(Address from, const uint8_t* data, size_t size)> Receiver;
+
+    Network(Scheduler& scheduler, uint32_t seed);
+    ~Network();
+
+    Network(const Network&) = delete;
+    Network& operator=(const Network&) = delete;
+
+    /**
+     * Adds an endpoint. The packets delivered to an endpoint without a receiver are
+     * queued until read with receive().
+     */
+    Address add_endpoint(Receiver receiver = nullptr);
+
+    /**
+     * Removes an endpoint with the packets queued for it and the configuration and statistics
+     * of its links. The packets still in flight to it are dropped, and its address is
+     * reused by the endpoints added later.
+     */
+    void remove_endpoint(Address address);
+
+    /**
+     * Sets the impairment of the links without their own configuration.
+     */
+    void set_default_link(const LinkConfig& config) { default_config = config; }
+
+    const LinkConfig& default_link() const { return default_config; }
+
+    /**
+     * Sets the impairment of the packets sent from one endpoint to another.
+     */
+    void set_link(Address from, Address to, const LinkConfig& config);
+
+    /**
+     * Sends a packet. Lost packets are accepted as they would be by a socket.
+     * @return false if either endpoint doesn't exist.
+     */
+    bool send(Address from, Address to, const uint8_t* data, size_t size);
+
+    /**
+     * Reads the next packet queued for an endpoint, truncated to the buffer size.
+     * @return the size of the packet read, or 0 when none is queued.
+     */
+    size_t receive(Address at, uint8_t* buffer, size_t size, Address* from = nullptr);
+
+    /**
+     * The number of packets queued for an endpoint.
+     */
+    size_t available(Address at) const;
+
+    LinkStats stats(Address from, Address to) const;
+
+    /**
+     * Routes the sockets of the gcc HAL through this network.
+     */
+    void install();
+    void uninstall();
+
+    /**
+     * The installed network, or nullptr when the HAL sockets use the host network.
+     */
+    static Network* installed() { return current; }
+
+    Scheduler& get_scheduler() { return scheduler; }
+
+private:
+    struct Endpoint
+    {
+        bool used = false;
+        // incremented each time the address is reused, so that the packets sent to a
+        // removed endpoint aren't delivered to the next one
+        unsigned generation = 0;
+        Receiver receiver;
+        std::deque<std::pair<Address, Packet>> queue;
+    };
+
+    struct Link
+    {
+        LinkConfig config;
+        LinkStats stats;
+        // time the last packet sent finishes serializing
+        sim_time_t busy_until = 0;
+        // delivery time of the last packet, to keep an ordered link in order
+        sim_time_t last_delivery = 0;
+    };
+
+    Scheduler& scheduler;
+    std::mt19937 random;
+    LinkConfig default_config;
+    std::vector<Endpoint> endpoints;
+    std::map<std::pair<Address, Address>, Link> links;
+
+    static Network* current;
+
+    bool exists(Address address) const { return address < endpoints.size() && endpoints[address].used; }
+    Link& link(Address from, Address to);
+    void deliver(Address from, Address to, unsigned generation, Packet& packet);
+
+    /**
+     * A uniform value in [0, 1), computed from the generator output alone so the
+     * sequence doesn't depend on the standard library.
+     */
+    double uniform();
+};
+
+}} // namespace particle::simulation
@@ -26,6 +26,11 @@
 #include "socket_hal.h"
 #include "inet_hal.h"
 #include "core_msg.h"
+#include "system_error.h"
+#include "simulation.h"
+#include "timer_hal.h"
+#include "delay_hal.h"
+#include <deque>
 #include <vector>
 
 #pragma GCC diagnostic ignored "-Wunused-variable"
@@ -39,6 +44,12 @@
 
 #include <boost/system/system_error.hpp>
 
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstring>
+
 namespace ip = boost::asio::ip;
 
 const sock_handle_t SOCKET_COUNT = sock_handle_t(8);
@@ -136,6 +147,200 @@ bool is_valid(ip::udp::socket& handle) {
     return &handle!=&invalid_udp();
 }
 
+using particle::simulation::Network;
+using particle::simulation::LinkConfig;
+
+namespace {
+
+/**
+ * While a simulated network is installed, the sockets opened exchange their data through it.
+ * Each socket has an endpoint on the device side and one on the host side: the host endpoint
+ * writes the packets delivered to it to the host socket, and sends the data read from the host
+ * socket to the device endpoint. The datagrams carry the 6 bytes of their host address ahead of
+ * the payload. The links of a TCP socket keep the order of the data and lose none of it, as
+ * TCP retransmits what the network drops.
+ */
+struct SimulatedSocket
+{
+    bool open = false;
+    // incremented each time the handle is opened, so the packets still in flight for a
+    // closed socket aren't delivered to the socket reopened with its handle
+    unsigned generation = 0;
+    Network::Address device = 0;
+    Network::Address host = 0;
+    // the TCP data delivered to the device and not read yet
+    std::deque<uint8_t> stream;
+    // the error of the host socket, returned once the data delivered before it is read
+    sock_result_t error = 0;
+};
+
+const size_t SIMULATED_ADDRESS_SIZE = 6;
+const size_t SIMULATED_PACKET_SIZE = 2048;
+
+SimulatedSocket simulated_sockets[SOCKET_MAX];
+
+SimulatedSocket* simulated(sock_handle_t sd)
+{
+    if (!Network::installed() || sd>=SOCKET_MAX || !simulated_sockets[sd].open)
+        return nullptr;
+    return &simulated_sockets[sd];
+}
+
+bool would_block(const boost::system::error_code& error)
+{
+    return error==boost::asio::error::would_block || error==boost::asio::error::try_again;
+}
+
+void write_host_address(const ip::udp::endpoint& endpoint, uint8_t* address)
+{
+    const uint16_t port = endpoint.port();
+    const uint32_t ip = endpoint.address().to_v4().to_ulong();
+    address[0] = port >> 8;
+    address[1] = port & 0xFF;
+    address[2] = (ip >> 24) & 0xFF;
+    address[3] = (ip >> 16) & 0xFF;
+    address[4] = (ip >> 8) & 0xFF;
+    address[5] = (ip >> 0) & 0xFF;
+}
+
+ip::udp::endpoint read_host_address(const uint8_t* address)
+{
+    ip::address_v4::bytes_type ip = {{ address[2], address[3], address[4], address[5] }};
+    return ip::udp::endpoint(ip::address_v4(ip), address[0] << 8 | address[1]);
+}
+
+void forward_to_host(sock_handle_t sd, const uint8_t* data, size_t size)
+{
+    boost::system::error_code error;
+    if (is_tcp_socket(sd)) {
+        boost::asio::write(tcp_from(sd), boost::asio::buffer(data, size), error);
+    }
+    else if (size>=SIMULATED_ADDRESS_SIZE) {
+        udp_from(sd).send_to(boost::asio::buffer(data+SIMULATED_ADDRESS_SIZE, size-SIMULATED_ADDRESS_SIZE),
+                read_host_address(data), 0, error);
+    }
+    if (error)
+        DEBUG("simulated socket %d: host send error: %s", sd, error.message().c_str());
+}
+
+void simulated_open(sock_handle_t sd)
+{
+    Network* network = Network::installed();
+    if (!network)
+        return;
+    SimulatedSocket& s = simulated_sockets[sd];
+    s.open = true;
+    s.stream.clear();
+    s.error = 0;
+    const unsigned generation = ++s.generation;
+    s.device = network->add_endpoint();
+    s.host = network->add_endpoint([sd, generation](Network::Address from, const uint8_t* data, size_t size) {
+        const SimulatedSocket& s = simulated_sockets[sd];
+        if (s.open && s.generation==generation)
+            forward_to_host(sd, data, size);
+    });
+    if (is_tcp_socket(sd)) {
+        LinkConfig config = network->default_link();
+        config.loss = 0;
+        config.ordered = true;
+        network->set_link(s.device, s.host, config);
+        network->set_link(s.host, s.device, config);
+    }
+}
+
+/**
+ * Sends the data received by the host socket into the network, and runs the deliveries due.
+ */
+void simulated_host_receive(sock_handle_t sd, SimulatedSocket& s)
+{
+    Network& network = *Network::installed();
+    uint8_t buf[SIMULATED_PACKET_SIZE];
+    boost::system::error_code error;
+    if (is_tcp_socket(sd)) {
+        auto& socket = tcp_from(sd);
+        while (!s.error) {
+            const size_t count = socket.read_some(boost::asio::buffer(buf), error);
+            if (error) {
+                if (!would_block(error))
+                    s.error = -abs(error.value());
+                break;
+            }
+            network.send(s.host, s.device, buf, count);
+        }
+    }
+    else {
+        auto& socket = udp_from(sd);
+        for (;;) {
+            ip::udp::endpoint endpoint;
+            const size_t count = socket.receive_from(boost::asio::buffer(buf+SIMULATED_ADDRESS_SIZE,
+                    sizeof(buf)-SIMULATED_ADDRESS_SIZE), endpoint, 0, error);
+            if (error)
+                break;
+            write_host_address(endpoint, buf);
+            network.send(s.host, s.device, buf, count+SIMULATED_ADDRESS_SIZE);
+        }
+    }
+    network.get_scheduler().sync();
+}
+
+sock_result_t simulated_receive(sock_handle_t sd, SimulatedSocket& s, void* buffer, socklen_t len)
+{
+    simulated_host_receive(sd, s);
+    Network& network = *Network::installed();
+    uint8_t buf[SIMULATED_PACKET_SIZE];
+    while (network.available(s.device)) {
+        const size_t count = network.receive(s.device, buf, sizeof(buf));
+        s.stream.insert(s.stream.end(), buf, buf+count);
+    }
+    if (s.stream.empty())
+        return s.error;
+    const size_t count = std::min(size_t(len), s.stream.size());
+    std::copy(s.stream.begin(), s.stream.begin()+count, static_cast<uint8_t*>(buffer));
+    s.stream.erase(s.stream.begin(), s.stream.begin()+count);
+    return count;
+}
+
+sock_result_t simulated_receivefrom(sock_handle_t sd, SimulatedSocket& s, void* buffer, socklen_t len, sockaddr_t* addr, socklen_t* addrsize)
+{
+    simulated_host_receive(sd, s);
+    Network& network = *Network::installed();
+    if (!network.available(s.device))
+        return 0;
+    uint8_t buf[SIMULATED_PACKET_SIZE];
+    const size_t size = network.receive(s.device, buf, sizeof(buf));
+    if (size<SIMULATED_ADDRESS_SIZE)
+        return 0;
+    if (addr && addrsize && *addrsize>=SIMULATED_ADDRESS_SIZE)
+        memcpy(addr->sa_data, buf, SIMULATED_ADDRESS_SIZE);
+    const size_t count = std::min(size_t(len), size-SIMULATED_ADDRESS_SIZE);
+    memcpy(buffer, buf+SIMULATED_ADDRESS_SIZE, count);
+    return count;
+}
+
+sock_result_t simulated_send(SimulatedSocket& s, const void* buffer, socklen_t len, const sockaddr_t* addr)
+{
+    Network& network = *Network::installed();
+    if (addr) {
+        std::vector<uint8_t> packet(SIMULATED_ADDRESS_SIZE+len);
+        memcpy(packet.data(), addr->sa_data, SIMULATED_ADDRESS_SIZE);
+        memcpy(packet.data()+SIMULATED_ADDRESS_SIZE, buffer, len);
+        network.send(s.device, s.host, packet.data(), packet.size());
+    }
+    else {
+        network.send(s.device, s.host, static_cast<const uint8_t*>(buffer), len);
+    }
+    network.get_scheduler().sync();
+    return len;
+}
+
+bool simulated_readable(sock_handle_t sd, SimulatedSocket& s)
+{
+    simulated_host_receive(sd, s);
+    return !s.stream.empty() || s.error || Network::installed()->available(s.device);
+}
+
+} // namespace
+
 
 
 class TCPServer
@@ -177,6 +382,11 @@ public:
 		acceptor.cancel();
 	}
 
+	int native_handle()
+	{
+		return acceptor.native_handle();
+	}
+
 	sock_handle_t accept()
 	{
 		sock_handle_t handle = next_unused_tcp();
@@ -274,6 +484,8 @@ sock_result_t socket_reset_blocking_call()
 
 sock_result_t socket_receive(sock_handle_t sd, void* buffer, socklen_t len, system_tick_t _timeout)
 {
+    if (SimulatedSocket* s = simulated(sd))
+        return simulated_receive(sd, *s, buffer, len);
     auto& handle = tcp_from(sd);
     if (!is_valid(handle))
         return -1;
@@ -298,6 +510,8 @@ sock_result_t socket_receive(sock_handle_t sd, void* buffer, socklen_t len, syst
 
 sock_result_t socket_send(sock_handle_t sd, const void* buffer, socklen_t len)
 {
+    if (SimulatedSocket* s = simulated(sd))
+        return simulated_send(*s, buffer, len, nullptr);
     auto& socket = tcp_from(sd);
     if (!is_valid(socket))
         return -1;
@@ -321,6 +535,9 @@ sock_result_t socket_create_nonblocking_server(sock_handle_t sock, uint16_t port
 
 sock_result_t socket_receivefrom(sock_handle_t sock, void* buffer, socklen_t bufLen, uint32_t flags, sockaddr_t* addr, socklen_t* addrsize)
 {
+	if (SimulatedSocket* s = simulated(sock))
+		return simulated_receivefrom(sock, *s, buffer, bufLen, addr, addrsize);
+
 	ip::udp::endpoint endpoint;
 	auto& socket = udp_from(sock);
 
@@ -352,6 +569,9 @@ sock_result_t socket_receivefrom(sock_handle_t sock, void* buffer, socklen_t buf
 
 sock_result_t socket_sendto(sock_handle_t sd, const void* buffer, socklen_t len, uint32_t flags, sockaddr_t* addr, socklen_t addr_size)
 {
+    if (SimulatedSocket* s = simulated(sd))
+        return simulated_send(*s, buffer, len, addr);
+
     unsigned port = addr->sa_data[0] << 8 | addr->sa_data[1];
     // 2-5 are IP address in network byte order
     const uint8_t* dest = addr->sa_data+2;
@@ -388,6 +608,13 @@ uint8_t socket_active_status(sock_handle_t socket)
 
 sock_result_t socket_close(sock_handle_t socket)
 {
+	if (SimulatedSocket* s = simulated(socket))
+	{
+		Network::installed()->remove_endpoint(s->device);
+		Network::installed()->remove_endpoint(s->host);
+	}
+	if (socket<SOCKET_MAX)
+		simulated_sockets[socket].open = false;
 	if (servers.is_valid(socket))
 	{
 		servers.dispose(socket);
@@ -449,7 +676,10 @@ sock_handle_t socket_create(uint8_t family, uint8_t type, uint8_t protocol, uint
     }
 
     sock_handle_t result = ec.value();
-    return result ? result : handle;
+    if (result)
+        return result;
+    simulated_open(handle);
+    return handle;
 }
 
 uint8_t socket_handle_valid(sock_handle_t handle) {
@@ -493,3 +723,197 @@ sock_result_t socket_peer(sock_handle_t sd, sock_peer_t* peer, void* reserved)
 {
     return -1;
 }
+
+#define SOCKET_BATCH_LOOP_ONLY
+#include "socket_batch.h"
+
+namespace {
+
+// The number of datagrams passed to the kernel in one sendmmsg()/recvmmsg() call
+const socklen_t MMSG_BATCH_SIZE = SOCKET_BATCH_SIZE;
+
+void to_native(const sockaddr_t& addr, sockaddr_in& native)
+{
+    memset(&native, 0, sizeof(native));
+    native.sin_family = AF_INET;
+    memcpy(&native.sin_port, addr.sa_data, 2);     // both in network byte order
+    memcpy(&native.sin_addr, addr.sa_data + 2, 4);
+}
+
+void from_native(const sockaddr_in& native, sockaddr_t& addr)
+{
+    addr.sa_family = AF_INET;
+    memcpy(addr.sa_data, &native.sin_port, 2);
+    memcpy(addr.sa_data + 2, &native.sin_addr, 4);
+}
+
+} // namespace
+
+sock_result_t socket_sendto_batch(sock_handle_t sd, sock_msg_t* msgs, socklen_t count, uint32_t flags, void* reserved)
+{
+    if (simulated(sd))
+        return socket_sendto_loop(sd, msgs, count);
+
+    auto& socket = udp_from(sd);
+    if (!is_valid(socket) || !socket.is_open())
+        return -1;
+
+    mmsghdr hdrs[MMSG_BATCH_SIZE];
+    iovec iov[MMSG_BATCH_SIZE];
+    sockaddr_in addrs[MMSG_BATCH_SIZE];
+    socklen_t sent = 0;
+    while (sent<count) {
+        const socklen_t n = std::min(count-sent, MMSG_BATCH_SIZE);
+        memset(hdrs, 0, sizeof(hdrs[0])*n);
+        for (socklen_t i=0; i<n; i++) {
+            sock_msg_t& msg = msgs[sent+i];
+            iov[i].iov_base = msg.buffer;
+            iov[i].iov_len = msg.len;
+            to_native(msg.addr, addrs[i]);
+            hdrs[i].msg_hdr.msg_name = &addrs[i];
+            hdrs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            hdrs[i].msg_hdr.msg_iov = &iov[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int result = ::sendmmsg(socket.native_handle(), hdrs, n, 0);
+        if (result<0) {
+            if (errno==EAGAIN || errno==EWOULDBLOCK)
+                break;
+            return sent ? sent : -errno;
+        }
+        for (int i=0; i<result; i++) {
+            msgs[sent+i].result = hdrs[i].msg_len;
+        }
+        sent += result;
+        if (socklen_t(result)<n)
+            break;
+    }
+    return sent;
+}
+
+sock_result_t socket_receivefrom_batch(sock_handle_t sd, sock_msg_t* msgs, socklen_t count, uint32_t flags, void* reserved)
+{
+    if (simulated(sd))
+        return socket_receivefrom_loop(sd, msgs, count);
+
+    auto& socket = udp_from(sd);
+    if (!is_valid(socket) || !socket.is_open())
+        return -1;
+
+    mmsghdr hdrs[MMSG_BATCH_SIZE];
+    iovec iov[MMSG_BATCH_SIZE];
+    sockaddr_in addrs[MMSG_BATCH_SIZE];
+    socklen_t received = 0;
+    while (received<count) {
+        const socklen_t n = std::min(count-received, MMSG_BATCH_SIZE);
+        memset(hdrs, 0, sizeof(hdrs[0])*n);
+        for (socklen_t i=0; i<n; i++) {
+            sock_msg_t& msg = msgs[received+i];
+            iov[i].iov_base = msg.buffer;
+            iov[i].iov_len = msg.len;
+            hdrs[i].msg_hdr.msg_name = &addrs[i];
+            hdrs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            hdrs[i].msg_hdr.msg_iov = &iov[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int result = ::recvmmsg(socket.native_handle(), hdrs, n, MSG_DONTWAIT, nullptr);
+        if (result<0) {
+            if (errno==EAGAIN || errno==EWOULDBLOCK)
+                break;
+            return received ? received : -errno;
+        }
+        for (int i=0; i<result; i++) {
+            sock_msg_t& msg = msgs[received+i];
+            msg.result = hdrs[i].msg_len;
+            from_native(addrs[i], msg.addr);
+        }
+        received += result;
+        if (socklen_t(result)<n)
+            break;
+    }
+    return received;
+}
+
+namespace {
+
+sock_result_t host_poll(sock_poll_t* fds, socklen_t count, system_tick_t timeout)
+{
+    std::vector<pollfd> pfds(count);
+    for (socklen_t i=0; i<count; i++) {
+        const sock_handle_t sd = fds[i].sock;
+        int fd = -1;
+        if (servers.is_valid(sd)) {
+            TCPServer* server = servers.from(sd);
+            if (server)
+                fd = server->native_handle();
+        }
+        else if (is_tcp_socket(sd) && tcp_from(sd).is_open()) {
+            fd = tcp_from(sd).native_handle();
+        }
+        else if (is_udp_socket(sd) && udp_from(sd).is_open()) {
+            fd = udp_from(sd).native_handle();
+        }
+        pfds[i].fd = fd;
+        pfds[i].events = ((fds[i].events & SOCKET_POLL_READ) ? POLLIN : 0) |
+                ((fds[i].events & SOCKET_POLL_WRITE) ? POLLOUT : 0);
+        pfds[i].revents = 0;
+        fds[i].revents = 0;
+    }
+
+    int result = 0;
+    for (socklen_t i=0; i<count; i++) {
+        if (pfds[i].fd<0) {
+            fds[i].revents = SOCKET_POLL_ERROR;
+            result++;
+        }
+    }
+    if (result)
+        return result;
+
+    result = ::poll(pfds.data(), count, timeout);
+    if (result<0)
+        return SYSTEM_ERROR_IO;
+
+    for (socklen_t i=0; i<count; i++) {
+        const short revents = pfds[i].revents;
+        fds[i].revents = ((revents & POLLIN) ? SOCKET_POLL_READ : 0) |
+                ((revents & POLLOUT) ? SOCKET_POLL_WRITE : 0) |
+                ((revents & (POLLERR | POLLHUP | POLLNVAL)) ? SOCKET_POLL_ERROR : 0);
+    }
+    return result;
+}
+
+/**
+ * Polls the simulated sockets until one is ready or the timeout expires, the others with
+ * the host poll.
+ */
+sock_result_t simulated_poll(sock_poll_t* fds, socklen_t count, system_tick_t timeout)
+{
+    const system_tick_t start = HAL_Timer_Get_Milli_Seconds();
+    for (;;) {
+        int result = 0;
+        for (socklen_t i=0; i<count; i++) {
+            if (SimulatedSocket* s = simulated(fds[i].sock)) {
+                fds[i].revents = ((fds[i].events & SOCKET_POLL_READ) && simulated_readable(fds[i].sock, *s) ? SOCKET_POLL_READ : 0) |
+                        (fds[i].events & SOCKET_POLL_WRITE);
+            }
+            else if (host_poll(&fds[i], 1, 0)<0) {
+                return SYSTEM_ERROR_IO;
+            }
+            if (fds[i].revents)
+                result++;
+        }
+        if (result || HAL_Timer_Get_Milli_Seconds()-start>=timeout)
+            return result;
+        HAL_Delay_Milliseconds(1);
+    }
+}
+
+} // namespace
+
+sock_result_t socket_poll(sock_poll_t* fds, socklen_t count, system_tick_t timeout, void* reserved)
+{
+    if (Network::installed())
+        return simulated_poll(fds, count, timeout);
+    return host_poll(fds, count, timeout);
+}
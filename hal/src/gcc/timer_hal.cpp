@@ -1,12 +1,20 @@
 
 #include "timer_hal.h"
+#include "simulation.h"
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 auto start = boost::posix_time::microsec_clock::universal_time();
 
+using particle::simulation::Scheduler;
+
 system_tick_t HAL_Timer_Get_Micro_Seconds(void)
 {
+    if (Scheduler* scheduler = Scheduler::installed())
+    {
+        scheduler->sync();
+        return scheduler->now();
+    }
     auto now = boost::posix_time::microsec_clock::universal_time();
     auto diff = now - start;
     return diff.total_microseconds();
@@ -14,6 +22,11 @@ system_tick_t HAL_Timer_Get_Micro_Seconds(void)
 
 system_tick_t HAL_Timer_Get_Milli_Seconds(void)
 {
+    if (Scheduler* scheduler = Scheduler::installed())
+    {
+        scheduler->sync();
+        return scheduler->now() / particle::simulation::MICROS_PER_MILLI;
+    }
     auto now = boost::posix_time::microsec_clock::universal_time();
     auto diff = now - start;
     return diff.total_milliseconds();
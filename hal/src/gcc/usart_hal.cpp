@@ -1,9 +1,11 @@
 /* Includes ------------------------------------------------------------------*/
 #include "usart_hal.h"
 #include "socket_hal.h"
+#include "byte_ringbuf.h"
+#include <algorithm>
 
 struct Usart {
-    virtual void init(Ring_Buffer *rx_buffer, Ring_Buffer *tx_buffer)=0;
+    virtual void init(uint8_t* rx_buffer, size_t rx_size, uint8_t* tx_buffer, size_t tx_size)=0;
     virtual void begin(uint32_t baud)=0;
     virtual void end()=0;
     virtual int32_t available()=0;
@@ -11,6 +13,9 @@ struct Usart {
     virtual int32_t read()=0;
     virtual int32_t peek()=0;
     virtual uint32_t write(uint8_t byte)=0;
+    virtual uint32_t write(const uint8_t* data, uint32_t size, bool blocking)=0;
+    virtual uint32_t read(uint8_t* data, uint32_t size)=0;
+    virtual uint32_t peekBuffer(const uint8_t** data)=0;
     virtual void flush()=0;
 
     bool enabled() { return true; }
@@ -21,8 +26,8 @@ const sock_handle_t SOCKET_INVALID = sock_handle_t(-1);
 class SocketUsartBase : public Usart
 {
     private:
-        Ring_Buffer* rx;
-        Ring_Buffer* tx;
+        byte_ringbuf_t rx;
+        byte_ringbuf_t tx;
 
     protected:
         sock_handle_t socket;
@@ -32,46 +37,27 @@ class SocketUsartBase : public Usart
 
         virtual bool initSocket()=0;
 
-        inline int32_t read_char(bool peek=false)
-        {
-            if (rx->tail==rx->head)
-                return -1;
-
-            int32_t c = rx->buffer[rx->tail];
-            if (!peek)
-                rx->tail = (rx->tail+1) % SERIAL_BUFFER_SIZE;
-            return c;
-        }
-
-        inline void write_char(unsigned char c)
-        {
-            unsigned i = (unsigned int)(tx->head + 1) % SERIAL_BUFFER_SIZE;
-            if (i != tx->tail)
-            {
-                tx->buffer[tx->head] = c;
-                tx->head = i;
-            }
-        }
-
         void fillFromSocketIfNeeded() {
-            int space;
-            if (rx->head>rx->tail) {    // head after tail, so can fill up to end of buffer
-                space = SERIAL_BUFFER_SIZE-rx->tail;
-            }
-            else {
-                space = rx->tail-rx->head;  // may be 0
-            }
-            if (socket!=SOCKET_INVALID && space>0) {
-                socket_receive(socket, rx->buffer+rx->head, space, 0);
+            // Receive directly into the free space at the head, then after wrapping around
+            for (int i = 0; i < 2 && socket!=SOCKET_INVALID; i++) {
+                const uint32_t space = ring_space_contig(rx.size, rx.head, rx.tail);
+                if (!space) {
+                    break;
+                }
+                const sock_result_t n = socket_receive(socket, rx.buffer+rx.head, space, 0);
+                if (n <= 0) {
+                    break;
+                }
+                rx.head = ring_wrap(rx.size, rx.head + n);
             }
         }
 
 
     public:
-        virtual void init(Ring_Buffer *rx_buffer, Ring_Buffer *tx_buffer) override
+        virtual void init(uint8_t* rx_buffer, size_t rx_size, uint8_t* tx_buffer, size_t tx_size) override
         {
-            this->rx = rx_buffer;
-            this->tx = tx_buffer;
+            byte_ringbuf_init(&rx, rx_buffer, rx_size);
+            byte_ringbuf_init(&tx, tx_buffer, tx_size);
         }
 
         virtual void end() override {
@@ -83,23 +69,44 @@ class SocketUsartBase : public Usart
 
         virtual int32_t available() override {
             fillFromSocketIfNeeded();
-            return (rx->head-rx->tail) % SERIAL_BUFFER_SIZE;
+            return byte_ringbuf_data_avail(&rx);
         }
         virtual int32_t availableForWrite() override {
-            return (SERIAL_BUFFER_SIZE + tx->head - tx->tail) % SERIAL_BUFFER_SIZE;
+            // Data is sent to the socket right away
+            return tx.size ? tx.size - 1 : 0;
         }
         virtual int32_t read() override {
             fillFromSocketIfNeeded();
-            return read_char();
+            return byte_ringbuf_get(&rx);
         }
         virtual int32_t peek() override {
             fillFromSocketIfNeeded();
-            return read_char(true);
+            return byte_ringbuf_peek(&rx);
+        }
+        virtual uint32_t read(uint8_t* data, uint32_t size) override {
+            fillFromSocketIfNeeded();
+            return byte_ringbuf_read(&rx, data, size);
+        }
+        virtual uint32_t peekBuffer(const uint8_t** data) override {
+            fillFromSocketIfNeeded();
+            *data = rx.buffer + rx.tail;
+            return byte_ringbuf_data_contig(&rx);
         }
         virtual uint32_t write(uint8_t byte) override {
+            return write(&byte, 1, true);
+        }
+        virtual uint32_t write(const uint8_t* data, uint32_t size, bool blocking) override {
             if (!initSocket())
                 return 0;
-            return socket_send(socket, &byte, 1);
+            // Sending to the socket waits until it's all gone, so without blocking only
+            // as much is taken as availableForWrite() promises
+            if (!blocking) {
+                size = std::min<uint32_t>(size, availableForWrite());
+            }
+            if (!size)
+                return 0;
+            const sock_result_t n = socket_send(socket, data, size);
+            return n > 0 ? n : 0;
         }
 };
 
@@ -180,7 +187,28 @@ static SocketUsartClient usart2 = SocketUsartClient();
 
 void HAL_USART_Init(HAL_USART_Serial serial, Ring_Buffer *rx_buffer, Ring_Buffer *tx_buffer)
 {
-    usartMap(serial).init(rx_buffer, tx_buffer);
+    // Only 8-bit data is exchanged with the socket, so the buffers are used as byte storage
+    usartMap(serial).init((uint8_t*)rx_buffer->buffer, sizeof(rx_buffer->buffer), (uint8_t*)tx_buffer->buffer, sizeof(tx_buffer->buffer));
+}
+
+void HAL_USART_Init_Ex(HAL_USART_Serial serial, const HAL_USART_Buffer_Config* config, void* reserved)
+{
+    usartMap(serial).init(config->rx_buffer, config->rx_buffer_size, config->tx_buffer, config->tx_buffer_size);
+}
+
+uint32_t HAL_USART_Write_Bytes(HAL_USART_Serial serial, const uint8_t* data, uint32_t size, bool blocking)
+{
+    return usartMap(serial).write(data, size, blocking);
+}
+
+uint32_t HAL_USART_Read_Bytes(HAL_USART_Serial serial, uint8_t* data, uint32_t size)
+{
+    return usartMap(serial).read(data, size);
+}
+
+uint32_t HAL_USART_Peek_Buffer(HAL_USART_Serial serial, const uint8_t** data)
+{
+    return usartMap(serial).peekBuffer(data);
 }
 
 void HAL_USART_Begin(HAL_USART_Serial serial, uint32_t baud)
@@ -246,6 +274,11 @@ void HAL_USART_Send_Break(HAL_USART_Serial serial, void* reserved)
 }
 
 uint8_t HAL_USART_Break_Detected(HAL_USART_Serial serial)
+{
+  return 0;
+}
+
+uint8_t HAL_USART_Rx_Overrun(HAL_USART_Serial serial, void* reserved)
 {
   return 0;
 }
\ No newline at end of file
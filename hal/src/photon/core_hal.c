@@ -50,6 +50,7 @@ const unsigned USART2Index = 54;
 const unsigned ButtonExtiIndex = BUTTON1_EXTI_IRQ_INDEX;
 const unsigned TIM7Index = 71;
 const unsigned DMA2Stream2Index = 74;
+const unsigned DMA1Stream5Index = 32;
 const unsigned CAN2_TX_IRQHandler_Idx               = 79;
 const unsigned CAN2_RX0_IRQHandler_Idx              = 80;
 const unsigned CAN2_RX1_IRQHandler_Idx              = 81;
@@ -77,6 +78,7 @@ void HAL_Core_Setup_override_interrupts(void) {
     isrs[ButtonExtiIndex] = (uint32_t)Mode_Button_EXTI_irq;
     isrs[TIM7Index] = (uint32_t)TIM7_override;  // WICED uses this for a JTAG watchdog handler
     isrs[DMA2Stream2Index] = (uint32_t)DMA2_Stream2_irq_override;
+    isrs[DMA1Stream5Index] = (uint32_t)DMA1_Stream5_irq_override;
     isrs[CAN2_TX_IRQHandler_Idx]            = (uint32_t)CAN2_TX_irq;
     isrs[CAN2_RX0_IRQHandler_Idx]           = (uint32_t)CAN2_RX0_irq;
     isrs[CAN2_RX1_IRQHandler_Idx]           = (uint32_t)CAN2_RX1_irq;
@@ -24,6 +24,7 @@
  */
 
 #include "socket_hal.h"
+#include "system_error.h"
 #include "wiced.h"
 #include "service_debug.h"
 #include "spark_macros.h"
@@ -1104,3 +1105,10 @@ sock_result_t socket_peer(sock_handle_t sd, sock_peer_t* peer, void* reserved)
     }
     return result;
 }
+
+#include "socket_batch.h"
+
+sock_result_t socket_poll(sock_poll_t* fds, socklen_t count, system_tick_t timeout, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
@@ -85,6 +85,15 @@ void DMA1_Stream7_irq(void);
 void DMA2_Stream5_irq(void);
 void DMA1_Stream2_irq(void);
 void DMA2_Stream2_irq_override(void);
+void DMA1_Stream5_irq_override(void);
+void DMA1_Stream1_irq_override(void);
+void DMA1_Stream0_irq_override(void);
+
+/**
+ * Handles the interrupt of a DMA stream used by a USART to receive, returns false if no
+ * USART receives with the stream. Called by the handlers of the streams shared with SPI.
+ */
+bool HAL_USART_Rx_DMA_Stream_Handler(DMA_Stream_TypeDef* stream);
 
 void EXTI0_IRQHandler(void);
 void EXTI1_IRQHandler(void);
@@ -30,6 +30,7 @@
 #include "pinmap_impl.h"
 #include "interrupts_hal.h"
 #include "debug.h"
+#include "core_hal_stm32f2xx.h"
 
 /* Private define ------------------------------------------------------------*/
 #if PLATFORM_ID == 10 // Electron
@@ -609,6 +610,9 @@ void DMA2_Stream5_irq(void)
  */
 void DMA1_Stream2_irq(void)
 {
+    // UART4 RX shares the stream with SPI3 RX
+    if (HAL_USART_Rx_DMA_Stream_Handler(DMA1_Stream2))
+        return;
     //HAL_SPI_INTERFACE2 and HAL_SPI_INTERFACE3 shares same DMA peripheral and stream
 #if TOTAL_SPI==3
     if (spiState[HAL_SPI_INTERFACE3].SPI_DMA_Configured)
@@ -625,6 +629,9 @@ void DMA1_Stream2_irq(void)
  */
 void DMA2_Stream2_irq_override(void)
 {
+    // USART1 RX shares the stream with SPI1 RX
+    if (HAL_USART_Rx_DMA_Stream_Handler(DMA2_Stream2))
+        return;
     HAL_SPI_RX_DMA_Stream_InterruptHandler(HAL_SPI_INTERFACE1);
 }
 
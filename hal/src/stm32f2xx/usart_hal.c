@@ -30,6 +30,8 @@
 #include "stm32f2xx.h"
 #include <string.h>
 #include "interrupts_hal.h"
+#include "byte_ringbuf.h"
+#include "core_hal_stm32f2xx.h"
 
 /* Private typedef -----------------------------------------------------------*/
 typedef enum USART_Num_Def {
@@ -73,8 +75,37 @@ typedef struct STM32_USART_Info {
 	bool usart_transmitting;
 
 	uint32_t usart_config;
+
+	// Byte buffers used instead of the Ring_Buffers when initialized with HAL_USART_Init_Ex()
+	bool usart_byte_buffers;
+	uint16_t usart_buffer_flags;
+	byte_ringbuf_t usart_rx_ring;
+	byte_ringbuf_t usart_tx_ring;
+	// Number of bytes handed to the TX DMA stream and not yet released from usart_tx_ring
+	volatile uint32_t usart_tx_dma_count;
+	// Set when received data was lost, cleared by HAL_USART_Rx_Overrun()
+	volatile bool usart_rx_overrun;
+	// Set when the RX DMA stream overwrote unread data, cleared by the reader once it has moved the read position
+	volatile bool usart_rx_resync;
 } STM32_USART_Info;
 
+typedef struct STM32_USART_DMA_Info {
+	uint32_t dma_clock_en;
+
+	DMA_Stream_TypeDef* rx_stream;
+	uint32_t rx_flags;
+	uint32_t rx_ht_flag;
+	uint32_t rx_tc_flag;
+	IRQn_Type rx_irq;
+
+	DMA_Stream_TypeDef* tx_stream;
+	uint32_t tx_flags;
+} STM32_USART_DMA_Info;
+
+#define USART_DMA_FLAGS(n) (DMA_FLAG_TCIF##n | DMA_FLAG_HTIF##n | DMA_FLAG_TEIF##n | DMA_FLAG_DMEIF##n | DMA_FLAG_FEIF##n)
+// RX stream, its flags, its half transfer and transfer complete flags and its interrupt
+#define USART_DMA_RX(d, n) DMA##d##_Stream##n, USART_DMA_FLAGS(n), DMA_FLAG_HTIF##n, DMA_FLAG_TCIF##n, DMA##d##_Stream##n##_IRQn
+
 /*
  * USART mapping
  */
@@ -106,6 +137,30 @@ STM32_USART_Info USART_MAP[TOTAL_USARTS] =
 #endif
 };
 
+/*
+ * USART DMA mapping, indexed like USART_MAP. All USART requests are on DMA channel 4.
+ * Note that some of the streams are shared with the SPI DMA streams (USART1 RX with SPI1 RX,
+ * UART4 RX with SPI3 RX and UART5 TX with SPI3 TX), so DMA transfers on those SPI
+ * peripherals can't be used together with DMA on the corresponding USART.
+ */
+static const STM32_USART_DMA_Info USART_DMA_MAP[TOTAL_USARTS] =
+{
+		/*
+		 * DMA clock enable bit value (RCC_AHB1Periph_DMAx)
+		 * RX stream, RX stream flags, half transfer and transfer complete flags, RX stream interrupt
+		 * TX stream, TX stream flags
+		 */
+		{ RCC_AHB1Periph_DMA2, USART_DMA_RX(2, 2), DMA2_Stream7, USART_DMA_FLAGS(7) }, // USART 1
+		{ RCC_AHB1Periph_DMA1, USART_DMA_RX(1, 5), DMA1_Stream6, USART_DMA_FLAGS(6) } // USART 2
+#if PLATFORM_ID == 10 // Electron
+		,{ RCC_AHB1Periph_DMA1, USART_DMA_RX(1, 1), DMA1_Stream3, USART_DMA_FLAGS(3) } // USART 3
+		,{ RCC_AHB1Periph_DMA1, USART_DMA_RX(1, 2), DMA1_Stream4, USART_DMA_FLAGS(4) } // UART 4
+		,{ RCC_AHB1Periph_DMA1, USART_DMA_RX(1, 0), DMA1_Stream7, USART_DMA_FLAGS(7) } // UART 5
+#endif
+};
+
+#define USART_DMA_CHANNEL DMA_Channel_4
+
 static USART_InitTypeDef USART_InitStructure;
 static STM32_USART_Info *usartMap[TOTAL_USARTS]; // pointer to USART_MAP[] containing USART peripheral register locations (etc)
 
@@ -128,6 +183,12 @@ inline void store_char(uint16_t c, Ring_Buffer *buffer)
 static uint8_t HAL_USART_Calculate_Word_Length(uint32_t config, uint8_t noparity);
 static uint32_t HAL_USART_Calculate_Data_Bits_Mask(uint32_t config);
 static uint8_t HAL_USART_Validate_Config(uint32_t config);
+static void HAL_USART_Map_Serial(HAL_USART_Serial serial);
+static void HAL_USART_Configure_DMA(HAL_USART_Serial serial);
+static void HAL_USART_Rx_DMA_Update(HAL_USART_Serial serial);
+static void HAL_USART_Rx_DMA_Sync(HAL_USART_Serial serial);
+static void HAL_USART_Tx_DMA_Start(HAL_USART_Serial serial);
+static void HAL_USART_Handler(HAL_USART_Serial serial);
 
 uint8_t HAL_USART_Calculate_Word_Length(uint32_t config, uint8_t noparity)
 {
@@ -191,7 +252,7 @@ uint8_t HAL_USART_Validate_Config(uint32_t config)
 	return 1;
 }
 
-void HAL_USART_Init(HAL_USART_Serial serial, Ring_Buffer *rx_buffer, Ring_Buffer *tx_buffer)
+void HAL_USART_Map_Serial(HAL_USART_Serial serial)
 {
 	if(serial == HAL_USART_SERIAL1)
 	{
@@ -215,7 +276,49 @@ void HAL_USART_Init(HAL_USART_Serial serial, Ring_Buffer *rx_buffer, Ring_Buffer
 		usartMap[serial] = &USART_MAP[USART_C1_C0];
 	}
 #endif
+}
+
+static inline const STM32_USART_DMA_Info* HAL_USART_DMA_Info(HAL_USART_Serial serial)
+{
+	return &USART_DMA_MAP[usartMap[serial] - USART_MAP];
+}
+
+static inline bool HAL_USART_Rx_DMA_Enabled(HAL_USART_Serial serial)
+{
+	return usartMap[serial]->usart_byte_buffers && (usartMap[serial]->usart_buffer_flags & HAL_USART_BUFFER_DMA_RX);
+}
+
+static inline bool HAL_USART_Tx_DMA_Enabled(HAL_USART_Serial serial)
+{
+	return usartMap[serial]->usart_byte_buffers && (usartMap[serial]->usart_buffer_flags & HAL_USART_BUFFER_DMA_TX);
+}
+
+static inline bool HAL_USART_Tx_Pending(HAL_USART_Serial serial)
+{
+	if (usartMap[serial]->usart_byte_buffers)
+		return byte_ringbuf_data_avail(&usartMap[serial]->usart_tx_ring) || usartMap[serial]->usart_tx_dma_count;
+	return usartMap[serial]->usart_tx_buffer->head != usartMap[serial]->usart_tx_buffer->tail;
+}
+
+static inline void HAL_USART_Clear_Buffers(HAL_USART_Serial serial)
+{
+	if (usartMap[serial]->usart_byte_buffers) {
+		byte_ringbuf_init(&usartMap[serial]->usart_rx_ring, usartMap[serial]->usart_rx_ring.buffer, usartMap[serial]->usart_rx_ring.size);
+		byte_ringbuf_init(&usartMap[serial]->usart_tx_ring, usartMap[serial]->usart_tx_ring.buffer, usartMap[serial]->usart_tx_ring.size);
+		usartMap[serial]->usart_tx_dma_count = 0;
+		usartMap[serial]->usart_rx_overrun = false;
+		usartMap[serial]->usart_rx_resync = false;
+	} else {
+		memset(usartMap[serial]->usart_rx_buffer, 0, sizeof(Ring_Buffer));
+		memset(usartMap[serial]->usart_tx_buffer, 0, sizeof(Ring_Buffer));
+	}
+}
 
+void HAL_USART_Init(HAL_USART_Serial serial, Ring_Buffer *rx_buffer, Ring_Buffer *tx_buffer)
+{
+	HAL_USART_Map_Serial(serial);
+
+	usartMap[serial]->usart_byte_buffers = false;
 	usartMap[serial]->usart_rx_buffer = rx_buffer;
 	usartMap[serial]->usart_tx_buffer = tx_buffer;
 
@@ -226,6 +329,163 @@ void HAL_USART_Init(HAL_USART_Serial serial, Ring_Buffer *rx_buffer, Ring_Buffer
 	usartMap[serial]->usart_transmitting = false;
 }
 
+void HAL_USART_Init_Ex(HAL_USART_Serial serial, const HAL_USART_Buffer_Config* config, void* reserved)
+{
+	HAL_USART_Map_Serial(serial);
+
+	usartMap[serial]->usart_byte_buffers = true;
+	usartMap[serial]->usart_buffer_flags = config->flags;
+	byte_ringbuf_init(&usartMap[serial]->usart_rx_ring, config->rx_buffer, config->rx_buffer_size);
+	byte_ringbuf_init(&usartMap[serial]->usart_tx_ring, config->tx_buffer, config->tx_buffer_size);
+	usartMap[serial]->usart_tx_dma_count = 0;
+
+	usartMap[serial]->usart_enabled = false;
+	usartMap[serial]->usart_transmitting = false;
+}
+
+void HAL_USART_Configure_DMA(HAL_USART_Serial serial)
+{
+	const STM32_USART_DMA_Info* dma = HAL_USART_DMA_Info(serial);
+	DMA_InitTypeDef DMA_InitStructure;
+
+	RCC_AHB1PeriphClockCmd(dma->dma_clock_en, ENABLE);
+
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = USART_DMA_CHANNEL;
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&usartMap[serial]->usart_peripheral->DR;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+
+	if (HAL_USART_Rx_DMA_Enabled(serial)) {
+		// The receive buffer is filled continuously, the read position is tracked by the ring buffer
+		DMA_DeInit(dma->rx_stream);
+		DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+		DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)usartMap[serial]->usart_rx_ring.buffer;
+		DMA_InitStructure.DMA_BufferSize = usartMap[serial]->usart_rx_ring.size;
+		DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+		DMA_Init(dma->rx_stream, &DMA_InitStructure);
+		DMA_ClearFlag(dma->rx_stream, dma->rx_flags);
+		// The half transfer and transfer complete interrupts publish the position at least
+		// twice per lap of the buffer, so a continuous stream without idle gaps can't lap it unnoticed
+		DMA_ITConfig(dma->rx_stream, DMA_IT_HT | DMA_IT_TC, ENABLE);
+		NVIC_InitTypeDef NVIC_InitStructure;
+		NVIC_InitStructure.NVIC_IRQChannel = dma->rx_irq;
+		NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 7;
+		NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+		NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+		NVIC_Init(&NVIC_InitStructure);
+		DMA_Cmd(dma->rx_stream, ENABLE);
+		USART_DMACmd(usartMap[serial]->usart_peripheral, USART_DMAReq_Rx, ENABLE);
+	}
+
+	if (HAL_USART_Tx_DMA_Enabled(serial)) {
+		// Memory address and length are set for each contiguous block in HAL_USART_Tx_DMA_Start()
+		DMA_DeInit(dma->tx_stream);
+		DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+		DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)usartMap[serial]->usart_tx_ring.buffer;
+		DMA_InitStructure.DMA_BufferSize = 1;
+		DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+		DMA_Init(dma->tx_stream, &DMA_InitStructure);
+		USART_DMACmd(usartMap[serial]->usart_peripheral, USART_DMAReq_Tx, ENABLE);
+	}
+}
+
+// Moves the receive buffer head to the current RX DMA position. Only the head is moved, so
+// that the interrupt handlers never race the reader for the tail of the buffer
+void HAL_USART_Rx_DMA_Update(HAL_USART_Serial serial)
+{
+	byte_ringbuf_t* rx = &usartMap[serial]->usart_rx_ring;
+	int overrun = 0;
+	int32_t state = HAL_disable_irq();
+	byte_ringbuf_dma_produced(rx, rx->size - DMA_GetCurrDataCounter(HAL_USART_DMA_Info(serial)->rx_stream), &overrun);
+	if (overrun) {
+		usartMap[serial]->usart_rx_overrun = true;
+		usartMap[serial]->usart_rx_resync = true;
+	}
+	HAL_enable_irq(state);
+}
+
+// Called by the reader before it looks at the receive buffer: updates the head and, if the
+// RX DMA stream overwrote unread data, skips the read position past it
+void HAL_USART_Rx_DMA_Sync(HAL_USART_Serial serial)
+{
+	int32_t state = HAL_disable_irq();
+	HAL_USART_Rx_DMA_Update(serial);
+	if (usartMap[serial]->usart_rx_resync) {
+		byte_ringbuf_dma_resync(&usartMap[serial]->usart_rx_ring);
+		usartMap[serial]->usart_rx_resync = false;
+	}
+	HAL_enable_irq(state);
+}
+
+bool HAL_USART_Rx_DMA_Stream_Handler(DMA_Stream_TypeDef* stream)
+{
+	for (int serial = 0; serial < TOTAL_USARTS; serial++) {
+		if (!usartMap[serial] || !usartMap[serial]->usart_enabled || !HAL_USART_Rx_DMA_Enabled(serial))
+			continue;
+		const STM32_USART_DMA_Info* dma = HAL_USART_DMA_Info(serial);
+		if (dma->rx_stream != stream)
+			continue;
+		// Each event is half a lap after the previous one. If both are pending, one of them
+		// wasn't serviced in time and the position may have wrapped past the last one seen
+		const bool ht = DMA_GetFlagStatus(stream, dma->rx_ht_flag) != RESET;
+		const bool tc = DMA_GetFlagStatus(stream, dma->rx_tc_flag) != RESET;
+		DMA_ClearFlag(stream, dma->rx_ht_flag | dma->rx_tc_flag);
+		if (ht && tc)
+			usartMap[serial]->usart_rx_overrun = true;
+		HAL_USART_Rx_DMA_Update(serial);
+		return true;
+	}
+	return false;
+}
+
+// RX DMA stream interrupts of the USARTs whose stream isn't shared with SPI
+
+void DMA1_Stream5_irq_override(void)
+{
+	HAL_USART_Rx_DMA_Stream_Handler(DMA1_Stream5);
+}
+
+#if PLATFORM_ID == 10 // Electron
+void DMA1_Stream1_irq_override(void)
+{
+	HAL_USART_Rx_DMA_Stream_Handler(DMA1_Stream1);
+}
+
+void DMA1_Stream0_irq_override(void)
+{
+	HAL_USART_Rx_DMA_Stream_Handler(DMA1_Stream0);
+}
+#endif
+
+// Starts sending the next contiguous block of the transmit buffer if the TX DMA stream is idle.
+// Must be called with interrupts disabled or from the USART interrupt handler.
+void HAL_USART_Tx_DMA_Start(HAL_USART_Serial serial)
+{
+	if (usartMap[serial]->usart_tx_dma_count)
+		return;
+
+	uint32_t count = byte_ringbuf_data_contig(&usartMap[serial]->usart_tx_ring);
+	if (!count) {
+		USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_TC, DISABLE);
+		return;
+	}
+
+	const STM32_USART_DMA_Info* dma = HAL_USART_DMA_Info(serial);
+	usartMap[serial]->usart_tx_dma_count = count;
+	DMA_ClearFlag(dma->tx_stream, dma->tx_flags);
+	DMA_MemoryTargetConfig(dma->tx_stream, (uint32_t)(usartMap[serial]->usart_tx_ring.buffer + usartMap[serial]->usart_tx_ring.tail), DMA_Memory_0);
+	DMA_SetCurrDataCounter(dma->tx_stream, count);
+	// Transmission complete interrupt releases the block once it's on the wire
+	USART_ClearFlag(usartMap[serial]->usart_peripheral, USART_FLAG_TC);
+	DMA_Cmd(dma->tx_stream, ENABLE);
+	USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_TC, ENABLE);
+}
+
 void HAL_USART_Begin(HAL_USART_Serial serial, uint32_t baud)
 {
 	HAL_USART_BeginConfig(serial, baud, 0, 0); // Default serial configuration is 8N1
@@ -400,15 +660,28 @@ void HAL_USART_BeginConfig(HAL_USART_Serial serial, uint32_t baud, uint32_t conf
 	usartMap[serial]->usart_enabled = true;
 	usartMap[serial]->usart_transmitting = false;
 
-	// Enable USART Receive and Transmit interrupts
-	USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_TXE, ENABLE);
-	USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_RXNE, ENABLE);
+	if (usartMap[serial]->usart_byte_buffers) {
+		HAL_USART_Clear_Buffers(serial);
+		HAL_USART_Configure_DMA(serial);
+	}
+
+	// Enable USART Receive and Transmit interrupts. With DMA the idle line interrupt makes
+	// received data visible after a burst, the RX stream interrupts during a long one, and
+	// the transmission complete interrupt starts the next block
+	if (!HAL_USART_Tx_DMA_Enabled(serial)) {
+		USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_TXE, ENABLE);
+	}
+	if (HAL_USART_Rx_DMA_Enabled(serial)) {
+		USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_IDLE, ENABLE);
+	} else {
+		USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_RXNE, ENABLE);
+	}
 }
 
 void HAL_USART_End(HAL_USART_Serial serial)
 {
 	// Wait for transmission of outgoing data
-	while (usartMap[serial]->usart_tx_buffer->head != usartMap[serial]->usart_tx_buffer->tail);
+	while (HAL_USART_Tx_Pending(serial));
 
 	// Disable the USART
 	USART_Cmd(usartMap[serial]->usart_peripheral, DISABLE);
@@ -422,6 +695,18 @@ void HAL_USART_End(HAL_USART_Serial serial)
 	// Disable USART Receive and Transmit interrupts
 	USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_RXNE, DISABLE);
 	USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_TXE, DISABLE);
+	USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_IDLE, DISABLE);
+	USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_TC, DISABLE);
+
+	// Stop the DMA streams. The RX stream interrupt may be shared with SPI, so only
+	// its sources are disabled
+	if (HAL_USART_Rx_DMA_Enabled(serial)) {
+		DMA_ITConfig(HAL_USART_DMA_Info(serial)->rx_stream, DMA_IT_HT | DMA_IT_TC, DISABLE);
+		DMA_Cmd(HAL_USART_DMA_Info(serial)->rx_stream, DISABLE);
+	}
+	if (HAL_USART_Tx_DMA_Enabled(serial)) {
+		DMA_Cmd(HAL_USART_DMA_Info(serial)->tx_stream, DISABLE);
+	}
 
 	NVIC_InitTypeDef NVIC_InitStructure;
 
@@ -434,14 +719,11 @@ void HAL_USART_End(HAL_USART_Serial serial)
 	// Disable USART Clock
 	*usartMap[serial]->usart_apbReg &= ~usartMap[serial]->usart_clock_en;
 
-	// clear any received data
-	usartMap[serial]->usart_rx_buffer->head = usartMap[serial]->usart_rx_buffer->tail;
-
 	// Undo any pin re-mapping done for this USART
 	// ...
 
-	memset(usartMap[serial]->usart_rx_buffer, 0, sizeof(Ring_Buffer));
-	memset(usartMap[serial]->usart_tx_buffer, 0, sizeof(Ring_Buffer));
+	// clear any received data
+	HAL_USART_Clear_Buffers(serial);
 
 	usartMap[serial]->usart_enabled = false;
 	usartMap[serial]->usart_transmitting = false;
@@ -454,6 +736,12 @@ uint32_t HAL_USART_Write_Data(HAL_USART_Serial serial, uint8_t data)
 
 uint32_t HAL_USART_Write_NineBitData(HAL_USART_Serial serial, uint16_t data)
 {
+	if (usartMap[serial]->usart_byte_buffers) {
+		// Byte buffers hold up to 8 data bits
+		uint8_t c = data & HAL_USART_Calculate_Data_Bits_Mask(usartMap[serial]->usart_config);
+		return HAL_USART_Write_Bytes(serial, &c, 1, true);
+	}
+
 	// Remove any bits exceeding data bits configured
 	data &= HAL_USART_Calculate_Data_Bits_Mask(usartMap[serial]->usart_config);
 	// interrupts are off and data in queue;
@@ -493,13 +781,97 @@ uint32_t HAL_USART_Write_NineBitData(HAL_USART_Serial serial, uint16_t data)
 	return 1;
 }
 
+uint32_t HAL_USART_Write_Bytes(HAL_USART_Serial serial, const uint8_t* data, uint32_t size, bool blocking)
+{
+	if (!usartMap[serial]->usart_byte_buffers) {
+		uint32_t written = 0;
+		while (written < size && (blocking || HAL_USART_Available_Data_For_Write(serial) > 0)) {
+			written += HAL_USART_Write_NineBitData(serial, data[written]);
+		}
+		return written;
+	}
+
+	byte_ringbuf_t* tx = &usartMap[serial]->usart_tx_ring;
+	uint32_t written = 0;
+	for (;;) {
+		written += byte_ringbuf_write(tx, data + written, size - written);
+		usartMap[serial]->usart_transmitting = true;
+		if (HAL_USART_Tx_DMA_Enabled(serial)) {
+			int32_t state = HAL_disable_irq();
+			HAL_USART_Tx_DMA_Start(serial);
+			HAL_enable_irq(state);
+		} else {
+			USART_ITConfig(usartMap[serial]->usart_peripheral, USART_IT_TXE, ENABLE);
+		}
+		// Called with interrupts off, e.g. on panic: get the data out by servicing the USART here
+		const bool polled = (__get_PRIMASK() & 1);
+		if (written == size && !(polled && HAL_USART_Tx_Pending(serial)))
+			break;
+		if (!blocking && !polled)
+			break;
+		if (polled)
+			HAL_USART_Handler(serial);
+	}
+	return written;
+}
+
+uint32_t HAL_USART_Read_Bytes(HAL_USART_Serial serial, uint8_t* data, uint32_t size)
+{
+	if (!usartMap[serial]->usart_byte_buffers) {
+		uint32_t count = 0;
+		int32_t c;
+		while (count < size && (c = HAL_USART_Read_Data(serial)) >= 0) {
+			if (data)
+				data[count] = c;
+			count++;
+		}
+		return count;
+	}
+
+	if (HAL_USART_Rx_DMA_Enabled(serial)) {
+		HAL_USART_Rx_DMA_Sync(serial);
+	}
+	const uint32_t count = byte_ringbuf_read(&usartMap[serial]->usart_rx_ring, data, size);
+	const uint8_t mask = HAL_USART_Calculate_Data_Bits_Mask(usartMap[serial]->usart_config);
+	if (data && mask != 0xff && HAL_USART_Rx_DMA_Enabled(serial)) {
+		// Remove parity bits from data received by DMA
+		for (uint32_t i = 0; i < count; ++i) {
+			data[i] &= mask;
+		}
+	}
+	return count;
+}
+
+uint32_t HAL_USART_Peek_Buffer(HAL_USART_Serial serial, const uint8_t** data)
+{
+	// Characters received by DMA with 7 data bits still carry the parity bit, so they have to be copied out
+	if (!usartMap[serial]->usart_byte_buffers ||
+			(HAL_USART_Rx_DMA_Enabled(serial) && HAL_USART_Calculate_Data_Bits_Mask(usartMap[serial]->usart_config) != 0xff))
+		return 0;
+
+	if (HAL_USART_Rx_DMA_Enabled(serial)) {
+		HAL_USART_Rx_DMA_Sync(serial);
+	}
+	*data = usartMap[serial]->usart_rx_ring.buffer + usartMap[serial]->usart_rx_ring.tail;
+	return byte_ringbuf_data_contig(&usartMap[serial]->usart_rx_ring);
+}
+
 int32_t HAL_USART_Available_Data(HAL_USART_Serial serial)
 {
+	if (usartMap[serial]->usart_byte_buffers) {
+		if (HAL_USART_Rx_DMA_Enabled(serial)) {
+			HAL_USART_Rx_DMA_Sync(serial);
+		}
+		return byte_ringbuf_data_avail(&usartMap[serial]->usart_rx_ring);
+	}
 	return (unsigned int)(SERIAL_BUFFER_SIZE + usartMap[serial]->usart_rx_buffer->head - usartMap[serial]->usart_rx_buffer->tail) % SERIAL_BUFFER_SIZE;
 }
 
 int32_t HAL_USART_Available_Data_For_Write(HAL_USART_Serial serial)
 {
+	if (usartMap[serial]->usart_byte_buffers)
+		return byte_ringbuf_space_avail(&usartMap[serial]->usart_tx_ring);
+
 	int32_t tail = usartMap[serial]->usart_tx_buffer->tail;
 	int32_t available = SERIAL_BUFFER_SIZE - (usartMap[serial]->usart_tx_buffer->head >= tail ?
 		usartMap[serial]->usart_tx_buffer->head - tail :
@@ -511,6 +883,11 @@ int32_t HAL_USART_Available_Data_For_Write(HAL_USART_Serial serial)
 
 int32_t HAL_USART_Read_Data(HAL_USART_Serial serial)
 {
+	if (usartMap[serial]->usart_byte_buffers) {
+		uint8_t c;
+		return HAL_USART_Read_Bytes(serial, &c, 1) ? c : -1;
+	}
+
 	// if the head isn't ahead of the tail, we don't have any characters
 	if (usartMap[serial]->usart_rx_buffer->head == usartMap[serial]->usart_rx_buffer->tail)
 	{
@@ -526,6 +903,14 @@ int32_t HAL_USART_Read_Data(HAL_USART_Serial serial)
 
 int32_t HAL_USART_Peek_Data(HAL_USART_Serial serial)
 {
+	if (usartMap[serial]->usart_byte_buffers) {
+		if (HAL_USART_Rx_DMA_Enabled(serial)) {
+			HAL_USART_Rx_DMA_Sync(serial);
+		}
+		int32_t c = byte_ringbuf_peek(&usartMap[serial]->usart_rx_ring);
+		return c < 0 ? c : (c & HAL_USART_Calculate_Data_Bits_Mask(usartMap[serial]->usart_config));
+	}
+
 	if (usartMap[serial]->usart_rx_buffer->head == usartMap[serial]->usart_rx_buffer->tail)
 	{
 		return -1;
@@ -539,9 +924,10 @@ int32_t HAL_USART_Peek_Data(HAL_USART_Serial serial)
 void HAL_USART_Flush_Data(HAL_USART_Serial serial)
 {
 	// Loop until USART DR register is empty
-	while ( usartMap[serial]->usart_tx_buffer->head != usartMap[serial]->usart_tx_buffer->tail );
-	// Loop until last frame transmission complete
-	while (usartMap[serial]->usart_transmitting && (USART_GetFlagStatus(usartMap[serial]->usart_peripheral, USART_FLAG_TC) == RESET));
+	while (HAL_USART_Tx_Pending(serial));
+	// Loop until last frame transmission complete. With DMA the last block is only released
+	// by the transmission complete interrupt, so it has been sent already
+	while (usartMap[serial]->usart_transmitting && !HAL_USART_Tx_DMA_Enabled(serial) && (USART_GetFlagStatus(usartMap[serial]->usart_peripheral, USART_FLAG_TC) == RESET));
 	usartMap[serial]->usart_transmitting = false;
 }
 
@@ -575,10 +961,85 @@ uint8_t HAL_USART_Break_Detected(HAL_USART_Serial serial)
 	return 0;
 }
 
+uint8_t HAL_USART_Rx_Overrun(HAL_USART_Serial serial, void* reserved)
+{
+	if (!usartMap[serial]->usart_byte_buffers)
+		return 0;
+	if (HAL_USART_Rx_DMA_Enabled(serial)) {
+		HAL_USART_Rx_DMA_Sync(serial);
+	}
+	int32_t state = HAL_disable_irq();
+	const bool overrun = usartMap[serial]->usart_rx_overrun;
+	usartMap[serial]->usart_rx_overrun = false;
+	HAL_enable_irq(state);
+	return overrun;
+}
+
+// Interrupt handler for USARTs initialized with HAL_USART_Init_Ex()
+static void HAL_USART_Byte_Buffers_Handler(HAL_USART_Serial serial)
+{
+	USART_TypeDef* usart = usartMap[serial]->usart_peripheral;
+
+	if (USART_GetITStatus(usart, USART_IT_IDLE) != RESET)
+	{
+		// Idle line after a burst of data: clear the flag by reading SR followed by DR
+		(void)usart->SR;
+		(void)usart->DR;
+		HAL_USART_Rx_DMA_Update(serial);
+	}
+
+	if (USART_GetITStatus(usart, USART_IT_RXNE) != RESET)
+	{
+		uint16_t c = USART_ReceiveData(usart);
+		c &= HAL_USART_Calculate_Data_Bits_Mask(usartMap[serial]->usart_config);
+		if (!byte_ringbuf_put(&usartMap[serial]->usart_rx_ring, c))
+			usartMap[serial]->usart_rx_overrun = true;
+	}
+
+	if (USART_GetITStatus(usart, USART_IT_TC) != RESET)
+	{
+		USART_ClearITPendingBit(usart, USART_IT_TC);
+		// TC can also be set when the DMA stream is late to refill DR, so check it has finished
+		if (usartMap[serial]->usart_tx_dma_count && !DMA_GetCurrDataCounter(HAL_USART_DMA_Info(serial)->tx_stream))
+		{
+			byte_ringbuf_consume(&usartMap[serial]->usart_tx_ring, usartMap[serial]->usart_tx_dma_count);
+			usartMap[serial]->usart_tx_dma_count = 0;
+			HAL_USART_Tx_DMA_Start(serial);
+		}
+	}
+
+	if (USART_GetITStatus(usart, USART_IT_TXE) != RESET)
+	{
+		int c = byte_ringbuf_get(&usartMap[serial]->usart_tx_ring);
+		if (c < 0)
+		{
+			// Buffer empty, so disable the USART Transmit interrupt
+			USART_ITConfig(usart, USART_IT_TXE, DISABLE);
+		}
+		else
+		{
+			USART_SendData(usart, c);
+		}
+	}
+
+	if (USART_GetFlagStatus(usart, USART_FLAG_ORE) != RESET)
+	{
+		// If Overrun flag is still set, clear it
+		(void)USART_ReceiveData(usart);
+		usartMap[serial]->usart_rx_overrun = true;
+	}
+}
+
 // Shared Interrupt Handler for USART2/Serial1 and USART1/Serial2
 // WARNING: This function MUST remain reentrance compliant -- no local static variables etc.
 static void HAL_USART_Handler(HAL_USART_Serial serial)
 {
+	if (usartMap[serial]->usart_byte_buffers)
+	{
+		HAL_USART_Byte_Buffers_Handler(serial);
+		return;
+	}
+
 	if(USART_GetITStatus(usartMap[serial]->usart_peripheral, USART_IT_RXNE) != RESET)
 	{
 		// Read byte from the receive data register
@@ -24,6 +24,7 @@
  */
 
 #include "socket_hal.h"
+#include "system_error.h"
 
 
 int32_t socket_connect(sock_handle_t sd, const sockaddr_t *addr, long addrlen)
@@ -117,3 +118,10 @@ sock_result_t socket_peer(sock_handle_t sd, sock_peer_t* peer, void* reserved)
 {
     return -1;
 }
+
+#include "socket_batch.h"
+
+sock_result_t socket_poll(sock_poll_t* fds, socklen_t count, system_tick_t timeout, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
@@ -69,4 +69,27 @@ bool HAL_USART_Is_Enabled(HAL_USART_Serial serial)
 
 void HAL_USART_Half_Duplex(HAL_USART_Serial serial, bool Enable)
 {
-}
\ No newline at end of file
+}
+void HAL_USART_Init_Ex(HAL_USART_Serial serial, const HAL_USART_Buffer_Config* config, void* reserved)
+{
+}
+
+uint32_t HAL_USART_Write_Bytes(HAL_USART_Serial serial, const uint8_t* data, uint32_t size, bool blocking)
+{
+    return 0;
+}
+
+uint32_t HAL_USART_Read_Bytes(HAL_USART_Serial serial, uint8_t* data, uint32_t size)
+{
+    return 0;
+}
+
+uint32_t HAL_USART_Peek_Buffer(HAL_USART_Serial serial, const uint8_t** data)
+{
+    return 0;
+}
+
+uint8_t HAL_USART_Rx_Overrun(HAL_USART_Serial serial, void* reserved)
+{
+    return 0;
+}
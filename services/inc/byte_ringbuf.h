@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BYTE_RINGBUF_H_
+#define BYTE_RINGBUF_H_
+
+#include "ringbuf_helper.h"
+#include <string.h>
+
+/*
+ * Single producer, single consumer byte ring buffer over caller-provided storage.
+ * One byte of storage is always kept free to tell a full buffer from an empty one.
+ *
+ * Either side can be driven by DMA: a circular DMA producer reports its position
+ * with byte_ringbuf_dma_produced(), and a DMA consumer transfers at most
+ * byte_ringbuf_data_contig() bytes at a time and releases them with byte_ringbuf_consume().
+ */
+typedef struct byte_ringbuf_t {
+    uint8_t* buffer;
+    uint32_t size;
+    volatile uint32_t head; // Write position
+    volatile uint32_t tail; // Read position
+} byte_ringbuf_t;
+
+static inline void byte_ringbuf_init(byte_ringbuf_t* rb, uint8_t* buffer, uint32_t size)
+{
+    rb->buffer = buffer;
+    rb->size = buffer ? size : 0;
+    rb->head = 0;
+    rb->tail = 0;
+}
+
+/* Discards all buffered data */
+static inline void byte_ringbuf_clear(byte_ringbuf_t* rb)
+{
+    rb->tail = rb->head;
+}
+
+static inline uint32_t byte_ringbuf_data_avail(const byte_ringbuf_t* rb)
+{
+    return ring_data_avail(rb->size, rb->head, rb->tail);
+}
+
+static inline uint32_t byte_ringbuf_space_avail(const byte_ringbuf_t* rb)
+{
+    return ring_space_avail(rb->size, rb->head, rb->tail);
+}
+
+/* Returns the number of bytes that can be read starting at the tail without wrapping */
+static inline uint32_t byte_ringbuf_data_contig(const byte_ringbuf_t* rb)
+{
+    return ring_data_contig(rb->size, rb->head, rb->tail);
+}
+
+/* Releases count bytes at the tail, e.g. after they were sent by DMA */
+static inline void byte_ringbuf_consume(byte_ringbuf_t* rb, uint32_t count)
+{
+    rb->tail = ring_wrap(rb->size, rb->tail + count);
+}
+
+/* Appends a byte, returns 0 if the buffer is full */
+static inline int byte_ringbuf_put(byte_ringbuf_t* rb, uint8_t c)
+{
+    const uint32_t head = rb->head;
+    const uint32_t next = ring_wrap(rb->size, head + 1);
+    if (next == rb->tail) {
+        return 0;
+    }
+    rb->buffer[head] = c;
+    rb->head = next;
+    return 1;
+}
+
+/* Returns the byte at the tail without removing it, or -1 if the buffer is empty */
+static inline int byte_ringbuf_peek(const byte_ringbuf_t* rb)
+{
+    if (rb->head == rb->tail) {
+        return -1;
+    }
+    return rb->buffer[rb->tail];
+}
+
+/* Removes and returns the byte at the tail, or -1 if the buffer is empty */
+static inline int byte_ringbuf_get(byte_ringbuf_t* rb)
+{
+    const uint32_t tail = rb->tail;
+    if (rb->head == tail) {
+        return -1;
+    }
+    const uint8_t c = rb->buffer[tail];
+    rb->tail = ring_wrap(rb->size, tail + 1);
+    return c;
+}
+
+/* Appends up to size bytes, returns the number of bytes that fit */
+static inline uint32_t byte_ringbuf_write(byte_ringbuf_t* rb, const uint8_t* data, uint32_t size)
+{
+    uint32_t head = rb->head;
+    const uint32_t tail = rb->tail;
+    uint32_t n = ring_space_avail(rb->size, head, tail);
+    if (n > size) {
+        n = size;
+    }
+    uint32_t contig = ring_space_contig(rb->size, head, tail);
+    if (contig > n) {
+        contig = n;
+    }
+    memcpy(rb->buffer + head, data, contig);
+    if (n > contig) {
+        memcpy(rb->buffer, data + contig, n - contig);
+    }
+    rb->head = ring_wrap(rb->size, head + n);
+    return n;
+}
+
+/* Removes up to size bytes and copies them to data unless it's NULL, returns the number of bytes removed */
+static inline uint32_t byte_ringbuf_read(byte_ringbuf_t* rb, uint8_t* data, uint32_t size)
+{
+    const uint32_t head = rb->head;
+    uint32_t tail = rb->tail;
+    uint32_t n = ring_data_avail(rb->size, head, tail);
+    if (n > size) {
+        n = size;
+    }
+    uint32_t contig = ring_data_contig(rb->size, head, tail);
+    if (contig > n) {
+        contig = n;
+    }
+    if (data) {
+        memcpy(data, rb->buffer + tail, contig);
+        if (n > contig) {
+            memcpy(data + contig, rb->buffer, n - contig);
+        }
+    }
+    rb->tail = ring_wrap(rb->size, tail + n);
+    return n;
+}
+
+/*
+ * Moves the head to the position of a circular DMA producer and returns the number of
+ * bytes received since the previous call. The position has to be reported at least once
+ * per buffer length. If the producer overwrote unread data, *overrun is set. The tail
+ * belongs to the consumer and isn't moved here: until the consumer calls
+ * byte_ringbuf_dma_resync(), the amount of data available is meaningless.
+ */
+static inline uint32_t byte_ringbuf_dma_produced(byte_ringbuf_t* rb, uint32_t pos, int* overrun)
+{
+    const uint32_t head = rb->head;
+    pos = ring_wrap(rb->size, pos);
+    const uint32_t count = ring_data_avail(rb->size, pos, head);
+    const int lost = count > ring_space_avail(rb->size, head, rb->tail);
+    rb->head = pos;
+    if (overrun) {
+        *overrun = lost;
+    }
+    return count;
+}
+
+/*
+ * Called by the consumer after byte_ringbuf_dma_produced() reported an overrun, while the
+ * producer can't report a new position: moves the tail past the head so that the oldest
+ * bytes that weren't overwritten are read next.
+ */
+static inline void byte_ringbuf_dma_resync(byte_ringbuf_t* rb)
+{
+    rb->tail = ring_wrap(rb->size, rb->head + 1);
+}
+
+#endif // BYTE_RINGBUF_H_
@@ -24,7 +24,13 @@
 #include "spark_wiring_vector.h"
 #include "system_tick_hal.h"
 
+#if PLATFORM_THREADING
+#include "spark_wiring_thread.h"
+#endif
+
+#include <functional>
 #include <limits>
+#include <mutex>
 
 extern "C" {
 #endif // defined(__cplusplus)
@@ -105,25 +111,105 @@ private:
     }
 };
 
+namespace detail {
+
+// Lock guarding the static pools of the handler containers, which are shared by all containers of
+// the same type regardless of the thread using them. On the host, the virtual devices of the test
+// fleet run on a pool of threads
+#if PLATFORM_THREADING
+typedef Mutex HandlerPoolLock;
+#elif PLATFORM_ID == 3
+typedef std::mutex HandlerPoolLock;
+#else
+typedef spark::NoLock HandlerPoolLock;
+#endif
+
+// Helper functions maintaining a binary min-heap of handlers ordered by their expiration time.
+// `placed(i)` is invoked for every element that has been moved to the position `i`
+template<typename T, typename PlacedFn>
+inline void siftHandlerUp(T* heap, int i, PlacedFn placed) {
+    T h(std::move(heap[i]));
+    while (i > 0) {
+        const int parent = (i - 1) / 2;
+        if (heap[parent].ticks <= h.ticks) {
+            break;
+        }
+        heap[i] = std::move(heap[parent]);
+        placed(i);
+        i = parent;
+    }
+    heap[i] = std::move(h);
+    placed(i);
+}
+
+template<typename T, typename PlacedFn>
+inline void siftHandlerDown(T* heap, int size, int i, PlacedFn placed) {
+    T h(std::move(heap[i]));
+    for (;;) {
+        int child = i * 2 + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && heap[child + 1].ticks < heap[child].ticks) {
+            ++child;
+        }
+        if (h.ticks <= heap[child].ticks) {
+            break;
+        }
+        heap[i] = std::move(heap[child]);
+        placed(i);
+        i = child;
+    }
+    heap[i] = std::move(h);
+    placed(i);
+}
+
+// Removes the element at the position `i` from the heap
+template<typename T, typename AllocatorT, typename PlacedFn>
+inline T takeHandler(spark::Vector<T, AllocatorT>& heap, int i, PlacedFn placed) {
+    T h(std::move(heap[i]));
+    const int last = heap.size() - 1;
+    if (i != last) {
+        heap[i] = std::move(heap[last]);
+        placed(i);
+        heap.takeLast();
+        if (i > 0 && heap[i].ticks < heap[(i - 1) / 2].ticks) {
+            siftHandlerUp(heap.data(), i, placed);
+        } else {
+            siftHandlerDown(heap.data(), last, i, placed);
+        }
+    } else {
+        heap.takeLast();
+    }
+    return h;
+}
+
+// Returns the expiration time of a handler, saturating at the maximum value of system_tick_t
+inline system_tick_t handlerExpirationTime(system_tick_t ticks, system_tick_t timeout) {
+    const system_tick_t maxTicks = std::numeric_limits<system_tick_t>::max();
+    return (timeout > maxTicks - ticks) ? maxTicks : ticks + timeout;
+}
+
+} // namespace particle::detail
+
 // Container class storing a list of CompletionHandler instances. This class manages handler timeouts,
-// see update() method for details
+// see update() method for details. Handlers are kept in a min-heap ordered by expiration time, so
+// adding a handler and expiring a handler take O(log n) time. An instance isn't thread-safe, but
+// different instances can be used by different threads
 class CompletionHandlerList {
 public:
     static const system_tick_t MAX_TIMEOUT = std::numeric_limits<system_tick_t>::max();
 
     explicit CompletionHandlerList(system_tick_t defaultTimeout = 60000) :
             defaultTimeout_(defaultTimeout),
-            timeoutTicks_(MAX_TIMEOUT),
             ticks_(0) {
     }
 
     bool addHandler(CompletionHandler&& handler, system_tick_t timeout) {
         if (handler) {
-            const system_tick_t t = ticks_ + timeout; // Handler expiration time
+            const system_tick_t t = detail::handlerExpirationTime(ticks_, timeout);
             if (handlers_.append(Handler(std::move(handler), t))) {
-                if (t < timeoutTicks_) {
-                    timeoutTicks_ = t; // Update nearest expiration time
-                }
+                detail::siftHandlerUp(handlers_.data(), handlers_.size() - 1, [](int) {});
                 return true;
             }
         }
@@ -171,37 +257,26 @@ public:
     // This method needs to be called periodically in order to invoke expired handlers.
     // `ticks` argument specifies a number of milliseconds passed since previous update
     int update(system_tick_t ticks) {
-        if (!handlers_.isEmpty()) {
-            ticks_ += ticks;
-            if (ticks_ >= timeoutTicks_) {
-                timeoutTicks_ = MAX_TIMEOUT;
-                int count = 0; // Number of expired handlers
-                int i = 0;
-                do {
-                    Handler& h = handlers_.at(i);
-                    if (ticks_ >= h.ticks) {
-                        // Remove expired handler
-                        CompletionHandler handler = handlers_.takeAt(i).handler;
-                        handler.setError(SYSTEM_ERROR_TIMEOUT);
-                        ++count;
-                    } else {
-                        // Update handler expiration time
-                        h.ticks -= ticks_;
-                        if (h.ticks < timeoutTicks_) {
-                            timeoutTicks_ = h.ticks;
-                        }
-                        ++i;
-                    }
-                } while (i < handlers_.size());
-                ticks_ = 0;
-                return count;
-            }
+        if (handlers_.isEmpty()) {
+            return 0;
+        }
+        ticks_ = detail::handlerExpirationTime(ticks_, ticks);
+        int count = 0; // Number of expired handlers
+        while (!handlers_.isEmpty() && handlers_.first().ticks <= ticks_) {
+            CompletionHandler handler = detail::takeHandler(handlers_, 0, [](int) {}).handler;
+            handler.setError(SYSTEM_ERROR_TIMEOUT);
+            ++count;
         }
-        return 0;
+        if (handlers_.isEmpty()) {
+            ticks_ = 0;
+        } else if (ticks_ > MAX_TIMEOUT / 2) {
+            rebase();
+        }
+        return count;
     }
 
     system_tick_t nearestTimeout() const {
-        return timeoutTicks_ - ticks_;
+        return handlers_.isEmpty() ? MAX_TIMEOUT : handlers_.first().ticks - ticks_;
     }
 
 private:
@@ -215,21 +290,39 @@ private:
         }
     };
 
+    // Handler lists are short and change often, so their storage is taken from a small static pool
+    // rather than from the heap. Longer lists fall back to the heap. The pool is shared by all lists,
+    // so it's locked while it's updated
+    typedef spark::PoolAllocator<sizeof(Handler) * 8, 2, Handler, spark::DefaultAllocator,
+            detail::HandlerPoolLock> HandlerAllocator;
+
     const system_tick_t defaultTimeout_;
 
-    spark::Vector<Handler> handlers_;
-    system_tick_t timeoutTicks_; // Nearest handler expiration time
-    system_tick_t ticks_;
+    spark::Vector<Handler, HandlerAllocator> handlers_; // Min-heap
+    system_tick_t ticks_; // Time passed since the list became non-empty
 
     void reset() {
         handlers_.clear();
-        timeoutTicks_ = MAX_TIMEOUT;
+        ticks_ = 0;
+    }
+
+    // Makes expiration times relative to the current time to keep them from overflowing.
+    // Shifting all elements by the same amount doesn't change their order in the heap
+    void rebase() {
+        for (Handler& h: handlers_) {
+            if (h.ticks != MAX_TIMEOUT) {
+                h.ticks -= ticks_;
+            }
+        }
         ticks_ = 0;
     }
 };
 
 // Container class storing CompletionHandler instances arranged by key. This class manages handler
-// timeouts, see update() method for details
+// timeouts, see update() method for details. Handlers are kept in a min-heap ordered by expiration
+// time, and a hash table maps keys to positions in the heap, so that adding a handler, or removing
+// it by key or on expiration, takes O(log n) time regardless of the number of pending handlers.
+// An instance isn't thread-safe, but different instances can be used by different threads
 template<typename KeyT>
 class CompletionHandlerMap {
 public:
@@ -237,17 +330,19 @@ public:
 
     explicit CompletionHandlerMap(system_tick_t defaultTimeout = 60000) :
             defaultTimeout_(defaultTimeout),
-            timeoutTicks_(MAX_TIMEOUT),
             ticks_(0) {
     }
 
     bool addHandler(const KeyT& key, CompletionHandler&& handler, system_tick_t timeout) {
         if (handler) {
-            const system_tick_t t = ticks_ + timeout; // Handler expiration time
+            const int n = handlers_.size();
+            if ((n + 1) * 2 > index_.size() && !rehash(index_.isEmpty() ? MIN_INDEX_SIZE : index_.size() * 2)) {
+                return false;
+            }
+            const system_tick_t t = detail::handlerExpirationTime(ticks_, timeout);
             if (handlers_.append(Handler(key, std::move(handler), t))) {
-                if (t < timeoutTicks_) {
-                    timeoutTicks_ = t; // Update nearest expiration time
-                }
+                insertSlot(n);
+                detail::siftHandlerUp(handlers_.data(), n, Placed(this));
                 return true;
             }
         }
@@ -260,32 +355,18 @@ public:
 
     CompletionHandler takeHandler(const KeyT& key) {
         CompletionHandler handler;
-        timeoutTicks_ = MAX_TIMEOUT;
-        int i = 0;
-        while (i < handlers_.size()) {
-            const Handler& h = handlers_.at(i);
-            if (h.key == key) {
-                handler = handlers_.takeAt(i).handler;
-                if (handlers_.isEmpty()) {
-                    ticks_ = 0;
-                }
-            } else {
-                if (h.ticks < timeoutTicks_) {
-                    timeoutTicks_ = h.ticks;
-                }
-                ++i;
-            }
+        int slot = 0;
+        while ((slot = findSlot(key)) >= 0) {
+            handler = takeAt(index_[slot]);
+        }
+        if (handlers_.isEmpty()) {
+            ticks_ = 0;
         }
         return handler;
     }
 
     bool hasHandler(const KeyT& key) const {
-        for (const Handler& h: handlers_) {
-            if (h.key == key) {
-                return true;
-            }
-        }
-        return false;
+        return findSlot(key) >= 0;
     }
 
     void clear() {
@@ -293,7 +374,7 @@ public:
             h.handler.setError(SYSTEM_ERROR_ABORTED);
         }
         handlers_.clear();
-        timeoutTicks_ = MAX_TIMEOUT;
+        index_.clear();
         ticks_ = 0;
     }
 
@@ -321,37 +402,26 @@ public:
     // This method needs to be called periodically in order to invoke expired handlers.
     // `ticks` argument specifies a number of milliseconds passed since previous update
     int update(system_tick_t ticks) {
-        if (!handlers_.isEmpty()) {
-            ticks_ += ticks;
-            if (ticks_ >= timeoutTicks_) {
-                timeoutTicks_ = MAX_TIMEOUT;
-                int count = 0; // Number of expired handlers
-                int i = 0;
-                do {
-                    Handler& h = handlers_.at(i);
-                    if (ticks_ >= h.ticks) {
-                        // Remove expired handler
-                        CompletionHandler handler = handlers_.takeAt(i).handler;
-                        handler.setError(SYSTEM_ERROR_TIMEOUT);
-                        ++count;
-                    } else {
-                        // Update handler expiration time
-                        h.ticks -= ticks_;
-                        if (h.ticks < timeoutTicks_) {
-                            timeoutTicks_ = h.ticks;
-                        }
-                        ++i;
-                    }
-                } while (i < handlers_.size());
-                ticks_ = 0;
-                return count;
-            }
+        if (handlers_.isEmpty()) {
+            return 0;
+        }
+        ticks_ = detail::handlerExpirationTime(ticks_, ticks);
+        int count = 0; // Number of expired handlers
+        while (!handlers_.isEmpty() && handlers_.first().ticks <= ticks_) {
+            CompletionHandler handler = takeAt(0);
+            handler.setError(SYSTEM_ERROR_TIMEOUT);
+            ++count;
         }
-        return 0;
+        if (handlers_.isEmpty()) {
+            ticks_ = 0;
+        } else if (ticks_ > MAX_TIMEOUT / 2) {
+            rebase();
+        }
+        return count;
     }
 
     system_tick_t nearestTimeout() const {
-        return timeoutTicks_ - ticks_;
+        return handlers_.isEmpty() ? MAX_TIMEOUT : handlers_.first().ticks - ticks_;
     }
 
 private:
@@ -359,24 +429,137 @@ private:
         KeyT key;
         CompletionHandler handler;
         system_tick_t ticks; // Expiration time
+        int slot; // Index of the hash table slot referencing this handler
 
         Handler(KeyT key, CompletionHandler handler, system_tick_t ticks) :
                 key(std::move(key)),
                 handler(std::move(handler)),
-                ticks(ticks) {
+                ticks(ticks),
+                slot(-1) {
         }
     };
 
+    // Updates the hash table when a handler is moved within the heap
+    struct Placed {
+        CompletionHandlerMap* map;
+
+        explicit Placed(CompletionHandlerMap* map) :
+                map(map) {
+        }
+
+        void operator()(int i) const {
+            map->index_[map->handlers_[i].slot] = i;
+        }
+    };
+
+    struct IndexTag;
+
+    // Handler lists are short and change often, so their storage is taken from small static pools
+    // rather than from the heap. Longer lists fall back to the heap. The pools are shared by all maps
+    // with the same key type, so they're locked while they're updated
+    typedef spark::PoolAllocator<sizeof(Handler) * 8, 2, Handler, spark::DefaultAllocator,
+            detail::HandlerPoolLock> HandlerAllocator;
+    typedef spark::PoolAllocator<sizeof(int) * 16, 2, IndexTag, spark::DefaultAllocator,
+            detail::HandlerPoolLock> IndexAllocator;
+
+    // The hash table uses linear probing and is kept at most half full
+    static const int MIN_INDEX_SIZE = 8;
+
     const system_tick_t defaultTimeout_;
 
-    spark::Vector<Handler> handlers_;
-    system_tick_t timeoutTicks_; // Nearest handler expiration time
-    system_tick_t ticks_;
+    spark::Vector<Handler, HandlerAllocator> handlers_; // Min-heap
+    spark::Vector<int, IndexAllocator> index_; // Hash table of heap positions, -1 for empty slots
+    system_tick_t ticks_; // Time passed since the map became non-empty
+
+    static size_t hash(const KeyT& key) {
+        return std::hash<KeyT>()(key);
+    }
+
+    int findSlot(const KeyT& key) const {
+        if (index_.isEmpty()) {
+            return -1;
+        }
+        const int mask = index_.size() - 1;
+        for (int s = hash(key) & mask;; s = (s + 1) & mask) {
+            const int i = index_[s];
+            if (i < 0) {
+                return -1;
+            }
+            if (handlers_[i].key == key) {
+                return s;
+            }
+        }
+    }
+
+    void insertSlot(int i) {
+        const int mask = index_.size() - 1;
+        int s = hash(handlers_[i].key) & mask;
+        while (index_[s] >= 0) {
+            s = (s + 1) & mask;
+        }
+        index_[s] = i;
+        handlers_[i].slot = s;
+    }
+
+    // Releases a slot, moving subsequent entries of the same probe sequence back
+    void eraseSlot(int s) {
+        const int mask = index_.size() - 1;
+        int j = s;
+        for (;;) {
+            index_[s] = -1;
+            for (;;) {
+                j = (j + 1) & mask;
+                const int i = index_[j];
+                if (i < 0) {
+                    return;
+                }
+                const int home = hash(handlers_[i].key) & mask;
+                // Keep the entry in place if its home slot is cyclically within (s, j]
+                if (s <= j ? (s < home && home <= j) : (s < home || home <= j)) {
+                    continue;
+                }
+                index_[s] = i;
+                handlers_[i].slot = s;
+                s = j;
+                break;
+            }
+        }
+    }
+
+    bool rehash(int size) {
+        spark::Vector<int, IndexAllocator> index(size, -1);
+        if (index.size() != size) {
+            return false;
+        }
+        using std::swap;
+        swap(index_, index);
+        for (int i = 0; i < handlers_.size(); ++i) {
+            insertSlot(i);
+        }
+        return true;
+    }
+
+    CompletionHandler takeAt(int i) {
+        eraseSlot(handlers_[i].slot);
+        return detail::takeHandler(handlers_, i, Placed(this)).handler;
+    }
+
+    void rebase() {
+        for (Handler& h: handlers_) {
+            if (h.ticks != MAX_TIMEOUT) {
+                h.ticks -= ticks_;
+            }
+        }
+        ticks_ = 0;
+    }
 };
 
 template<typename KeyT>
 const system_tick_t CompletionHandlerMap<KeyT>::MAX_TIMEOUT;
 
+template<typename KeyT>
+const int CompletionHandlerMap<KeyT>::MIN_INDEX_SIZE;
+
 } // namespace particle
 
 #endif // defined(__cplusplus)
@@ -297,15 +297,21 @@ public:
         return started;
     }
 
-    template<typename R> void invoke_async(const std::function<R(void)>& work)
+    /**
+     * Queues the work to run on this thread.
+     * @return false if the work couldn't be queued, and won't run.
+     */
+    template<typename R> bool invoke_async(const std::function<R(void)>& work)
     {
         auto task = new AsyncTask<R>(work);
         if (task)
         {
 			Item message = task;
-			if (!put(message))
-				delete task;
+			if (put(message))
+				return true;
+			delete task;
         }
+        return false;
 	}
 
     template<typename R> SystemPromise<R>* invoke_future(const std::function<R(void)>& work)
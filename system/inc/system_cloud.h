@@ -179,6 +179,25 @@ ProtocolFacade* system_cloud_protocol_instance(void);
 
 int spark_set_connection_property(unsigned property_id, unsigned data, void* datap, void* reserved);
 
+/**
+ * Reads the metrics of the cloud protocol: retransmissions, acknowledgement round-trip
+ * times, rate-limited events, OTA chunk errors, handshakes and bytes transferred.
+ * @param metrics   The metrics read. Set the size field to sizeof(protocol_metrics).
+ * @param reserved  For future expansion, set to NULL.
+ * @return 0 on success.
+ */
+int spark_get_protocol_metrics(protocol_metrics* metrics, void* reserved);
+
+/**
+ * Publishes the protocol metrics as the private event spark/device/diagnostics, for example
+ * `r:2,t:0,l:1,c:0,h:1,hf:0,tx:5120,rx:20480,rtt:14/3/1/0/0/0/0/0,hd:0/1/0/0/0/0/0/0`:
+ * coap_retransmits, coap_timeouts, events_rate_limited, ota_chunk_crc_failures, handshakes,
+ * handshake_failures, bytes_sent, bytes_received, then the ack_rtt and handshake_duration
+ * histogram buckets.
+ * @param reserved  For future expansion, set to NULL.
+ */
+bool spark_publish_protocol_metrics(void* reserved);
+
 
 #define SPARK_BUF_LEN			        600
 
@@ -199,7 +218,7 @@ int spark_set_connection_property(unsigned property_id, unsigned data, void* dat
 
 #define USER_FUNC_MAX_COUNT		        4
 #define USER_FUNC_KEY_LENGTH		        12
-#define USER_FUNC_ARG_LENGTH		        64
+#define USER_FUNC_ARG_LENGTH		        622
 
 #define USER_EVENT_NAME_LENGTH		        64
 #define USER_EVENT_DATA_LENGTH		        64
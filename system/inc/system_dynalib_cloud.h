@@ -48,6 +48,8 @@ DYNALIB_FN(11, system_cloud, spark_sync_time, bool(void*))
 DYNALIB_FN(12, system_cloud, spark_sync_time_pending, bool(void*))
 DYNALIB_FN(13, system_cloud, spark_sync_time_last, system_tick_t(time_t*, void*))
 DYNALIB_FN(14, system_cloud, spark_set_connection_property, int(unsigned, unsigned, void*, void*))
+DYNALIB_FN(15, system_cloud, spark_get_protocol_metrics, int(protocol_metrics*, void*))
+DYNALIB_FN(16, system_cloud, spark_publish_protocol_metrics, bool(void*))
 
 DYNALIB_END(system_cloud)
 
@@ -48,6 +48,13 @@ void Network_Setup(bool threaded);
 void Spark_Idle_Events(bool force_events);
 inline void Spark_Idle() { Spark_Idle_Events(false); }
 
+/**
+ * Returns the duration in milliseconds of the longest iteration of the system loop, during which
+ * the LED, the ISR task queue and application messages were not serviced.
+ * @param reset when true, the measurement starts over.
+ */
+system_tick_t system_loop_max_stall(bool reset);
+
 /**
  * The old method
  */
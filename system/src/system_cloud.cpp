@@ -37,6 +37,7 @@
 #include "events.h"
 #include "deviceid_hal.h"
 #include "system_mode.h"
+#include <stdio.h>
 
 
 #ifndef SPARK_NO_CLOUD
@@ -168,6 +169,44 @@ bool spark_function(const char *funcKey, p_user_function_int_str_t pFunc, void*
     return result;
 }
 
+int spark_get_protocol_metrics(protocol_metrics* metrics, void* reserved)
+{
+    // the metrics are atomic counters, read without switching to the system thread
+    return spark_protocol_get_metrics(sp, metrics, nullptr);
+}
+
+/**
+ * Formats the metrics as the data of the diagnostic event, see spark_publish_protocol_metrics().
+ */
+static void format_protocol_metrics(const protocol_metrics& m, char* buf, size_t size)
+{
+    int n = snprintf(buf, size, "r:%u,t:%u,l:%u,c:%u,h:%u,hf:%u,tx:%u,rx:%u",
+            (unsigned)m.coap_retransmits, (unsigned)m.coap_timeouts, (unsigned)m.events_rate_limited,
+            (unsigned)m.ota_chunk_crc_failures, (unsigned)m.handshakes, (unsigned)m.handshake_failures,
+            (unsigned)m.bytes_sent, (unsigned)m.bytes_received);
+    const char* const names[] = { "rtt", "hd" };
+    const uint32_t* const histograms[] = { m.ack_rtt, m.handshake_duration };
+    for (size_t h = 0; h < 2; ++h) {
+        for (size_t i = 0; i < PROTOCOL_METRICS_HISTOGRAM_BUCKETS; ++i) {
+            if (n < 0 || (size_t)n >= size)
+                return;
+            const unsigned count = histograms[h][i];
+            n += i ? snprintf(buf + n, size - n, "/%u", count) :
+                    snprintf(buf + n, size - n, ",%s:%u", names[h], count);
+        }
+    }
+}
+
+bool spark_publish_protocol_metrics(void* reserved)
+{
+    protocol_metrics metrics = {};
+    metrics.size = sizeof(metrics);
+    spark_get_protocol_metrics(&metrics, nullptr);
+    char buf[320];
+    format_protocol_metrics(metrics, buf, sizeof(buf));
+    return spark_send_event("spark/device/diagnostics", buf, 60, PUBLISH_EVENT_FLAG_PRIVATE, nullptr);
+}
+
 #endif
 
 bool spark_cloud_flag_connected(void)
@@ -50,6 +50,8 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
 
 #define IPNUM(ip)       ((ip)>>24)&0xff,((ip)>>16)&0xff,((ip)>> 8)&0xff,((ip)>> 0)&0xff
 
@@ -665,10 +667,17 @@ void system_set_time(time_t time, unsigned param, void*)
 
 const int CLAIM_CODE_SIZE = 63;
 
-int Spark_Handshake(bool presence_announce)
+int Spark_Handshake(bool presence_announce, bool start)
 {
-	LOG(INFO,"Starting handshake: presense_announce=%d", presence_announce);
-    int err = spark_protocol_handshake(sp);
+    if (start)
+    {
+        LOG(INFO,"Starting handshake: presense_announce=%d", presence_announce);
+    }
+    int err = spark_protocol_handshake_step(sp, start);
+    if (err==particle::protocol::HANDSHAKE_IN_PROGRESS)
+    {
+        return err;
+    }
     if (!err)
     {
         char buf[CLAIM_CODE_SIZE + 1];
@@ -1089,11 +1098,55 @@ const void *getUserVar(const char *varKey)
     return result;
 }
 
-void userFuncScheduleImpl(User_Func_Lookup_Table_t* item, const char* paramString, bool freeParamString, SparkDescriptor::FunctionResultCallback callback)
+#if PLATFORM_THREADING
+
+/**
+ * Holds the argument of a function call that is dispatched to the application thread.
+ * The buffer is leased to one call at a time, calls arriving while it's in use get a
+ * copy on the heap.
+ */
+class FunctionArgBuffer
+{
+    char buffer[MAX_FUNCTION_ARG_LENGTH + 1];
+    std::atomic_flag leased = ATOMIC_FLAG_INIT;
+
+public:
+    char* lease(const char* arg, size_t length)
+    {
+        char* p = nullptr;
+        if (length <= MAX_FUNCTION_ARG_LENGTH && !leased.test_and_set())
+            p = buffer;
+        else
+            p = (char*)malloc(length + 1);
+        if (p)
+        {
+            memcpy(p, arg, length);
+            p[length] = 0;
+        }
+        return p;
+    }
+
+    void release(const char* arg)
+    {
+        if (arg == buffer)
+            leased.clear();
+        else
+            free((void*)arg);
+    }
+};
+
+static FunctionArgBuffer functionArg;
+
+#endif // PLATFORM_THREADING
+
+void userFuncScheduleImpl(User_Func_Lookup_Table_t* item, const char* paramString, size_t paramLength, bool leasedParamString, SparkDescriptor::FunctionResultCallback callback)
 {
-    int result = item->pUserFunc(item->pUserFuncData, paramString, NULL);
-    if (freeParamString)
-        delete paramString;
+    FunctionCallInfo info = { sizeof(FunctionCallInfo), paramLength };
+    int result = item->pUserFunc(item->pUserFuncData, paramString, &info);
+#if PLATFORM_THREADING
+    if (leasedParamString)
+        functionArg.release(paramString);
+#endif
     // run the cloud return on the system thread again
     SYSTEM_THREAD_CONTEXT_ASYNC(callback((const void*)result, SparkReturnType::INT));
     callback((const void*)long(result), SparkReturnType::INT);
@@ -1106,13 +1159,26 @@ int userFuncSchedule(const char *funcKey, const char *paramString, SparkDescript
     if (!item)
         return -1;
 
+    const FunctionCallInfo* info = (const FunctionCallInfo*)reserved;
+    const size_t paramLength = info ? info->arg_length : strlen(paramString);
 #if PLATFORM_THREADING
-    paramString = strdup(paramString);      // ensure we have a copy since the oriignal isn't guaranteed to be available once this function returns.
-    APPLICATION_THREAD_CONTEXT_ASYNC_RESULT(userFuncScheduleImpl(item, paramString, true, callback), 0);
-    userFuncScheduleImpl(item, paramString, true, callback);
-#else
-    userFuncScheduleImpl(item, paramString, false, callback);
+    if (ApplicationThread.isStarted() && !ApplicationThread.isCurrentThread())
+    {
+        // the argument points into the receive buffer, which is reused once this function returns
+        paramString = functionArg.lease(paramString, paramLength);
+        if (!paramString)
+            return -1;
+        auto lambda = [=]() { userFuncScheduleImpl(item, paramString, paramLength, true, callback); };
+        if (!ApplicationThread.invoke_async(FFL(lambda)))
+        {
+            // the call won't run to release the argument
+            functionArg.release(paramString);
+            return -1;
+        }
+        return 0;
+    }
 #endif
+    userFuncScheduleImpl(item, paramString, paramLength, false, callback);
     return 0;
 }
 
@@ -1369,3 +1435,13 @@ void Spark_Wake(void)
 	spark_protocol_command(sp, ProtocolCommands::WAKE);
 #endif
 }
+
+void Spark_Precompute_Keys(void)
+{
+#ifndef SPARK_NO_CLOUD
+	if (sp && spark_protocol_is_initialized(sp))
+	{
+		spark_protocol_command(sp, ProtocolCommands::PRECOMPUTE_KEYS);
+	}
+#endif
+}
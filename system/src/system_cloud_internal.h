@@ -33,7 +33,13 @@ int spark_cloud_socket_connect(void);
 int spark_cloud_socket_disconnect(void);
 
 void Spark_Protocol_Init(void);
-int Spark_Handshake(bool presence_announce);
+/**
+ * Performs the next step of the cloud handshake, and the announcements that follow it once
+ * the handshake completes.
+ * @param start true to start a new handshake.
+ * @return HANDSHAKE_IN_PROGRESS while more steps are needed, otherwise the result of the handshake.
+ */
+int Spark_Handshake(bool presence_announce, bool start);
 bool Spark_Communication_Loop(void);
 void Multicast_Presence_Announcement(void);
 void Spark_Signal(bool on, unsigned, void*);
@@ -41,6 +47,7 @@ void Spark_SetTime(unsigned long dateTime);
 void Spark_Process_Events();
 void Spark_Sleep();
 void Spark_Wake();
+void Spark_Precompute_Keys();
 
 void system_set_time(time_t time, unsigned param, void* reserved);
 
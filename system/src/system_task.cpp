@@ -49,6 +49,12 @@ using particle::LEDStatus;
 
 volatile system_tick_t spark_loop_total_millis = 0;
 
+/**
+ * Time left in the delay() the application is waiting in while it runs the system loop,
+ * zero otherwise. The system loop can spend that long without holding up the application.
+ */
+static system_tick_t system_delay_remaining_millis = 0;
+
 // Auth options are WLAN_SEC_UNSEC, WLAN_SEC_WPA, WLAN_SEC_WEP, and WLAN_SEC_WPA2
 unsigned char _auth = WLAN_SEC_WPA2;
 
@@ -323,11 +329,40 @@ void establish_cloud_connection()
     }
 }
 
+/**
+ * Set while a cloud handshake is performed in steps by the system loop.
+ */
+static bool cloud_handshake_in_progress = false;
+
+/**
+ * The longest an ephemeral key generation has taken, starting from a conservative guess.
+ */
+static system_tick_t key_precompute_millis = 1000;
+
+/**
+ * Determines if the system loop can run a task of the given duration without holding up
+ * the application loop.
+ */
+static bool system_loop_idle(system_tick_t duration)
+{
+    // the application loop runs in its own thread
+    if (system_thread_get_state(nullptr) == spark::feature::ENABLED)
+        return true;
+    return system_delay_remaining_millis >= duration;
+}
+
 int cloud_handshake()
 {
 	bool udp = HAL_Feature_Get(FEATURE_CLOUD_UDP);
 	bool presence_announce = !udp;
-	int err = Spark_Handshake(presence_announce);
+	bool start = !cloud_handshake_in_progress;
+	if (start)
+	{
+		system_loop_max_stall(true);
+		LED_SIGNAL_START(CLOUD_HANDSHAKE, NORMAL);
+	}
+	int err = Spark_Handshake(presence_announce, start);
+	cloud_handshake_in_progress = (err == particle::protocol::HANDSHAKE_IN_PROGRESS);
 	return err;
 }
 
@@ -341,8 +376,12 @@ void handle_cloud_connection(bool force_events)
     {
         if (!SPARK_CLOUD_CONNECTED)
         {
-            LED_SIGNAL_START(CLOUD_HANDSHAKE, NORMAL);
             int err = cloud_handshake();
+            if (err == particle::protocol::HANDSHAKE_IN_PROGRESS)
+            {
+                // the handshake continues in the next iterations of the system loop
+                return;
+            }
             if (err)
             {
                 if (!SPARK_WLAN_RESET && !network.listening())
@@ -367,7 +406,8 @@ void handle_cloud_connection(bool force_events)
             }
             else
             {
-                INFO("Cloud connected");
+                INFO("Cloud connected, longest system loop iteration during the handshake: %u ms",
+                        (unsigned)system_loop_max_stall(false));
                 SPARK_CLOUD_CONNECTED = 1;
                 cloud_failed_connection_attempts = 0;
                 system_notify_event(cloud_status, cloud_status_connected);
@@ -398,6 +438,17 @@ void manage_cloud_connection(bool force_events)
         establish_cloud_connection();
 
         handle_cloud_connection(force_events);
+
+        // prepare the ephemeral key of the next handshake while no handshake is in progress
+        // and the key generation doesn't stall the application
+        if ((SPARK_CLOUD_CONNECTED || !SPARK_CLOUD_SOCKETED) && system_loop_idle(key_precompute_millis))
+        {
+            const system_tick_t start = HAL_Timer_Get_Milli_Seconds();
+            Spark_Precompute_Keys();
+            const system_tick_t elapsed = HAL_Timer_Get_Milli_Seconds() - start;
+            if (elapsed > key_precompute_millis)
+                key_precompute_millis = elapsed;
+        }
     }
 }
 #endif // !SPARK_NO_CLOUD
@@ -411,8 +462,25 @@ static void process_isr_task_queue()
 extern void system_handle_button_click();
 #endif
 
+/**
+ * The longest iteration of the system loop, during which the LED, the ISR task queue
+ * and application messages were not serviced.
+ */
+static system_tick_t system_loop_max_iteration = 0;
+
+system_tick_t system_loop_max_stall(bool reset)
+{
+    system_tick_t max = system_loop_max_iteration;
+    if (reset)
+    {
+        system_loop_max_iteration = 0;
+    }
+    return max;
+}
+
 void Spark_Idle_Events(bool force_events/*=false*/)
 {
+    const system_tick_t start_millis = HAL_Timer_Get_Milli_Seconds();
     HAL_Notify_WDT();
 
     ON_EVENT_DELTA();
@@ -440,6 +508,12 @@ void Spark_Idle_Events(bool force_events/*=false*/)
         system_pending_shutdown();
     }
     system_shutdown_if_needed();
+
+    const system_tick_t elapsed_millis = HAL_Timer_Get_Milli_Seconds() - start_millis;
+    if (elapsed_millis > system_loop_max_iteration)
+    {
+        system_loop_max_iteration = elapsed_millis;
+    }
 }
 
 /*
@@ -491,12 +565,14 @@ void system_delay_pump(unsigned long ms, bool force_no_background_loop=false)
         		bool threading = system_thread_get_state(nullptr);
             spark_loop_elapsed_millis = elapsed_millis + SPARK_LOOP_DELAY_MILLIS;
             //spark_loop_total_millis is reset to 0 in Spark_Idle()
+            system_delay_remaining_millis = ms - elapsed_millis;
             do
             {
                 //Run once if the above condition passes
                 spark_process();
             }
             while (!threading && SPARK_FLASH_UPDATE); //loop during OTA update
+            system_delay_remaining_millis = 0;
         }
     }
 }
@@ -540,6 +616,7 @@ void cloud_disconnect(bool closeSocket)
         SPARK_FLASH_UPDATE = 0;
         SPARK_CLOUD_CONNECTED = 0;
         SPARK_CLOUD_SOCKETED = 0;
+        cloud_handshake_in_progress = false;
 
         LED_SIGNAL_STOP(CLOUD_CONNECTED);
         LED_SIGNAL_STOP(CLOUD_HANDSHAKE);
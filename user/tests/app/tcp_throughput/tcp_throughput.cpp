@@ -0,0 +1,112 @@
+/**
+ * Measures TCPClient write throughput with and without write buffering, and read
+ * throughput with small and large reads.
+ *
+ * On the gcc virtual device the client connects to a TCPServer running in the same
+ * application over the loopback interface:
+ *
+ *   make PLATFORM=gcc TEST=app/tcp_throughput
+ */
+
+#include "application.h"
+
+SYSTEM_MODE(MANUAL);
+
+namespace {
+
+const uint16_t PORT = 8088;
+const IPAddress LOOPBACK(127, 0, 0, 1);
+const size_t TOTAL_BYTES = 1024 * 1024;
+const size_t CHUNK_SIZE = 1024;
+
+TCPServer server(PORT);
+
+// Writes TOTAL_BYTES in pieces of the given size, draining the server side as it goes
+void runWrite(TCPClient& client, TCPClient& peer, size_t pieceSize, const char* name)
+{
+    uint8_t piece[64];
+    memset(piece, 'x', sizeof(piece));
+    uint8_t sink[CHUNK_SIZE];
+    size_t received = 0;
+    const system_tick_t start = millis();
+    for (size_t sent = 0; sent < TOTAL_BYTES; sent += pieceSize) {
+        client.write(piece, pieceSize);
+        while (peer.available() > 0) {
+            received += peer.read(sink, sizeof(sink));
+        }
+    }
+    client.flush();
+    while (received < TOTAL_BYTES && peer.connected()) {
+        const int n = peer.read(sink, sizeof(sink));
+        if (n > 0) {
+            received += n;
+        }
+    }
+    const system_tick_t elapsed = std::max(millis() - start, (system_tick_t)1);
+    Serial.printlnf("%s: %u bytes in %u ms (%u KB/s)", name, (unsigned)received, (unsigned)elapsed,
+            (unsigned)(received / elapsed));
+}
+
+// Reads TOTAL_BYTES from the client using reads of the given size
+void runRead(TCPClient& client, TCPClient& peer, size_t readSize, const char* name)
+{
+    static uint8_t chunk[CHUNK_SIZE];
+    memset(chunk, 'y', sizeof(chunk));
+    uint8_t sink[CHUNK_SIZE];
+    size_t received = 0;
+    const system_tick_t start = millis();
+    for (size_t sent = 0; sent < TOTAL_BYTES; sent += sizeof(chunk)) {
+        peer.write(chunk, sizeof(chunk));
+        int n;
+        while ((n = client.read(sink, readSize)) > 0) {
+            received += n;
+        }
+    }
+    while (received < TOTAL_BYTES && client.connected()) {
+        const int n = client.read(sink, readSize);
+        if (n > 0) {
+            received += n;
+        }
+    }
+    const system_tick_t elapsed = std::max(millis() - start, (system_tick_t)1);
+    Serial.printlnf("%s: %u bytes in %u ms (%u KB/s)", name, (unsigned)received, (unsigned)elapsed,
+            (unsigned)(received / elapsed));
+}
+
+} // namespace
+
+void setup()
+{
+    Serial.begin(9600);
+    WiFi.on();
+    WiFi.connect();
+    waitUntil(WiFi.ready);
+    server.begin();
+
+    TCPClient client;
+    if (!client.connect(LOOPBACK, PORT)) {
+        Serial.println("connection failed");
+        return;
+    }
+    TCPClient peer;
+    while (!(peer = server.available()).connected()) {
+        Particle.process();
+    }
+
+    runWrite(client, peer, 1, "unbuffered, 1 byte writes");
+    runWrite(client, peer, 16, "unbuffered, 16 byte writes");
+    client.setWriteBuffer(1460);
+    runWrite(client, peer, 1, "buffered, 1 byte writes");
+    runWrite(client, peer, 16, "buffered, 16 byte writes");
+    client.setWriteBuffer(0);
+
+    runRead(client, peer, 64, "64 byte reads");
+    runRead(client, peer, CHUNK_SIZE, "1024 byte reads");
+
+    client.stop();
+    peer.stop();
+}
+
+void loop()
+{
+}
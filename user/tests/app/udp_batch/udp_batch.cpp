@@ -0,0 +1,107 @@
+/**
+ * Measures UDP packets per second sent and received one at a time with
+ * sendPacket()/receivePacket() and in batches with sendPackets()/receivePackets().
+ *
+ * On the gcc virtual device UDP sockets are bound to the mDNS multicast group,
+ * so the packets are sent to that group with multicast loopback enabled:
+ *
+ *   make PLATFORM=gcc TEST=app/udp_batch
+ */
+
+#include "application.h"
+
+SYSTEM_MODE(MANUAL);
+
+namespace {
+
+const uint16_t PORT = 5353;
+const IPAddress GROUP(224, 0, 0, 251);
+const size_t PACKET_COUNT = 100000;
+const size_t PACKET_SIZE = 64;
+const size_t BATCH_SIZE = 32;
+
+UDP sender;
+UDP receiver;
+
+uint8_t txData[BATCH_SIZE][PACKET_SIZE];
+uint8_t rxData[BATCH_SIZE][PACKET_SIZE];
+
+void report(const char* name, size_t sent, size_t received, system_tick_t start)
+{
+    const system_tick_t elapsed = std::max(millis() - start, (system_tick_t)1);
+    Serial.printlnf("%s: %u sent, %u received in %u ms (%u packets/s)", name, (unsigned)sent, (unsigned)received,
+            (unsigned)elapsed, (unsigned)(received * 1000ULL / elapsed));
+}
+
+void runSingle()
+{
+    size_t sent = 0, received = 0;
+    const system_tick_t start = millis();
+    while (sent < PACKET_COUNT) {
+        if (sender.sendPacket(txData[0], PACKET_SIZE, GROUP, PORT) > 0) {
+            ++sent;
+        }
+        while (receiver.receivePacket(rxData[0], PACKET_SIZE) > 0) {
+            ++received;
+        }
+    }
+    while (receiver.receivePacket(rxData[0], PACKET_SIZE) > 0) {
+        ++received;
+    }
+    report("single", sent, received, start);
+}
+
+void runBatch()
+{
+    UDPPacket tx[BATCH_SIZE];
+    UDPPacket rx[BATCH_SIZE];
+    for (size_t i = 0; i < BATCH_SIZE; ++i) {
+        tx[i].buffer = txData[i];
+        tx[i].size = PACKET_SIZE;
+        tx[i].remoteIP = GROUP;
+        tx[i].remotePort = PORT;
+        rx[i].buffer = rxData[i];
+        rx[i].size = PACKET_SIZE;
+    }
+    size_t sent = 0, received = 0;
+    int n = 0;
+    const system_tick_t start = millis();
+    while (sent < PACKET_COUNT) {
+        n = sender.sendPackets(tx, BATCH_SIZE);
+        if (n > 0) {
+            sent += n;
+        }
+        while ((n = receiver.receivePackets(rx, BATCH_SIZE)) > 0) {
+            received += n;
+        }
+    }
+    while ((n = receiver.receivePackets(rx, BATCH_SIZE)) > 0) {
+        received += n;
+    }
+    report("batch", sent, received, start);
+}
+
+} // namespace
+
+void setup()
+{
+    Serial.begin(9600);
+    WiFi.on();
+    WiFi.connect();
+    waitUntil(WiFi.ready);
+
+    memset(txData, 'x', sizeof(txData));
+    receiver.begin(PORT);
+    receiver.joinMulticast(GROUP);
+    sender.begin(PORT + 1);
+
+    runSingle();
+    runBatch();
+
+    sender.stop();
+    receiver.stop();
+}
+
+void loop()
+{
+}
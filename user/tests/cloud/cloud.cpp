@@ -0,0 +1,372 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "cloud_server.h"
+#include "eckeygen.h"
+#include "mbedtls/pk.h"
+
+#include <boost/program_options.hpp>
+#include <sys/stat.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+using namespace particle::cloud;
+namespace po = boost::program_options;
+
+namespace {
+
+const size_t SERVER_PUBLIC_KEY_FILE_LENGTH = 512;
+// offsets of the server address in the server key of the device, see HAL_FLASH_Read_ServerAddress()
+const size_t SERVER_ADDRESS_OFFSET = 384;
+const size_t SERVER_ADDRESS_OFFSET_EC = 192;
+
+// SubjectPublicKeyInfo of an RSA-2048 key, up to the modulus
+const uint8_t RSA_PUBLIC_KEY_HEADER[] = {
+    0x30, 0x82, 0x01, 0x22, 0x30, 0x0d, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01,
+    0x01, 0x05, 0x00, 0x03, 0x82, 0x01, 0x0f, 0x00, 0x30, 0x82, 0x01, 0x0a, 0x02, 0x82, 0x01, 0x01,
+    0x00
+};
+const uint8_t RSA_PUBLIC_EXPONENT[] = { 0x02, 0x03, 0x01, 0x00, 0x01 };
+const size_t RSA_KEY_BITS = 2048;
+
+std::mt19937& generator()
+{
+    static std::mt19937 gen(std::random_device{}());
+    return gen;
+}
+
+int rng(void*, uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        data[i] = generator()();
+    return 0;
+}
+
+int rsa_rng(void*)
+{
+    return generator()();
+}
+
+bool read_file(const std::string& path, std::vector<uint8_t>& data)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool write_file(const std::string& path, const uint8_t* data, size_t size)
+{
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char*)data, size);
+    return bool(out);
+}
+
+/**
+ * The key components of the server RSA key, stored in hex, one per line.
+ */
+mpi* rsa_components(rsa_context& key, size_t index)
+{
+    mpi* components[] = { &key.N, &key.E, &key.D, &key.P, &key.Q, &key.DP, &key.DQ, &key.QP };
+    return index < sizeof(components) / sizeof(components[0]) ? components[index] : nullptr;
+}
+
+/**
+ * Loads the RSA key of the server from the key directory, generating it on first use.
+ */
+bool server_rsa_key(const std::string& dir, rsa_context& key)
+{
+    rsa_init(&key, RSA_PKCS_V15, RSA_RAW, rsa_rng, nullptr);
+    const std::string path = dir + "/server_rsa.txt";
+    std::ifstream in(path);
+    if (in)
+    {
+        std::string line;
+        for (size_t i = 0; mpi* component = rsa_components(key, i); ++i)
+        {
+            if (!std::getline(in, line) || mpi_read_string(component, 16, line.c_str()))
+                return false;
+        }
+        key.len = (mpi_msb(&key.N) + 7) >> 3;
+        return !rsa_check_privkey(&key);
+    }
+    if (rsa_gen_key(&key, RSA_KEY_BITS, 65537))
+        return false;
+    std::ofstream out(path);
+    for (size_t i = 0; mpi* component = rsa_components(key, i); ++i)
+    {
+        char hex[RSA_KEY_BITS / 4 + 8];
+        int length = sizeof(hex);
+        if (mpi_write_string(component, 16, hex, &length))
+            return false;
+        out << hex << std::endl;
+    }
+    return bool(out);
+}
+
+/**
+ * Loads the EC key of the server (DER) from the key directory, generating it on first use.
+ */
+bool server_ec_key(const std::string& dir, std::vector<uint8_t>& key)
+{
+    const std::string path = dir + "/server_ec.der";
+    if (read_file(path, key))
+        return true;
+    key.assign(256, 0);
+    if (gen_ec_key(key.data(), key.size(), rng, nullptr))
+        return false;
+    key.resize(determine_der_length(key.data(), key.size()));
+    return write_file(path, key.data(), key.size());
+}
+
+/**
+ * Writes the server public key in the format read by the gcc device (--server_key):
+ * the DER encoded key followed at a fixed offset by the server address.
+ */
+bool write_server_public(const std::string& path, const uint8_t* der, size_t length, size_t address_offset,
+        const boost::asio::ip::address_v4& address)
+{
+    uint8_t file[SERVER_PUBLIC_KEY_FILE_LENGTH] = {};
+    memcpy(file, der, length);
+    const auto ip = address.to_bytes();
+    file[address_offset] = 0;   // IP_ADDRESS
+    file[address_offset + 1] = ip.size();
+    memcpy(file + address_offset + 2, ip.data(), ip.size());
+    return write_file(path, file, sizeof(file));
+}
+
+bool write_server_public_rsa(const std::string& path, rsa_context& key, const boost::asio::ip::address_v4& address)
+{
+    uint8_t der[sizeof(RSA_PUBLIC_KEY_HEADER) + RSA_KEY_BITS / 8 + sizeof(RSA_PUBLIC_EXPONENT)];
+    memcpy(der, RSA_PUBLIC_KEY_HEADER, sizeof(RSA_PUBLIC_KEY_HEADER));
+    if (mpi_write_binary(&key.N, der + sizeof(RSA_PUBLIC_KEY_HEADER), RSA_KEY_BITS / 8))
+        return false;
+    memcpy(der + sizeof(der) - sizeof(RSA_PUBLIC_EXPONENT), RSA_PUBLIC_EXPONENT, sizeof(RSA_PUBLIC_EXPONENT));
+    return write_server_public(path, der, sizeof(der), SERVER_ADDRESS_OFFSET, address);
+}
+
+bool write_server_public_ec(const std::string& path, const std::vector<uint8_t>& key, const boost::asio::ip::address_v4& address)
+{
+    mbedtls_pk_context pk;
+    mbedtls_pk_init(&pk);
+    uint8_t der[SERVER_ADDRESS_OFFSET_EC];
+    int length = mbedtls_pk_parse_key(&pk, key.data(), key.size(), nullptr, 0);
+    if (!length)
+        length = mbedtls_pk_write_pubkey_der(&pk, der, sizeof(der));
+    mbedtls_pk_free(&pk);
+    if (length <= 0)
+        return false;
+    // the key is written at the end of the buffer
+    return write_server_public(path, der + sizeof(der) - length, length, SERVER_ADDRESS_OFFSET_EC, address);
+}
+
+bool parse_impairment(const po::variables_map& vm, const char* direction, Impairment& impairment)
+{
+    const std::string suffix = std::string("-") + direction;
+    impairment.loss = vm["loss" + suffix].as<double>() / 100;
+    impairment.delay = vm["delay" + suffix].as<unsigned>();
+    impairment.jitter = vm["jitter" + suffix].as<unsigned>();
+    return impairment.loss >= 0 && impairment.loss <= 1;
+}
+
+} // namespace
+
+/**
+ * Random numbers for mbedTLS.
+ */
+uint32_t HAL_RNG_GetRandomNumber(void)
+{
+    return generator()();
+}
+
+int main(int argc, char* argv[])
+{
+    po::options_description desc("Runs a stand-in cloud server performing a scripted workload with each device");
+    desc.add_options()
+        ("help,h", "show this help")
+        ("tcp-port", po::value<uint16_t>()->default_value(5683), "TCP port of the LightSSL devices, 0 to not listen")
+        ("udp-port", po::value<uint16_t>()->default_value(5684), "UDP port of the DTLS devices, 0 to not listen")
+        ("keys", po::value<std::string>()->default_value("cloud_keys"), "directory of the server keys, generated when missing")
+        ("address", po::value<std::string>()->default_value("127.0.0.1"), "server IPv4 address written in the public key files of the devices")
+        ("workload,w", po::value<std::vector<std::string>>()->multitoken(), "the steps run with each device, operation[:count[:interval]] with operation ping, describe, variable, function, event or ota")
+        ("repeat", "run the steps again once the last one completed")
+        ("window", po::value<unsigned>()->default_value(1), "requests in flight per device")
+        ("function", po::value<std::string>(), "function called, the first one described by the device by default")
+        ("argument", po::value<std::string>()->default_value("1"), "function argument")
+        ("variable", po::value<std::string>(), "variable requested, the first one described by the device by default")
+        ("event-name", po::value<std::string>()->default_value("cloud/load"), "name of the events sent to the devices")
+        ("event-size", po::value<size_t>()->default_value(32), "size of the events sent to the devices")
+        ("ota-size", po::value<size_t>()->default_value(64 * 1024), "size of the firmware updates")
+        ("chunk-size", po::value<size_t>()->default_value(512), "chunk size of the firmware updates")
+        ("loss-to-device", po::value<double>()->default_value(0), "percentage of the datagrams to the devices dropped")
+        ("delay-to-device", po::value<unsigned>()->default_value(0), "milliseconds added to the packets to the devices")
+        ("jitter-to-device", po::value<unsigned>()->default_value(0), "maximum random milliseconds added to the packets to the devices")
+        ("loss-from-device", po::value<double>()->default_value(0), "percentage of the datagrams from the devices dropped")
+        ("delay-from-device", po::value<unsigned>()->default_value(0), "milliseconds added to the packets from the devices")
+        ("jitter-from-device", po::value<unsigned>()->default_value(0), "maximum random milliseconds added to the packets from the devices")
+        ("duration,d", po::value<unsigned>()->default_value(0), "seconds to run, 0 to run until interrupted")
+        ("report-interval", po::value<unsigned>()->default_value(10), "seconds between the reports")
+        ("verbose,v", "log the sessions");
+
+    po::variables_map vm;
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help"))
+        {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    }
+    catch (const po::error& e)
+    {
+        std::cerr << e.what() << std::endl << desc << std::endl;
+        return 1;
+    }
+
+    Workload workload;
+    if (vm.count("workload"))
+    {
+        for (const auto& text: vm["workload"].as<std::vector<std::string>>())
+        {
+            WorkloadStep step;
+            if (!WorkloadStep::parse(text, step))
+            {
+                std::cerr << "Invalid workload step " << text << std::endl;
+                return 1;
+            }
+            workload.steps.push_back(step);
+        }
+    }
+    workload.repeat = vm.count("repeat");
+    workload.window = vm["window"].as<unsigned>();
+    if (vm.count("function"))
+        workload.function = vm["function"].as<std::string>();
+    workload.argument = vm["argument"].as<std::string>();
+    if (vm.count("variable"))
+        workload.variable = vm["variable"].as<std::string>();
+    workload.event_name = vm["event-name"].as<std::string>();
+    workload.event_size = vm["event-size"].as<size_t>();
+    workload.ota_size = vm["ota-size"].as<size_t>();
+    workload.chunk_size = vm["chunk-size"].as<size_t>();
+    if (!workload.ota_size || !workload.chunk_size || workload.chunk_size > 1024)
+    {
+        std::cerr << "The OTA size should not be 0, the chunk size should be between 1 and 1024" << std::endl;
+        return 1;
+    }
+
+    CloudConfig config;
+    config.tcp_port = vm["tcp-port"].as<uint16_t>();
+    config.udp_port = vm["udp-port"].as<uint16_t>();
+    config.verbose = vm.count("verbose");
+    if (!parse_impairment(vm, "to-device", config.to_device) || !parse_impairment(vm, "from-device", config.from_device))
+    {
+        std::cerr << "The loss should be a percentage" << std::endl;
+        return 1;
+    }
+    boost::system::error_code ec;
+    const auto address = boost::asio::ip::address_v4::from_string(vm["address"].as<std::string>(), ec);
+    if (ec)
+    {
+        std::cerr << "Invalid address " << vm["address"].as<std::string>() << std::endl;
+        return 1;
+    }
+
+    const std::string key_dir = vm["keys"].as<std::string>();
+    mkdir(key_dir.c_str(), 0755);
+    rsa_context rsa_key;
+    std::vector<uint8_t> ec_key;
+    DTLSServerConfig dtls;
+    if (!server_rsa_key(key_dir, rsa_key) || !server_ec_key(key_dir, ec_key) ||
+            dtls.init(ec_key.data(), ec_key.size(), rng))
+    {
+        std::cerr << "Unable to load or generate the server keys in " << key_dir << std::endl;
+        return 1;
+    }
+    if (!write_server_public_rsa(key_dir + "/server_public_rsa.der", rsa_key, address) ||
+            !write_server_public_ec(key_dir + "/server_public_ec.der", ec_key, address))
+    {
+        std::cerr << "Unable to write the server public keys in " << key_dir << std::endl;
+        return 1;
+    }
+
+    boost::asio::io_service io;
+    CloudStats stats;
+    CloudServer server(io, config, workload, stats, rsa_key, dtls, rng);
+    if (!server.start())
+        return 1;
+    printf("listening on TCP %u, UDP %u, device keys %s/server_public_rsa.der and %s/server_public_ec.der\n",
+            config.tcp_port, config.udp_port, key_dir.c_str(), key_dir.c_str());
+    fflush(stdout);
+
+    const unsigned duration = vm["duration"].as<unsigned>();
+    const unsigned report_interval = vm["report-interval"].as<unsigned>();
+    const Clock::time_point start = Clock::now();
+    boost::asio::steady_timer report_timer(io);
+    std::function<void()> schedule_report = [&]() {
+        report_timer.expires_from_now(std::chrono::seconds(report_interval));
+        report_timer.async_wait([&](const boost::system::error_code& ec) {
+            if (ec)
+                return;
+            // the latencies are accumulated over the run
+            const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            printf("elapsed: %.1fs, sessions %u, connections %u, handshakes %u, disconnects %u, dropped %u\n",
+                    elapsed, unsigned(server.sessions()), stats.connections, stats.handshakes,
+                    stats.disconnects, server.dropped());
+            stats.latency.report(stdout, elapsed);
+            schedule_report();
+        });
+    };
+    if (report_interval)
+        schedule_report();
+
+    boost::asio::steady_timer stop_timer(io);
+    boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+    auto stop = [&]() {
+        boost::system::error_code ignored;
+        stop_timer.cancel(ignored);
+        report_timer.cancel(ignored);
+        signals.cancel(ignored);
+        server.stop();
+    };
+    if (duration)
+    {
+        stop_timer.expires_from_now(std::chrono::seconds(duration));
+        stop_timer.async_wait([&](const boost::system::error_code& ec) {
+            if (!ec)
+                stop();
+        });
+    }
+    signals.async_wait([&](const boost::system::error_code& ec, int) {
+        if (!ec)
+            stop();
+    });
+
+    io.run();
+
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("total: %.1fs, connections %u, handshakes %u, disconnects %u, dropped %u\n",
+            elapsed, stats.connections, stats.handshakes, stats.disconnects, server.dropped());
+    stats.latency.report(stdout, elapsed);
+    rsa_free(&rsa_key);
+    return 0;
+}
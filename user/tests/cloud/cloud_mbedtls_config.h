@@ -0,0 +1,15 @@
+/**
+ * Adjustments to communication/src/mbedtls_config.h for the stand-in cloud server.
+ */
+#pragma once
+
+/**
+ * The server side of the DTLS handshake, not needed on the devices.
+ */
+#define MBEDTLS_SSL_SRV_C
+
+/**
+ * The pool of ephemeral keys belongs to the device, the server generates its keys
+ * during the handshake.
+ */
+#undef MBEDTLS_ECDH_GEN_PUBLIC_ALT
@@ -0,0 +1,375 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "cloud_server.h"
+
+namespace particle { namespace cloud {
+
+namespace {
+
+// interval of the retransmission and pacing timers of the sessions
+const auto TICK_INTERVAL = std::chrono::milliseconds(10);
+
+const uint8_t CONTENT_TYPE_HANDSHAKE = 22;
+const uint8_t HANDSHAKE_CLIENT_HELLO = 1;
+const size_t RECORD_HEADER_LENGTH = 13;
+const uint8_t CONTENT_TYPE_APPLICATION_DATA = 23;
+// application data of a session moved to a new endpoint, see DTLSMessageChannel::send()
+const uint8_t CONTENT_TYPE_MOVE_SESSION = 254;
+const size_t DEVICE_ID_LENGTH = 12;
+
+std::string hex_id(const uint8_t* id)
+{
+    char hex[DEVICE_ID_LENGTH * 2 + 1];
+    for (size_t i = 0; i < DEVICE_ID_LENGTH; ++i)
+        sprintf(hex + i * 2, "%02x", id[i]);
+    return hex;
+}
+
+/**
+ * Returns true if the datagram starts with the ClientHello of an initial handshake (epoch 0).
+ */
+bool client_hello(const Packet& data)
+{
+    return data.size() > RECORD_HEADER_LENGTH && data[0] == CONTENT_TYPE_HANDSHAKE && !data[3] && !data[4] &&
+            data[RECORD_HEADER_LENGTH] == HANDSHAKE_CLIENT_HELLO;
+}
+
+} // namespace
+
+CloudServer::TcpConnection::TcpConnection(CloudServer& server) :
+        socket(server.io),
+        to_device(server.io, server.config.to_device, server.random, true),
+        from_device(server.io, server.config.from_device, server.random, true),
+        session(server.workload, server.stats, server.random, server.config.verbose)
+{
+}
+
+CloudServer::UdpSession::UdpSession(CloudServer& server, const udp::endpoint& endpoint) :
+        endpoint(endpoint),
+        session(server.workload, server.stats, server.random, server.config.verbose)
+{
+}
+
+CloudServer::CloudServer(boost::asio::io_service& io, const CloudConfig& config, const Workload& workload,
+        CloudStats& stats, rsa_context& rsa_key, const DTLSServerConfig& dtls, Rng rng) :
+        io(io),
+        config(config),
+        workload(workload),
+        stats(stats),
+        rsa_key(rsa_key),
+        dtls(dtls),
+        rng(rng),
+        random(std::random_device{}()),
+        acceptor(io),
+        udp_socket(io),
+        timer(io),
+        stopped(false),
+        udp_to_device(io, config.to_device, random, false),
+        udp_from_device(io, config.from_device, random, false)
+{
+}
+
+bool CloudServer::start()
+{
+    boost::system::error_code ec;
+    if (config.tcp_port)
+    {
+        const tcp::endpoint endpoint(tcp::v4(), config.tcp_port);
+        acceptor.open(endpoint.protocol(), ec);
+        if (!ec)
+            acceptor.set_option(tcp::acceptor::reuse_address(true), ec);
+        if (!ec)
+            acceptor.bind(endpoint, ec);
+        if (!ec)
+            acceptor.listen(boost::asio::socket_base::max_connections, ec);
+        if (ec)
+        {
+            fprintf(stderr, "Unable to listen on TCP port %u: %s\n", config.tcp_port, ec.message().c_str());
+            return false;
+        }
+        accept();
+    }
+    if (config.udp_port)
+    {
+        udp_socket.open(udp::v4(), ec);
+        if (!ec)
+            udp_socket.bind(udp::endpoint(udp::v4(), config.udp_port), ec);
+        if (ec)
+        {
+            fprintf(stderr, "Unable to bind UDP port %u: %s\n", config.udp_port, ec.message().c_str());
+            return false;
+        }
+        receive();
+    }
+    schedule_tick();
+    return true;
+}
+
+void CloudServer::stop()
+{
+    stopped = true;
+    boost::system::error_code ec;
+    acceptor.close(ec);
+    udp_socket.close(ec);
+    timer.cancel(ec);
+    // copies, as closing removes them from the containers
+    while (!tcp_connections.empty())
+        close(TcpConnectionPtr(*tcp_connections.begin()));
+    while (!udp_sessions.empty())
+        close(UdpSessionPtr(udp_sessions.begin()->second));
+}
+
+void CloudServer::schedule_tick()
+{
+    timer.expires_from_now(TICK_INTERVAL);
+    timer.async_wait([this](const boost::system::error_code& ec) {
+        if (ec || stopped)
+            return;
+        // the sessions that fail are closed from a posted handler, the sets aren't modified here
+        for (const auto& connection: tcp_connections)
+            connection->session.tick();
+        for (const auto& entry: udp_sessions)
+            entry.second->session.tick();
+        schedule_tick();
+    });
+}
+
+void CloudServer::accept()
+{
+    auto connection = std::make_shared<TcpConnection>(*this);
+    acceptor.async_accept(connection->socket, [this, connection](const boost::system::error_code& ec) {
+        if (stopped)
+            return;
+        if (!ec)
+        {
+            boost::system::error_code ignored;
+            connection->socket.set_option(tcp::no_delay(true), ignored);
+            tcp_connections.insert(connection);
+            std::weak_ptr<TcpConnection> weak = connection;
+            auto transmit = [this, weak](Packet packet) {
+                auto c = weak.lock();
+                if (!c || c->closed)
+                    return;
+                c->to_device.pass(std::move(packet), [this, weak](Packet& data) {
+                    auto c = weak.lock();
+                    if (!c || c->closed)
+                        return;
+                    c->output.push_back(std::move(data));
+                    write(c);
+                });
+            };
+            std::unique_ptr<ServerChannel> channel(new LightSSLServerChannel(connection->session, transmit, rsa_key, rng));
+            connection->session.start(std::move(channel), [this, weak]() {
+                io.post([this, weak]() {
+                    if (auto c = weak.lock())
+                        close(c);
+                });
+            });
+            read(connection);
+        }
+        accept();
+    });
+}
+
+void CloudServer::read(const TcpConnectionPtr& connection)
+{
+    connection->socket.async_read_some(boost::asio::buffer(connection->buffer),
+            [this, connection](const boost::system::error_code& ec, size_t size) {
+        if (connection->closed)
+            return;
+        if (ec)
+        {
+            close(connection);
+            return;
+        }
+        std::weak_ptr<TcpConnection> weak = connection;
+        connection->from_device.pass(Packet(connection->buffer, connection->buffer + size), [weak](Packet& data) {
+            auto c = weak.lock();
+            if (c && !c->closed)
+                c->session.channel().received(data.data(), data.size());
+        });
+        read(connection);
+    });
+}
+
+void CloudServer::write(const TcpConnectionPtr& connection)
+{
+    if (connection->writing || connection->output.empty())
+        return;
+    connection->writing = true;
+    boost::asio::async_write(connection->socket, boost::asio::buffer(connection->output.front()),
+            [this, connection](const boost::system::error_code& ec, size_t) {
+        connection->writing = false;
+        if (connection->closed)
+            return;
+        if (ec)
+        {
+            close(connection);
+            return;
+        }
+        connection->output.pop_front();
+        write(connection);
+    });
+}
+
+void CloudServer::close(const TcpConnectionPtr& connection)
+{
+    if (connection->closed)
+        return;
+    connection->closed = true;
+    // the operations in flight when the server stops aren't failures
+    if (!stopped)
+    {
+        connection->session.disconnected();
+        stats.disconnects++;
+    }
+    boost::system::error_code ec;
+    connection->socket.close(ec);
+    tcp_connections.erase(connection);
+}
+
+void CloudServer::receive()
+{
+    udp_socket.async_receive_from(boost::asio::buffer(udp_buffer), udp_sender,
+            [this](const boost::system::error_code& ec, size_t size) {
+        if (stopped)
+            return;
+        // errors are reported for the ICMP messages of the previous datagrams, the socket remains usable
+        if (!ec)
+        {
+            const udp::endpoint endpoint = udp_sender;
+            udp_from_device.pass(Packet(udp_buffer, udp_buffer + size), [this, endpoint](Packet& data) {
+                if (!stopped)
+                    datagram(endpoint, data);
+            });
+        }
+        receive();
+    });
+}
+
+/**
+ * Passes a datagram to the session of its endpoint. A moved session is found by the device
+ * ID appended to the record, and a ClientHello from an unknown endpoint starts a new session.
+ */
+void CloudServer::datagram(const udp::endpoint& endpoint, Packet& data)
+{
+    if (data.empty())
+        return;
+    UdpSessionPtr session;
+    auto it = udp_sessions.find(endpoint);
+    if (data[0] == CONTENT_TYPE_MOVE_SESSION)
+    {
+        if (data.size() <= DEVICE_ID_LENGTH + 1 || data.back() != DEVICE_ID_LENGTH)
+            return;
+        const std::string id = hex_id(data.data() + data.size() - DEVICE_ID_LENGTH - 1);
+        data.resize(data.size() - DEVICE_ID_LENGTH - 1);
+        data[0] = CONTENT_TYPE_APPLICATION_DATA;
+        auto device = udp_devices.find(id);
+        if (device == udp_devices.end())
+        {
+            stats.latency.error("move-session");
+            return;
+        }
+        session = device->second;
+        if (session->endpoint != endpoint)
+        {
+            if (it != udp_sessions.end())
+                close(UdpSessionPtr(it->second));
+            udp_sessions.erase(session->endpoint);
+            session->endpoint = endpoint;
+            udp_sessions[endpoint] = session;
+            stats.latency.count("move-session");
+        }
+    }
+    else if (it != udp_sessions.end())
+    {
+        session = it->second;
+        // a new handshake from the endpoint of an established session replaces it, the other
+        // handshake messages are retransmissions of the last flight of the device
+        if (client_hello(data) && session->session.channel().established())
+        {
+            close(session);
+            session = create(endpoint);
+        }
+    }
+    else if (client_hello(data))
+        session = create(endpoint);
+    else
+        return;
+
+    session->session.channel().received(data.data(), data.size());
+
+    // the device ID is known from the hello, a device connecting again replaces its previous session
+    const std::string& id = session->session.id();
+    if (!id.empty())
+    {
+        UdpSessionPtr& entry = udp_devices[id];
+        if (entry != session)
+        {
+            const UdpSessionPtr previous = entry;
+            entry = session;
+            if (previous)
+                close(previous);
+        }
+    }
+}
+
+CloudServer::UdpSessionPtr CloudServer::create(const udp::endpoint& endpoint)
+{
+    auto session = std::make_shared<UdpSession>(*this, endpoint);
+    udp_sessions[endpoint] = session;
+    std::weak_ptr<UdpSession> weak = session;
+    auto transmit = [this, weak](Packet packet) {
+        udp_to_device.pass(std::move(packet), [this, weak](Packet& data) {
+            auto s = weak.lock();
+            if (!s || stopped)
+                return;
+            auto datagram = std::make_shared<Packet>(std::move(data));
+            udp_socket.async_send_to(boost::asio::buffer(*datagram), s->endpoint,
+                    [datagram](const boost::system::error_code&, size_t) {});
+        });
+    };
+    std::unique_ptr<ServerChannel> channel(new DTLSServerChannel(session->session, transmit, dtls));
+    session->session.start(std::move(channel), [this, weak]() {
+        io.post([this, weak]() {
+            if (auto s = weak.lock())
+                close(s);
+        });
+    });
+    return session;
+}
+
+void CloudServer::close(const UdpSessionPtr& session)
+{
+    auto it = udp_sessions.find(session->endpoint);
+    if (it == udp_sessions.end() || it->second != session)
+        return;
+    udp_sessions.erase(it);
+    auto device = udp_devices.find(session->session.id());
+    if (device != udp_devices.end() && device->second == session)
+        udp_devices.erase(device);
+    if (!stopped)
+    {
+        session->session.disconnected();
+        stats.disconnects++;
+    }
+}
+
+}} // namespace particle::cloud
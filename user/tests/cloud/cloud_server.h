@@ -0,0 +1,137 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include "device_session.h"
+
+#include <boost/asio.hpp>
+#include <map>
+#include <memory>
+#include <set>
+
+namespace particle { namespace cloud {
+
+/**
+ * Settings of the server.
+ */
+struct CloudConfig
+{
+    uint16_t tcp_port = 5683;
+    uint16_t udp_port = 5684;
+    /**
+     * Impairment of the packets sent to the devices, and of those received from them.
+     */
+    Impairment to_device;
+    Impairment from_device;
+    bool verbose = false;
+};
+
+/**
+ * Accepts the LightSSL connections of the devices over TCP and the DTLS sessions over
+ * UDP, and runs a DeviceSession for each. Runs on a single thread.
+ */
+class CloudServer
+{
+public:
+    typedef int (*Rng)(void*, uint8_t*, size_t);
+
+    CloudServer(boost::asio::io_service& io, const CloudConfig& config, const Workload& workload,
+            CloudStats& stats, rsa_context& rsa_key, const DTLSServerConfig& dtls, Rng rng);
+
+    CloudServer(const CloudServer&) = delete;
+    CloudServer& operator=(const CloudServer&) = delete;
+
+    /**
+     * Opens the sockets and starts accepting devices.
+     */
+    bool start();
+    void stop();
+
+    size_t sessions() const { return tcp_connections.size() + udp_sessions.size(); }
+
+    unsigned dropped() const { return udp_to_device.dropped() + udp_from_device.dropped(); }
+
+private:
+    typedef boost::asio::ip::tcp tcp;
+    typedef boost::asio::ip::udp udp;
+
+    struct TcpConnection
+    {
+        tcp::socket socket;
+        ImpairedLink to_device;
+        ImpairedLink from_device;
+        DeviceSession session;
+        uint8_t buffer[1024];
+        std::deque<Packet> output;
+        bool writing = false;
+        bool closed = false;
+
+        TcpConnection(CloudServer& server);
+    };
+
+    struct UdpSession
+    {
+        udp::endpoint endpoint;
+        DeviceSession session;
+
+        UdpSession(CloudServer& server, const udp::endpoint& endpoint);
+    };
+
+    typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+    typedef std::shared_ptr<UdpSession> UdpSessionPtr;
+
+    boost::asio::io_service& io;
+    const CloudConfig& config;
+    const Workload& workload;
+    CloudStats& stats;
+    rsa_context& rsa_key;
+    const DTLSServerConfig& dtls;
+    Rng rng;
+    std::mt19937 random;
+
+    tcp::acceptor acceptor;
+    udp::socket udp_socket;
+    boost::asio::steady_timer timer;
+    bool stopped;
+
+    std::set<TcpConnectionPtr> tcp_connections;
+
+    ImpairedLink udp_to_device;
+    ImpairedLink udp_from_device;
+    udp::endpoint udp_sender;
+    uint8_t udp_buffer[2048];
+    std::map<udp::endpoint, UdpSessionPtr> udp_sessions;
+    // the sessions by device ID, to find the session moved to a new endpoint
+    std::map<std::string, UdpSessionPtr> udp_devices;
+
+    void accept();
+    void read(const TcpConnectionPtr& connection);
+    void write(const TcpConnectionPtr& connection);
+    void close(const TcpConnectionPtr& connection);
+
+    void receive();
+    void datagram(const udp::endpoint& endpoint, Packet& data);
+    UdpSessionPtr create(const udp::endpoint& endpoint);
+    void close(const UdpSessionPtr& session);
+
+    void schedule_tick();
+};
+
+}} // namespace particle::cloud
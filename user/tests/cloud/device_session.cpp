@@ -0,0 +1,792 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "device_session.h"
+#include "messages.h"
+
+#include <boost/crc.hpp>
+#include <cstdarg>
+#include <ctime>
+
+namespace particle { namespace cloud {
+
+using namespace particle::protocol;
+
+namespace {
+
+// CoAP retransmission of the confirmable requests (RFC 7252), as done by the device
+const auto ACK_TIMEOUT = std::chrono::milliseconds(2000);
+const unsigned MAX_RETRANSMIT = 4;
+// time for a separate response (function result, update ready) once the request is acknowledged
+const auto RESPONSE_TIMEOUT = std::chrono::seconds(20);
+// time without progress before a firmware update is failed
+const auto UPDATE_TIMEOUT = std::chrono::seconds(15);
+// chunks sent per tick of the server, so that the socket buffer of the device isn't overrun
+const unsigned CHUNKS_PER_TICK = 8;
+// acknowledgements kept to answer the retransmissions of the device
+const size_t RECENT_ACKS = 16;
+
+const uint32_t NO_BLOCK = 0xFFFFFFFF;
+
+const uint8_t GET = 0x01;
+const uint8_t POST = 0x02;
+const uint8_t PUT = 0x03;
+const uint8_t CONTENT = 0x45;
+
+size_t header(uint8_t* buf, CoAPType::Enum type, uint8_t code, message_id_t id, const token_t* token)
+{
+    buf[0] = COAP_MSG_HEADER(type, token ? 1 : 0);
+    buf[1] = code;
+    buf[2] = id >> 8;
+    buf[3] = id & 0xff;
+    if (!token)
+        return 4;
+    buf[4] = *token;
+    return 5;
+}
+
+size_t path(uint8_t* buf, char path)
+{
+    return CoAP::option(buf, CoAPOption::URI_PATH, (const uint8_t*)&path, 1);
+}
+
+size_t path(uint8_t* buf, char path, const std::string& name)
+{
+    size_t size = CoAP::option(buf, CoAPOption::URI_PATH, (const uint8_t*)&path, 1);
+    return size + CoAP::option(buf + size, 0, (const uint8_t*)name.data(), name.size());
+}
+
+void encode_uint32(uint8_t* buf, uint32_t value)
+{
+    buf[0] = value >> 24;
+    buf[1] = value >> 16;
+    buf[2] = value >> 8;
+    buf[3] = value;
+}
+
+/**
+ * Returns the first name in the JSON array or object following the given key of a
+ * describe message, e.g. "f":["name",...] or "v":{"name":2,...}.
+ */
+std::string first_name(const std::string& description, const char* key)
+{
+    size_t pos = description.find(key);
+    if (pos == std::string::npos)
+        return std::string();
+    pos += strlen(key);
+    if (pos >= description.size() || description[pos] != '"')
+        return std::string();
+    const size_t end = description.find('"', pos + 1);
+    return end == std::string::npos ? std::string() : description.substr(pos + 1, end - pos - 1);
+}
+
+} // namespace
+
+DeviceSession::DeviceSession(const Workload& workload, CloudStats& stats, std::mt19937& random, bool verbose) :
+        workload(workload),
+        stats(stats),
+        random(random),
+        verbose(verbose),
+        started(Clock::now()),
+        failed(false),
+        ready(false),
+        next_message_id(random()),
+        next_token(random()),
+        function(workload.function),
+        variable(workload.variable),
+        repeat_from(0),
+        step_index(0),
+        issued(0),
+        completed(0),
+        in_flight(0),
+        pumping(false),
+        pump_again(false)
+{
+}
+
+void DeviceSession::start(std::unique_ptr<ServerChannel> channel, const Close& close)
+{
+    channel_ = std::move(channel);
+    this->close = close;
+    started = Clock::now();
+    stats.connections++;
+    channel_->start();
+}
+
+void DeviceSession::log(const char* format, ...)
+{
+    if (!verbose)
+        return;
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    printf("[%s] %s\n", device_id.empty() ? "-" : device_id.c_str(), message);
+    fflush(stdout);
+}
+
+bool DeviceSession::send(const Packet& message)
+{
+    return !failed && channel_->send(message.data(), message.size());
+}
+
+void DeviceSession::reply(const uint8_t* request, Packet response)
+{
+    send(response);
+    recent_acks.emplace_back(CoAP::message_id(request), std::move(response));
+    if (recent_acks.size() > RECENT_ACKS)
+        recent_acks.pop_front();
+}
+
+void DeviceSession::acknowledge(const uint8_t* request)
+{
+    if (CoAP::type(request) != CoAPType::CON)
+        return;
+    Packet ack(4);
+    Messages::empty_ack(ack.data(), request[2], request[3]);
+    reply(request, std::move(ack));
+}
+
+void DeviceSession::channel_established(const uint8_t* id)
+{
+    stats.handshakes++;
+    stats.latency.add("handshake", Clock::now() - started);
+    if (id)
+    {
+        char hex[25];
+        for (size_t i = 0; i < 12; ++i)
+            sprintf(hex + i * 2, "%02x", id[i]);
+        device_id = hex;
+        // the LightSSL device waits for the hello of the server before its own
+        Packet hello(6);
+        const size_t size = header(hello.data(), CoAPType::NON, POST, message_id(), nullptr);
+        path(hello.data() + size, 'h');
+        send(hello);
+    }
+    log("handshake completed");
+}
+
+void DeviceSession::channel_error(const char* message)
+{
+    log("%s", message);
+    if (!channel_->established())
+        stats.latency.error("handshake");
+    disconnected();
+    failed = true;
+    if (close)
+        close();
+}
+
+void DeviceSession::disconnected()
+{
+    if (failed)
+        return;
+    for (const auto& entry: requests)
+    {
+        if (entry.second.operation != Operation::OTA)
+            stats.latency.error(operation_name(entry.second.operation));
+    }
+    requests.clear();
+    if (update.phase != Update::IDLE)
+        stats.latency.error(operation_name(Operation::OTA));
+    update = Update();
+    in_flight = 0;
+    ready = false;
+}
+
+void DeviceSession::channel_message(uint8_t* data, size_t length)
+{
+    // shorter records are keep-alives
+    if (length < 4)
+        return;
+    const CoAPType::Enum type = CoAP::type(data);
+    if (type == CoAPType::CON)
+    {
+        const message_id_t id = CoAP::message_id(data);
+        for (const auto& ack: recent_acks)
+        {
+            if (ack.first == id)
+            {
+                stats.latency.count("duplicate");
+                send(ack.second);
+                return;
+            }
+        }
+    }
+    const uint8_t code = data[1];
+    if (type == CoAPType::ACK)
+        handle_acknowledgement(data, length);
+    else if (type == CoAPType::RESET)
+        handle_reset(data);
+    else if (code == 0)
+        acknowledge(data);  // ping
+    else if (code < 0x20)
+        handle_request(data, length);
+    else
+        handle_response(data, length);
+}
+
+void DeviceSession::hello_received(const uint8_t* data, size_t length)
+{
+    // the DTLS device sends its ID in the hello, see Messages::hello()
+    if (device_id.empty() && length >= 29 && data[6] == 0xFF && (data[15] << 8 | data[16]) == 12)
+    {
+        char hex[25];
+        for (size_t i = 0; i < 12; ++i)
+            sprintf(hex + i * 2, "%02x", data[17 + i]);
+        device_id = hex;
+    }
+    stats.latency.count("hello");
+    log("hello");
+    if (ready)
+        return;
+    ready = true;
+    steps = workload.steps;
+    repeat_from = 0;
+    bool named = true;
+    for (const auto& step: steps)
+    {
+        if ((step.operation == Operation::FUNCTION && function.empty()) ||
+                (step.operation == Operation::VARIABLE && variable.empty()))
+            named = false;
+    }
+    if (!named)
+    {
+        WorkloadStep describe;
+        describe.operation = Operation::DESCRIBE;
+        steps.insert(steps.begin(), describe);
+        repeat_from = 1;
+    }
+    step_index = 0;
+    issued = 0;
+    completed = 0;
+    pump();
+}
+
+void DeviceSession::handle_request(uint8_t* data, size_t length)
+{
+    const size_t token_length = data[0] & 0x0F;
+    const token_t token = token_length ? data[4] : 0;
+    const uint8_t code = data[1];
+    const char path = length > 5 + token_length ? CoAP::path(data)[0] : 0;
+
+    if (code == GET && path == 't')
+    {
+        Packet response(10);
+        const size_t size = Messages::content(response.data(), CoAP::message_id(data), token);
+        encode_uint32(response.data() + size, time(nullptr));
+        stats.latency.count("time");
+        reply(data, std::move(response));
+        return;
+    }
+    acknowledge(data);
+    if (code == POST && path == 'h')
+        hello_received(data, length);
+    else if (code == POST && (path == 'e' || path == 'E'))
+        stats.latency.count("device-event");
+    else if (code == GET && path == 'e')
+        stats.latency.count("subscribe");
+    else if (code == PUT && path == 'u')
+        finish_update(true);    // all the chunks were received, see ChunkedTransfer::handle_chunk()
+    else if (code == GET && path == 'c' && update.phase != Update::IDLE)
+    {
+        CoAPOptionIterator it(data, length);
+        while (it.next())
+            ;
+        const uint8_t* payload = it.payload();
+        for (size_t i = 0; i + 1 < it.payload_size(); i += 2)
+            update.missed.push_back(payload[i] << 8 | payload[i + 1]);
+        update.last_activity = Clock::now();
+        stats.latency.count("chunk-missed");
+    }
+}
+
+void DeviceSession::handle_response(uint8_t* data, size_t length)
+{
+    acknowledge(data);
+    const token_t token = (data[0] & 0x0F) ? data[4] : 0;
+    const uint8_t code = data[1];
+    if (update.phase == Update::BEGIN && token == update.token)
+    {
+        // update ready, see ChunkedTransfer::handle_update_begin()
+        for (auto it = requests.begin(); it != requests.end(); ++it)
+        {
+            if (it->second.operation == Operation::OTA)
+            {
+                requests.erase(it);
+                break;
+            }
+        }
+        if (code != ChunkReceivedCode::OK)
+        {
+            finish_update(false);
+            return;
+        }
+        update.phase = Update::SENDING;
+        update.last_activity = Clock::now();
+        send_chunks();
+        return;
+    }
+    for (auto it = requests.begin(); it != requests.end(); ++it)
+    {
+        if (it->second.operation == Operation::FUNCTION && it->second.token == token)
+        {
+            const Clock::time_point start = it->second.start;
+            requests.erase(it);
+            complete(Operation::FUNCTION, start, code == ChunkReceivedCode::OK);
+            return;
+        }
+    }
+}
+
+void DeviceSession::handle_acknowledgement(uint8_t* data, size_t length)
+{
+    auto it = requests.find(CoAP::message_id(data));
+    if (it == requests.end())
+        return;
+    Request& request = it->second;
+    const uint8_t code = data[1];
+    const Operation::Enum operation = request.operation;
+    const Clock::time_point start = request.start;
+
+    switch (operation)
+    {
+    case Operation::DESCRIBE:
+    case Operation::VARIABLE:
+    {
+        const token_t token = request.token;
+        requests.erase(it);
+        if (code != CONTENT)
+        {
+            complete(operation, start, false);
+            break;
+        }
+        CoAPOptionIterator options(data, length);
+        uint32_t next_block = NO_BLOCK;
+        while (options.next())
+        {
+            if (options.option() == CoAPOption::BLOCK2)
+            {
+                CoAPBlock block = CoAPBlock::decode(CoAP::decode_uint(options.data(), options.size()));
+                if (block.more)
+                {
+                    block.num++;
+                    block.more = false;
+                    next_block = block.encode();
+                }
+            }
+        }
+        if (operation == Operation::DESCRIBE && options.payload())
+            description.append((const char*)options.payload(), options.payload_size());
+        if (next_block != NO_BLOCK)
+        {
+            request_block(operation, token, start, next_block);
+            break;
+        }
+        if (operation == Operation::DESCRIBE)
+            described();
+        complete(operation, start, true);
+        break;
+    }
+    case Operation::FUNCTION:
+        if (code)
+        {
+            requests.erase(it);
+            complete(operation, start, false);
+        }
+        else
+        {
+            request.acknowledged = true;
+            request.deadline = Clock::now() + RESPONSE_TIMEOUT;
+        }
+        break;
+
+    case Operation::OTA:
+        if (update.phase == Update::BEGIN)
+        {
+            if (code)
+            {
+                requests.erase(it);
+                finish_update(false);
+            }
+            else
+            {
+                request.acknowledged = true;
+                request.deadline = Clock::now() + RESPONSE_TIMEOUT;
+            }
+        }
+        else
+        {
+            // update done, the device requests the missed chunks when some are missing
+            requests.erase(it);
+            if (code == ChunkReceivedCode::OK)
+                finish_update(true);
+            else
+                update.last_activity = Clock::now();
+        }
+        break;
+
+    default:
+        requests.erase(it);
+        complete(operation, start, code == 0);
+        break;
+    }
+}
+
+void DeviceSession::handle_reset(const uint8_t* data)
+{
+    auto it = requests.find(CoAP::message_id(data));
+    if (it == requests.end())
+        return;
+    const Operation::Enum operation = it->second.operation;
+    const Clock::time_point start = it->second.start;
+    requests.erase(it);
+    if (operation == Operation::OTA)
+        finish_update(false);
+    else
+        complete(operation, start, false);
+}
+
+void DeviceSession::tick()
+{
+    if (failed)
+        return;
+    channel_->tick();
+    const Clock::time_point now = Clock::now();
+    std::vector<message_id_t> expired;
+    for (auto& entry: requests)
+    {
+        Request& request = entry.second;
+        if (now < request.deadline)
+            continue;
+        // also over TCP: the device drops the requests received while it waits for the
+        // acknowledgement of its own confirmable message, see CoAPMessageStore::send_synchronous()
+        if (!request.acknowledged && request.retransmits < MAX_RETRANSMIT)
+        {
+            request.retransmits++;
+            request.deadline = now + ACK_TIMEOUT * (1 << request.retransmits);
+            stats.latency.count("retransmit");
+            send(request.message);
+        }
+        else
+            expired.push_back(entry.first);
+    }
+    for (message_id_t id: expired)
+    {
+        auto it = requests.find(id);
+        if (it == requests.end())
+            continue;
+        const Operation::Enum operation = it->second.operation;
+        const Clock::time_point start = it->second.start;
+        requests.erase(it);
+        log("%s timed out", operation_name(operation));
+        if (operation == Operation::OTA)
+            finish_update(false);
+        else
+            complete(operation, start, false);
+    }
+
+    if (update.phase == Update::SENDING || (update.phase == Update::DONE && !update.missed.empty()))
+        send_chunks();
+    if (update.phase != Update::IDLE && now - update.last_activity > UPDATE_TIMEOUT)
+    {
+        log("update timed out");
+        finish_update(false);
+    }
+    pump();
+}
+
+/**
+ * Starts the operations of the current step that the window and interval allow, and
+ * moves to the next step once all the operations of the step completed.
+ */
+void DeviceSession::pump()
+{
+    if (pumping)
+    {
+        pump_again = true;
+        return;
+    }
+    pumping = true;
+    do
+    {
+        pump_again = false;
+        while (ready && !failed)
+        {
+            if (step_index >= steps.size())
+            {
+                if (!workload.repeat || steps.size() == repeat_from)
+                    break;
+                step_index = repeat_from;
+                issued = 0;
+                completed = 0;
+            }
+            const WorkloadStep& step = steps[step_index];
+            if (completed >= step.count)
+            {
+                step_index++;
+                issued = 0;
+                completed = 0;
+                continue;
+            }
+            const bool serial = step.operation == Operation::OTA || step.operation == Operation::DESCRIBE;
+            const unsigned window = serial || !workload.window ? 1 : workload.window;
+            if (issued >= step.count || in_flight >= window)
+                break;
+            const Clock::time_point now = Clock::now();
+            if (step.interval && issued && now < next_issue)
+                break;
+            next_issue = now + std::chrono::milliseconds(step.interval);
+            issued++;
+            in_flight++;
+            issue(step.operation);
+        }
+    }
+    while (pump_again);
+    pumping = false;
+}
+
+void DeviceSession::issue(Operation::Enum operation)
+{
+    const Clock::time_point now = Clock::now();
+    switch (operation)
+    {
+    case Operation::PING:
+    {
+        Packet message(4);
+        Messages::ping(message.data(), message_id());
+        send_request(operation, std::move(message), 0, now);
+        break;
+    }
+    case Operation::DESCRIBE:
+        description.clear();
+        request_block(operation, next_token++, now, NO_BLOCK);
+        break;
+
+    case Operation::VARIABLE:
+        if (variable.empty())
+            complete(operation, now, false);
+        else
+            request_block(operation, next_token++, now, NO_BLOCK);
+        break;
+
+    case Operation::FUNCTION:
+    {
+        if (function.empty())
+        {
+            complete(operation, now, false);
+            break;
+        }
+        const token_t token = next_token++;
+        Packet message(5 + 2 + 5 + function.size() + 5 + workload.argument.size());
+        size_t size = header(message.data(), CoAPType::CON, POST, message_id(), &token);
+        size += path(message.data() + size, 'f', function);
+        size += CoAP::option(message.data() + size, CoAPOption::URI_QUERY - CoAPOption::URI_PATH,
+                (const uint8_t*)workload.argument.data(), workload.argument.size());
+        message.resize(size);
+        send_request(operation, std::move(message), token, now);
+        break;
+    }
+    case Operation::EVENT:
+    {
+        const std::string data(workload.event_size, 'x');
+        const bool confirmable = !channel_->reliable();
+        Packet message(5 + 2 + 5 + workload.event_name.size() + 1 + data.size());
+        size_t size = header(message.data(), confirmable ? CoAPType::CON : CoAPType::NON, POST, message_id(), nullptr);
+        size += path(message.data() + size, 'e', workload.event_name);
+        message[size++] = 0xFF;
+        memcpy(message.data() + size, data.data(), data.size());
+        message.resize(size + data.size());
+        if (confirmable)
+            send_request(operation, std::move(message), 0, now);
+        else
+        {
+            // the device acknowledges events only on unreliable channels, see Subscriptions::handle_event()
+            send(message);
+            stats.latency.count(operation_name(operation));
+            finished();
+        }
+        break;
+    }
+    case Operation::OTA:
+        begin_update();
+        break;
+
+    default:
+        complete(operation, now, false);
+        break;
+    }
+}
+
+void DeviceSession::send_request(Operation::Enum operation, Packet message, token_t token, Clock::time_point start)
+{
+    Request request;
+    request.operation = operation;
+    request.start = start;
+    request.deadline = Clock::now() + ACK_TIMEOUT;
+    request.token = token;
+    request.retransmits = 0;
+    request.acknowledged = false;
+    request.message = std::move(message);
+    const message_id_t id = CoAP::message_id(request.message.data());
+    auto& entry = requests[id] = std::move(request);
+    send(entry.message);
+}
+
+void DeviceSession::complete(Operation::Enum operation, Clock::time_point start, bool success)
+{
+    if (success)
+        stats.latency.add(operation_name(operation), Clock::now() - start);
+    else
+        stats.latency.error(operation_name(operation));
+    finished();
+}
+
+void DeviceSession::finished()
+{
+    if (in_flight)
+        in_flight--;
+    completed++;
+    pump();
+}
+
+void DeviceSession::request_block(Operation::Enum operation, token_t token, Clock::time_point start, uint32_t block)
+{
+    const std::string& name = operation == Operation::VARIABLE ? variable : std::string();
+    Packet message(5 + 2 + 5 + name.size() + 5);
+    size_t size = header(message.data(), CoAPType::CON, GET, message_id(), &token);
+    if (operation == Operation::VARIABLE)
+        size += path(message.data() + size, 'v', name);
+    else
+        size += path(message.data() + size, 'd');
+    if (block != NO_BLOCK)
+        size += CoAP::uint_option(message.data() + size, CoAPOption::BLOCK2 - CoAPOption::URI_PATH, block);
+    message.resize(size);
+    send_request(operation, std::move(message), token, start);
+}
+
+void DeviceSession::described()
+{
+    if (function.empty())
+        function = first_name(description, "\"f\":[");
+    if (variable.empty())
+        variable = first_name(description, "\"v\":{");
+    log("function '%s', variable '%s'", function.c_str(), variable.c_str());
+}
+
+/**
+ * Sends UPDATE_BEGIN for a file of random data, requesting fast OTA: the chunks are sent
+ * without waiting for their acknowledgement, and the device requests the missed chunks
+ * at the end. The chunks are sent once the device replies that it is ready.
+ */
+void DeviceSession::begin_update()
+{
+    const Clock::time_point now = Clock::now();
+    update = Update();
+    update.phase = Update::BEGIN;
+    update.token = next_token++;
+    update.start = now;
+    update.last_activity = now;
+    update.data.resize(workload.ota_size);
+    for (auto& byte: update.data)
+        byte = random();
+    update.chunk_count = (workload.ota_size + workload.chunk_size - 1) / workload.chunk_size;
+
+    Packet message(20);
+    size_t size = header(message.data(), CoAPType::CON, POST, message_id(), &update.token);
+    size += path(message.data() + size, 'u');
+    message[size++] = 0xFF;
+    message[size++] = 1;    // fast OTA
+    message[size++] = workload.chunk_size >> 8;
+    message[size++] = workload.chunk_size & 0xFF;
+    encode_uint32(message.data() + size, workload.ota_size);
+    size += 4;
+    message[size++] = 0;    // FileTransfer::Store::FIRMWARE
+    encode_uint32(message.data() + size, 0);
+    send_request(Operation::OTA, std::move(message), update.token, now);
+}
+
+void DeviceSession::send_chunks()
+{
+    unsigned sent = 0;
+    for (; sent < CHUNKS_PER_TICK && !update.missed.empty(); ++sent)
+    {
+        send_chunk(update.missed.front());
+        update.missed.pop_front();
+    }
+    for (; sent < CHUNKS_PER_TICK && update.next_chunk < update.chunk_count; ++sent)
+        send_chunk(update.next_chunk++);
+    if (update.phase == Update::SENDING && update.next_chunk == update.chunk_count && update.missed.empty())
+    {
+        update.phase = Update::DONE;
+        update.last_activity = Clock::now();
+        Packet message(6);
+        Messages::update_done(message.data(), message_id(), true);
+        send_request(Operation::OTA, std::move(message), 0, update.start);
+    }
+}
+
+/**
+ * Sends a chunk with its CRC and index, see ChunkedTransfer::handle_chunk().
+ */
+void DeviceSession::send_chunk(unsigned index)
+{
+    if (index >= update.chunk_count)
+        return;
+    const size_t offset = index * workload.chunk_size;
+    const size_t length = std::min(workload.chunk_size, update.data.size() - offset);
+    boost::crc_32_type crc;
+    crc.process_bytes(update.data.data() + offset, length);
+    uint8_t crc_value[4];
+    encode_uint32(crc_value, crc.checksum());
+    const uint8_t index_value[2] = { uint8_t(index >> 8), uint8_t(index & 0xFF) };
+
+    Packet message(5 + 2 + 5 + 3 + 1 + length);
+    size_t size = header(message.data(), CoAPType::NON, POST, message_id(), &update.token);
+    size += path(message.data() + size, 'c');
+    size += CoAP::option(message.data() + size, CoAPOption::URI_QUERY - CoAPOption::URI_PATH, crc_value, sizeof(crc_value));
+    size += CoAP::option(message.data() + size, 0, index_value, sizeof(index_value));
+    message[size++] = 0xFF;
+    memcpy(message.data() + size, update.data.data() + offset, length);
+    message.resize(size + length);
+    send(message);
+    update.last_activity = Clock::now();
+}
+
+void DeviceSession::finish_update(bool success)
+{
+    if (update.phase == Update::IDLE)
+        return;
+    for (auto it = requests.begin(); it != requests.end();)
+    {
+        if (it->second.operation == Operation::OTA)
+            it = requests.erase(it);
+        else
+            ++it;
+    }
+    if (success)
+        stats.latency.count("ota-bytes", update.data.size());
+    const Clock::time_point start = update.start;
+    update = Update();
+    log("update %s", success ? "completed" : "failed");
+    complete(Operation::OTA, start, success);
+}
+
+}} // namespace particle::cloud
@@ -0,0 +1,193 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include "server_channel.h"
+#include "workload.h"
+#include "coap.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+
+namespace particle { namespace cloud {
+
+/**
+ * Counters and latencies shared by the sessions of the server.
+ */
+struct CloudStats
+{
+    unsigned connections = 0;
+    unsigned handshakes = 0;
+    unsigned disconnects = 0;
+    LatencyStats latency;
+};
+
+/**
+ * The cloud side of the CoAP exchanges with one device: answers the requests of the device
+ * (hello, events, time, missed chunks) and runs the workload, timing each operation from
+ * the first transmission of the request to its response.
+ */
+class DeviceSession : public ServerChannel::Handler
+{
+public:
+    typedef std::function<void()> Close;
+
+    DeviceSession(const Workload& workload, CloudStats& stats, std::mt19937& random, bool verbose);
+
+    DeviceSession(const DeviceSession&) = delete;
+    DeviceSession& operator=(const DeviceSession&) = delete;
+
+    /**
+     * Sets the channel and starts its handshake.
+     * @param close     Called when the session has failed and should be removed by the server.
+     */
+    void start(std::unique_ptr<ServerChannel> channel, const Close& close);
+
+    ServerChannel& channel() { return *channel_; }
+
+    /**
+     * Runs the retransmission and pacing timers, and starts the operations of the workload
+     * that were waiting for their interval.
+     */
+    void tick();
+
+    /**
+     * The connection was closed or replaced, fails the operations in flight.
+     */
+    void disconnected();
+
+    /**
+     * The device ID in hex, empty until known.
+     */
+    const std::string& id() const { return device_id; }
+
+    void channel_established(const uint8_t* device_id) override;
+    void channel_message(uint8_t* data, size_t length) override;
+    void channel_error(const char* message) override;
+
+private:
+    typedef protocol::message_id_t message_id_t;
+    typedef protocol::token_t token_t;
+
+    /**
+     * A confirmable request sent to the device, retransmitted until acknowledged.
+     */
+    struct Request
+    {
+        Operation::Enum operation;
+        Clock::time_point start;
+        Clock::time_point deadline;
+        Packet message;
+        token_t token;
+        unsigned retransmits;
+        bool acknowledged;
+    };
+
+    /**
+     * The state of a firmware update (fast OTA, the chunks are not acknowledged).
+     */
+    struct Update
+    {
+        enum Phase
+        {
+            IDLE,
+            BEGIN,
+            SENDING,
+            DONE
+        };
+
+        Phase phase = IDLE;
+        token_t token = 0;
+        Clock::time_point start;
+        Clock::time_point last_activity;
+        Packet data;
+        unsigned chunk_count = 0;
+        unsigned next_chunk = 0;
+        std::deque<unsigned> missed;
+    };
+
+    const Workload& workload;
+    CloudStats& stats;
+    std::mt19937& random;
+    bool verbose;
+    std::unique_ptr<ServerChannel> channel_;
+    Close close;
+    Clock::time_point started;
+    bool failed;
+
+    std::string device_id;
+    bool ready;
+    message_id_t next_message_id;
+    token_t next_token;
+    std::map<message_id_t, Request> requests;
+    // acknowledgements of the recent confirmable messages of the device, sent again for duplicates
+    std::deque<std::pair<message_id_t, Packet>> recent_acks;
+
+    std::string function;
+    std::string variable;
+    std::string description;
+
+    // the workload steps, preceded by a describe when the function or variable isn't named
+    std::vector<WorkloadStep> steps;
+    size_t repeat_from;
+    size_t step_index;
+    unsigned issued;
+    unsigned completed;
+    unsigned in_flight;
+    bool pumping;
+    bool pump_again;
+    Clock::time_point next_issue;
+
+    Update update;
+
+    void log(const char* format, ...);
+
+    bool send(const Packet& message);
+    /**
+     * Sends the response to a confirmable message of the device, and keeps it to answer
+     * the retransmissions of the message.
+     */
+    void reply(const uint8_t* request, Packet response);
+    void acknowledge(const uint8_t* request);
+    message_id_t message_id() { return next_message_id++; }
+
+    void handle_request(uint8_t* data, size_t length);
+    void handle_response(uint8_t* data, size_t length);
+    void handle_acknowledgement(uint8_t* data, size_t length);
+    void handle_reset(const uint8_t* data);
+    void hello_received(const uint8_t* data, size_t length);
+
+    void pump();
+    void issue(Operation::Enum operation);
+    void send_request(Operation::Enum operation, Packet message, token_t token, Clock::time_point start);
+    void complete(Operation::Enum operation, Clock::time_point start, bool success);
+    void finished();
+
+    void request_block(Operation::Enum operation, token_t token, Clock::time_point start, uint32_t block);
+    void described();
+
+    void begin_update();
+    void send_chunks();
+    void send_chunk(unsigned index);
+    void finish_update(bool success);
+};
+
+}} // namespace particle::cloud
@@ -0,0 +1,94 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "impairment.h"
+
+#include <memory>
+
+namespace particle { namespace cloud {
+
+ImpairedLink::ImpairedLink(boost::asio::io_service& io, const Impairment& impairment, std::mt19937& random, bool ordered) :
+        io(io),
+        impairment(impairment),
+        random(random),
+        ordered(ordered),
+        dropped_(0),
+        timer(io)
+{
+}
+
+void ImpairedLink::pass(Packet packet, const Deliver& deliver)
+{
+    if (impairment.none())
+    {
+        deliver(packet);
+        return;
+    }
+    if (!ordered && impairment.loss > 0 && std::uniform_real_distribution<double>()(random) < impairment.loss)
+    {
+        dropped_++;
+        return;
+    }
+    unsigned delay = impairment.delay;
+    if (impairment.jitter)
+        delay += std::uniform_int_distribution<unsigned>(0, impairment.jitter)(random);
+    const Clock::time_point due = Clock::now() + std::chrono::milliseconds(delay);
+    if (ordered)
+    {
+        // a packet is delivered after those passed before it, whatever its delay
+        pending.push_back(Pending{ pending.empty() || pending.back().due < due ? due : pending.back().due,
+                std::move(packet), deliver });
+        if (pending.size() == 1)
+        {
+            timer.expires_at(pending.front().due);
+            timer.async_wait([this](const boost::system::error_code& ec) { deliver_pending(ec); });
+        }
+        return;
+    }
+    if (due <= Clock::now())
+    {
+        deliver(packet);
+        return;
+    }
+    auto packet_timer = std::make_shared<boost::asio::steady_timer>(io, due);
+    auto data = std::make_shared<Packet>(std::move(packet));
+    packet_timer->async_wait([packet_timer, data, deliver](const boost::system::error_code&) {
+        deliver(*data);
+    });
+}
+
+void ImpairedLink::deliver_pending(const boost::system::error_code& ec)
+{
+    // the link was destroyed with its connection
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+    while (!pending.empty() && pending.front().due <= Clock::now())
+    {
+        Pending next = std::move(pending.front());
+        pending.pop_front();
+        next.deliver(next.packet);
+    }
+    if (!pending.empty())
+    {
+        timer.expires_at(pending.front().due);
+        timer.async_wait([this](const boost::system::error_code& ec) { deliver_pending(ec); });
+    }
+}
+
+}} // namespace particle::cloud
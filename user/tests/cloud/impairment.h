@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include "latency.h"
+
+#include <boost/asio.hpp>
+#include <deque>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace particle { namespace cloud {
+
+typedef std::vector<uint8_t> Packet;
+
+/**
+ * Loss and delay injected in one direction of the connections.
+ */
+struct Impairment
+{
+    /**
+     * Probability that a datagram is dropped. Not applied to TCP, where the stream
+     * would be corrupted.
+     */
+    double loss = 0;
+    /**
+     * Delay added to each packet, in milliseconds.
+     */
+    unsigned delay = 0;
+    /**
+     * Maximum random delay added to the fixed delay, in milliseconds. Datagrams may
+     * be reordered, the data of a TCP connection keeps its order.
+     */
+    unsigned jitter = 0;
+
+    bool none() const { return !loss && !delay && !jitter; }
+};
+
+/**
+ * One direction of a connection, passing the packets through the impairment before
+ * delivering them.
+ */
+class ImpairedLink
+{
+public:
+    typedef std::function<void(Packet&)> Deliver;
+
+    /**
+     * @param ordered   Keep the packets in order and never drop them (TCP).
+     */
+    ImpairedLink(boost::asio::io_service& io, const Impairment& impairment, std::mt19937& random, bool ordered);
+
+    void pass(Packet packet, const Deliver& deliver);
+
+    unsigned dropped() const { return dropped_; }
+
+private:
+    struct Pending
+    {
+        Clock::time_point due;
+        Packet packet;
+        Deliver deliver;
+    };
+
+    boost::asio::io_service& io;
+    const Impairment& impairment;
+    std::mt19937& random;
+    bool ordered;
+    unsigned dropped_;
+    // the delayed packets of an ordered link, delivered by a single timer as the timers
+    // expiring at the same time don't complete in order
+    std::deque<Pending> pending;
+    boost::asio::steady_timer timer;
+
+    void deliver_pending(const boost::system::error_code& ec);
+};
+
+}} // namespace particle::cloud
@@ -0,0 +1,80 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "latency.h"
+
+#include <algorithm>
+
+namespace particle { namespace cloud {
+
+namespace {
+
+double percentile(const std::vector<uint32_t>& sorted, unsigned p)
+{
+    if (sorted.empty())
+        return 0;
+    const size_t index = (sorted.size() * p + 99) / 100;
+    return sorted[index ? index - 1 : 0] / 1000.0;
+}
+
+} // namespace
+
+void LatencyStats::add(const std::string& operation, Clock::duration latency)
+{
+    Operation& op = operations[operation];
+    op.samples.push_back(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    op.count++;
+}
+
+void LatencyStats::error(const std::string& operation)
+{
+    operations[operation].errors++;
+}
+
+void LatencyStats::count(const std::string& operation, unsigned n)
+{
+    operations[operation].count += n;
+}
+
+void LatencyStats::report(FILE* out, double seconds) const
+{
+    fprintf(out, "%-12s %8s %6s %9s %9s %9s %9s %9s\n", "operation", "count", "errors", "rate/s",
+            "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (const auto& entry: operations)
+    {
+        const Operation& op = entry.second;
+        std::vector<uint32_t> sorted(op.samples);
+        std::sort(sorted.begin(), sorted.end());
+        fprintf(out, "%-12s %8u %6u %9.1f", entry.first.c_str(), op.count, op.errors,
+                seconds > 0 ? op.count / seconds : 0.0);
+        if (sorted.empty())
+            fprintf(out, " %9s %9s %9s %9s\n", "-", "-", "-", "-");
+        else
+            fprintf(out, " %9.2f %9.2f %9.2f %9.2f\n", percentile(sorted, 50), percentile(sorted, 90),
+                    percentile(sorted, 99), sorted.back() / 1000.0);
+    }
+    fflush(out);
+}
+
+void LatencyStats::clear()
+{
+    operations.clear();
+}
+
+}} // namespace particle::cloud
@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace particle { namespace cloud {
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Collects the latencies of the operations performed by the server, by operation name,
+ * and reports their percentiles.
+ */
+class LatencyStats
+{
+public:
+    void add(const std::string& operation, Clock::duration latency);
+    void error(const std::string& operation);
+
+    /**
+     * Counts an operation that has no latency, such as an event published by a device.
+     */
+    void count(const std::string& operation, unsigned n = 1);
+
+    /**
+     * Prints a line per operation: the count, errors, rate over the given period and
+     * the 50th, 90th, 99th percentile and maximum latency in milliseconds.
+     */
+    void report(FILE* out, double seconds) const;
+
+    void clear();
+
+private:
+    struct Operation
+    {
+        std::vector<uint32_t> samples;  // microseconds
+        unsigned errors = 0;
+        unsigned count = 0;
+    };
+
+    std::map<std::string, Operation> operations;
+};
+
+}} // namespace particle::cloud
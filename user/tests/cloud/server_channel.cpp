@@ -0,0 +1,323 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "server_channel.h"
+#include "tropicssl/sha1.h"
+
+#include <cstring>
+
+namespace particle { namespace cloud {
+
+namespace {
+
+// the device encrypts the nonce, its ID and its public key with the server key (RSA-2048)
+const size_t NONCE_CIPHERTEXT_LENGTH = 256;
+// the credentials encrypted with the device key (RSA-1024) and signed with the server key
+const size_t CREDENTIALS_CIPHERTEXT_LENGTH = 128;
+const size_t DEVICE_ID_LENGTH = 12;
+const size_t DEVICE_PUBLIC_KEY_LENGTH = 162;
+// offset of the modulus in the device public key, see extract_public_rsa_key()
+const size_t DEVICE_PUBLIC_KEY_MODULUS_OFFSET = 29;
+
+// the largest CoAP message sent by the device
+const size_t MAX_MESSAGE_LENGTH = 1500;
+
+} // namespace
+
+LightSSLServerChannel::LightSSLServerChannel(Handler& handler, const Transmit& transmit, rsa_context& server_key,
+        int (*rng)(void*, uint8_t*, size_t)) :
+        ServerChannel(handler, transmit),
+        server_key(server_key),
+        rng(rng),
+        state(IDLE)
+{
+}
+
+void LightSSLServerChannel::start()
+{
+    rng(nullptr, nonce, sizeof(nonce));
+    state = RECEIVE_NONCE_CIPHERTEXT;
+    transmit(Packet(nonce, nonce + sizeof(nonce)));
+}
+
+/**
+ * Checks the nonce returned by the device and sends it the session key, as the cloud does:
+ * the AES key, IV and salt encrypted with the device public key, followed by the signature
+ * of their HMAC with the server private key.
+ */
+bool LightSSLServerChannel::handshake()
+{
+    uint8_t plaintext[NONCE_CIPHERTEXT_LENGTH];
+    int length = 0;
+    if (rsa_pkcs1_decrypt(&server_key, RSA_PRIVATE, &length, input.data(), plaintext, sizeof(plaintext)))
+        return false;
+    if (length < int(NONCE_LENGTH + DEVICE_ID_LENGTH + DEVICE_PUBLIC_KEY_LENGTH) || memcmp(plaintext, nonce, NONCE_LENGTH))
+        return false;
+    const uint8_t* device_id = plaintext + NONCE_LENGTH;
+    const uint8_t* device_public = device_id + DEVICE_ID_LENGTH;
+
+    rsa_context device_key;
+    rsa_init(&device_key, RSA_PKCS_V15, RSA_RAW, nullptr, nullptr);
+    device_key.len = CREDENTIALS_CIPHERTEXT_LENGTH;
+    mpi_read_binary(&device_key.N, device_public + DEVICE_PUBLIC_KEY_MODULUS_OFFSET, CREDENTIALS_CIPHERTEXT_LENGTH);
+    mpi_read_string(&device_key.E, 16, "10001");
+
+    uint8_t credentials[CREDENTIALS_LENGTH];
+    rng(nullptr, credentials, sizeof(credentials));
+    Packet response(CREDENTIALS_CIPHERTEXT_LENGTH + server_key.len);
+    int error = rsa_pkcs1_encrypt(&device_key, RSA_PUBLIC, sizeof(credentials), credentials, response.data());
+    rsa_free(&device_key);
+    if (error)
+        return false;
+    uint8_t hmac[20];
+    sha1_hmac(credentials, sizeof(credentials), response.data(), CREDENTIALS_CIPHERTEXT_LENGTH, hmac);
+    if (rsa_pkcs1_sign(&server_key, RSA_PRIVATE, RSA_RAW, sizeof(hmac), hmac, response.data() + CREDENTIALS_CIPHERTEXT_LENGTH))
+        return false;
+
+    aes_setkey_enc(&aes_enc, credentials, 128);
+    aes_setkey_dec(&aes_dec, credentials, 128);
+    memcpy(iv_send, credentials + 16, 16);
+    memcpy(iv_receive, credentials + 16, 16);
+    state = ESTABLISHED;
+    transmit(std::move(response));
+    handler.channel_established(device_id);
+    return true;
+}
+
+void LightSSLServerChannel::received(const uint8_t* data, size_t length)
+{
+    if (state == IDLE || state == FAILED)
+        return;
+    input.insert(input.end(), data, data + length);
+    if (state == RECEIVE_NONCE_CIPHERTEXT)
+    {
+        if (input.size() < NONCE_CIPHERTEXT_LENGTH)
+            return;
+        if (!handshake())
+        {
+            state = FAILED;
+            handler.channel_error("LightSSL handshake failed");
+            return;
+        }
+        input.erase(input.begin(), input.begin() + NONCE_CIPHERTEXT_LENGTH);
+    }
+
+    // each message is its length followed by the message encrypted with AES-CBC, see
+    // LightSSLMessageChannel::receive(), the IV of the next message is the first block
+    size_t offset = 0;
+    while (state == ESTABLISHED && input.size() - offset >= 2)
+    {
+        const size_t size = input[offset] << 8 | input[offset + 1];
+        if (input.size() - offset - 2 < size)
+            break;
+        uint8_t* buf = input.data() + offset + 2;
+        offset += 2 + size;
+        if (!size || size % 16 || size > MAX_MESSAGE_LENGTH)
+        {
+            state = FAILED;
+            handler.channel_error("invalid LightSSL message length");
+            return;
+        }
+        uint8_t next_iv[16];
+        memcpy(next_iv, buf, 16);
+        aes_crypt_cbc(&aes_dec, AES_DECRYPT, size, iv_receive, buf, buf);
+        memcpy(iv_receive, next_iv, 16);
+        const size_t padding = buf[size - 1];
+        if (!padding || padding > 16)
+        {
+            state = FAILED;
+            handler.channel_error("invalid LightSSL message padding");
+            return;
+        }
+        handler.channel_message(buf, size - padding);
+    }
+    input.erase(input.begin(), input.begin() + offset);
+}
+
+bool LightSSLServerChannel::send(const uint8_t* data, size_t length)
+{
+    if (state != ESTABLISHED)
+        return false;
+    // PKCS#7 padding, see LightSSLMessageChannel::wrap()
+    const size_t size = (length & ~15) + 16;
+    Packet packet(2 + size);
+    packet[0] = size >> 8;
+    packet[1] = size & 0xff;
+    memcpy(packet.data() + 2, data, length);
+    memset(packet.data() + 2 + length, size - length, size - length);
+    aes_crypt_cbc(&aes_enc, AES_ENCRYPT, size, iv_send, packet.data() + 2, packet.data() + 2);
+    memcpy(iv_send, packet.data() + 2, 16);
+    transmit(std::move(packet));
+    return true;
+}
+
+DTLSServerConfig::DTLSServerConfig()
+{
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_pk_init(&key);
+    mbedtls_x509_crt_init(&cert);
+}
+
+DTLSServerConfig::~DTLSServerConfig()
+{
+    mbedtls_x509_crt_free(&cert);
+    mbedtls_pk_free(&key);
+    mbedtls_ssl_config_free(&conf);
+}
+
+/**
+ * Mirrors the client configuration in DTLSMessageChannel::init(): the device has the server
+ * key and doesn't receive a certificate, it sends its own key as a raw public key.
+ */
+int DTLSServerConfig::init(const uint8_t* private_key, size_t length, int (*rng)(void*, uint8_t*, size_t))
+{
+    int ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_SERVER,
+            MBEDTLS_SSL_TRANSPORT_DATAGRAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret)
+        return ret;
+    mbedtls_ssl_conf_rng(&conf, rng, nullptr);
+    mbedtls_ssl_conf_min_version(&conf, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+
+    ret = mbedtls_pk_parse_key(&key, private_key, length, nullptr, 0);
+    if (ret)
+        return ret;
+    ret = mbedtls_ssl_conf_own_cert(&conf, &cert, &key);
+    if (ret)
+        return ret;
+
+    // the device key is received to verify the handshake, it isn't checked against a registry
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_OPTIONAL);
+    static int cert_types[] = { MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY, MBEDTLS_TLS_CERT_TYPE_NONE };
+    mbedtls_ssl_conf_client_certificate_types(&conf, cert_types);
+    mbedtls_ssl_conf_server_certificate_types(&conf, cert_types);
+    mbedtls_ssl_conf_certificate_send(&conf, MBEDTLS_SSL_SEND_CERTIFICATE_DISABLED);
+    mbedtls_ssl_conf_dtls_cookies(&conf, nullptr, nullptr, nullptr);
+    return 0;
+}
+
+DTLSServerChannel::DTLSServerChannel(Handler& handler, const Transmit& transmit, const DTLSServerConfig& config) :
+        ServerChannel(handler, transmit),
+        config(config),
+        failed(false)
+{
+    mbedtls_ssl_init(&ssl);
+    if (mbedtls_ssl_setup(&ssl, config.get()))
+    {
+        failed = true;
+        return;
+    }
+    mbedtls_ssl_set_timer_cb(&ssl, &timer, mbedtls_timing_set_delay, mbedtls_timing_get_delay);
+    mbedtls_ssl_set_bio(&ssl, this, send_, recv_, nullptr);
+}
+
+DTLSServerChannel::~DTLSServerChannel()
+{
+    mbedtls_ssl_free(&ssl);
+}
+
+void DTLSServerChannel::received(const uint8_t* data, size_t length)
+{
+    datagrams.emplace_back(data, data + length);
+    if (established())
+        read();
+    else
+        handshake();
+}
+
+void DTLSServerChannel::tick()
+{
+    // retransmits the last flight when the handshake timer expires
+    if (!established())
+        handshake();
+}
+
+void DTLSServerChannel::handshake()
+{
+    if (failed)
+        return;
+    const int ret = mbedtls_ssl_handshake(&ssl);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+        return;
+    if (ret)
+    {
+        failed = true;
+        datagrams.clear();
+        char message[48];
+        snprintf(message, sizeof(message), "DTLS handshake failed: -0x%04x", -ret);
+        handler.channel_error(message);
+        return;
+    }
+    handler.channel_established(nullptr);
+    read();
+}
+
+void DTLSServerChannel::read()
+{
+    uint8_t buf[MAX_MESSAGE_LENGTH];
+    // a datagram may hold several records, read until mbedTLS asks for the next datagram
+    while (!failed)
+    {
+        const int ret = mbedtls_ssl_read(&ssl, buf, sizeof(buf));
+        if (ret > 0)
+            handler.channel_message(buf, ret);
+        else if (ret == MBEDTLS_ERR_SSL_WANT_READ)
+            break;
+        else if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+        {
+            failed = true;
+            handler.channel_error("DTLS session closed by the device");
+        }
+        else if (ret < 0 && ret != MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE)
+        {
+            failed = true;
+            char message[48];
+            snprintf(message, sizeof(message), "DTLS receive failed: -0x%04x", -ret);
+            handler.channel_error(message);
+        }
+    }
+}
+
+bool DTLSServerChannel::send(const uint8_t* data, size_t length)
+{
+    if (failed || !established())
+        return false;
+    const int ret = mbedtls_ssl_write(&ssl, data, length);
+    return ret >= 0;
+}
+
+int DTLSServerChannel::send_(void* ctx, const unsigned char* buf, size_t len)
+{
+    DTLSServerChannel* channel = static_cast<DTLSServerChannel*>(ctx);
+    channel->transmit(Packet(buf, buf + len));
+    return len;
+}
+
+int DTLSServerChannel::recv_(void* ctx, unsigned char* buf, size_t len)
+{
+    DTLSServerChannel* channel = static_cast<DTLSServerChannel*>(ctx);
+    if (channel->datagrams.empty())
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    Packet& datagram = channel->datagrams.front();
+    const size_t size = datagram.size() < len ? datagram.size() : len;
+    memcpy(buf, datagram.data(), size);
+    channel->datagrams.pop_front();
+    return size;
+}
+
+}} // namespace particle::cloud
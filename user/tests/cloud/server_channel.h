@@ -0,0 +1,191 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include "impairment.h"
+#include "tropicssl/aes.h"
+#include "tropicssl/rsa.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/timing.h"
+
+#include <deque>
+#include <functional>
+#include <string>
+
+namespace particle { namespace cloud {
+
+/**
+ * The server side of the secure channels, the counterpart of LightSSLMessageChannel
+ * and DTLSMessageChannel.
+ */
+class ServerChannel
+{
+public:
+    /**
+     * Receives the events of a channel.
+     */
+    struct Handler
+    {
+        /**
+         * The handshake completed. The device ID is known from the handshake with
+         * LightSSL, from the hello message with DTLS (nullptr).
+         */
+        virtual void channel_established(const uint8_t* device_id) = 0;
+        virtual void channel_message(uint8_t* data, size_t length) = 0;
+        virtual void channel_error(const char* message) = 0;
+    };
+
+    typedef std::function<void(Packet)> Transmit;
+
+    ServerChannel(Handler& handler, const Transmit& transmit) :
+            handler(handler),
+            transmit(transmit)
+    {
+    }
+
+    virtual ~ServerChannel() = default;
+
+    /**
+     * Starts the handshake.
+     */
+    virtual void start() {}
+
+    /**
+     * Processes data received from the transport: a datagram, or the next bytes of the stream.
+     */
+    virtual void received(const uint8_t* data, size_t length) = 0;
+
+    /**
+     * Sends a CoAP message once the channel is established.
+     */
+    virtual bool send(const uint8_t* data, size_t length) = 0;
+
+    /**
+     * Runs the timers of the handshake.
+     */
+    virtual void tick() {}
+
+    virtual bool established() const = 0;
+    virtual bool reliable() const = 0;
+
+protected:
+    Handler& handler;
+    Transmit transmit;
+};
+
+/**
+ * The server half of the LightSSL handshake and the AES-CBC framing used over TCP.
+ */
+class LightSSLServerChannel : public ServerChannel
+{
+public:
+    /**
+     * @param server_key    The RSA-2048 private key of the server.
+     */
+    LightSSLServerChannel(Handler& handler, const Transmit& transmit, rsa_context& server_key,
+            int (*rng)(void*, uint8_t*, size_t));
+
+    void start() override;
+    void received(const uint8_t* data, size_t length) override;
+    bool send(const uint8_t* data, size_t length) override;
+
+    bool established() const override { return state == ESTABLISHED; }
+    bool reliable() const override { return true; }
+
+private:
+    enum State
+    {
+        IDLE,
+        RECEIVE_NONCE_CIPHERTEXT,
+        ESTABLISHED,
+        FAILED
+    };
+
+    static const size_t NONCE_LENGTH = 40;
+    static const size_t CREDENTIALS_LENGTH = 40;
+
+    rsa_context& server_key;
+    int (*rng)(void*, uint8_t*, size_t);
+    State state;
+    uint8_t nonce[NONCE_LENGTH];
+    std::vector<uint8_t> input;
+    aes_context aes_enc;
+    aes_context aes_dec;
+    uint8_t iv_send[16];
+    uint8_t iv_receive[16];
+
+    bool handshake();
+};
+
+/**
+ * The configuration shared by the DTLS server channels: the server key and the settings
+ * the device expects (raw public keys, no cookies, DTLS 1.2).
+ */
+class DTLSServerConfig
+{
+public:
+    DTLSServerConfig();
+    ~DTLSServerConfig();
+
+    /**
+     * @param private_key   The DER encoded EC private key of the server.
+     */
+    int init(const uint8_t* private_key, size_t length, int (*rng)(void*, uint8_t*, size_t));
+
+    const mbedtls_ssl_config* get() const { return &conf; }
+
+private:
+    mbedtls_ssl_config conf;
+    mbedtls_pk_context key;
+    mbedtls_x509_crt cert;
+};
+
+/**
+ * The server end of a DTLS session using the mbedTLS server. Datagrams are passed in by
+ * the server socket, which demultiplexes them by endpoint or moved session.
+ */
+class DTLSServerChannel : public ServerChannel
+{
+public:
+    DTLSServerChannel(Handler& handler, const Transmit& transmit, const DTLSServerConfig& config);
+    ~DTLSServerChannel();
+
+    void received(const uint8_t* data, size_t length) override;
+    bool send(const uint8_t* data, size_t length) override;
+    void tick() override;
+
+    bool established() const override { return ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER; }
+    bool reliable() const override { return false; }
+
+private:
+    const DTLSServerConfig& config;
+    mbedtls_ssl_context ssl;
+    mbedtls_timing_delay_context timer;
+    std::deque<Packet> datagrams;
+    bool failed;
+
+    void handshake();
+    void read();
+
+    static int send_(void* ctx, const unsigned char* buf, size_t len);
+    static int recv_(void* ctx, unsigned char* buf, size_t len);
+};
+
+}} // namespace particle::cloud
@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "workload.h"
+
+#include <cstdlib>
+
+namespace particle { namespace cloud {
+
+namespace {
+
+const char* const OPERATION_NAMES[Operation::COUNT] = {
+    "ping",
+    "describe",
+    "variable",
+    "function",
+    "event",
+    "ota"
+};
+
+bool parse_unsigned(const std::string& text, unsigned& value)
+{
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    value = strtoul(text.c_str(), nullptr, 10);
+    return true;
+}
+
+} // namespace
+
+const char* operation_name(Operation::Enum operation)
+{
+    return operation < Operation::COUNT ? OPERATION_NAMES[operation] : "unknown";
+}
+
+bool WorkloadStep::parse(const std::string& text, WorkloadStep& step)
+{
+    const size_t count_pos = text.find(':');
+    const std::string name = text.substr(0, count_pos);
+    int operation = 0;
+    while (operation < Operation::COUNT && name != OPERATION_NAMES[operation])
+        ++operation;
+    if (operation == Operation::COUNT)
+        return false;
+    step = WorkloadStep();
+    step.operation = Operation::Enum(operation);
+    if (count_pos == std::string::npos)
+        return true;
+    const size_t interval_pos = text.find(':', count_pos + 1);
+    if (!parse_unsigned(text.substr(count_pos + 1, interval_pos - count_pos - 1), step.count))
+        return false;
+    return interval_pos == std::string::npos || parse_unsigned(text.substr(interval_pos + 1), step.interval);
+}
+
+}} // namespace particle::cloud
@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace particle { namespace cloud {
+
+namespace Operation {
+enum Enum {
+    PING,
+    DESCRIBE,
+    VARIABLE,
+    FUNCTION,
+    EVENT,
+    OTA,
+    COUNT
+};
+}
+
+const char* operation_name(Operation::Enum operation);
+
+/**
+ * Performs an operation a number of times, e.g. "variable:100:10" requests a variable 100
+ * times, 10 milliseconds apart.
+ */
+struct WorkloadStep
+{
+    Operation::Enum operation = Operation::PING;
+    unsigned count = 1;
+    /**
+     * Milliseconds between the starts of the operations, 0 to start the next operation as
+     * soon as the window allows.
+     */
+    unsigned interval = 0;
+
+    /**
+     * Parses "operation[:count[:interval]]".
+     */
+    static bool parse(const std::string& text, WorkloadStep& step);
+};
+
+/**
+ * The script run by the server for each device once it has said hello.
+ */
+struct Workload
+{
+    std::vector<WorkloadStep> steps;
+    /**
+     * Run the steps again once the last one completed.
+     */
+    bool repeat = false;
+    /**
+     * Requests in flight per device. OTA and describe are always one at a time.
+     */
+    unsigned window = 1;
+
+    /**
+     * The function and variable used, the first ones described by the device when empty.
+     */
+    std::string function;
+    std::string argument = "1";
+    std::string variable;
+
+    std::string event_name = "cloud/load";
+    size_t event_size = 32;
+
+    size_t ota_size = 64 * 1024;
+    size_t chunk_size = 512;
+};
+
+}} // namespace particle::cloud
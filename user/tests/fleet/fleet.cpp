@@ -0,0 +1,297 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "virtual_device.h"
+#include "device_keys.h"
+#include "dsakeygen.h"
+#include "eckeygen.h"
+#include "rng_hal.h"
+#include "mbedtls/debug.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/ssl_ciphersuites.h"
+
+#include <boost/program_options.hpp>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <thread>
+
+using namespace particle::fleet;
+namespace po = boost::program_options;
+
+namespace {
+
+std::mt19937& generator()
+{
+    static thread_local std::mt19937 gen(std::random_device{}());
+    return gen;
+}
+
+int rng(void*, uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        data[i] = generator()();
+    return 0;
+}
+
+int rsa_rng(void*)
+{
+    return generator()();
+}
+
+bool read_file(const std::string& path, std::vector<uint8_t>& data)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool write_file(const std::string& path, const uint8_t* data, size_t size)
+{
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char*)data, size);
+    return bool(out);
+}
+
+/**
+ * Loads the private key of a device from the key directory, generating it on first use.
+ */
+bool device_key(const std::string& dir, const std::string& id, bool tcp, std::vector<uint8_t>& key)
+{
+    const std::string path = dir + "/" + id + (tcp ? "_rsa.der" : "_ec.der");
+    if (read_file(path, key))
+    {
+        key.resize(MAX_DEVICE_PRIVATE_KEY_LENGTH);
+        return true;
+    }
+    key.assign(MAX_DEVICE_PRIVATE_KEY_LENGTH, 0);
+    size_t length;
+    if (tcp)
+    {
+        if (gen_rsa_key(key.data(), key.size(), rsa_rng, nullptr))
+            return false;
+        length = key[0] == 0x30 && key[1] == 0x82 ? 4 + (key[2] << 8 | key[3]) : key.size();
+    }
+    else
+    {
+        if (gen_ec_key(key.data(), key.size(), rng, nullptr))
+            return false;
+        length = determine_der_length(key.data(), key.size());
+    }
+    return write_file(path, key.data(), length);
+}
+
+/**
+ * Builds the tables that mbedTLS initializes on first use before the pool threads are
+ * started. The other state shared by the devices is locked or atomic.
+ */
+void init_shared_state()
+{
+    mbedtls_ecp_grp_id_list();
+    mbedtls_ssl_list_ciphersuites();
+}
+
+double cpu_seconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+struct Sample
+{
+    std::chrono::steady_clock::time_point time;
+    double cpu;
+    uint32_t connects;
+    uint32_t publishes;
+
+    explicit Sample(const FleetStats& stats) :
+            time(std::chrono::steady_clock::now()),
+            cpu(cpu_seconds()),
+            connects(stats.connects),
+            publishes(stats.publishes)
+    {
+    }
+};
+
+/**
+ * Prints the rates between two samples, per second of wall time and per second of
+ * CPU time (the rate a single fully used core would sustain).
+ */
+void report(const char* label, const Sample& from, const Sample& to, const FleetStats& stats)
+{
+    const double wall = std::chrono::duration<double>(to.time - from.time).count();
+    const double cpu = to.cpu - from.cpu;
+    const uint32_t connects = to.connects - from.connects;
+    const uint32_t publishes = to.publishes - from.publishes;
+    printf("%s: %.1fs, connects %.1f/s (%.1f/s per core), publishes %.1f/s (%.1f/s per core), "
+            "cores used %.2f, errors connect %u publish %u disconnect %u\n",
+            label, wall, connects / wall, cpu > 0 ? connects / cpu : 0.0,
+            publishes / wall, cpu > 0 ? publishes / cpu : 0.0, wall > 0 ? cpu / wall : 0.0,
+            unsigned(stats.connect_errors), unsigned(stats.publish_errors), unsigned(stats.disconnects));
+    fflush(stdout);
+}
+
+} // namespace
+
+/**
+ * Random numbers for the handshakes of the devices, from a generator per pool thread.
+ */
+uint32_t HAL_RNG_GetRandomNumber(void)
+{
+    return generator()();
+}
+
+int main(int argc, char* argv[])
+{
+    po::options_description desc("Runs a fleet of virtual devices connected to the cloud");
+    desc.add_options()
+        ("help,h", "show this help")
+        ("devices,n", po::value<unsigned>()->default_value(100), "number of devices")
+        ("threads,t", po::value<unsigned>()->default_value(std::thread::hardware_concurrency()), "number of threads in the pool")
+        ("server,s", po::value<std::string>()->default_value("127.0.0.1"), "server address")
+        ("port,p", po::value<uint16_t>(), "server port (default 5684, or 5683 with --tcp)")
+        ("tcp", "use the TCP protocol (LightSSL, RSA keys) instead of DTLS")
+        ("server-key", po::value<std::string>()->required(), "server public key (DER)")
+        ("keys", po::value<std::string>()->default_value("fleet_keys"), "directory of the device private keys, generated when missing")
+        ("id-prefix", po::value<std::string>()->default_value("f1ee7000"), "hex digits prefixed to the device number to form the device IDs")
+        ("duration,d", po::value<unsigned>()->default_value(60), "seconds to run, 0 to run until interrupted")
+        ("publish-interval", po::value<unsigned>()->default_value(1000), "milliseconds between the events published by each device, 0 to not publish")
+        ("reconnect-interval", po::value<unsigned>()->default_value(0), "milliseconds each device stays connected before reconnecting, 0 to stay connected")
+        ("no-resume", "perform a full handshake on each connection instead of resuming the DTLS session")
+        ("report-interval", po::value<unsigned>()->default_value(5), "seconds between the reports");
+
+    po::variables_map vm;
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help"))
+        {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    }
+    catch (const po::error& e)
+    {
+        std::cerr << e.what() << std::endl << desc << std::endl;
+        return 1;
+    }
+
+    boost::asio::io_service io;
+    FleetConfig config;
+    config.tcp = vm.count("tcp");
+    config.server_port = vm.count("port") ? vm["port"].as<uint16_t>() : (config.tcp ? 5683 : 5684);
+    config.publish_interval = vm["publish-interval"].as<unsigned>();
+    config.reconnect_interval = vm["reconnect-interval"].as<unsigned>();
+    config.resume_session = !vm.count("no-resume");
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::resolver resolver(io);
+    auto it = resolver.resolve(boost::asio::ip::tcp::resolver::query(vm["server"].as<std::string>(), ""), ec);
+    if (ec)
+    {
+        std::cerr << "Unable to resolve " << vm["server"].as<std::string>() << ": " << ec.message() << std::endl;
+        return 1;
+    }
+    config.server_address = it->endpoint().address();
+    if (!read_file(vm["server-key"].as<std::string>(), config.server_public))
+    {
+        std::cerr << "Unable to read " << vm["server-key"].as<std::string>() << std::endl;
+        return 1;
+    }
+    config.server_public.resize(MAX_SERVER_PUBLIC_KEY_LENGTH);
+
+    const std::string key_dir = vm["keys"].as<std::string>();
+    mkdir(key_dir.c_str(), 0755);
+    const std::string prefix = vm["id-prefix"].as<std::string>();
+    if (prefix.size() > 16 || prefix.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+    {
+        std::cerr << "The ID prefix should have at most 16 hex digits" << std::endl;
+        return 1;
+    }
+
+    init_shared_state();
+    FleetStats stats;
+    const unsigned count = vm["devices"].as<unsigned>();
+    std::vector<std::unique_ptr<VirtualDevice>> devices;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        char hex[25];
+        snprintf(hex, sizeof(hex), "%s%0*x", prefix.c_str(), int(24 - prefix.size()), i);
+        uint8_t id[12];
+        for (size_t j = 0; j < sizeof(id); ++j)
+            id[j] = std::stoi(std::string(hex + j * 2, 2), nullptr, 16);
+        std::vector<uint8_t> key;
+        if (!device_key(key_dir, hex, config.tcp, key))
+        {
+            std::cerr << "Unable to generate the key of device " << hex << std::endl;
+            return 1;
+        }
+        devices.emplace_back(new VirtualDevice(io, config, stats, id, std::move(key)));
+        if (!devices.back()->init())
+        {
+            std::cerr << "Unable to initialize device " << hex << std::endl;
+            return 1;
+        }
+    }
+    // the channels enable the mbedTLS messages, printed to stdout on this platform
+    mbedtls_debug_set_threshold(0);
+
+    printf("%u devices, %u threads, %s server %s:%u\n", count, vm["threads"].as<unsigned>(),
+            config.tcp ? "TCP" : "UDP", config.server_address.to_string().c_str(), config.server_port);
+    fflush(stdout);
+
+    std::unique_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(io));
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < vm["threads"].as<unsigned>(); ++i)
+        pool.emplace_back([&io]() { io.run(); });
+
+    const Sample start(stats);
+    for (auto& device: devices)
+        device->start();
+
+    const unsigned duration = vm["duration"].as<unsigned>();
+    const unsigned report_interval = vm["report-interval"].as<unsigned>();
+    Sample last = start;
+    for (unsigned elapsed = 0; !duration || elapsed < duration;)
+    {
+        const unsigned interval = duration && duration - elapsed < report_interval ? duration - elapsed : report_interval;
+        std::this_thread::sleep_for(std::chrono::seconds(interval));
+        elapsed += interval;
+        const Sample now(stats);
+        report("interval", last, now, stats);
+        last = now;
+    }
+
+    for (auto& device: devices)
+        device->stop();
+    work.reset();
+    for (auto& thread: pool)
+        thread.join();
+    report("total", start, Sample(stats), stats);
+    printf("function calls %u, variable requests %u, update bytes %u\n", unsigned(stats.function_calls),
+            unsigned(stats.variable_requests), unsigned(stats.update_bytes));
+    return 0;
+}
@@ -0,0 +1,11 @@
+/**
+ * Adjustments to communication/src/mbedtls_config.h for the fleet simulator,
+ * where the devices of the fleet run their handshakes on several threads.
+ */
+#pragma once
+
+/**
+ * The pool of ephemeral keys is a single instance filled by the system thread of a
+ * device, it isn't shared between the devices of the fleet.
+ */
+#undef MBEDTLS_ECDH_GEN_PUBLIC_ALT
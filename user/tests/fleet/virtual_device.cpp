@@ -0,0 +1,474 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "virtual_device.h"
+#include "dtls_protocol.h"
+#include "lightssl_protocol.h"
+#include "timer_hal.h"
+
+#include <boost/crc.hpp>
+#include <cstdio>
+
+namespace particle { namespace fleet {
+
+using namespace particle::protocol;
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+namespace {
+
+// how long a device waits for the server before the handshake is stepped again
+const unsigned HANDSHAKE_POLL_INTERVAL = 100;
+// how long a connected device waits for a message before running the protocol timers
+const unsigned IDLE_POLL_INTERVAL = 250;
+// delay before reconnecting after an error
+const unsigned RECONNECT_DELAY = 1000;
+// received messages processed before the device yields the thread
+const unsigned MAX_MESSAGES_PER_STEP = 8;
+
+const char* const FUNCTION_KEY = "count";
+const char* const VARIABLE_KEY = "count";
+
+} // namespace
+
+thread_local VirtualDevice* VirtualDevice::current = nullptr;
+
+VirtualDevice::VirtualDevice(boost::asio::io_service& io, const FleetConfig& config, FleetStats& stats,
+        const uint8_t* device_id, std::vector<uint8_t> private_key) :
+        io(io),
+        strand(io),
+        timer(io),
+        udp(io),
+        tcp(io),
+        config(config),
+        stats(stats),
+        private_key(std::move(private_key)),
+        state(DISCONNECTED),
+        wait_generation(0),
+        connected_millis(0),
+        next_publish(0),
+        counter(0)
+{
+    memcpy(this->device_id, device_id, sizeof(this->device_id));
+}
+
+VirtualDevice::~VirtualDevice()
+{
+    Scope scope(this);
+    protocol.reset();
+}
+
+std::string VirtualDevice::id() const
+{
+    char hex[sizeof(device_id) * 2 + 1];
+    for (size_t i = 0; i < sizeof(device_id); ++i)
+        sprintf(hex + i * 2, "%02x", device_id[i]);
+    return hex;
+}
+
+bool VirtualDevice::init()
+{
+    Scope scope(this);
+    if (config.tcp)
+        protocol.reset(new LightSSLProtocol());
+    else
+        protocol.reset(new DTLSProtocol());
+
+    SparkKeys keys = {};
+    keys.size = sizeof(keys);
+    keys.core_private = private_key.data();
+    keys.server_public = const_cast<uint8_t*>(config.server_public.data());
+
+    SparkCallbacks callbacks = {};
+    callbacks.size = sizeof(callbacks);
+    callbacks.protocolFactory = config.tcp ? PROTOCOL_LIGHTSSL : PROTOCOL_DTLS;
+    callbacks.send = send;
+    callbacks.receive = receive;
+    callbacks.prepare_for_firmware_update = prepare_for_firmware_update;
+    callbacks.save_firmware_chunk = save_firmware_chunk;
+    callbacks.finish_firmware_update = finish_firmware_update;
+    callbacks.calculate_crc = calculate_crc;
+    callbacks.signal = signal;
+    callbacks.millis = millis;
+    callbacks.set_time = set_time;
+    callbacks.save = save;
+    callbacks.restore = restore;
+
+    SparkDescriptor descriptor = {};
+    descriptor.size = sizeof(descriptor);
+    descriptor.num_functions = num_functions;
+    descriptor.get_function_key = get_function_key;
+    descriptor.call_function = call_function;
+    descriptor.num_variables = num_variables;
+    descriptor.get_variable_key = get_variable_key;
+    descriptor.variable_type = variable_type;
+    descriptor.get_variable = get_variable;
+    descriptor.was_ota_upgrade_successful = was_ota_upgrade_successful;
+    descriptor.ota_upgrade_status_sent = ota_upgrade_status_sent;
+    descriptor.call_event_handler = call_event_handler;
+
+    protocol->init((const char*)device_id, keys, callbacks, descriptor);
+    return protocol->is_initialized();
+}
+
+void VirtualDevice::start()
+{
+    post();
+}
+
+void VirtualDevice::stop()
+{
+    strand.dispatch([this]() {
+        Scope scope(this);
+        disconnect(false);
+        state = STOPPED;
+        boost::system::error_code ec;
+        timer.cancel(ec);
+    });
+}
+
+void VirtualDevice::post()
+{
+    const unsigned generation = ++wait_generation;
+    strand.post([this, generation]() {
+        if (generation == wait_generation)
+            step();
+    });
+}
+
+void VirtualDevice::wait(unsigned timeout)
+{
+    const unsigned generation = ++wait_generation;
+    auto wake = strand.wrap([this, generation](const boost::system::error_code&) {
+        if (generation != wait_generation || state == STOPPED)
+            return;
+        ++wait_generation;
+        boost::system::error_code ec;
+        timer.cancel(ec);
+        if (config.tcp)
+            tcp.cancel(ec);
+        else
+            udp.cancel(ec);
+        step();
+    });
+    timer.expires_from_now(std::chrono::milliseconds(timeout));
+    timer.async_wait(wake);
+    if (config.tcp && tcp.is_open())
+        tcp.async_wait(tcp::socket::wait_read, wake);
+    else if (!config.tcp && udp.is_open())
+        udp.async_wait(udp::socket::wait_read, wake);
+}
+
+void VirtualDevice::step()
+{
+    Scope scope(this);
+    switch (state)
+    {
+    case DISCONNECTED:
+        connect();
+        break;
+    case HANDSHAKE:
+        handshake(false);
+        break;
+    case CONNECTED:
+        run();
+        break;
+    default:
+        break;
+    }
+}
+
+void VirtualDevice::connect()
+{
+    state = CONNECTING;
+    boost::system::error_code ec;
+    if (config.tcp)
+    {
+        const tcp::endpoint server(config.server_address, config.server_port);
+        tcp.async_connect(server, strand.wrap([this](const boost::system::error_code& ec) {
+            if (state != CONNECTING)
+                return;
+            Scope scope(this);
+            if (ec)
+            {
+                ++stats.connect_errors;
+                disconnect(false);
+                wait(RECONNECT_DELAY);
+                return;
+            }
+            boost::system::error_code ignored;
+            tcp.non_blocking(true, ignored);
+            handshake(true);
+        }));
+        return;
+    }
+    const udp::endpoint server(config.server_address, config.server_port);
+    udp.open(server.protocol(), ec);
+    if (!ec)
+        udp.connect(server, ec);
+    if (!ec)
+        udp.non_blocking(true, ec);
+    if (ec)
+    {
+        ++stats.connect_errors;
+        disconnect(false);
+        wait(RECONNECT_DELAY);
+        return;
+    }
+    handshake(true);
+}
+
+void VirtualDevice::handshake(bool start)
+{
+    state = HANDSHAKE;
+    if (start && !config.resume_session)
+        session.clear();
+    const int error = start ? protocol->begin_start() : protocol->begin_step();
+    if (error == HANDSHAKE_IN_PROGRESS)
+    {
+        wait(HANDSHAKE_POLL_INTERVAL);
+        return;
+    }
+    if (error != NO_ERROR && error != SESSION_RESUMED)
+    {
+        ++stats.connect_errors;
+        // a session the server doesn't know is discarded by the channel
+        disconnect(false);
+        wait(RECONNECT_DELAY);
+        return;
+    }
+    ++stats.connects;
+    state = CONNECTED;
+    connected_millis = millis();
+    next_publish = connected_millis;
+    post();
+}
+
+void VirtualDevice::run()
+{
+    const system_tick_t now = millis();
+    if (config.reconnect_interval && now - connected_millis >= config.reconnect_interval)
+    {
+        disconnect(false);
+        post();
+        return;
+    }
+    for (unsigned i = 0; i < MAX_MESSAGES_PER_STEP; ++i)
+    {
+        CoAPMessageType::Enum type;
+        if (protocol->event_loop(type) != NO_ERROR)
+        {
+            ++stats.disconnects;
+            disconnect(true);
+            wait(RECONNECT_DELAY);
+            return;
+        }
+        if (type == CoAPMessageType::NONE)
+            break;
+    }
+    unsigned timeout = IDLE_POLL_INTERVAL;
+    if (config.publish_interval)
+    {
+        if (int(now - next_publish) >= 0)
+        {
+            publish();
+            next_publish += config.publish_interval;
+            // don't try to catch up with the events that couldn't be published in time
+            if (int(now - next_publish) >= 0)
+                next_publish = now + config.publish_interval;
+        }
+        const unsigned until_publish = next_publish - now;
+        if (until_publish < timeout)
+            timeout = until_publish;
+    }
+    wait(timeout);
+}
+
+void VirtualDevice::publish()
+{
+    char data[16];
+    snprintf(data, sizeof(data), "%d", counter);
+    auto completed = [](int error, const void*, void* callback_data, void*) {
+        FleetStats& stats = *static_cast<FleetStats*>(callback_data);
+        if (error)
+            ++stats.publish_errors;
+        else
+            ++stats.publishes;
+    };
+    // the completion handler is called with an error when the event can't be sent
+    protocol->send_event("fleet", data, 60, EventType::PRIVATE, EventType::WITH_ACK,
+            CompletionHandler(completed, &stats));
+}
+
+void VirtualDevice::disconnect(bool error)
+{
+    boost::system::error_code ec;
+    if (config.tcp)
+        tcp.close(ec);
+    else
+        udp.close(ec);
+    if (error)
+        session.clear();
+    state = DISCONNECTED;
+}
+
+int VirtualDevice::send_data(const uint8_t* data, size_t length)
+{
+    boost::system::error_code ec;
+    size_t sent;
+    if (config.tcp)
+        sent = tcp.write_some(boost::asio::buffer(data, length), ec);
+    else
+        sent = udp.send(boost::asio::buffer(data, length), 0, ec);
+    if (ec == boost::asio::error::would_block)
+        return 0;
+    return ec ? -1 : int(sent);
+}
+
+int VirtualDevice::receive_data(uint8_t* data, size_t length)
+{
+    boost::system::error_code ec;
+    size_t received;
+    if (config.tcp)
+        received = tcp.read_some(boost::asio::buffer(data, length), ec);
+    else
+        received = udp.receive(boost::asio::buffer(data, length), 0, ec);
+    if (ec == boost::asio::error::would_block)
+        return 0;
+    return ec ? -1 : int(received);
+}
+
+int VirtualDevice::send(const unsigned char* buf, uint32_t buflen, void*)
+{
+    return current->send_data(buf, buflen);
+}
+
+int VirtualDevice::receive(unsigned char* buf, uint32_t buflen, void*)
+{
+    return current->receive_data(buf, buflen);
+}
+
+system_tick_t VirtualDevice::millis()
+{
+    return HAL_Timer_Get_Milli_Seconds();
+}
+
+uint32_t VirtualDevice::calculate_crc(const unsigned char* buf, uint32_t buflen)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(buf, buflen);
+    return crc.checksum();
+}
+
+void VirtualDevice::signal(bool, unsigned int, void*)
+{
+}
+
+void VirtualDevice::set_time(time_t, unsigned int, void*)
+{
+}
+
+int VirtualDevice::save(const void* data, size_t length, uint8_t type, void*)
+{
+    if (type != SparkCallbacks::PERSIST_SESSION)
+        return -1;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    current->session.assign(bytes, bytes + length);
+    return 0;
+}
+
+int VirtualDevice::restore(void* data, size_t max_length, uint8_t type, void*)
+{
+    const std::vector<uint8_t>& session = current->session;
+    if (type != SparkCallbacks::PERSIST_SESSION || session.size() > max_length)
+        return -1;
+    memcpy(data, session.data(), session.size());
+    return session.size();
+}
+
+int VirtualDevice::prepare_for_firmware_update(FileTransfer::Descriptor&, uint32_t, void*)
+{
+    return 0;
+}
+
+int VirtualDevice::save_firmware_chunk(FileTransfer::Descriptor& descriptor, const unsigned char*, void*)
+{
+    current->stats.update_bytes += descriptor.chunk_size;
+    return 0;
+}
+
+int VirtualDevice::finish_firmware_update(FileTransfer::Descriptor&, uint32_t, void*)
+{
+    return 0;
+}
+
+int VirtualDevice::num_functions()
+{
+    return 1;
+}
+
+const char* VirtualDevice::get_function_key(int)
+{
+    return FUNCTION_KEY;
+}
+
+int VirtualDevice::call_function(const char* key, const char*, SparkDescriptor::FunctionResultCallback callback, void*)
+{
+    if (strcmp(key, FUNCTION_KEY))
+        return -1;
+    ++current->stats.function_calls;
+    callback((const void*)long(++current->counter), SparkReturnType::INT);
+    return 0;
+}
+
+int VirtualDevice::num_variables()
+{
+    return 1;
+}
+
+const char* VirtualDevice::get_variable_key(int)
+{
+    return VARIABLE_KEY;
+}
+
+SparkReturnType::Enum VirtualDevice::variable_type(const char*)
+{
+    return SparkReturnType::INT;
+}
+
+const void* VirtualDevice::get_variable(const char*)
+{
+    ++current->stats.variable_requests;
+    return &current->counter;
+}
+
+bool VirtualDevice::was_ota_upgrade_successful()
+{
+    return false;
+}
+
+void VirtualDevice::ota_upgrade_status_sent()
+{
+}
+
+void VirtualDevice::call_event_handler(uint16_t, FilteringEventHandler*, const char*, const char*, void*)
+{
+}
+
+}} // namespace particle::fleet
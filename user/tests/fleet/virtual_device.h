@@ -0,0 +1,195 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include "protocol.h"
+#include "spark_protocol_functions.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace particle { namespace fleet {
+
+/**
+ * Settings shared by the devices of a fleet.
+ */
+struct FleetConfig
+{
+    bool tcp = false;
+    boost::asio::ip::address server_address;
+    uint16_t server_port = 0;
+    /**
+     * The server public key, padded to MAX_SERVER_PUBLIC_KEY_LENGTH.
+     */
+    std::vector<uint8_t> server_public;
+    /**
+     * Interval between the events published by each device, 0 to not publish.
+     */
+    unsigned publish_interval = 1000;
+    /**
+     * Time each device stays connected before reconnecting, 0 to stay connected.
+     */
+    unsigned reconnect_interval = 0;
+    /**
+     * Resume the saved DTLS session when reconnecting.
+     */
+    bool resume_session = true;
+};
+
+/**
+ * Counters updated by the devices of a fleet from any thread of the pool.
+ */
+struct FleetStats
+{
+    std::atomic<uint32_t> connects{0};
+    std::atomic<uint32_t> connect_errors{0};
+    std::atomic<uint32_t> disconnects{0};
+    std::atomic<uint32_t> publishes{0};
+    std::atomic<uint32_t> publish_errors{0};
+    std::atomic<uint32_t> function_calls{0};
+    std::atomic<uint32_t> variable_requests{0};
+    std::atomic<uint32_t> update_bytes{0};
+};
+
+/**
+ * A virtual device: an instance of the cloud protocol with its own device ID, keys,
+ * session and socket. The devices of a fleet share an io_service and the threads
+ * running it; the handshake is performed in steps (Protocol::begin_step()) so that
+ * a device waiting for the server doesn't hold a thread of the pool.
+ *
+ * The protocol callbacks have no context argument, so they are dispatched to the
+ * device stepped by the calling thread (see Scope).
+ */
+class VirtualDevice
+{
+public:
+    VirtualDevice(boost::asio::io_service& io, const FleetConfig& config, FleetStats& stats,
+            const uint8_t* device_id, std::vector<uint8_t> private_key);
+    ~VirtualDevice();
+
+    VirtualDevice(const VirtualDevice&) = delete;
+    VirtualDevice& operator=(const VirtualDevice&) = delete;
+
+    /**
+     * Initializes the protocol. Called from the main thread before the pool is started,
+     * as the channels precompute the tables shared by the devices.
+     */
+    bool init();
+
+    void start();
+    void stop();
+
+    std::string id() const;
+
+private:
+    enum State
+    {
+        DISCONNECTED,
+        CONNECTING,
+        HANDSHAKE,
+        CONNECTED,
+        STOPPED
+    };
+
+    /**
+     * Makes this device the target of the protocol callbacks on the current thread.
+     */
+    class Scope
+    {
+        VirtualDevice* previous;
+
+    public:
+        explicit Scope(VirtualDevice* device) :
+                previous(current)
+        {
+            current = device;
+        }
+
+        ~Scope()
+        {
+            current = previous;
+        }
+    };
+
+    static thread_local VirtualDevice* current;
+
+    boost::asio::io_service& io;
+    boost::asio::io_service::strand strand;
+    boost::asio::steady_timer timer;
+    boost::asio::ip::udp::socket udp;
+    boost::asio::ip::tcp::socket tcp;
+
+    const FleetConfig& config;
+    FleetStats& stats;
+    uint8_t device_id[12];
+    std::vector<uint8_t> private_key;
+    std::unique_ptr<protocol::Protocol> protocol;
+    std::vector<uint8_t> session;
+
+    State state;
+    unsigned wait_generation;
+    system_tick_t connected_millis;
+    system_tick_t next_publish;
+    int counter;
+
+    void step();
+    void connect();
+    void handshake(bool start);
+    void run();
+    void publish();
+    void disconnect(bool error);
+
+    /**
+     * Steps the device again once the socket has data to read or after the given time.
+     */
+    void wait(unsigned timeout);
+    void post();
+
+    int send_data(const uint8_t* data, size_t length);
+    int receive_data(uint8_t* data, size_t length);
+
+    static int send(const unsigned char* buf, uint32_t buflen, void* handle);
+    static int receive(unsigned char* buf, uint32_t buflen, void* handle);
+    static system_tick_t millis();
+    static uint32_t calculate_crc(const unsigned char* buf, uint32_t buflen);
+    static void signal(bool on, unsigned int param, void* reserved);
+    static void set_time(time_t t, unsigned int param, void* reserved);
+    static int save(const void* data, size_t length, uint8_t type, void* reserved);
+    static int restore(void* data, size_t max_length, uint8_t type, void* reserved);
+    static int prepare_for_firmware_update(FileTransfer::Descriptor& data, uint32_t flags, void* reserved);
+    static int save_firmware_chunk(FileTransfer::Descriptor& descriptor, const unsigned char* chunk, void* reserved);
+    static int finish_firmware_update(FileTransfer::Descriptor& data, uint32_t flags, void* reserved);
+
+    static int num_functions();
+    static const char* get_function_key(int index);
+    static int call_function(const char* key, const char* arg, SparkDescriptor::FunctionResultCallback callback, void* reserved);
+    static int num_variables();
+    static const char* get_variable_key(int index);
+    static SparkReturnType::Enum variable_type(const char* key);
+    static const void* get_variable(const char* key);
+    static bool was_ota_upgrade_successful();
+    static void ota_upgrade_status_sent();
+    static void call_event_handler(uint16_t size, FilteringEventHandler* handler, const char* event, const char* data, void* reserved);
+};
+
+}} // namespace particle::fleet
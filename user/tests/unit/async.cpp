@@ -3,11 +3,15 @@
 #include "completion_handler.h"
 
 #include "tools/catch.h"
+#include "tools/benchmark.h"
 
 #include <boost/optional.hpp>
 
 #include <thread>
 #include <deque>
+#include <map>
+#include <vector>
+#include <cstdlib>
 
 namespace {
 
@@ -45,18 +49,25 @@ public:
         instance()->processEvents();
     }
 
-    static void invokeApplicationCallback(void (*callback)(void* data), void* data) {
+    static bool invokeApplicationCallback(void (*callback)(void* data), void* data) {
         instance()->postEvent([=]() {
             callback(data);
         });
+        return true;
     }
 
     static bool isApplicationThreadCurrent() {
-        return true; // TODO
+        return instance()->appThread_;
+    }
+
+    // Makes the Future implementation behave as if it was running in a system thread
+    void setApplicationThreadCurrent(bool current) {
+        appThread_ = current;
     }
 
 private:
     std::deque<Event> events_;
+    bool appThread_ = true;
 };
 
 template<typename ResultT>
@@ -371,6 +382,99 @@ TEST_CASE("Future<int>") {
     }
 }
 
+TEST_CASE("Future completed in a system thread") {
+    using Future = ::Future<int>;
+    using Promise = ::Promise<int>;
+    resetContext();
+
+    SECTION("callbacks are invoked in the application thread") {
+        Promise p;
+        int result = 0;
+        bool failed = false;
+        p.future().onSuccess([&result](int r) {
+            result = r;
+        }).onError([&failed](const Error&) {
+            failed = true;
+        });
+        Context::instance()->setApplicationThreadCurrent(false);
+        p.setResult(1);
+        Context::instance()->setApplicationThreadCurrent(true);
+        CHECK(result == 0); // Callback is pending
+        Context::processApplicationEvents();
+        CHECK(result == 1);
+        CHECK(failed == false);
+    }
+
+    SECTION("pending callbacks keep the future alive") {
+        int result = 0;
+        {
+            Promise p;
+            p.future().onSuccess([&result](int r) {
+                result = r;
+            });
+            Context::instance()->setApplicationThreadCurrent(false);
+            p.setResult(2);
+            Context::instance()->setApplicationThreadCurrent(true);
+        }
+        Context::processApplicationEvents();
+        CHECK(result == 2);
+    }
+
+    SECTION("promise can be passed through a C callback") {
+        Promise p;
+        Future f = p.future();
+        void* const data = p.dataPtr();
+        Promise::defaultCallback(Error::NONE, nullptr, data, nullptr);
+        CHECK(f.isSucceeded() == true);
+        CHECK(f.result() == 0);
+    }
+
+    SECTION("replacing a callback") {
+        Promise p;
+        int calls1 = 0, calls2 = 0;
+        Future f = p.future();
+        f.onSuccess([&calls1](int) {
+            ++calls1;
+        });
+        f.onSuccess([&calls2](int) {
+            ++calls2;
+        });
+        p.setResult(1);
+        CHECK(calls1 == 0);
+        CHECK(calls2 == 1);
+        f.onSuccess([&calls1](int) { // Invoked immediately for a completed future
+            ++calls1;
+        });
+        CHECK(calls1 == 1);
+    }
+    resetContext();
+}
+
+TEST_CASE("Future benchmark", "[.][benchmark]") {
+    using Future = ::Future<bool>;
+    using Promise = ::Promise<bool>;
+    const size_t iterations = 200000;
+    int count = 0;
+    // Emulates the lifecycle of a future returned by Particle.publish()
+    test::benchmark("publish with completion callback", iterations, [&]() {
+        Promise p;
+        void* const data = p.dataPtr();
+        Future f = p.future();
+        f.onSuccess([&count](bool) {
+            ++count;
+        });
+        Promise::fromDataPtr(data).setResult(true);
+    });
+    test::benchmark("publish without callback", iterations, [&]() {
+        Promise p;
+        void* const data = p.dataPtr();
+        Future f = p.future();
+        Promise::fromDataPtr(data).setResult(true);
+        count += f.result();
+    });
+    CHECK(count == (int)iterations * 2);
+}
+
 TEST_CASE("AdaptedFuture<int>") {
     using Future = ::Future<int>;
     using AdaptedFuture = ::AdaptedFuture<int, 1>; // Default value is 1
@@ -778,3 +882,119 @@ TEST_CASE("CompletionHandlerMap") {
         CHECK(m.nearestTimeout() == CompletionHandlerMap::MAX_TIMEOUT);
     }
 }
+
+TEST_CASE("CompletionHandlerMap with many pending handlers") {
+    // Compares the map against a reference model tracking handler expiration times
+    CompletionHandlerMap<int> m;
+    std::vector<CompletionData<int>> data(3000);
+    std::map<int, system_tick_t> pending; // Expiration times of pending handlers
+    system_tick_t now = 0;
+    int nextKey = 0;
+    std::srand(1);
+    for (int step = 0; step < 20000; ++step) {
+        const int op = std::rand() % 8;
+        if (op < 4 && nextKey < (int)data.size()) {
+            const system_tick_t timeout = std::rand() % 1000;
+            REQUIRE(m.addHandler(nextKey, data[nextKey].handler(), timeout));
+            pending[nextKey] = now + timeout;
+            ++nextKey;
+        } else if (op < 6 && !pending.empty()) {
+            auto it = pending.begin();
+            std::advance(it, std::rand() % pending.size());
+            m.setResult(it->first, it->first);
+            REQUIRE(data[it->first].result() == it->first);
+            pending.erase(it);
+        } else {
+            const system_tick_t ticks = std::rand() % 50;
+            now += ticks;
+            int expired = 0;
+            for (auto it = pending.begin(); it != pending.end();) {
+                if (it->second <= now) {
+                    ++expired;
+                    it = pending.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            REQUIRE(m.update(ticks) == expired);
+        }
+        REQUIRE(m.size() == (int)pending.size());
+        if (pending.empty()) {
+            REQUIRE(m.nearestTimeout() == CompletionHandlerMap<int>::MAX_TIMEOUT);
+            now = 0; // The map restarts counting time when it becomes empty
+        } else {
+            system_tick_t nearest = CompletionHandlerMap<int>::MAX_TIMEOUT;
+            for (const auto& entry: pending) {
+                nearest = std::min(nearest, entry.second);
+            }
+            REQUIRE(m.nearestTimeout() == nearest - now);
+        }
+    }
+    for (int key = 0; key < nextKey; ++key) {
+        const bool isPending = pending.count(key);
+        REQUIRE(m.hasHandler(key) == isPending);
+        REQUIRE((data[key].hasResult() || data[key].hasError()) == !isPending);
+        if (data[key].hasError()) {
+            REQUIRE(data[key].error() == Error::TIMEOUT);
+        }
+    }
+    m.clear();
+}
+
+TEST_CASE("CompletionHandlerMap instances used by concurrent threads") {
+    // The maps share the static pools of their handlers and hash tables
+    std::vector<std::thread> threads;
+    std::vector<int> failures(4);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t, &failures]() {
+            CompletionHandlerMap<int> m;
+            CompletionData<int> data[6];
+            for (int i = 0; i < 2000; ++i) {
+                for (int key = 0; key < 6; ++key) {
+                    data[key].reset();
+                    if (!m.addHandler(key, data[key].handler())) {
+                        ++failures[t];
+                    }
+                }
+                for (int key = 0; key < 6; ++key) {
+                    m.setResult(key, key + t);
+                    if (data[key].result() != key + t) {
+                        ++failures[t];
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    for (int t = 0; t < 4; ++t) {
+        CHECK(failures[t] == 0);
+    }
+}
+
+TEST_CASE("CompletionHandlerMap benchmark", "[.][benchmark]") {
+    const int count = 2000; // Number of pending handlers
+    const size_t iterations = 20000;
+    CompletionHandlerMap<int> m;
+    std::vector<CompletionData<int>> data(count);
+    std::vector<int> keys(count);
+    for (int i = 0; i < count; ++i) {
+        keys[i] = i;
+        m.addHandler(i, data[i].handler(), 60000 + i);
+    }
+    int nextKey = count;
+    std::srand(1);
+    // Each iteration acknowledges a random message, sends a new one and advances the time,
+    // so that the nearest handler expires every few iterations
+    test::benchmark("ack, add and update with " + std::to_string(count) + " pending handlers", iterations, [&]() {
+        const int i = std::rand() % count;
+        m.setResult(keys[i]);
+        keys[i] = nextKey++;
+        data[i].reset();
+        m.addHandler(keys[i], data[i].handler(), 60000);
+        m.update(3);
+    });
+    CHECK(m.size() <= count);
+    m.clear();
+}
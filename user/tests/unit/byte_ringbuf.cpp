@@ -0,0 +1,220 @@
+#include "byte_ringbuf.h"
+
+#include "catch.hpp"
+
+#include <vector>
+#include <cstdlib>
+
+namespace {
+
+// Emulates a circular DMA stream writing received bytes into the buffer of a ring
+class RxDma {
+public:
+    explicit RxDma(byte_ringbuf_t* rb) :
+            rb_(rb),
+            pos_(0) {
+    }
+
+    void receive(const uint8_t* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            rb_->buffer[pos_] = data[i];
+            pos_ = (pos_ + 1) % rb_->size;
+        }
+    }
+
+    // Same as the number of transfers remaining in the DMA stream
+    uint32_t remaining() const {
+        return rb_->size - pos_;
+    }
+
+private:
+    byte_ringbuf_t* rb_;
+    uint32_t pos_;
+};
+
+// Emulates a transmitting DMA stream, which is started for a contiguous block of the ring
+class TxDma {
+public:
+    explicit TxDma(byte_ringbuf_t* rb) :
+            rb_(rb),
+            count_(0) {
+    }
+
+    bool start() {
+        if (count_) {
+            return true;
+        }
+        count_ = byte_ringbuf_data_contig(rb_);
+        return count_ > 0;
+    }
+
+    // Sends the current block and releases it from the ring
+    void complete(RxDma* rx) {
+        rx->receive(rb_->buffer + rb_->tail, count_);
+        byte_ringbuf_consume(rb_, count_);
+        count_ = 0;
+    }
+
+    uint32_t count() const {
+        return count_;
+    }
+
+private:
+    byte_ringbuf_t* rb_;
+    uint32_t count_;
+};
+
+} // namespace
+
+TEST_CASE("byte_ringbuf_t") {
+    uint8_t storage[8];
+    byte_ringbuf_t rb;
+    byte_ringbuf_init(&rb, storage, sizeof(storage));
+
+    SECTION("is empty after initialization") {
+        CHECK(byte_ringbuf_data_avail(&rb) == 0);
+        CHECK(byte_ringbuf_space_avail(&rb) == 7);
+        CHECK(byte_ringbuf_get(&rb) == -1);
+        CHECK(byte_ringbuf_peek(&rb) == -1);
+    }
+
+    SECTION("holds one byte less than its storage") {
+        for (int i = 0; i < 7; ++i) {
+            CHECK(byte_ringbuf_put(&rb, i) == 1);
+        }
+        CHECK(byte_ringbuf_put(&rb, 7) == 0);
+        CHECK(byte_ringbuf_data_avail(&rb) == 7);
+        CHECK(byte_ringbuf_space_avail(&rb) == 0);
+        for (int i = 0; i < 7; ++i) {
+            CHECK(byte_ringbuf_peek(&rb) == i);
+            CHECK(byte_ringbuf_get(&rb) == i);
+        }
+        CHECK(byte_ringbuf_get(&rb) == -1);
+    }
+
+    SECTION("bulk write and read wrap around the end of the storage") {
+        const uint8_t data[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+        uint8_t out[sizeof(data)] = {};
+        CHECK(byte_ringbuf_write(&rb, data, 5) == 5);
+        CHECK(byte_ringbuf_read(&rb, out, 5) == 5);
+        CHECK(memcmp(out, data, 5) == 0);
+        // Only 7 bytes fit
+        CHECK(byte_ringbuf_write(&rb, data, sizeof(data)) == 7);
+        CHECK(rb.head == 4);
+        CHECK(byte_ringbuf_data_contig(&rb) == 3);
+        CHECK(byte_ringbuf_read(&rb, out, sizeof(out)) == 7);
+        CHECK(memcmp(out, data, 7) == 0);
+        CHECK(byte_ringbuf_data_avail(&rb) == 0);
+    }
+
+    SECTION("clear discards buffered data") {
+        byte_ringbuf_put(&rb, 1);
+        byte_ringbuf_put(&rb, 2);
+        byte_ringbuf_clear(&rb);
+        CHECK(byte_ringbuf_data_avail(&rb) == 0);
+        CHECK(byte_ringbuf_space_avail(&rb) == 7);
+    }
+
+    SECTION("a buffer without storage accepts nothing") {
+        byte_ringbuf_init(&rb, nullptr, 16);
+        CHECK(byte_ringbuf_space_avail(&rb) == 0);
+        CHECK(byte_ringbuf_write(&rb, storage, sizeof(storage)) == 0);
+    }
+}
+
+TEST_CASE("byte_ringbuf_dma_produced()") {
+    uint8_t storage[8];
+    byte_ringbuf_t rb;
+    byte_ringbuf_init(&rb, storage, sizeof(storage));
+    RxDma dma(&rb);
+    int overrun = -1;
+
+    SECTION("makes the received bytes available") {
+        const uint8_t data[] = { 'a', 'b', 'c' };
+        dma.receive(data, sizeof(data));
+        CHECK(byte_ringbuf_data_avail(&rb) == 0);
+        CHECK(byte_ringbuf_dma_produced(&rb, rb.size - dma.remaining(), &overrun) == 3);
+        CHECK(overrun == 0);
+        CHECK(byte_ringbuf_get(&rb) == 'a');
+        CHECK(byte_ringbuf_dma_produced(&rb, rb.size - dma.remaining(), &overrun) == 0);
+        CHECK(byte_ringbuf_data_avail(&rb) == 2);
+    }
+
+    SECTION("handles the DMA position at the end of the buffer") {
+        const uint8_t data[8] = {};
+        dma.receive(data, 6);
+        byte_ringbuf_dma_produced(&rb, rb.size - dma.remaining(), nullptr);
+        CHECK(byte_ringbuf_read(&rb, storage, 6) == 6);
+        dma.receive(data, 2);
+        // The stream reloads its counter, so the position is reported as 0 rather than 8
+        CHECK(dma.remaining() == 8);
+        CHECK(byte_ringbuf_dma_produced(&rb, rb.size - dma.remaining(), &overrun) == 2);
+        CHECK(overrun == 0);
+        CHECK(byte_ringbuf_data_avail(&rb) == 2);
+    }
+
+    SECTION("keeps the newest data on overrun") {
+        uint8_t data[10];
+        for (size_t i = 0; i < sizeof(data); ++i) {
+            data[i] = i;
+        }
+        dma.receive(data, 6);
+        byte_ringbuf_dma_produced(&rb, rb.size - dma.remaining(), nullptr);
+        dma.receive(data + 6, 4);
+        byte_ringbuf_dma_produced(&rb, rb.size - dma.remaining(), &overrun);
+        CHECK(overrun == 1);
+        // The producer leaves the tail to the consumer
+        CHECK(rb.tail == 0);
+        byte_ringbuf_dma_resync(&rb);
+        uint8_t out[8];
+        REQUIRE(byte_ringbuf_read(&rb, out, sizeof(out)) == 7);
+        for (int i = 0; i < 7; ++i) {
+            CHECK(out[i] == i + 3);
+        }
+    }
+}
+
+TEST_CASE("USART buffers loopback through emulated DMA") {
+    uint8_t txStorage[64];
+    uint8_t rxStorage[128];
+    byte_ringbuf_t tx, rx;
+    byte_ringbuf_init(&tx, txStorage, sizeof(txStorage));
+    byte_ringbuf_init(&rx, rxStorage, sizeof(rxStorage));
+    TxDma txDma(&tx);
+    RxDma rxDma(&rx);
+
+    std::srand(1);
+    std::vector<uint8_t> sent, received;
+    uint8_t next = 0;
+    size_t chunks = 0;
+    while (received.size() < 10000) {
+        // Application writes a block of random size, as much as fits
+        uint8_t out[100];
+        const size_t size = std::rand() % sizeof(out) + 1;
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = next++;
+        }
+        const size_t n = byte_ringbuf_write(&tx, out, size);
+        sent.insert(sent.end(), out, out + n);
+        next -= size - n;
+        // Transmission completes and the next block is started
+        if (txDma.start()) {
+            ++chunks;
+            CHECK(txDma.count() <= sizeof(txStorage) - tx.tail);
+            txDma.complete(&rxDma);
+        }
+        // Idle line is detected on the receiving side
+        int overrun = 0;
+        byte_ringbuf_dma_produced(&rx, rx.size - rxDma.remaining(), &overrun);
+        REQUIRE(overrun == 0);
+        // Application reads blocks of random size, keeping up with the transmitter
+        do {
+            uint8_t in[100];
+            const size_t m = byte_ringbuf_read(&rx, in, std::rand() % sizeof(in) + 1);
+            received.insert(received.end(), in, in + m);
+        } while (byte_ringbuf_data_avail(&rx) > rx.size / 2);
+    }
+    REQUIRE(received.size() <= sent.size());
+    CHECK(std::equal(received.begin(), received.end(), sent.begin()));
+    CHECK(chunks > 0);
+}
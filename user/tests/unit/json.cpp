@@ -3,12 +3,20 @@
 
 #include "tools/stream.h"
 #include "tools/buffer.h"
+#include "tools/benchmark.h"
 
 #include <boost/variant.hpp>
 
+#include <algorithm>
 #include <deque>
+#include <vector>
+#include <thread>
+#include <atomic>
 #include <string>
 #include <cstdlib>
+#include <climits>
+#include <cmath>
+#include <iostream>
 
 namespace {
 
@@ -169,6 +177,92 @@ inline JSONValue parse(const std::string &json) {
     return JSONValue::parseCopy(json.data(), json.size());
 }
 
+// Generates a document similar to a device configuration: an object with the given number of
+// properties having values of different types
+std::string configJson(size_t props) {
+    std::string s = "{";
+    for (size_t i = 0; i < props; ++i) {
+        if (i) {
+            s += ",";
+        }
+        s += "\"prop" + std::to_string(i) + "\":";
+        switch (i % 4) {
+        case 0:
+            s += std::to_string(i * 1000);
+            break;
+        case 1:
+            s += "\"value " + std::to_string(i) + "\\n\"";
+            break;
+        case 2:
+            s += "[true,false,null]";
+            break;
+        default:
+            s += "{\"a\":1,\"b\":2.5}";
+            break;
+        }
+    }
+    s += "}";
+    return s;
+}
+
+// Parser recording the parsing events as a string
+class TestStreamParser: public JSONStreamParser {
+public:
+    explicit TestStreamParser(size_t bufSize = 64) :
+            JSONStreamParser(buf_, std::min(bufSize, sizeof(buf_))) {
+    }
+
+    const std::string& events() const {
+        return s_;
+    }
+
+protected:
+    virtual void beginArray() override {
+        s_ += "[";
+    }
+
+    virtual void endArray() override {
+        s_ += "]";
+    }
+
+    virtual void beginObject() override {
+        s_ += "{";
+    }
+
+    virtual void endObject() override {
+        s_ += "}";
+    }
+
+    virtual void name(const char *name, size_t size) override {
+        CHECK(strlen(name) == size);
+        s_ += "n:" + std::string(name, size) + " ";
+    }
+
+    virtual void value(JSONType type, const char *data, size_t size) override {
+        CHECK(data[size] == '\0');
+        s_ += std::to_string((int)type) + ":" + std::string(data, size) + " ";
+    }
+
+private:
+    std::string s_;
+    char buf_[64];
+};
+
+// Parses a document passing it to the parser in chunks of the specified size
+std::string parseStream(const std::string &json, size_t chunkSize, size_t bufSize = 64) {
+    TestStreamParser p(bufSize);
+    for (size_t i = 0; i < json.size(); i += chunkSize) {
+        if (!p.parse(json.data() + i, std::min(chunkSize, json.size() - i))) {
+            return "error";
+        }
+    }
+    if (!p.finish()) {
+        return "error";
+    }
+    CHECK(p.depth() == 0);
+    return p.events();
+}
+
 inline Checker check(const JSONValue &val) {
     return Checker(val);
 }
@@ -805,6 +899,89 @@ TEST_CASE("JSONString") {
     }
 }
 
+TEST_CASE("JSONValue::get()") {
+    SECTION("small object") {
+        const JSONValue v = parse("{\"a\":1,\"b\":{\"c\":[1,{\"d\":2}],\"e\":3},\"f\":\"x\\ty\",\"a\":4}");
+        CHECK(v.get("a").toInt() == 1); // First of the duplicate names
+        check(v.get("b")).beginObject().name("c").beginArray().number(1).beginObject().name("d").number(2).endObject()
+                .endArray().name("e").number(3).endObject();
+        CHECK(v["b"]["e"].toInt() == 3);
+        CHECK(v["f"].toString() == "x\ty");
+        CHECK(v.get(String("f")).toString() == "x\ty");
+        CHECK(v.get("f\0", 2).isValid() == false);
+        CHECK(v.get("d").isValid() == false); // Only direct properties are looked up
+        CHECK(v.get("").isValid() == false);
+    }
+
+    SECTION("large object") {
+        const JSONValue v = parse(configJson(200));
+        for (int i = 199; i >= 0; --i) {
+            const String name = String("prop") + String(i);
+            const JSONValue p = v[name];
+            switch (i % 4) {
+            case 0:
+                check(p).number(i * 1000);
+                break;
+            case 1:
+                check(p).string("value " + std::to_string(i) + "\n");
+                break;
+            case 2:
+                check(p).beginArray().boolean(true).boolean(false).null().endArray();
+                break;
+            default:
+                check(p).beginObject().name("a").number(1).name("b").number(2.5).endObject();
+                break;
+            }
+        }
+        CHECK(v.get("prop200").isValid() == false);
+        CHECK(v.get("prop").isValid() == false);
+    }
+
+    SECTION("large object parsed using an arena") {
+        const std::string json = configJson(100);
+        JSONArena arena;
+        const JSONValue v = JSONValue::parseCopy(json.data(), json.size(), arena);
+        CHECK(v["prop99"]["b"].toDouble() == 2.5);
+        char buf[16384];
+        JSONArena fixedArena(buf, sizeof(buf));
+        const JSONValue v2 = JSONValue::parseCopy(json.data(), json.size(), fixedArena);
+        const size_t usedSize = fixedArena.usedSize();
+        CHECK(v2["prop99"]["b"].toDouble() == 2.5);
+        CHECK(fixedArena.usedSize() == usedSize); // Index was allocated in the arena when parsing
+        CHECK(v2["prop48"].toInt() == 48000);
+    }
+
+    SECTION("large object looked up from several threads") {
+        const JSONValue v = parse(configJson(100));
+        std::vector<std::thread> threads;
+        std::atomic<int> found(0);
+        for (int i = 0; i < 4; ++i) {
+            const JSONValue copy = v;
+            threads.emplace_back([copy, &found]() {
+                for (int j = 0; j < 100; j += 4) {
+                    if (copy[String("prop") + String(j)].toInt() == j * 1000) {
+                        ++found;
+                    }
+                }
+            });
+        }
+        for (auto& t: threads) {
+            t.join();
+        }
+        CHECK(found == 4 * 25);
+    }
+
+    SECTION("non-object values") {
+        CHECK(JSONValue().get("a").isValid() == false);
+        CHECK(parse("[\"a\",1]").get("a").isValid() == false);
+        CHECK(parse("\"a\"")["a"].isValid() == false);
+    }
+
+    SECTION("malformed object") {
+        check(parse("[{\"a\"}]")).invalid(); // Missing value
+    }
+}
+
 TEST_CASE("JSONArrayIterator") {
     SECTION("construction") {
         JSONArrayIterator it1;
@@ -835,6 +1012,385 @@ TEST_CASE("JSONObjectIterator") {
     }
 }
 
+TEST_CASE("JSONArena") {
+    SECTION("construction") {
+        JSONArena a1;
+        CHECK(a1.size() == 0);
+        CHECK(a1.usedSize() == 0);
+        JSONArena a2(nullptr, 100); // Invalid buffer
+        CHECK(a2.size() == 0);
+    }
+
+    SECTION("parsing into a fixed-size buffer") {
+        char buf[1024];
+        JSONArena arena(buf, sizeof(buf));
+        std::string json = "{\"a\":[1,2],\"b\":\"x\\ny\"}";
+        const JSONValue v = JSONValue::parse(&json.front(), json.size(), arena);
+        check(v).beginObject().name("a").beginArray().number(1).number(2).endArray().name("b").string("x\ny").endObject();
+        CHECK(arena.usedSize() > 0);
+        CHECK(arena.usedSize() <= sizeof(buf));
+        CHECK(arena.size() <= sizeof(buf));
+    }
+
+    SECTION("parsing a copy into a fixed-size buffer") {
+        char buf[1024];
+        JSONArena arena(buf, sizeof(buf));
+        const std::string json = configJson(10);
+        const JSONValue v = JSONValue::parseCopy(json.data(), json.size(), arena);
+        REQUIRE(v.isObject());
+        JSONObjectIterator it(v);
+        CHECK(it.count() == 10);
+        REQUIRE(it.next());
+        CHECK(it.name() == "prop0");
+        CHECK(it.value().toInt() == 0);
+        CHECK(arena.usedSize() > json.size());
+    }
+
+    SECTION("primitive root value is copied to the arena") {
+        char buf[256];
+        JSONArena arena(buf, sizeof(buf));
+        char json[] = { '1', '2', '3' }; // Not null-terminated
+        check(JSONValue::parse(json, sizeof(json), arena)).number(123);
+        CHECK(json[2] == '3');
+    }
+
+    SECTION("too small buffer") {
+        char buf[64];
+        JSONArena arena(buf, sizeof(buf));
+        const std::string json = configJson(10);
+        check(JSONValue::parseCopy(json.data(), json.size(), arena)).invalid();
+        CHECK(arena.usedSize() == 0);
+        CHECK(arena.size() <= sizeof(buf)); // Arena doesn't grow
+    }
+
+    SECTION("arena allocating memory on demand") {
+        JSONArena arena;
+        const std::string json1 = configJson(200);
+        const JSONValue v1 = JSONValue::parseCopy(json1.data(), json1.size(), arena);
+        REQUIRE(v1.isObject());
+        CHECK(JSONObjectIterator(v1).count() == 200);
+        const size_t size = arena.size();
+        CHECK(size >= arena.usedSize());
+        // Memory is reused for subsequent parsing
+        const std::string json2 = configJson(20);
+        const JSONValue v2 = JSONValue::parseCopy(json2.data(), json2.size(), arena);
+        REQUIRE(v2.isObject());
+        CHECK(JSONObjectIterator(v2).count() == 20);
+        CHECK(arena.size() == size);
+    }
+
+    SECTION("parsing errors") {
+        JSONArena arena;
+        check(JSONValue::parseCopy("", 0, arena)).invalid();
+        check(JSONValue::parseCopy("[1,", 3, arena)).invalid();
+        check(JSONValue::parseCopy("\"\\x\"", 4, arena)).invalid();
+        CHECK(arena.usedSize() == 0);
+    }
+}
+
+TEST_CASE("Parsing large JSON documents") {
+    SECTION("token storage grows as necessary") {
+        std::string json = "[";
+        for (size_t i = 0; i < 1000; ++i) {
+            json += i ? ",0" : "0"; // Two characters per token
+        }
+        json += "]";
+        const JSONValue v = parse(json);
+        REQUIRE(v.isArray());
+        JSONArrayIterator it(v);
+        CHECK(it.count() == 1000);
+        size_t n = 0;
+        while (it.next()) {
+            CHECK(it.value().toInt() == 0);
+            ++n;
+        }
+        CHECK(n == 1000);
+    }
+
+    SECTION("nested values") {
+        const std::string json = configJson(200);
+        const JSONValue v = parse(json);
+        REQUIRE(v.isObject());
+        JSONObjectIterator it(v);
+        size_t i = 0;
+        while (it.next()) {
+            CHECK(it.name() == String("prop") + String(i));
+            ++i;
+        }
+        CHECK(i == 200);
+    }
+}
+
+TEST_CASE("JSON parsing benchmark", "[.][benchmark]") {
+    const std::string json = configJson(200);
+    const size_t iterations = 5000;
+    test::benchmark("parseCopy()", iterations, [&]() {
+        REQUIRE(JSONValue::parseCopy(json.data(), json.size()).isObject());
+    });
+    std::string data;
+    test::benchmark("parse()", iterations, [&]() {
+        data = json;
+        REQUIRE(JSONValue::parse(&data.front(), data.size()).isObject());
+    });
+    JSONArena arena;
+    test::benchmark("parseCopy() with arena", iterations, [&]() {
+        REQUIRE(JSONValue::parseCopy(json.data(), json.size(), arena).isObject());
+    });
+    std::unique_ptr<char[]> buf(new char[arena.size()]);
+    JSONArena fixedArena(buf.get(), arena.size());
+    test::benchmark("parse() with fixed-size arena", iterations, [&]() {
+        data = json;
+        REQUIRE(JSONValue::parse(&data.front(), data.size(), fixedArena).isObject());
+    });
+}
+
+TEST_CASE("JSON lookup benchmark", "[.][benchmark]") {
+    const JSONValue v = parse(configJson(200));
+    std::vector<String> names;
+    for (int i = 0; i < 200; ++i) {
+        names.push_back(String("prop") + String(i));
+    }
+    const size_t iterations = 200;
+    test::benchmark("200 lookups with JSONObjectIterator", iterations, [&]() {
+        size_t n = 0;
+        for (const String& name: names) {
+            JSONObjectIterator it(v);
+            while (it.next()) {
+                if (it.name() == name) {
+                    ++n;
+                    break;
+                }
+            }
+        }
+        REQUIRE(n == names.size());
+    });
+    test::benchmark("200 lookups with JSONValue::get()", iterations, [&]() {
+        size_t n = 0;
+        for (const String& name: names) {
+            if (v.get(name).isValid()) {
+                ++n;
+            }
+        }
+        REQUIRE(n == names.size());
+    });
+}
+
+TEST_CASE("JSONStreamParser") {
+    SECTION("primitive values") {
+        CHECK(parseStream("null", 1) == "1:null ");
+        CHECK(parseStream(" true ", 1) == "2:true ");
+        CHECK(parseStream("-12.5e+3", 3) == "3:-12.5e+3 ");
+        CHECK(parseStream("\"a\\\"b\\u0041\\n\"", 1) == "4:a\"bA\n ");
+    }
+
+    SECTION("arbitrary chunk boundaries") {
+        const std::string json = " {\"a\" : [1, true, null, \"x\\\\\\\"y\", {}, []], \"b\\tc\":{\"d\":-0.5}} ";
+        const std::string expected = "{n:a [3:1 2:true 1:null 4:x\\\"y {}[]]n:b\tc {n:d 3:-0.5 }}";
+        for (size_t chunkSize = 1; chunkSize <= json.size(); ++chunkSize) {
+            CHECK(parseStream(json, chunkSize) == expected);
+        }
+    }
+
+    SECTION("documents equivalent to the ones parsed by JSONValue") {
+        const std::string json = configJson(100);
+        const std::string events = parseStream(json, 7);
+        CHECK(events.find("n:prop99 {n:a 3:1 n:b 3:2.5 }}") != std::string::npos);
+        CHECK(events == parseStream(json, json.size()));
+    }
+
+    SECTION("parsing errors") {
+        const char* const docs[] = { "", "[", "]", "[1,", "[1,]", "{", "}", "{null", "{\"1\"", "{\"1\":", "{\"1\" 2}",
+                "{\"1\":2,}", "[}", "{]", "[1 2]", "1 2", "nul", "truex", "-", "\"\\x\"", "\"\\u01\"", "\"abc", "[\"a\":1]" };
+        for (const char *doc: docs) {
+            CATCH_INFO(doc);
+            for (size_t chunkSize = 1; chunkSize <= 3; ++chunkSize) {
+                CHECK(parseStream(doc, chunkSize) == "error");
+            }
+        }
+    }
+
+    SECTION("values longer than the buffer") {
+        CHECK(parseStream("[\"abcdefgh\"]", 2, 8) == "error");
+        CHECK(parseStream("[\"abcdefg\"]", 2, 8) == "[4:abcdefg ]"); // One byte is reserved for term. null
+        CHECK(parseStream("[123456789]", 2, 8) == "error");
+    }
+
+    SECTION("maximum nesting level") {
+        const size_t n = JSONStreamParser::MAX_DEPTH;
+        CHECK(parseStream(std::string(n, '[') + std::string(n, ']'), 5) == std::string(n, '[') + std::string(n, ']'));
+        CHECK(parseStream(std::string(n + 1, '[') + std::string(n + 1, ']'), 5) == "error");
+    }
+
+    SECTION("parsing a stream") {
+        for (size_t chunkSize: { 0, 1, 5, 100 }) {
+            test::InputStream strm("{\"a\":[1,2]} {\"b\":3}", chunkSize);
+            TestStreamParser p;
+            CHECK(p.parse(strm));
+            CHECK(p.isDone());
+            CHECK(p.events() == "{n:a [3:1 3:2 ]}");
+            CHECK(strm.readString() == " {\"b\":3}"); // Data following the document is not consumed
+        }
+    }
+
+    SECTION("reset") {
+        TestStreamParser p;
+        CHECK_FALSE(p.parse("[}", 2));
+        CHECK(p.hasError());
+        p.reset();
+        CHECK_FALSE(p.hasError());
+        CHECK(p.parse("[1]", 3));
+        CHECK(p.finish());
+    }
+}
+
+TEST_CASE("JSON number conversions") {
+    std::srand(1);
+    // Random values with random magnitudes, including the ones close to the rounding boundaries
+    auto randomValue = []() {
+        double v = (double)std::rand() / RAND_MAX;
+        switch (std::rand() % 4) {
+        case 0:
+            v = std::ldexp(v, std::rand() % 256 - 128);
+            break;
+        case 1:
+            v = (float)std::ldexp(v, std::rand() % 256 - 128);
+            break;
+        case 2:
+            v = std::round(v * 1e6) / std::pow(10.0, std::rand() % 12); // Short decimal fractions
+            break;
+        default:
+            v = (std::rand() % 2000000) + 0.5; // Ties
+            break;
+        }
+        return (std::rand() % 2) ? v : -v;
+    };
+
+    SECTION("formatting integers") {
+        const int vals[] = { 0, 1, -1, 9, 10, -10, 99, 100, 12345, -12345, INT_MAX, INT_MIN };
+        for (int val: vals) {
+            char buf[32];
+            JSONBufferWriter w(buf, sizeof(buf));
+            w.value(val);
+            CHECK(std::string(buf, w.dataSize()) == std::to_string(val));
+            w = JSONBufferWriter(buf, sizeof(buf));
+            w.value((unsigned)val);
+            CHECK(std::string(buf, w.dataSize()) == std::to_string((unsigned)val));
+        }
+    }
+
+    SECTION("formatting floating point numbers matches printf()") {
+        const double vals[] = { 0.0, -0.0, 1.0, 0.1, 0.0001, 0.00001, 123456.0, 1234567.0, 999999.5, 9999995.0, 0.5, 1e-30,
+                9.9999999e29, 1e30, 3.40282e+38, 1.17549e-38, INFINITY, -INFINITY, NAN };
+        std::vector<double> values(std::begin(vals), std::end(vals));
+        for (int i = 0; i < 20000; ++i) {
+            values.push_back(randomValue());
+        }
+        for (double val: values) {
+            for (int prec: { 6, 0, 1, 3, 9, 12 }) {
+                char expected[64];
+                snprintf(expected, sizeof(expected), "%.*g", prec, val);
+                char buf[64];
+                JSONBufferWriter w(buf, sizeof(buf));
+                if (prec == 6) {
+                    w.value(val);
+                } else {
+                    w.value(val, prec);
+                }
+                REQUIRE(std::string(buf, w.dataSize()) == expected);
+            }
+        }
+    }
+
+    SECTION("parsing floating point numbers matches strtod()") {
+        const char* const strs[] = { "0", "-0", "1", "-1.5", "0.1", "1e5", "1E-5", "1.7976931348623157e308", "4.9e-324",
+                "123456789012345678901234567890", "9007199254740993", "0.30000000000000004", "1e23", "1e-23", "5." };
+        std::vector<std::string> values(std::begin(strs), std::end(strs));
+        for (int i = 0; i < 20000; ++i) {
+            char buf[64];
+            const char* const fmt[] = { "%.17g", "%g", "%.3f", "%.9e" };
+            snprintf(buf, sizeof(buf), fmt[i % 4], randomValue());
+            values.push_back(buf);
+        }
+        for (const std::string& str: values) {
+            const double expected = strtod(str.c_str(), nullptr);
+            const double val = parse(str).toDouble();
+            CATCH_INFO(str);
+            REQUIRE(std::memcmp(&val, &expected, sizeof(double)) == 0); // Compare bitwise
+            const double val2 = parse("\"" + str + "\"").toDouble();
+            REQUIRE(std::memcmp(&val2, &expected, sizeof(double)) == 0);
+        }
+        CHECK(parse("\"12abc\"").toDouble() == 12.0);
+        CHECK(parse("\" 7\"").toDouble() == 7.0);
+    }
+}
+
+TEST_CASE("JSON number conversion benchmark", "[.][benchmark]") {
+    std::srand(1);
+    std::vector<double> floats;
+    std::vector<int> ints;
+    for (int i = 0; i < 1000; ++i) {
+        floats.push_back((std::rand() % 100000) / 100.0 - 500.0); // Telemetry values, e.g. temperature
+        ints.push_back(std::rand() - RAND_MAX / 2);
+    }
+    char buf[16384];
+    const size_t iterations = 1000;
+    double ns = test::benchmark("1000 doubles with JSONWriter::value()", iterations, [&]() {
+        JSONBufferWriter w(buf, sizeof(buf));
+        w.beginArray();
+        for (double v: floats) {
+            w.value(v);
+        }
+        w.endArray();
+    });
+    std::cout << "  " << (size_t)(1e9 * floats.size() / ns) << " values per second" << std::endl;
+    ns = test::benchmark("1000 doubles with snprintf(\"%g\")", iterations, [&]() {
+        char* s = buf;
+        for (double v: floats) {
+            s += snprintf(s, 32, "%g,", v);
+        }
+    });
+    std::cout << "  " << (size_t)(1e9 * floats.size() / ns) << " values per second" << std::endl;
+    ns = test::benchmark("1000 ints with JSONWriter::value()", iterations, [&]() {
+        JSONBufferWriter w(buf, sizeof(buf));
+        w.beginArray();
+        for (int v: ints) {
+            w.value(v);
+        }
+        w.endArray();
+    });
+    std::cout << "  " << (size_t)(1e9 * ints.size() / ns) << " values per second" << std::endl;
+    ns = test::benchmark("1000 ints with snprintf(\"%d\")", iterations, [&]() {
+        char* s = buf;
+        for (int v: ints) {
+            s += snprintf(s, 16, "%d,", v);
+        }
+    });
+    std::cout << "  " << (size_t)(1e9 * ints.size() / ns) << " values per second" << std::endl;
+    JSONBufferWriter w(buf, sizeof(buf));
+    w.beginArray();
+    for (double v: floats) {
+        w.value(v);
+    }
+    w.endArray();
+    const JSONValue arr = JSONValue::parseCopy(buf, w.dataSize());
+    test::benchmark("1000 JSONValue::toDouble()", iterations, [&]() {
+        double sum = 0;
+        JSONArrayIterator it(arr);
+        while (it.next()) {
+            sum += it.value().toDouble();
+        }
+        REQUIRE(sum != 0);
+    });
+    test::benchmark("1000 strtod()", iterations, [&]() {
+        double sum = 0;
+        JSONArrayIterator it(arr);
+        while (it.next()) {
+            sum += strtod(it.value().toString().data(), nullptr);
+        }
+        REQUIRE(sum != 0);
+    });
+}
+
 TEST_CASE("JSONStreamWriter") {
     SECTION("construction") {
         test::OutputStream strm;
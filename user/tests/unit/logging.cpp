@@ -14,6 +14,8 @@
 
 #include <queue>
 #include <map>
+#include <vector>
+#include <thread>
 
 #define CHECK_LOG_ATTR_FLAG(flag, value) \
         do { \
@@ -849,6 +851,35 @@ TEST_CASE("Malformed category name") {
     }
 }
 
+TEST_CASE("Category filters created by concurrent threads") {
+    // The filters share the static arena of their lookup tables
+    std::vector<std::thread> threads;
+    std::vector<int> failures(4);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t, &failures]() {
+            for (int i = 0; i < 500; ++i) {
+                const TestLogHandler handler(LOG_LEVEL_ERROR, {
+                    { "a", LOG_LEVEL_WARN },
+                    { "a.b", LOG_LEVEL_INFO },
+                    { "a.b.c", LOG_LEVEL_TRACE },
+                    { "d", (LogLevel)(LOG_LEVEL_TRACE + t) }
+                }, nullptr);
+                if (handler.level("a.b.c") != LOG_LEVEL_TRACE || handler.level("a.b") != LOG_LEVEL_INFO ||
+                        handler.level("a.x") != LOG_LEVEL_WARN || handler.level("d") != LOG_LEVEL_TRACE + t ||
+                        handler.level("x") != LOG_LEVEL_ERROR) {
+                    ++failures[t];
+                }
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    for (int t = 0; t < 4; ++t) {
+        CHECK(failures[t] == 0);
+    }
+}
+
 TEST_CASE("Miscellaneous") {
     SECTION("exact category match") {
         DefaultLogHandler log(LOG_LEVEL_ERROR, {
@@ -2,6 +2,14 @@
 #include "catch.hpp"
 #include "spark_wiring_print.h"
 
+#include "tools/benchmark.h"
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+
 
 class BufferPrint : public Print
 {
@@ -56,3 +64,162 @@ SCENARIO("Print.printf() with a a > 20 char string", "[print]")
     print.printf("abcdabcdabcdabcd %d xyzxyzxyzxyzxyzxyzxyzxyz", 100);
     REQUIRE(String("abcdabcdabcdabcd 100 xyzxyzxyzxyzxyzxyzxyzxyz") == print.result());
 }
+
+namespace {
+
+class StringPrint : public Print
+{
+    std::string value;
+
+public:
+    size_t write(uint8_t c) override
+    {
+        value += (char)c;
+        return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override
+    {
+        value.append((const char*)data, size);
+        return size;
+    }
+
+    const std::string& result() const
+    {
+        return value;
+    }
+};
+
+// Formats the arguments with Print::printf() and snprintf() and checks that the results match
+template<typename... ArgsT>
+void checkPrintf(const char* format, ArgsT... args) {
+    char expected[256];
+    snprintf(expected, sizeof(expected), format, args...);
+    StringPrint print;
+    const size_t n = print.printf(format, args...);
+    INFO(format);
+    CHECK(print.result() == expected);
+    CHECK(n == strlen(expected));
+}
+
+} // namespace
+
+TEST_CASE("Print::printf() output matches snprintf()", "[print]") {
+    SECTION("integers") {
+        checkPrintf("%d %i %u %o %x %X", 0, -1, 4000000000u, 8, 0xbeef, 0xbeef);
+        checkPrintf("%5d|%-5d|%05d|%+d|% d|%+5d|%-+5d|", 42, 42, -42, 42, 42, -42, 42);
+        checkPrintf("%.3d|%8.3d|%08.3d|%.0d|%.0x|", 7, -7, 7, 0, 0);
+        checkPrintf("%#x|%#X|%#o|%#o|%#.0o|%#x|", 255, 255, 8, 0, 0, 0);
+        checkPrintf("%*d|%-*d|%*d|%.*d|%.*d|", 6, 1, 6, 2, -6, 3, 4, 5, -1, 6);
+        checkPrintf("%hhd %hhu %hd %hu", 300, 300, 70000, 70000);
+        checkPrintf("%ld %lu %lx", -123456789L, 123456789UL, 0xdeadbeefUL);
+        checkPrintf("%lld %llu %llx %llo", -1234567890123456789LL, 18446744073709551615ULL, 0x123456789abcdefULL, 01777ULL);
+        checkPrintf("%zu %zx %td %jd", (size_t)12345, (size_t)0xabc, (ptrdiff_t)-5, (intmax_t)-9);
+        checkPrintf("%d %d", INT_MIN, INT_MAX);
+    }
+
+    SECTION("characters and strings") {
+        checkPrintf("%c%c%c", 'a', 'b', 'c');
+        checkPrintf("%3c|%-3c|", 'x', 'y');
+        checkPrintf("%s|%10s|%-10s|%.2s|%10.2s|%.10s|", "abc", "abc", "abc", "abc", "abc", "abc");
+        checkPrintf("%s %s", "", std::string(200, 'z').c_str()); // Longer than the internal buffer
+        checkPrintf("%%|%5%|");
+    }
+
+    SECTION("floating point numbers") {
+        checkPrintf("%f %e %g %E %G", 3.14159, 31415.9, 0.0001234, 1e-10, 1e20);
+        checkPrintf("%.2f|%10.3f|%-10.1f|%010.2f|%+f|% f|%+010.1f|", 1.005, -2.5, 3.25, -4.125, 5.0, 6.0, 7.5);
+        checkPrintf("%#g|%#.0f|%.0e|%g|%g", 1.0, 2.0, 12345.0, 100000.0, 1000000.0);
+        checkPrintf("%f|%5f|%-6f|%06f|%f|", (double)INFINITY, (double)-INFINITY, (double)INFINITY, (double)INFINITY, (double)NAN);
+        checkPrintf("%a|%A|%010a|", 1.5, -0.25, 2.0);
+        checkPrintf("%f", 1e100); // Longer than the internal buffer
+        checkPrintf("%*.*f|", 12, 3, 2.71828);
+        checkPrintf("%Lf %Lg", (long double)1.5, (long double)2.5e-5);
+    }
+
+    SECTION("%n stores number of characters") {
+        int n1 = 0, n2 = 0;
+        StringPrint print;
+        print.printf("abc%n%s%n", &n1, std::string(100, 'x').c_str(), &n2);
+        CHECK(n1 == 3);
+        CHECK(n2 == 103);
+    }
+
+    SECTION("malformed format strings") {
+        StringPrint print;
+        print.printf("abc %");
+        CHECK(print.result() == "abc %");
+    }
+}
+
+TEST_CASE("Print::printf() bounds the length of a floating point conversion", "[print]") {
+    char expected[2048];
+    StringPrint print;
+
+    SECTION("prints \"%f\" of the largest double in full") {
+        snprintf(expected, sizeof(expected), "%f", -1.7e308);
+        print.printf("%f", -1.7e308);
+        CHECK(print.result() == expected);
+    }
+
+    SECTION("prints \"%Lf\" of a long double that fits the buffer in full") {
+        snprintf(expected, sizeof(expected), "%Lf", 1e300L);
+        print.printf("%Lf", 1e300L);
+        CHECK(print.result() == expected);
+    }
+
+    SECTION("falls back to exponent form for a conversion that doesn't fit the buffer") {
+        CHECK(print.printf("%.*f|", 1000, 0.1) == 13);
+        CHECK(print.result() == "1.000000e-01|");
+    }
+
+    SECTION("keeps the flags, case and field width in exponent form") {
+        print.printf("%+LF|%-16Lf|%#.500G|", 1e1000L, -1e1000L, 2.0);
+        CHECK(print.result() == "+1.000000E+1000|-1.000000e+1000 |2.000000E+00|");
+    }
+}
+
+TEST_CASE("Print::printf() writes output in chunks", "[print]") {
+    // Counts write() calls
+    class ChunkPrint: public Print {
+    public:
+        size_t writes = 0, size = 0;
+
+        virtual size_t write(uint8_t c) override {
+            return write(&c, 1);
+        }
+
+        virtual size_t write(const uint8_t* data, size_t n) override {
+            ++writes;
+            size += n;
+            return n;
+        }
+    };
+    ChunkPrint p;
+    const std::string s(1000, 'a');
+    CHECK(p.printlnf("%d %s %d", 1, s.c_str(), 2) == 1006);
+    CHECK(p.size == 1006);
+    CHECK(p.writes <= 3);
+}
+
+TEST_CASE("Print::printf() benchmark", "[.][benchmark]") {
+    class NullPrint: public Print {
+    public:
+        virtual size_t write(uint8_t c) override {
+            return 1;
+        }
+
+        virtual size_t write(const uint8_t* data, size_t n) override {
+            return n;
+        }
+    };
+    NullPrint p;
+    const size_t iterations = 100000;
+    test::benchmark("short line", iterations, [&]() {
+        p.printf("t=%lu v=%d", 123456ul, -42);
+    });
+    test::benchmark("long line", iterations, [&]() {
+        p.printlnf("sensor %s: temperature %d, humidity %u, pressure %lu, status 0x%08x, message %s", "outdoor-1", -12,
+                45u, 101325ul, 0xc0ffeeu, "all systems nominal");
+    });
+}
@@ -0,0 +1,356 @@
+#include "simulation.h"
+#include "timer_hal.h"
+#include "ping.h"
+
+#include "tools/catch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace particle::simulation;
+using particle::protocol::Pinger;
+using particle::protocol::ProtocolError;
+
+namespace {
+
+struct PingCounts {
+    unsigned pings = 0;
+    unsigned replies = 0;
+    unsigned timeouts = 0;
+};
+
+// Runs a device pinging an echo server for the given simulated time, processing its
+// pinger every 100 ms as the protocol loop does
+PingCounts run_pinger(const LinkConfig& link, uint32_t seed, sim_time_t duration) {
+    Scheduler scheduler;
+    scheduler.install();
+    Network network(scheduler, seed);
+    network.set_default_link(link);
+
+    PingCounts counts;
+    Pinger pinger;
+    pinger.init(15000, 10000);
+    system_tick_t last_message = 0;
+    const uint8_t ping = 0x40;
+    Network::Address server = 0;
+    const Network::Address device = network.add_endpoint([&](Network::Address, const uint8_t*, size_t) {
+        counts.replies++;
+        last_message = HAL_Timer_Get_Milli_Seconds();
+        pinger.message_received();
+    });
+    server = network.add_endpoint([&](Network::Address from, const uint8_t* data, size_t size) {
+        network.send(server, from, data, size);
+    });
+
+    std::function<void()> loop = [&]() {
+        const ProtocolError error = pinger.process(HAL_Timer_Get_Milli_Seconds() - last_message, [&]() {
+            counts.pings++;
+            last_message = HAL_Timer_Get_Milli_Seconds();
+            network.send(device, server, &ping, sizeof(ping));
+            return particle::protocol::NO_ERROR;
+        });
+        if (error) {
+            // reconnected
+            counts.timeouts++;
+            pinger.reset();
+            last_message = HAL_Timer_Get_Milli_Seconds();
+        }
+        scheduler.schedule_after(100 * MICROS_PER_MILLI, loop);
+    };
+    scheduler.schedule_at(0, loop);
+    scheduler.run_for(duration);
+    return counts;
+}
+
+} // namespace
+
+TEST_CASE("Scheduler") {
+    Scheduler scheduler;
+    std::vector<int> order;
+
+    SECTION("runs the events in the order of their time") {
+        scheduler.schedule_at(300, [&]() { order.push_back(3); });
+        scheduler.schedule_at(100, [&]() { order.push_back(1); });
+        scheduler.schedule_at(200, [&]() { order.push_back(2); });
+        CHECK(scheduler.pending() == 3);
+        CHECK(scheduler.run_until(1000) == 3);
+        CHECK(order == std::vector<int>({ 1, 2, 3 }));
+        CHECK(scheduler.now() == 1000);
+        CHECK(scheduler.pending() == 0);
+    }
+
+    SECTION("runs the events due at the same time in the order they were scheduled") {
+        for (int i = 0; i < 10; i++) {
+            scheduler.schedule_at(50, [&order, i]() { order.push_back(i); });
+        }
+        scheduler.run_for(50);
+        CHECK(order == std::vector<int>({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }));
+    }
+
+    SECTION("advances the clock to each event") {
+        std::vector<sim_time_t> times;
+        scheduler.schedule_at(10, [&]() { times.push_back(scheduler.now()); });
+        scheduler.schedule_at(25, [&]() { times.push_back(scheduler.now()); });
+        CHECK(scheduler.run_one());
+        CHECK(scheduler.now() == 10);
+        CHECK(scheduler.run_one());
+        CHECK_FALSE(scheduler.run_one());
+        CHECK(times == std::vector<sim_time_t>({ 10, 25 }));
+    }
+
+    SECTION("runs the events scheduled by events when they're due") {
+        scheduler.schedule_at(10, [&]() {
+            order.push_back(1);
+            scheduler.schedule_after(10, [&]() { order.push_back(2); });
+            scheduler.schedule_after(100, [&]() { order.push_back(3); });
+        });
+        CHECK(scheduler.run_until(50) == 2);
+        CHECK(order == std::vector<int>({ 1, 2 }));
+        CHECK(scheduler.pending() == 1);
+    }
+
+    SECTION("runs the events scheduled in the past now") {
+        scheduler.advance(100);
+        scheduler.schedule_at(10, [&]() { order.push_back(1); });
+        scheduler.run_for(0);
+        CHECK(order == std::vector<int>({ 1 }));
+        CHECK(scheduler.now() == 100);
+    }
+
+    SECTION("doesn't run cancelled events") {
+        const auto id = scheduler.schedule_at(10, [&]() { order.push_back(1); });
+        scheduler.schedule_at(20, [&]() { order.push_back(2); });
+        CHECK(scheduler.cancel(id));
+        CHECK_FALSE(scheduler.cancel(id));
+        CHECK(scheduler.pending() == 1);
+        scheduler.run_for(100);
+        CHECK(order == std::vector<int>({ 2 }));
+        CHECK_FALSE(scheduler.cancel(id));
+    }
+}
+
+TEST_CASE("Simulated HAL time") {
+    SECTION("the HAL timer returns the time of the installed scheduler") {
+        Scheduler scheduler(5 * MICROS_PER_SECOND);
+        scheduler.install();
+        CHECK(Scheduler::installed() == &scheduler);
+        CHECK(HAL_Timer_Get_Milli_Seconds() == 5000);
+        scheduler.run_for(1500);
+        CHECK(HAL_Timer_Get_Micro_Seconds() == 5001500);
+        CHECK(HAL_Timer_Get_Milli_Seconds() == 5001);
+    }
+
+    SECTION("the HAL timer runs the events due by the wall clock in real time") {
+        Scheduler scheduler(MICROS_PER_SECOND);
+        std::vector<int> order;
+        scheduler.schedule_after(10 * MICROS_PER_MILLI, [&]() { order.push_back(1); });
+        scheduler.schedule_after(60 * MICROS_PER_SECOND, [&]() { order.push_back(2); });
+        scheduler.set_realtime(true);
+        scheduler.install();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const system_tick_t millis = HAL_Timer_Get_Milli_Seconds();
+        CHECK(millis >= 1020);
+        CHECK(millis < 60000);
+        CHECK(order == std::vector<int>({ 1 }));
+        CHECK(scheduler.pending() == 1);
+    }
+
+    SECTION("the HAL timer returns to the wall clock when the scheduler is destroyed") {
+        {
+            Scheduler scheduler;
+            scheduler.install();
+        }
+        CHECK(Scheduler::installed() == nullptr);
+    }
+}
+
+TEST_CASE("Network") {
+    Scheduler scheduler;
+    Network network(scheduler, 1);
+    const auto a = network.add_endpoint();
+    const auto b = network.add_endpoint();
+    uint8_t data[100] = {};
+    uint8_t buffer[100];
+
+    SECTION("delivers a packet after the latency") {
+        LinkConfig config;
+        config.latency = 20 * MICROS_PER_MILLI;
+        network.set_link(a, b, config);
+        data[0] = 42;
+        CHECK(network.send(a, b, data, 10));
+        scheduler.run_until(20 * MICROS_PER_MILLI - 1);
+        CHECK(network.available(b) == 0);
+        scheduler.run_for(1);
+        CHECK(network.available(b) == 1);
+        Network::Address from = 99;
+        CHECK(network.receive(b, buffer, sizeof(buffer), &from) == 10);
+        CHECK(from == a);
+        CHECK(buffer[0] == 42);
+        CHECK(network.receive(b, buffer, sizeof(buffer)) == 0);
+    }
+
+    SECTION("configures each direction separately") {
+        LinkConfig config;
+        config.loss = 1;
+        network.set_link(a, b, config);
+        network.send(a, b, data, 10);
+        network.send(b, a, data, 10);
+        scheduler.run_for(1);
+        CHECK(network.available(b) == 0);
+        CHECK(network.available(a) == 1);
+        CHECK(network.stats(a, b).lost == 1);
+        CHECK(network.stats(b, a).delivered == 1);
+    }
+
+    SECTION("rejects unknown endpoints") {
+        CHECK_FALSE(network.send(a, 5, data, 10));
+    }
+
+    SECTION("removes an endpoint and reuses its address") {
+        LinkConfig config;
+        config.latency = 10;
+        network.set_link(a, b, config);
+        network.send(a, b, data, 10);
+        network.send(a, b, data, 10);
+        scheduler.run_for(10);
+        network.send(a, b, data, 10);
+        network.remove_endpoint(b);
+        CHECK(network.available(b) == 0);
+        CHECK(network.stats(a, b).delivered == 0);
+        CHECK_FALSE(network.send(a, b, data, 10));
+        CHECK(network.add_endpoint() == b);
+        // the packet in flight to the removed endpoint isn't delivered to the new one
+        scheduler.run_for(10);
+        CHECK(network.available(b) == 0);
+        CHECK(network.stats(a, b).delivered == 0);
+    }
+
+    SECTION("loses packets at the configured rate") {
+        LinkConfig config;
+        config.loss = 0.25;
+        network.set_link(a, b, config);
+        for (int i = 0; i < 4000; i++) {
+            network.send(a, b, data, 10);
+        }
+        scheduler.run_for(1);
+        const LinkStats stats = network.stats(a, b);
+        CHECK(stats.sent == 4000);
+        CHECK((stats.lost + stats.delivered) == 4000);
+        CHECK(stats.lost > 900);
+        CHECK(stats.lost < 1100);
+    }
+
+    SECTION("reproduces the impairments from the seed") {
+        LinkConfig config;
+        config.loss = 0.5;
+        config.jitter = 1000;
+        std::vector<std::vector<uint8_t>> runs;
+        for (int run = 0; run < 2; run++) {
+            Scheduler s;
+            Network n(s, 1234);
+            n.set_default_link(config);
+            std::vector<uint8_t> received;
+            const auto to = n.add_endpoint([&](Network::Address, const uint8_t* d, size_t) {
+                received.push_back(d[0]);
+            });
+            const auto from = n.add_endpoint();
+            for (uint8_t i = 0; i < 100; i++) {
+                n.send(from, to, &i, 1);
+            }
+            s.run_for(MICROS_PER_SECOND);
+            runs.push_back(received);
+        }
+        CHECK(runs[0] == runs[1]);
+        CHECK(runs[0].size() < 100);
+    }
+
+    SECTION("limits the bandwidth") {
+        LinkConfig config;
+        config.bandwidth = 10000;      // 100 bytes take 10 ms
+        network.set_link(a, b, config);
+        for (int i = 0; i < 5; i++) {
+            network.send(a, b, data, 100);
+        }
+        scheduler.run_for(10 * MICROS_PER_MILLI);
+        CHECK(network.available(b) == 1);
+        scheduler.run_for(40 * MICROS_PER_MILLI);
+        CHECK(network.available(b) == 5);
+        CHECK(network.stats(a, b).bytes_delivered == 500);
+    }
+
+    SECTION("drops the packets that overflow the queue") {
+        LinkConfig config;
+        config.bandwidth = 10000;
+        config.queue_limit = 300;
+        network.set_link(a, b, config);
+        for (int i = 0; i < 5; i++) {
+            network.send(a, b, data, 100);
+        }
+        scheduler.run_for(MICROS_PER_SECOND);
+        CHECK(network.available(b) == 3);
+        CHECK(network.stats(a, b).overflowed == 2);
+    }
+
+    SECTION("reorders the packets with jitter") {
+        LinkConfig config;
+        config.latency = 10 * MICROS_PER_MILLI;
+        config.jitter = 10 * MICROS_PER_MILLI;
+        std::vector<uint8_t> received;
+        const auto c = network.add_endpoint([&](Network::Address, const uint8_t* d, size_t) {
+            received.push_back(d[0]);
+        });
+        network.set_link(a, c, config);
+        for (uint8_t i = 0; i < 50; i++) {
+            network.send(a, c, &i, 1);
+            scheduler.run_for(MICROS_PER_MILLI);
+        }
+        scheduler.run_for(MICROS_PER_SECOND);
+        REQUIRE(received.size() == 50);
+        CHECK_FALSE(std::is_sorted(received.begin(), received.end()));
+
+        SECTION("unless the link is ordered") {
+            received.clear();
+            config.ordered = true;
+            network.set_link(a, c, config);
+            for (uint8_t i = 0; i < 50; i++) {
+                network.send(a, c, &i, 1);
+                scheduler.run_for(MICROS_PER_MILLI);
+            }
+            scheduler.run_for(MICROS_PER_SECOND);
+            REQUIRE(received.size() == 50);
+            CHECK(std::is_sorted(received.begin(), received.end()));
+        }
+    }
+}
+
+TEST_CASE("Pinger in simulated time") {
+    const sim_time_t DAY = 24 * 3600 * MICROS_PER_SECOND;
+
+    SECTION("pings every interval for a day without loss") {
+        LinkConfig link;
+        link.latency = 100 * MICROS_PER_MILLI;
+        const PingCounts counts = run_pinger(link, 1, DAY);
+        // a ping is sent on the first 100 ms tick more than 15 s after the last message:
+        // 15.1 s after the start, then 15.3 s after each ping as the reply takes 200 ms
+        CHECK(counts.pings == 1 + (86400000 - 15100) / 15300);
+        CHECK(counts.replies == counts.pings);
+        CHECK(counts.timeouts == 0);
+    }
+
+    SECTION("reproduces a day of lossy pings from the seed") {
+        LinkConfig link;
+        link.latency = 100 * MICROS_PER_MILLI;
+        link.jitter = 50 * MICROS_PER_MILLI;
+        link.loss = 0.1;
+        const PingCounts counts = run_pinger(link, 7, DAY);
+        CHECK(counts.replies < counts.pings);
+
+        const PingCounts again = run_pinger(link, 7, DAY);
+        CHECK(again.pings == counts.pings);
+        CHECK(again.replies == counts.replies);
+        CHECK(again.timeouts == counts.timeouts);
+    }
+}
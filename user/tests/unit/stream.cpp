@@ -0,0 +1,137 @@
+#include "spark_wiring_stream.h"
+
+#include "tools/catch.h"
+#include "tools/stream.h"
+#include "tools/benchmark.h"
+
+#include <cstring>
+
+namespace {
+
+using test::InputStream;
+
+// Chunk sizes used to test each method; 0 reads the stream a character at a time
+const size_t CHUNK_SIZES[] = { 0, 1, 3, 64 };
+
+} // namespace
+
+TEST_CASE("Stream::find()") {
+    for (size_t chunkSize: CHUNK_SIZES) {
+        SECTION("finds the target and consumes the data up to it, chunk size " + std::to_string(chunkSize)) {
+            InputStream s("abc OK\r\nrest", chunkSize);
+            CHECK(s.find((char*)"OK\r\n"));
+            CHECK(s.offset() == 8);
+            CHECK(s.readString() == "rest");
+        }
+        SECTION("finds a target overlapping a partial match, chunk size " + std::to_string(chunkSize)) {
+            InputStream s("aaab ababac", chunkSize);
+            CHECK(s.find((char*)"aab"));
+            CHECK(s.offset() == 4);
+            CHECK(s.find((char*)"abac"));
+            CHECK(s.offset() == 11);
+        }
+        SECTION("returns false on timeout, chunk size " + std::to_string(chunkSize)) {
+            InputStream s("abcdef", chunkSize);
+            CHECK_FALSE(s.find((char*)"xyz"));
+            CHECK(s.available() == 0);
+        }
+    }
+}
+
+TEST_CASE("Stream::findUntil()") {
+    for (size_t chunkSize: CHUNK_SIZES) {
+        SECTION("stops at the terminator, chunk size " + std::to_string(chunkSize)) {
+            InputStream s("+CSQ: 12\r\nOK\r\n+CREG", chunkSize);
+            CHECK_FALSE(s.findUntil((char*)"+CREG", (char*)"OK\r\n"));
+            CHECK(s.offset() == 14);
+            CHECK(s.findUntil((char*)"+CREG", (char*)"OK\r\n"));
+        }
+    }
+}
+
+TEST_CASE("Stream::readBytes()") {
+    for (size_t chunkSize: CHUNK_SIZES) {
+        SECTION("reads the requested number of characters, chunk size " + std::to_string(chunkSize)) {
+            InputStream s("0123456789", chunkSize);
+            char buf[16] = {};
+            CHECK(s.readBytes(buf, 4) == 4);
+            CHECK(strcmp(buf, "0123") == 0);
+            CHECK(s.readBytes(buf, sizeof(buf)) == 6);
+            CHECK(strncmp(buf, "456789", 6) == 0);
+        }
+    }
+}
+
+TEST_CASE("Stream::readBytesUntil()") {
+    for (size_t chunkSize: CHUNK_SIZES) {
+        SECTION("reads up to the terminator and consumes it, chunk size " + std::to_string(chunkSize)) {
+            InputStream s("first line\nsecond", chunkSize);
+            char buf[32] = {};
+            CHECK(s.readBytesUntil('\n', buf, sizeof(buf)) == 10);
+            CHECK(strncmp(buf, "first line", 10) == 0);
+            CHECK(s.offset() == 11);
+            CHECK(s.readBytesUntil('\n', buf, sizeof(buf)) == 6);
+            CHECK(strncmp(buf, "second", 6) == 0);
+        }
+        SECTION("stops when the buffer is full, chunk size " + std::to_string(chunkSize)) {
+            InputStream s("abcdef\n", chunkSize);
+            char buf[4];
+            CHECK(s.readBytesUntil('\n', buf, sizeof(buf)) == 4);
+            CHECK(s.offset() == 4);
+        }
+    }
+}
+
+TEST_CASE("Stream::parseInt() and Stream::parseFloat()") {
+    for (size_t chunkSize: CHUNK_SIZES) {
+        SECTION("parses numbers separated by other characters, chunk size " + std::to_string(chunkSize)) {
+            InputStream s("temp=-12, hum=1024; 3.25x", chunkSize);
+            CHECK(s.parseInt() == -12);
+            CHECK(s.parseInt() == 1024);
+            CHECK(s.parseFloat() == Approx(3.25));
+            CHECK(s.peek() == 'x');
+            CHECK(s.parseInt() == 0);
+        }
+    }
+}
+
+TEST_CASE("Stream::readStringUntil()") {
+    for (size_t chunkSize: CHUNK_SIZES) {
+        SECTION("reads up to the terminator, chunk size " + std::to_string(chunkSize)) {
+            InputStream s("key:value", chunkSize);
+            CHECK(s.readStringUntil(':') == "key");
+            CHECK(s.readStringUntil(':') == "value");
+        }
+    }
+}
+
+TEST_CASE("Stream parsing benchmark", "[.][benchmark]") {
+    std::string data;
+    for (int i = 0; i < 100; ++i) {
+        data += "+URC: " + std::to_string(i * 1234) + ",\"some payload text\"\r\n";
+    }
+    data += "OK\r\n";
+    const size_t iterations = 2000;
+    for (size_t chunkSize: { (size_t)0, (size_t)512 }) {
+        const std::string suffix = chunkSize ? " (buffered)" : " (per character)";
+        test::benchmark("find" + suffix, iterations, [&]() {
+            InputStream s(data, chunkSize);
+            REQUIRE(s.find((char*)"OK\r\n"));
+        });
+        test::benchmark("readBytesUntil" + suffix, iterations, [&]() {
+            InputStream s(data, chunkSize);
+            char line[64];
+            while (s.readBytesUntil('\n', line, sizeof(line)) > 0) {
+            }
+        });
+        test::benchmark("parseInt" + suffix, iterations, [&]() {
+            InputStream s(data, chunkSize);
+            long sum = 0;
+            for (int i = 0; i < 100; ++i) {
+                sum += s.parseInt();
+                s.find((char*)"\n");
+            }
+            REQUIRE(sum == 1234 * 99 * 100 / 2);
+        });
+    }
+}
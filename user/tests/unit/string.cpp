@@ -1,7 +1,10 @@
 
 #include <iostream>
 #include <limits.h>
+#include <string>
+#include <utility>
 #include "catch.hpp"
+#include "tools/benchmark.h"
 
 #include "spark_wiring_string.h"
 
@@ -77,3 +80,87 @@ TEST_CASE("Can format a string using printf like syntax") {
 TEST_CASE("Can convert a string to lowercase") {
     REQUIRE(String("In LOWERCAse").toLowerCase()==String("in lowercase"));
 }
+
+TEST_CASE("Short strings are stored inline") {
+    String s("0123456789abcde");
+    REQUIRE(s.length() == String::INLINE_CAPACITY);
+    REQUIRE(s == "0123456789abcde");
+    s += 'f';
+    REQUIRE(s == "0123456789abcdef");
+    String t(s);
+    REQUIRE(t == s);
+    String u(std::move(s));
+    REQUIRE(u == "0123456789abcdef");
+    String v(std::move(String("short")));
+    REQUIRE(v == "short");
+    v = std::move(u);
+    REQUIRE(v == "0123456789abcdef");
+    REQUIRE(String() == "");
+    REQUIRE(String().c_str() != nullptr);
+}
+
+TEST_CASE("Can concatenate a string to itself") {
+    String s("abc");
+    s += s;
+    REQUIRE(s == "abcabc");
+    for (int i = 0; i < 4; ++i) {
+        s.concat(s);
+    }
+    REQUIRE(s.length() == 96);
+    REQUIRE(s.startsWith("abcabcabc"));
+    REQUIRE(s.endsWith("abcabcabc"));
+}
+
+TEST_CASE("Concatenation builds long strings") {
+    String s;
+    std::string expected;
+    for (int i = 0; i < 1000; ++i) {
+        s += (char)('a' + i % 26);
+        s += i;
+        expected += (char)('a' + i % 26);
+        expected += std::to_string(i);
+    }
+    REQUIRE(s.length() == expected.size());
+    REQUIRE(expected == s.c_str());
+    String r;
+    REQUIRE(r.reserve(100));
+    r = "0123456789";
+    r += r;
+    r += "0123456789";
+    REQUIRE(r == "012345678901234567890123456789");
+}
+
+TEST_CASE("String benchmark", "[.][benchmark]") {
+    const size_t iterations = 20000;
+    size_t total = 0;
+    test::benchmark("concat 100 chars", iterations, [&]() {
+        String s;
+        for (int i = 0; i < 100; ++i) {
+            s += 'x';
+        }
+        total += s.length();
+    });
+    test::benchmark("concat 100 words", iterations, [&]() {
+        String s;
+        for (int i = 0; i < 100; ++i) {
+            s += "word ";
+        }
+        total += s.length();
+    });
+    test::benchmark("concat 100 numbers", iterations, [&]() {
+        String s;
+        for (int i = 0; i < 100; ++i) {
+            s += i;
+            s += ',';
+        }
+        total += s.length();
+    });
+    // The argument constructions done when calling a registered cloud function
+    for (const char* param: { "on", "set brightness to 50%", "" }) {
+        test::benchmark(std::string("function argument \"") + param + "\"", iterations * 10, [&]() {
+            String p(param);
+            total += p.length();
+        });
+    }
+    REQUIRE(total > 0);
+}
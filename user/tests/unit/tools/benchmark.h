@@ -0,0 +1,31 @@
+#ifndef TEST_TOOLS_BENCHMARK_H
+#define TEST_TOOLS_BENCHMARK_H
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+namespace test {
+
+// Runs a function the given number of times and prints the average time per call.
+// Benchmark test cases are tagged with [.][benchmark] so that they only run when
+// selected explicitly, e.g. `runner [benchmark]`
+template<typename FuncT>
+double benchmark(const std::string& name, size_t iterations, FuncT func);
+
+} // namespace test
+
+template<typename FuncT>
+inline double test::benchmark(const std::string& name, size_t iterations, FuncT func) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        func();
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    const double nsPerCall = elapsed.count() / iterations;
+    std::cout << name << ": " << std::fixed << std::setprecision(1) << nsPerCall << " ns" << std::endl;
+    return nsPerCall;
+}
+
+#endif // TEST_TOOLS_BENCHMARK_H
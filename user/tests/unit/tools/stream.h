@@ -2,10 +2,13 @@
 #define TEST_TOOLS_STREAM_H
 
 #include "spark_wiring_print.h"
+#include "spark_wiring_stream.h"
 
 #include "check.h"
 
+#include <algorithm>
 #include <string>
+#include <cstring>
 
 namespace test {
 
@@ -27,6 +30,28 @@ private:
     std::string s_;
 };
 
+// Stream reading from a string. If chunkSize is not 0, peekBuffer() exposes the data
+// in pieces of that size, otherwise the data can only be read a character at a time
+class InputStream: public Stream {
+public:
+    explicit InputStream(std::string s, size_t chunkSize = 0);
+
+    size_t offset() const;
+
+    virtual int available() override; // Stream
+    virtual int read() override; // Stream
+    virtual int peek() override; // Stream
+    virtual void flush() override; // Stream
+    virtual size_t peekBuffer(const uint8_t** data) override; // Stream
+    virtual size_t readAvailable(uint8_t* buffer, size_t size) override; // Stream
+    virtual size_t write(uint8_t byte) override; // Print
+
+private:
+    std::string s_;
+    size_t chunkSize_;
+    size_t offset_;
+};
+
 } // namespace test
 
 // test::OutputStream
@@ -51,4 +76,55 @@ inline test::OutputStream::operator std::string() const {
     return s_;
 }
 
+// test::InputStream
+inline test::InputStream::InputStream(std::string s, size_t chunkSize) :
+        s_(std::move(s)),
+        chunkSize_(chunkSize),
+        offset_(0) {
+    setTimeout(0);
+}
+
+inline size_t test::InputStream::offset() const {
+    return offset_;
+}
+
+inline int test::InputStream::available() {
+    return s_.size() - offset_;
+}
+
+inline int test::InputStream::read() {
+    return (offset_ < s_.size()) ? (uint8_t)s_[offset_++] : -1;
+}
+
+inline int test::InputStream::peek() {
+    return (offset_ < s_.size()) ? (uint8_t)s_[offset_] : -1;
+}
+
+inline void test::InputStream::flush() {
+}
+
+inline size_t test::InputStream::peekBuffer(const uint8_t** data) {
+    if (!chunkSize_) {
+        return 0;
+    }
+    *data = (const uint8_t*)s_.data() + offset_;
+    return std::min(chunkSize_, s_.size() - offset_);
+}
+
+inline size_t test::InputStream::readAvailable(uint8_t* buffer, size_t size) {
+    if (!chunkSize_) {
+        return Stream::readAvailable(buffer, size);
+    }
+    const size_t n = std::min(size, s_.size() - offset_);
+    if (buffer) {
+        memcpy(buffer, s_.data() + offset_, n);
+    }
+    offset_ += n;
+    return n;
+}
+
+inline size_t test::InputStream::write(uint8_t byte) {
+    return 0;
+}
+
 #endif // TEST_TOOLS_STREAM_H
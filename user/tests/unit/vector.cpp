@@ -2,8 +2,10 @@
 
 #include "tools/catch.h"
 #include "tools/alloc.h"
+#include "tools/benchmark.h"
 
 #include <type_traits>
+#include <cstdlib>
 
 namespace {
 
@@ -148,6 +150,27 @@ size_t NonTrivialInt::s_count = 0;
 
 static_assert(!PARTICLE_VECTOR_TRIVIALLY_COPYABLE_TRAIT<NonTrivialInt>::value, "NonTrivialInt is too trivial!");
 
+// Fallback allocator counting the requests that didn't fit into a pool or an arena
+struct CountingAllocator {
+    static void* malloc(size_t size) {
+        ++s_count;
+        return test::DefaultAllocator::malloc(size);
+    }
+
+    static void* realloc(void* ptr, size_t size) {
+        ++s_count;
+        return test::DefaultAllocator::realloc(ptr, size);
+    }
+
+    static void free(void* ptr) {
+        test::DefaultAllocator::free(ptr);
+    }
+
+    static size_t s_count;
+};
+
+size_t CountingAllocator::s_count = 0;
+
 template<typename T, typename AllocatorT>
 inline Checker<spark::Vector<T, AllocatorT>> check(const spark::Vector<T, AllocatorT> &vector) {
     return Checker<spark::Vector<T, AllocatorT>>(vector);
@@ -314,7 +337,7 @@ void testVector() {
             REQUIRE(a.insert(0, 1)); // i = 0
             check(a).values(1, 2, 4, 5).capacity(4);
             REQUIRE(a.insert(4, 6)); // i = size()
-            check(a).values(1, 2, 4, 5, 6).capacity(5);
+            check(a).values(1, 2, 4, 5, 6).capacity(6); // capacity grows by half
             REQUIRE(a.insert(2, 3)); // i = size() / 2
             check(a).values(1, 2, 3, 4, 5, 6).capacity(6);
             Vector b;
@@ -670,3 +693,199 @@ TEST_CASE("Vector<NonTrivialInt>") {
     test::DefaultAllocator::check();
     CHECK(NonTrivialInt::instanceCount() == 0);
 }
+
+TEST_CASE("Vector<int, PoolAllocator>") {
+    test::DefaultAllocator::reset();
+
+    using Allocator = spark::PoolAllocator<sizeof(int) * 8, 4, void, test::DefaultAllocator>;
+    using Vector = spark::Vector<int, Allocator>;
+    testVector<Vector>();
+
+    test::DefaultAllocator::check();
+    CHECK(Allocator::usedBlocks() == 0);
+}
+
+TEST_CASE("Vector<NonTrivialInt, PoolAllocator>") {
+    test::DefaultAllocator::reset();
+
+    using Allocator = spark::PoolAllocator<sizeof(NonTrivialInt) * 8, 4, void, test::DefaultAllocator>;
+    using Vector = spark::Vector<NonTrivialInt, Allocator>;
+    testVector<Vector>();
+
+    test::DefaultAllocator::check();
+    CHECK(Allocator::usedBlocks() == 0);
+    CHECK(NonTrivialInt::instanceCount() == 0);
+}
+
+TEST_CASE("Vector<NonTrivialInt, ArenaAllocator>") {
+    test::DefaultAllocator::reset();
+
+    using Allocator = spark::ArenaAllocator<256, void, test::DefaultAllocator>;
+    using Vector = spark::Vector<NonTrivialInt, Allocator>;
+    testVector<Vector>();
+
+    test::DefaultAllocator::check();
+    CHECK(Allocator::usedSize() == 0);
+    CHECK(NonTrivialInt::instanceCount() == 0);
+}
+
+TEST_CASE("PoolAllocator") {
+    struct Tag;
+    using Allocator = spark::PoolAllocator<32, 4, Tag, CountingAllocator>;
+    test::DefaultAllocator::reset();
+    CountingAllocator::s_count = 0;
+
+    SECTION("reuses released blocks") {
+        void* p[4];
+        for (int i = 0; i < 4; ++i) {
+            p[i] = Allocator::malloc(32);
+            REQUIRE(Allocator::owns(p[i]));
+        }
+        CHECK(Allocator::usedBlocks() == 4);
+        Allocator::free(p[1]);
+        void* const p2 = Allocator::malloc(1);
+        CHECK(p2 == p[1]);
+        Allocator::free(p2);
+        Allocator::free(p[0]);
+        Allocator::free(p[2]);
+        Allocator::free(p[3]);
+        CHECK(Allocator::usedBlocks() == 0);
+        CHECK(CountingAllocator::s_count == 0);
+    }
+
+    SECTION("forwards requests that don't fit to the fallback allocator") {
+        void* p[5];
+        for (int i = 0; i < 5; ++i) {
+            p[i] = Allocator::malloc(16);
+        }
+        CHECK_FALSE(Allocator::owns(p[4])); // The pool is exhausted
+        void* const big = Allocator::malloc(33);
+        CHECK_FALSE(Allocator::owns(big));
+        CHECK(CountingAllocator::s_count == 2);
+        for (int i = 0; i < 5; ++i) {
+            Allocator::free(p[i]);
+        }
+        Allocator::free(big);
+        CHECK(Allocator::usedBlocks() == 0);
+    }
+
+    SECTION("keeps a block in place while it fits and moves its data otherwise") {
+        char* p = (char*)Allocator::malloc(8);
+        memcpy(p, "abcdefg", 8);
+        CHECK(Allocator::realloc(p, 32) == p);
+        p = (char*)Allocator::realloc(p, 64);
+        CHECK_FALSE(Allocator::owns(p));
+        CHECK(strcmp(p, "abcdefg") == 0);
+        CHECK(Allocator::usedBlocks() == 0);
+        Allocator::free(p);
+    }
+
+    test::DefaultAllocator::check();
+}
+
+TEST_CASE("ArenaAllocator") {
+    struct Tag;
+    using Allocator = spark::ArenaAllocator<256, Tag, CountingAllocator>;
+    test::DefaultAllocator::reset();
+    CountingAllocator::s_count = 0;
+
+    SECTION("reclaims memory when the most recent or all allocations are released") {
+        void* const p1 = Allocator::malloc(10);
+        const size_t size = Allocator::usedSize();
+        void* const p2 = Allocator::malloc(10);
+        REQUIRE(Allocator::owns(p1));
+        REQUIRE(Allocator::owns(p2));
+        CHECK(((uintptr_t)p2 % alignof(std::max_align_t)) == 0);
+        Allocator::free(p2);
+        CHECK(Allocator::usedSize() == size);
+        void* const p3 = Allocator::malloc(10);
+        CHECK(p3 == p2);
+        Allocator::free(p1);
+        CHECK(Allocator::usedSize() > 0);
+        Allocator::free(p3);
+        CHECK(Allocator::usedSize() == 0);
+    }
+
+    SECTION("extends the most recent allocation in place") {
+        char* const p1 = (char*)Allocator::malloc(8);
+        char* const p2 = (char*)Allocator::malloc(8);
+        memcpy(p1, "abcdefg", 8);
+        CHECK(Allocator::realloc(p2, 100) == p2);
+        char* const p3 = (char*)Allocator::realloc(p1, 64);
+        CHECK(p3 != p1);
+        CHECK(strcmp(p3, "abcdefg") == 0);
+        Allocator::free(p2);
+        Allocator::free(p3);
+        CHECK(Allocator::usedSize() == 0);
+        CHECK(CountingAllocator::s_count == 0);
+    }
+
+    SECTION("forwards requests that don't fit to the fallback allocator") {
+        void* const p1 = Allocator::malloc(200);
+        void* const p2 = Allocator::malloc(200);
+        CHECK(Allocator::owns(p1));
+        CHECK_FALSE(Allocator::owns(p2));
+        CHECK(CountingAllocator::s_count == 1);
+        Allocator::free(p1);
+        Allocator::free(p2);
+    }
+
+    test::DefaultAllocator::check();
+}
+
+TEST_CASE("Pooled vectors don't use the heap while they fit into the pool") {
+    // Emulates a set of short handler lists that are repeatedly filled and emptied in random order
+    struct Tag;
+    using Allocator = spark::PoolAllocator<sizeof(NonTrivialInt) * 16, 8, Tag, CountingAllocator>;
+    using Vector = spark::Vector<NonTrivialInt, Allocator>;
+    test::DefaultAllocator::reset();
+    CountingAllocator::s_count = 0;
+    {
+        std::srand(1);
+        Vector lists[4];
+        for (int i = 0; i < 10000; ++i) {
+            Vector& v = lists[std::rand() % 4];
+            if (v.size() < 12 && std::rand() % 3 != 0) { // Capacity of 12 elements grows to 13
+                REQUIRE(v.append(i));
+            } else if (!v.isEmpty()) {
+                v.takeAt(std::rand() % v.size());
+            }
+            if (v.isEmpty()) {
+                v = Vector(); // Release the storage
+            }
+        }
+    }
+    CHECK(CountingAllocator::s_count == 0);
+    CHECK(Allocator::usedBlocks() == 0);
+    test::DefaultAllocator::check();
+}
+
+TEST_CASE("Vector allocator benchmark", "[.][benchmark]") {
+    struct PoolTag;
+    struct ArenaTag;
+    const size_t iterations = 20000;
+    const int count = 32;
+    int sum = 0;
+    test::benchmark("DefaultAllocator", iterations, [&]() {
+        spark::Vector<int> v;
+        for (int i = 0; i < count; ++i) {
+            v.append(i);
+        }
+        sum += v.size();
+    });
+    test::benchmark("PoolAllocator", iterations, [&]() {
+        spark::Vector<int, spark::PoolAllocator<sizeof(int) * count, 2, PoolTag>> v;
+        for (int i = 0; i < count; ++i) {
+            v.append(i);
+        }
+        sum += v.size();
+    });
+    test::benchmark("ArenaAllocator", iterations, [&]() {
+        spark::Vector<int, spark::ArenaAllocator<1024, ArenaTag>> v;
+        for (int i = 0; i < count; ++i) {
+            v.append(i);
+        }
+        sum += v.size();
+    });
+    CHECK(sum == (int)iterations * count * 3);
+}
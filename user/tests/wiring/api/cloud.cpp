@@ -90,6 +90,20 @@ test(api_spark_function) {
     API_COMPILE(Particle.function("name", &MyClass::handler, &myObj));
 }
 
+test(api_spark_function_with_length) {
+    int (*handler)(const char*, size_t) = NULL;
+
+    API_COMPILE(Particle.function("name", handler));
+    int calls = 0;
+    API_COMPILE(Particle.function("name", [&calls](const char* arg, size_t length) { return ++calls; }));
+
+    class MyClass {
+      public:
+        int handler(const char* arg, size_t length) { return 0; }
+    } myObj;
+    API_COMPILE(Particle.function("name", &MyClass::handler, &myObj));
+}
+
 test(api_spark_publish) {
     // Particle.publish(const char*, const char*, ...)
     API_COMPILE(Particle.publish("event"));
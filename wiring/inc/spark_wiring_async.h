@@ -27,8 +27,11 @@
 #include <functional>
 #include <memory>
 #include <atomic>
+#include <type_traits>
+#include <new>
 
-#if (ATOMIC_POINTER_LOCK_FREE != 2) || (ATOMIC_CHAR_LOCK_FREE != 2) || (ATOMIC_BOOL_LOCK_FREE != 2)
+#if (ATOMIC_POINTER_LOCK_FREE != 2) || (ATOMIC_CHAR_LOCK_FREE != 2) || (ATOMIC_BOOL_LOCK_FREE != 2) || \
+        (ATOMIC_INT_LOCK_FREE != 2)
 #error "std::atomic is not always lock-free for required types"
 #endif
 
@@ -50,8 +53,117 @@ struct FutureCallbackTypes<void> {
     typedef std::function<void(const Error&)> OnError;
 };
 
-// Helper function for FutureImplBase::invokeCallback()
-void futureCallbackWrapper(void* data);
+// Atomic holder of a completion callback. The callback is stored in the future object itself,
+// unless that storage is occupied by a callback that is being replaced or invoked concurrently,
+// in which case the new callback is allocated dynamically. Note that std::function may still
+// allocate memory for a functor that doesn't fit into its internal buffer
+template<typename FunctionT>
+class FutureCallback {
+public:
+    typedef FunctionT Function;
+
+    FutureCallback() :
+            ptr_(nullptr),
+            busy_(false) {
+    }
+
+    ~FutureCallback() {
+        destroy(ptr_.load(std::memory_order_relaxed));
+    }
+
+    void set(Function&& callback) {
+        Function* ptr = nullptr;
+        if (!busy_.exchange(true, std::memory_order_acquire)) {
+            ptr = new(&storage_) Function(std::move(callback));
+        } else {
+            ptr = new Function(std::move(callback));
+        }
+        destroy(ptr_.exchange(ptr, std::memory_order_acq_rel));
+    }
+
+    // Takes the callback and invokes it
+    template<typename... ArgsT>
+    void invoke(ArgsT&&... args) {
+        Function* const ptr = ptr_.exchange(nullptr, std::memory_order_acq_rel);
+        if (ptr) {
+            (*ptr)(std::forward<ArgsT>(args)...);
+            destroy(ptr);
+        }
+    }
+
+    // This class is non-copyable
+    FutureCallback(const FutureCallback&) = delete;
+    FutureCallback& operator=(const FutureCallback&) = delete;
+
+private:
+    std::atomic<Function*> ptr_;
+    std::atomic<bool> busy_; // Set if the internal storage is in use
+    typename std::aligned_storage<sizeof(Function), alignof(Function)>::type storage_;
+
+    void destroy(Function* ptr) {
+        if (ptr == (Function*)&storage_) {
+            ptr->~Function();
+            busy_.store(false, std::memory_order_release);
+        } else {
+            delete ptr;
+        }
+    }
+};
+
+// Smart pointer to a reference counted FutureImpl instance
+template<typename ImplT>
+class FutureRef {
+public:
+    FutureRef() :
+            p_(nullptr) {
+    }
+
+    // Takes ownership over a reference, the reference count is not incremented
+    explicit FutureRef(ImplT* p) :
+            p_(p) {
+    }
+
+    FutureRef(const FutureRef& ref) :
+            p_(ref.p_) {
+        if (p_) {
+            p_->addRef();
+        }
+    }
+
+    FutureRef(FutureRef&& ref) :
+            p_(ref.p_) {
+        ref.p_ = nullptr;
+    }
+
+    ~FutureRef() {
+        if (p_ && p_->releaseRef()) {
+            delete p_;
+        }
+    }
+
+    // Gives up ownership over the reference without decrementing the reference count
+    ImplT* release() {
+        ImplT* const p = p_;
+        p_ = nullptr;
+        return p;
+    }
+
+    ImplT* get() const {
+        return p_;
+    }
+
+    ImplT* operator->() const {
+        return p_;
+    }
+
+    FutureRef& operator=(FutureRef ref) {
+        std::swap(p_, ref.p_);
+        return *this;
+    }
+
+private:
+    ImplT* p_;
+};
 
 // Internal future implementation. Base class for FutureImpl
 template<typename ResultT, typename ContextT>
@@ -69,11 +181,6 @@ public:
     typedef typename detail::FutureCallbackTypes<ResultT>::OnSuccess OnSuccessCallback;
     typedef typename detail::FutureCallbackTypes<ResultT>::OnError OnErrorCallback;
 
-    ~FutureImplBase() {
-        delete onSuccess_.load(std::memory_order_relaxed);
-        delete onError_.load(std::memory_order_relaxed);
-    }
-
     bool wait(int timeout = 0) const {
         // TODO: Waiting for a future in a non-default application thread is not supported
         if (ContextT::isApplicationThreadCurrent()) {
@@ -118,17 +225,26 @@ public:
         return done_.load(std::memory_order_relaxed);
     }
 
+    void addRef() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns true if the last reference has been released
+    bool releaseRef() {
+        return refs_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
 protected:
     std::atomic<State> state_; // Future state
     std::atomic<bool> done_; // Flag signaling that future is in a final state
-    std::atomic<typename FutureCallbackTypes<ResultT>::OnSuccess*> onSuccess_; // User callback for succeeded operation
-    std::atomic<typename FutureCallbackTypes<ResultT>::OnError*> onError_; // User callback for failed operation
+    std::atomic<int> refs_; // Reference count
+    FutureCallback<typename FutureCallbackTypes<ResultT>::OnSuccess> onSuccess_; // User callback for succeeded operation
+    FutureCallback<typename FutureCallbackTypes<ResultT>::OnError> onError_; // User callback for failed operation
 
     explicit FutureImplBase(State state) :
             state_(state),
             done_(state != State::RUNNING),
-            onSuccess_(nullptr),
-            onError_(nullptr) {
+            refs_(1) {
     }
 
     bool changeState(State state) {
@@ -148,34 +264,26 @@ protected:
         return state_.load(std::memory_order_relaxed);
     }
 
-    template<typename FunctionT>
-    static void setCallback(std::atomic<std::function<FunctionT>*>& wrapper, std::function<FunctionT>&& callback) {
-        auto callbackPtr = new std::function<FunctionT>(callback); // New callback
-        callbackPtr = wrapper.exchange(callbackPtr, std::memory_order_acq_rel);
-        delete callbackPtr; // Delete old callback
-    }
-
-    // Takes a callback from its atomic wrapper and invokes it
-    template<typename FunctionT, typename... ArgsT>
-    static void invokeCallback(std::atomic<std::function<FunctionT>*>& wrapper, ArgsT&&... args) {
-        std::function<FunctionT>* callbackPtr = wrapper.exchange(nullptr, std::memory_order_acq_rel);
-        if (callbackPtr) {
-            invokeCallback(*callbackPtr, std::forward<ArgsT>(args)...);
-            delete callbackPtr;
-        }
-    }
-
-    // Invokes std::function in the application context
-    template<typename FunctionT, typename... ArgsT>
-    static void invokeCallback(const std::function<FunctionT>& callback, ArgsT&&... args) {
+    // Invokes the completion callbacks of a completed future in the application context. The
+    // callbacks are invoked synchronously if the current thread is the application thread,
+    // otherwise the future is kept alive until the application thread gets to invoke them
+    template<typename ImplT>
+    static void notify(ImplT* impl) {
         if (ContextT::isApplicationThreadCurrent()) {
-            callback(std::forward<ArgsT>(args)...); // Synchronous call
+            impl->invokeCallbacks();
         } else {
-            // Bind all arguments and wrap resulting function into a pointer
-            auto callbackPtr = new std::function<void()>(std::bind(callback, std::forward<ArgsT>(args)...));
-            ContextT::invokeApplicationCallback(futureCallbackWrapper, callbackPtr);
+            impl->addRef();
+            if (!ContextT::invokeApplicationCallback(notifyWrapper<ImplT>, impl)) {
+                FutureRef<ImplT> ref(impl);
+            }
         }
     }
+
+    template<typename ImplT>
+    static void notifyWrapper(void* data) {
+        const FutureRef<ImplT> ref(static_cast<ImplT*>(data));
+        ref->invokeCallbacks();
+    }
 };
 
 // Internal future implementation
@@ -218,7 +326,7 @@ public:
         if (this->changeState(State::SUCCEEDED)) {
             new(&result_) ResultT(std::move(result));
             this->releaseDone();
-            this->invokeCallback(this->onSuccess_, result_);
+            this->notify(this);
         }
     }
 
@@ -234,7 +342,7 @@ public:
         if (this->changeState(State::FAILED)) {
             new(&error_) Error(std::move(error));
             this->releaseDone();
-            this->invokeCallback(this->onError_, error_);
+            this->notify(this);
         }
     }
 
@@ -247,17 +355,29 @@ public:
     }
 
     void onSuccess(OnSuccessCallback callback) {
-        this->setCallback(this->onSuccess_, std::move(callback));
+        this->onSuccess_.set(std::move(callback));
         // Ensure that the newly assigned callback is invoked for already completed future
         if (this->acquireDone() && this->isSucceeded()) {
-            this->invokeCallback(this->onSuccess_, result_);
+            this->notify(this);
         }
     }
 
     void onError(OnErrorCallback callback) {
-        this->setCallback(this->onError_, std::move(callback));
+        this->onError_.set(std::move(callback));
         if (this->acquireDone() && this->isFailed()) {
-            this->invokeCallback(this->onError_, error_);
+            this->notify(this);
+        }
+    }
+
+    // Invokes the callback matching the future's state in the current thread
+    void invokeCallbacks() {
+        if (this->acquireDone()) {
+            const State s = this->state();
+            if (s == State::SUCCEEDED) {
+                this->onSuccess_.invoke(result_);
+            } else if (s == State::FAILED) {
+                this->onError_.invoke(error_);
+            }
         }
     }
 
@@ -292,7 +412,7 @@ public:
     void setResult() {
         if (this->changeState(State::SUCCEEDED)) {
             this->releaseDone();
-            this->invokeCallback(this->onSuccess_);
+            this->notify(this);
         }
     }
 
@@ -300,7 +420,7 @@ public:
         if (this->changeState(State::FAILED)) {
             error_ = std::move(error);
             this->releaseDone();
-            this->invokeCallback(this->onError_, error_);
+            this->notify(this);
         }
     }
 
@@ -313,17 +433,29 @@ public:
     }
 
     void onSuccess(OnSuccessCallback callback) {
-        this->setCallback(this->onSuccess_, std::move(callback));
+        this->onSuccess_.set(std::move(callback));
         // Ensure that the newly assigned callback is invoked for already completed future
         if (this->acquireDone() && this->isSucceeded()) {
-            this->invokeCallback(this->onSuccess_);
+            this->notify(this);
         }
     }
 
     void onError(OnErrorCallback callback) {
-        this->setCallback(this->onError_, std::move(callback));
+        this->onError_.set(std::move(callback));
         if (this->acquireDone() && this->isFailed()) {
-            this->invokeCallback(this->onError_, error_);
+            this->notify(this);
+        }
+    }
+
+    // Invokes the callback matching the future's state in the current thread
+    void invokeCallbacks() {
+        if (this->acquireDone()) {
+            const State s = this->state();
+            if (s == State::SUCCEEDED) {
+                this->onSuccess_.invoke();
+            } else if (s == State::FAILED) {
+                this->onError_.invoke(error_);
+            }
         }
     }
 
@@ -332,7 +464,7 @@ private:
 };
 
 template<typename ResultT, typename ContextT>
-using FutureImplPtr = std::shared_ptr<FutureImpl<ResultT, ContextT>>;
+using FutureImplPtr = FutureRef<FutureImpl<ResultT, ContextT>>;
 
 // Event loop and threading abstraction. Used for unit testing
 struct FutureContext {
@@ -385,18 +517,16 @@ public:
         return Future<ResultT, ContextT>(p_);
     }
 
-    // Wraps this promise into an object pointer that can be passed to a C function
+    // Wraps this promise into an object pointer that can be passed to a C function. The pointer
+    // holds a reference to the shared state and needs to be released via fromDataPtr()
     void* dataPtr() const {
-        // TODO: Use custom reference counting object to avoid unnecessary memory allocation
-        return new detail::FutureImplPtr<ResultT, ContextT>(p_);
+        return detail::FutureImplPtr<ResultT, ContextT>(p_).release();
     }
 
     // Unwraps promise from an object pointer created via dataPtr() method
     static Promise<ResultT, ContextT> fromDataPtr(void* data) {
-        auto d = static_cast<detail::FutureImplPtr<ResultT, ContextT>*>(data);
-        const Promise<ResultT, ContextT> p(*d);
-        delete d;
-        return p;
+        return Promise<ResultT, ContextT>(detail::FutureImplPtr<ResultT, ContextT>(
+                static_cast<detail::FutureImpl<ResultT, ContextT>*>(data)));
     }
 
 protected:
@@ -520,7 +650,8 @@ public:
 
     // Constructs succeeded future
     explicit Future(ResultT result = ResultT()) :
-            FutureBase<ResultT, ContextT>(std::make_shared<detail::FutureImpl<ResultT, ContextT>>(std::move(result))) {
+            FutureBase<ResultT, ContextT>(detail::FutureImplPtr<ResultT, ContextT>(
+                    new detail::FutureImpl<ResultT, ContextT>(std::move(result)))) {
     }
 
     ResultT result() const {
@@ -544,7 +675,8 @@ public:
 
     // Constructs succeeded future
     Future() :
-            FutureBase<void, ContextT>(std::make_shared<detail::FutureImpl<void, ContextT>>(State::SUCCEEDED)) {
+            FutureBase<void, ContextT>(detail::FutureImplPtr<void, ContextT>(
+                    new detail::FutureImpl<void, ContextT>(State::SUCCEEDED))) {
     }
 
 private:
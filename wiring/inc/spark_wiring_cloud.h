@@ -38,6 +38,9 @@
 using particle::Flags;
 
 typedef std::function<user_function_int_str_t> user_std_function_int_str_t;
+// Function handler that reads the argument in place rather than from a String copy
+typedef int (user_function_int_cstr_t)(const char* arg, size_t length);
+typedef std::function<user_function_int_cstr_t> user_std_function_int_cstr_t;
 typedef std::function<void (const char*, const char*)> wiring_event_handler_t;
 
 #ifdef SPARK_NO_CLOUD
@@ -209,7 +212,36 @@ public:
     template <typename T>
     static bool _function(const char *funcKey, int (T::*func)(String), T *instance) {
       using namespace std::placeholders;
-      return _function(funcKey, std::bind(func, instance, _1));
+      // the bound call also accepts (const char*, size_t), so the wrapper type is explicit
+      return _function(funcKey, user_std_function_int_str_t(std::bind(func, instance, _1)));
+    }
+
+    static bool _function(const char *funcKey, user_function_int_cstr_t* func)
+    {
+        return CLOUD_FN(register_function(call_raw_user_function_cstr, (void*)func, funcKey), false);
+    }
+
+    static bool _function(const char *funcKey, user_std_function_int_cstr_t func, void* reserved=NULL)
+    {
+#ifdef SPARK_NO_CLOUD
+        return false;
+#else
+        bool success = false;
+        if (func)
+        {
+            auto wrapper = new user_std_function_int_cstr_t(func);
+            if (wrapper) {
+                success = register_function(call_std_user_function_cstr, wrapper, funcKey);
+            }
+        }
+        return success;
+#endif
+    }
+
+    template <typename T>
+    static bool _function(const char *funcKey, int (T::*func)(const char*, size_t), T *instance) {
+      using namespace std::placeholders;
+      return _function(funcKey, user_std_function_int_cstr_t(std::bind(func, instance, _1, _2)));
     }
 
     inline particle::Future<bool> publish(const char *eventName, Flags<PublishFlag> flags1 = PUBLIC, Flags<PublishFlag> flags2 = Flags<PublishFlag>())
@@ -332,6 +364,8 @@ private:
     static bool register_function(cloud_function_t fn, void* data, const char* funcKey);
     static int call_raw_user_function(void* data, const char* param, void* reserved);
     static int call_std_user_function(void* data, const char* param, void* reserved);
+    static int call_raw_user_function_cstr(void* data, const char* param, void* reserved);
+    static int call_std_user_function_cstr(void* data, const char* param, void* reserved);
 
     static void call_wiring_event_handler(const void* param, const char *event_name, const char *data);
 
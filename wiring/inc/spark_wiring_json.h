@@ -26,6 +26,8 @@
 #include <cstring>
 #include <memory>
 
+class Stream;
+
 namespace spark {
 
 namespace detail {
@@ -49,6 +51,34 @@ class JSONString;
 class JSONArrayIterator;
 class JSONObjectIterator;
 
+// Memory for parsed JSON data. An arena constructed with a buffer never allocates memory, otherwise
+// memory is allocated on demand and kept for subsequent parsing. Values parsed using an arena become
+// invalid once the arena is reused for another document or destroyed
+class JSONArena {
+public:
+    JSONArena();
+    JSONArena(char *buf, size_t size);
+    ~JSONArena();
+
+    size_t size() const; // Returns size of the arena's memory
+    size_t usedSize() const; // Returns number of bytes used by the last parsed document and its indices
+
+private:
+    char *buf_;
+    size_t size_, used_;
+    bool alloc_; // Set if the memory is allocated by the arena
+
+    bool reserve(size_t size);
+    void* allocate(size_t size); // Allocates unused memory without growing the arena
+
+    // This class is non-copyable
+    JSONArena(const JSONArena&) = delete;
+    JSONArena& operator=(const JSONArena&) = delete;
+
+    friend class JSONValue;
+    friend struct detail::JSONData;
+};
+
 // Immutable JSON value
 class JSONValue {
 public:
@@ -61,6 +91,16 @@ public:
 
     JSONType type() const;
 
+    // Returns value of the object's property with the specified name, or an invalid value if this
+    // value is not an object or it doesn't have such a property. Properties of large objects are
+    // hashed on first lookup, so that subsequent lookups take constant time
+    JSONValue get(const char *name) const;
+    JSONValue get(const char *name, size_t size) const;
+    JSONValue get(const String &name) const;
+
+    JSONValue operator[](const char *name) const;
+    JSONValue operator[](const String &name) const;
+
     bool isNull() const;
     bool isBool() const;
     bool isNumber() const;
@@ -73,6 +113,10 @@ public:
     static JSONValue parse(char *json, size_t size);
     static JSONValue parseCopy(const char *json, size_t size);
     static JSONValue parseCopy(const char *json);
+    // Parse using memory of the arena. These methods don't allocate memory if the arena was
+    // constructed with a buffer
+    static JSONValue parse(char *json, size_t size, JSONArena &arena);
+    static JSONValue parseCopy(const char *json, size_t size, JSONArena &arena);
 
 private:
     detail::JSONDataPtr d_;
@@ -80,7 +124,7 @@ private:
 
     JSONValue(const jsmntok_t *token, detail::JSONDataPtr data);
 
-    static bool tokenize(const char *json, size_t size, jsmntok_t **tokens, size_t *count);
+    static JSONValue parse(const char *json, size_t size, JSONArena &arena, bool copy);
     static bool stringize(jsmntok_t *tokens, size_t count, char *json);
     static bool unescape(jsmntok_t *token, char *json);
 
@@ -159,6 +203,71 @@ private:
     JSONObjectIterator(const jsmntok_t *token, detail::JSONDataPtr data);
 };
 
+// Incremental JSON parser. Data can be passed to the parser in chunks of arbitrary size, and the
+// parser reports the document structure to its subclass via the virtual methods. Names and values
+// are accumulated in a caller-provided buffer, which limits their maximum length
+class JSONStreamParser {
+public:
+    static const size_t MAX_DEPTH = 32; // Maximum nesting level of arrays and objects
+
+    JSONStreamParser(char *buf, size_t size);
+    virtual ~JSONStreamParser() = default;
+
+    // Parses a chunk of data. Returns false in case of an error
+    bool parse(const char *data, size_t size);
+    // Parses data available in the stream without waiting for more data. The stream is read up
+    // to the end of the document, any data that follows it is left in the stream
+    bool parse(Stream &stream);
+    // Returns false if the document is malformed or incomplete
+    bool finish();
+    void reset();
+
+    bool isDone() const; // Returns true if the entire document has been parsed
+    bool hasError() const;
+
+    size_t depth() const; // Returns current nesting level
+
+protected:
+    virtual void beginArray();
+    virtual void endArray();
+    virtual void beginObject();
+    virtual void endObject();
+    // Name and value data is null-terminated, strings are unescaped
+    virtual void name(const char *name, size_t size);
+    virtual void value(JSONType type, const char *data, size_t size);
+
+private:
+    enum State {
+        VALUE, // Expecting a value
+        FIRST_VALUE, // Expecting first element of an array or end of the array
+        NAME, // Expecting name of an object's property
+        FIRST_NAME, // Expecting name of first property or end of the object
+        COLON, // Expecting colon after a property name
+        NEXT, // Expecting separator or end of an array or object
+        STRING, // Parsing a string
+        PRIMITIVE, // Parsing a number, boolean or null
+        DONE,
+        FAILED
+    };
+
+    char *buf_;
+    size_t bufSize_, n_;
+    uint32_t stack_; // Types of the nested values, one bit per level, set for objects
+    size_t depth_;
+    State state_;
+    bool nameStr_; // Set if the string being parsed is a property name
+    bool escape_; // Set if the previous character of the string is a backslash
+
+    size_t process(const char *data, size_t size, bool stopWhenDone);
+    void beginValue(char c);
+    void endContainer(bool object);
+    void endString();
+    void endPrimitive();
+    void endValue();
+    bool append(const char *data, size_t size);
+    void error();
+};
+
 // Abstract JSON document writer
 class JSONWriter {
 public:
@@ -175,7 +284,8 @@ public:
     JSONWriter& value(bool val);
     JSONWriter& value(int val);
     JSONWriter& value(unsigned val);
-    JSONWriter& value(double val);
+    JSONWriter& value(double val); // Same as value(val, 6)
+    JSONWriter& value(double val, int precision); // Formats the value like printf() with "%.*g"
     JSONWriter& value(const char *val);
     JSONWriter& value(const char *val, size_t size);
     JSONWriter& value(const String &val);
@@ -237,6 +347,22 @@ bool operator!=(const String &str1, const JSONString &str2);
 
 } // namespace spark
 
+// spark::JSONArena
+inline spark::JSONArena::JSONArena() :
+        buf_(nullptr),
+        size_(0),
+        used_(0),
+        alloc_(true) {
+}
+
+inline size_t spark::JSONArena::size() const {
+    return size_;
+}
+
+inline size_t spark::JSONArena::usedSize() const {
+    return used_;
+}
+
 // spark::JSONValue
 inline spark::JSONValue::JSONValue() :
         t_(nullptr) {
@@ -246,6 +372,22 @@ inline spark::JSONString spark::JSONValue::toString() const {
     return JSONString(t_, d_);
 }
 
+inline spark::JSONValue spark::JSONValue::get(const char *name) const {
+    return get(name, strlen(name));
+}
+
+inline spark::JSONValue spark::JSONValue::get(const String &name) const {
+    return get(name.c_str(), name.length());
+}
+
+inline spark::JSONValue spark::JSONValue::operator[](const char *name) const {
+    return get(name);
+}
+
+inline spark::JSONValue spark::JSONValue::operator[](const String &name) const {
+    return get(name);
+}
+
 inline bool spark::JSONValue::isNull() const {
     return type() == JSON_TYPE_NULL;
 }
@@ -278,6 +420,14 @@ inline spark::JSONValue spark::JSONValue::parseCopy(const char *json) {
     return parseCopy(json, strlen(json));
 }
 
+inline spark::JSONValue spark::JSONValue::parse(char *json, size_t size, JSONArena &arena) {
+    return parse(json, size, arena, false /* copy */);
+}
+
+inline spark::JSONValue spark::JSONValue::parseCopy(const char *json, size_t size, JSONArena &arena) {
+    return parse(json, size, arena, true /* copy */);
+}
+
 // spark::JSONString
 inline spark::JSONString::JSONString() :
         s_(""),
@@ -367,6 +517,47 @@ inline size_t spark::JSONObjectIterator::count() const {
     return n_;
 }
 
+// spark::JSONStreamParser
+inline spark::JSONStreamParser::JSONStreamParser(char *buf, size_t size) :
+        buf_(buf),
+        bufSize_(size) {
+    reset();
+}
+
+inline bool spark::JSONStreamParser::isDone() const {
+    return state_ == DONE;
+}
+
+inline bool spark::JSONStreamParser::hasError() const {
+    return state_ == FAILED;
+}
+
+inline size_t spark::JSONStreamParser::depth() const {
+    return depth_;
+}
+
+inline void spark::JSONStreamParser::beginArray() {
+}
+
+inline void spark::JSONStreamParser::endArray() {
+}
+
+inline void spark::JSONStreamParser::beginObject() {
+}
+
+inline void spark::JSONStreamParser::endObject() {
+}
+
+inline void spark::JSONStreamParser::name(const char *name, size_t size) {
+}
+
+inline void spark::JSONStreamParser::value(JSONType type, const char *data, size_t size) {
+}
+
+inline void spark::JSONStreamParser::error() {
+    state_ = FAILED;
+}
+
 // spark::JSONWriter
 inline spark::JSONWriter::JSONWriter() :
         state_(BEGIN) {
@@ -380,6 +571,10 @@ inline spark::JSONWriter& spark::JSONWriter::name(const String &name) {
     return this->name(name.c_str(), name.length());
 }
 
+inline spark::JSONWriter& spark::JSONWriter::value(double val) {
+    return value(val, 6);
+}
+
 inline spark::JSONWriter& spark::JSONWriter::value(const char *val) {
     return value(val, strlen(val));
 }
@@ -42,6 +42,31 @@ typedef Vector<LogCategoryFilter> LogCategoryFilters;
 
 namespace detail {
 
+// Lock guarding the node arena shared by all filters. Filters are created by the application as
+// well as by the system, e.g. for a log handler configured with a control request. They can also
+// be created during static initialization, so the mutex is created on first use
+#if PLATFORM_THREADING
+struct LogFilterLock {
+    void lock() {
+        mutex().lock();
+    }
+
+    void unlock() {
+        mutex().unlock();
+    }
+
+private:
+    static Mutex& mutex() {
+        static Mutex m;
+        return m;
+    }
+};
+#elif PLATFORM_ID == 3
+typedef std::mutex LogFilterLock; // The test fleet runs its virtual devices on a pool of threads
+#else
+typedef NoLock LogFilterLock;
+#endif
+
 // Internal implementation
 class LogFilter {
 public:
@@ -59,11 +84,16 @@ public:
 private:
     struct Node;
 
+    // Nodes are created once and released together with the filter, so they're allocated from
+    // an arena rather than scattered over the heap. The arena is shared by all filters
+    typedef ArenaAllocator<256, LogFilter, DefaultAllocator, LogFilterLock> NodeAllocator;
+    typedef Vector<Node, NodeAllocator> Nodes;
+
     Vector<String> cats_; // Category filter strings
-    Vector<Node> nodes_; // Lookup table
+    Nodes nodes_; // Lookup table
     LogLevel level_; // Default level
 
-    static int nodeIndex(const Vector<Node> &nodes, const char *name, size_t size, bool &found);
+    static int nodeIndex(const Nodes &nodes, const char *name, size_t size, bool &found);
 };
 
 } // namespace spark::detail
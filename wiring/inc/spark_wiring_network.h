@@ -27,6 +27,10 @@
 #define __SPARK_WIRING_NETWORK_H
 
 #include "spark_wiring_ipaddress.h"
+#include "system_tick_hal.h"
+
+class TCPClient;
+class UDP;
 
 namespace spark {
 
@@ -63,6 +67,47 @@ public:
         // hard-code for now until multiple-networks are implemented.
         return Network;
     }
+
+    /**
+     * Blocks the calling thread until at least one of the given clients has data available
+     * to read or has been closed by the peer, or the timeout expires.
+     *
+     * @param clients   The clients to wait on.
+     * @param count     The number of clients.
+     * @param timeout   The maximum time to wait in milliseconds.
+     * @return The index of a readable client, -1 if the timeout expired, or a negative
+     *      system error code.
+     */
+    static int waitReadable(TCPClient* const* clients, size_t count, system_tick_t timeout);
+
+    /**
+     * Blocks the calling thread until a packet has arrived on at least one of the given
+     * UDP sockets, or the timeout expires.
+     *
+     * @param sockets   The sockets to wait on.
+     * @param count     The number of sockets.
+     * @param timeout   The maximum time to wait in milliseconds.
+     * A socket whose packet has already been read with parsePacket() but not consumed
+     * is readable. On platforms that can't wait on sockets, the sockets are polled with
+     * parsePacket() instead, so the packet of the returned socket is in its buffer:
+     * available() is non-zero and read() returns its data without calling parsePacket().
+     *
+     * @return The index of a socket with a pending packet, -1 if the timeout expired, or a
+     *      negative system error code.
+     */
+    static int waitReadable(UDP* const* sockets, size_t count, system_tick_t timeout);
+
+    /**
+     * Blocks the calling thread until at least one of the given clients can accept more data
+     * to send, or the timeout expires.
+     *
+     * @param clients   The clients to wait on.
+     * @param count     The number of clients.
+     * @param timeout   The maximum time to wait in milliseconds.
+     * @return The index of a writable client, -1 if the timeout expired, or a negative
+     *      system error code.
+     */
+    static int waitWritable(TCPClient* const* clients, size_t count, system_tick_t timeout);
 };
 
 
@@ -28,6 +28,7 @@
 #define __SPARK_WIRING_PRINT_
 
 #include <stddef.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdint.h> // for uint8_t
 
@@ -51,6 +52,7 @@ class Print
   protected:
     void setWriteError(int err = 1) { write_error = err; }
     size_t printf_impl(bool newline, const char* format, ...);
+    size_t vprintf_impl(bool newline, const char* format, va_list args);
 
   public:
     Print() : write_error(0) {}
@@ -101,6 +103,11 @@ class Print
         return this->printf_impl(true, format, args...);
     }
 
+    // Formatted output is passed to write() in chunks as it's produced, so the output
+    // length is not limited by a buffer. A single floating point conversion is limited
+    // to 320 characters, which fits "%f" of any double with the default precision
+    size_t vprintf(const char* format, va_list args);
+
 };
 
 #endif
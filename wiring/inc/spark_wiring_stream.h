@@ -43,6 +43,9 @@ readBytesBetween( pre_string, terminator, buffer, length)
 
 class Stream : public Print
 {
+  private:
+    class Cursor;
+
   protected:
     system_tick_t _timeout;      // number of milliseconds to wait for the next char before aborting timed read
     system_tick_t _startMillis;  // used for timeout measurement
@@ -58,6 +61,18 @@ class Stream : public Print
 
     Stream() {_timeout=1000;}
 
+    // Bulk access to buffered data, used by the parsing methods to scan data without
+    // reading it a character at a time. Streams that buffer data should override these.
+
+    // returns the number of contiguous characters that can be read without waiting and
+    // points data at them. The data stays valid until the stream is read.
+    // returns 0 if no data is buffered or the stream doesn't expose its buffer.
+    virtual size_t peekBuffer(const uint8_t** data) { return 0; }
+
+    // reads up to size characters that are available without waiting, returns the number of
+    // characters read. The characters are discarded if buffer is NULL.
+    virtual size_t readAvailable(uint8_t* buffer, size_t size);
+
 // parsing methods
 
   void setTimeout(system_tick_t timeout);  // sets maximum milliseconds to wait for stream data, default is 1 second
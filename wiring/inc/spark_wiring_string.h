@@ -43,6 +43,15 @@
 class __FlashStringHelper;
 #define F(X) (X)
 
+// Short strings are stored in the object itself, except in modular firmware: there
+// Strings cross the dynalib boundary (e.g. spark_deviceID()) between modules built
+// at different times, so the object layout must stay as it was.
+#if !defined(MODULAR_FIRMWARE) || !MODULAR_FIRMWARE
+#define SPARK_WIRING_STRING_INLINE 1
+#else
+#define SPARK_WIRING_STRING_INLINE 0
+#endif
+
 // An inherited class for holding the result of a concatenation.  These
 // result objects are assumed to be writable by subsequent concatenations.
 class StringSumHelper;
@@ -83,7 +92,9 @@ public:
 	// memory management
 	// return true on success, false on failure (in which case, the string
 	// is left unchanged).  reserve(0), if successful, will validate an
-	// invalid string (i.e., "if (s)" will be true afterwards)
+	// invalid string (i.e., "if (s)" will be true afterwards).  strings of
+	// up to INLINE_CAPACITY characters are stored in the object itself and
+	// don't allocate memory (INLINE_CAPACITY is 0 in modular firmware)
 	unsigned char reserve(unsigned int size);
 	inline unsigned int length(void) const {return len;}
 
@@ -192,15 +203,30 @@ public:
 
         static String format(const char* format, ...);
 
+#if SPARK_WIRING_STRING_INLINE
+	static const unsigned int INLINE_CAPACITY = 15;
+#else
+	static const unsigned int INLINE_CAPACITY = 0;
+#endif
+
 protected:
 	char *buffer;	        // the actual char array
 	unsigned int capacity;  // the array length minus one (for the '\0')
 	unsigned int len;       // the String length (not counting the '\0')
 	unsigned char flags;    // unused, for future features
+#if SPARK_WIRING_STRING_INLINE
+	char inlineBuffer[INLINE_CAPACITY + 1]; // storage for short strings
+#endif
 protected:
 	void init(void);
 	void invalidate(void);
+#if SPARK_WIRING_STRING_INLINE
+	bool isInline(void) const { return buffer == inlineBuffer; }
+#else
+	bool isInline(void) const { return false; }
+#endif
 	unsigned char changeBuffer(unsigned int maxStrLen);
+	unsigned char grow(unsigned int maxStrLen);
 	unsigned char concat(const char *cstr, unsigned int length);
 
 	// copy and move
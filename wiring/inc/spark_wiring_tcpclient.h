@@ -31,9 +31,20 @@
 #include "spark_wiring_ipaddress.h"
 #include "spark_wiring_print.h"
 #include "socket_hal.h"
+#include <memory>
+
+namespace spark {
+class NetworkClass;
+}
 
 #define TCPCLIENT_BUF_MAX_SIZE	128
 
+/**
+ * Default time (in milliseconds) that buffered outgoing data may be held back before
+ * it is sent, when write buffering is enabled with TCPClient::setWriteBuffer().
+ */
+#define TCPCLIENT_WRITE_FLUSH_TIMEOUT	20
+
 class TCPClient : public Client {
 
 public:
@@ -50,8 +61,31 @@ public:
 	virtual int read();
 	virtual int read(uint8_t *buffer, size_t size);
 	virtual int peek();
+	virtual size_t peekBuffer(const uint8_t** data);
+	virtual size_t readAvailable(uint8_t* buffer, size_t size);
 	virtual void flush();
         void flush_buffer();
+
+        /**
+         * Enables buffering of outgoing data. Small writes, such as those produced by
+         * the Print methods, are coalesced and sent in one go when the buffer is full,
+         * when flush() or stop() is called, or once the oldest buffered byte has been
+         * pending for `flushTimeout` milliseconds. The timeout is checked on every write
+         * and after each iteration of loop().
+         *
+         * Copies of this client share the same buffer.
+         *
+         * @param size  The size of the buffer in bytes. 0 disables buffering.
+         * @param flushTimeout  Maximum time in milliseconds that data is held in the buffer.
+         * @return {@code true} if the buffer was allocated.
+         */
+        bool setWriteBuffer(size_t size, system_tick_t flushTimeout=TCPCLIENT_WRITE_FLUSH_TIMEOUT);
+
+        /**
+         * Sends the data held by buffered clients whose flush timeout has expired.
+         * Called by the system after each iteration of loop().
+         */
+        static void flushExpiredWrites();
 	virtual void stop();
 	virtual uint8_t connected();
 	virtual operator bool();
@@ -59,6 +93,7 @@ public:
         virtual IPAddress remoteIP();
 
 	friend class TCPServer;
+	friend class spark::NetworkClass;
 
 	using Print::write;
 
@@ -72,6 +107,8 @@ private:
 	uint16_t _offset;
 	uint16_t _total;
         IPAddress _remoteIP;
+        struct WriteBuffer;
+        std::shared_ptr<WriteBuffer> _writeBuffer;
 	inline int bufferCount();
 
 };
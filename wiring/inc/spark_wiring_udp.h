@@ -32,6 +32,39 @@
 #include "spark_wiring_stream.h"
 #include "socket_hal.h"
 
+namespace spark {
+class NetworkClass;
+}
+
+/**
+ * Describes a datagram sent with {@link UDP#sendPackets} or received with {@link UDP#receivePackets}.
+ */
+struct UDPPacket {
+        /**
+         * The data to send, or the buffer to receive the datagram to.
+         */
+        uint8_t* buffer;
+
+        /**
+         * The number of bytes to send, or the size of the receive buffer.
+         */
+        size_t size;
+
+        /**
+         * The destination address, or the address of the peer that sent the datagram.
+         */
+        IPAddress remoteIP;
+
+        /**
+         * The destination port, or the port of the peer that sent the datagram.
+         */
+        uint16_t remotePort;
+
+        /**
+         * Set to the number of bytes sent or received, or a negative value on error.
+         */
+        int result;
+};
 
 class UDP : public Stream, public Printable {
 private:
@@ -89,7 +122,7 @@ private:
          */
         uint8_t _buffer_allocated;
 
-
+        friend class spark::NetworkClass;
 
 public:
 	UDP();
@@ -152,6 +185,26 @@ public:
         virtual int receivePacket(uint8_t* buffer, size_t buf_size);
         virtual int receivePacket(char* buffer, size_t buf_size) { return receivePacket((uint8_t*)buffer, buf_size); }
 
+        /**
+         * Sends several packets in one call. This does not require the UDP instance to have an allocated buffer.
+         *
+         * @param packets       The packets to send. The `result` field of each sent packet is updated.
+         * @param count         The number of packets.
+         * @return The number of packets sent, or a negative value on error.
+         */
+        virtual int sendPackets(UDPPacket* packets, size_t count);
+
+        /**
+         * Retrieves the packets that have arrived, up to `count`, in one call. This does not require the UDP
+         * instance to have an allocated buffer. Packets that don't fit in the buffer are truncated.
+         *
+         * @param packets       The buffers to read packets to. The `result`, `remoteIP` and `remotePort` fields
+         *                      of each received packet are updated.
+         * @param count         The number of packets.
+         * @return The number of packets received, or a negative value on error.
+         */
+        virtual int receivePackets(UDPPacket* packets, size_t count);
+
         /**
          * Begin writing a packet to the given destination.
          * @param ip        The IP address of the destination peer.
@@ -199,6 +252,8 @@ public:
 
 	virtual int read(char* buffer, size_t len) { return read((unsigned char*)buffer, len); };
 	virtual int peek();
+	virtual size_t peekBuffer(const uint8_t** data);
+	virtual size_t readAvailable(uint8_t* buffer, size_t size);
 
         /**
          * Blocks until all data has been sent out
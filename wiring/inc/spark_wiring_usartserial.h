@@ -38,6 +38,8 @@ private:
   bool _blocking;
 public:
   USARTSerial(HAL_USART_Serial serial, Ring_Buffer *rx_buffer, Ring_Buffer *tx_buffer);
+  // Uses byte buffers of any size, and DMA if requested in config.flags
+  USARTSerial(HAL_USART_Serial serial, const HAL_USART_Buffer_Config& config);
   virtual ~USARTSerial() {};
   void begin(unsigned long);
   void begin(unsigned long, uint32_t);
@@ -53,11 +55,17 @@ public:
   virtual void flush(void);
   size_t write(uint16_t);
   virtual size_t write(uint8_t);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  virtual size_t peekBuffer(const uint8_t** data);
+  virtual size_t readAvailable(uint8_t* buffer, size_t size);
 
   // LIN
   void breakTx(void);
   bool breakRx(void);
 
+  // Returns true if received data was lost since the previous call, with byte buffers
+  bool rxOverrun(void);
+
   inline size_t write(unsigned long n) { return write((uint16_t)n); }
   inline size_t write(long n) { return write((uint16_t)n); }
   inline size_t write(unsigned int n) { return write((uint16_t)n); }
@@ -100,6 +108,19 @@ inline void __handleSerialEvent(USARTSerial& serial, void (*handler)(void))
 
 
 #ifndef SPARK_WIRING_NO_USART_SERIAL
+/**
+ * Override to give Serial1 larger buffers, e.g.
+ *
+ *   HAL_USART_Buffer_Config acquireSerial1Buffer() {
+ *     static uint8_t rx[1024], tx[1024];
+ *     return { sizeof(HAL_USART_Buffer_Config), HAL_USART_BUFFER_DMA_RX | HAL_USART_BUFFER_DMA_TX,
+ *         rx, sizeof(rx), tx, sizeof(tx) };
+ *   }
+ *
+ * The default configuration has no buffers, which selects the standard 64 character buffers.
+ */
+HAL_USART_Buffer_Config acquireSerial1Buffer();
+
 #define Serial1 __fetch_global_Serial1()
 extern USARTSerial& __fetch_global_Serial1();
 
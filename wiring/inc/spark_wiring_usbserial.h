@@ -55,6 +55,7 @@ public:
 	virtual int availableForWrite(void);
 	virtual int available();
 	virtual void flush();
+	virtual size_t readAvailable(uint8_t* buffer, size_t size);
 
 	virtual void blockOnOverrun(bool);
 
@@ -20,9 +20,11 @@
 
 #include <cstring>
 #include <cstdlib>
+#include <cstddef>
 #include <type_traits>
 #include <iterator>
 #include <utility>
+#include <mutex>
 
 // GCC didn't support std::is_trivially_copyable trait until 5.1.0
 #if defined(__GNUC__) && (__GNUC__ * 10000 + __GNUC_MINOR__ * 100 < 50100)
@@ -46,6 +48,86 @@ struct DefaultAllocator {
     static void free(void* ptr);
 };
 
+// Lock type that does nothing, for allocators that are used by a single thread
+struct NoLock {
+    void lock() {
+    }
+
+    void unlock() {
+    }
+};
+
+// Allocator serving requests of up to BlockSize bytes from a static pool of BlockCount blocks.
+// Larger requests, and requests made while all blocks are in use, are forwarded to FallbackT.
+// Reallocating a block within BlockSize bytes doesn't move it. Note that a growing Vector may
+// reserve up to 1.5 times its size, and that a Vector of non-trivially copyable elements needs a
+// second block while it's being reallocated. Every combination of template
+// arguments has its own pool, so TagT can be used to give a set of containers a dedicated pool.
+// The pool is shared by all containers using it: unless they are used by a single thread, LockT
+// needs to be a mutex type, which is locked while the pool is updated
+template<size_t BlockSize, size_t BlockCount, typename TagT = void, typename FallbackT = DefaultAllocator,
+        typename LockT = NoLock>
+class PoolAllocator {
+public:
+    static void* malloc(size_t size);
+    static void* realloc(void* ptr, size_t size);
+    static void free(void* ptr);
+
+    static bool owns(const void* ptr);
+    static size_t usedBlocks();
+
+private:
+    union Block {
+        Block* next;
+        char data[BlockSize];
+        std::max_align_t align;
+    };
+
+    static Block blocks_[BlockCount];
+    static Block* free_; // List of released blocks
+    static size_t fresh_; // Number of blocks that have never been allocated
+    static size_t used_;
+    static LockT lock_;
+};
+
+// Allocator serving requests from a static buffer of Size bytes by bumping an offset. Memory is
+// reclaimed when the most recent allocation is released, or when all allocations are released.
+// This suits containers that are built once and then live long, or are destroyed together.
+// Requests that don't fit are forwarded to FallbackT. As with PoolAllocator, the buffer is shared
+// by all containers using it: unless they are used by a single thread, LockT needs to be a mutex
+// type, which is locked while the buffer is updated
+template<size_t Size, typename TagT = void, typename FallbackT = DefaultAllocator, typename LockT = NoLock>
+class ArenaAllocator {
+public:
+    static void* malloc(size_t size);
+    static void* realloc(void* ptr, size_t size);
+    static void free(void* ptr);
+
+    static bool owns(const void* ptr);
+    static size_t usedSize();
+
+private:
+    static const size_t ALIGNMENT = alignof(std::max_align_t);
+    static const size_t HEADER_SIZE = ALIGNMENT; // Allocation size is stored before each block
+
+    union Storage {
+        char data[Size];
+        std::max_align_t align;
+    };
+
+    static Storage storage_;
+    static size_t offset_; // Offset of the free space
+    static size_t last_; // Offset of the most recent allocation
+    static size_t count_; // Number of live allocations
+    static LockT lock_;
+
+    static size_t& header(void* ptr) {
+        return *(size_t*)((char*)ptr - HEADER_SIZE);
+    }
+
+    static void* allocate(size_t size); // Called with the lock held
+};
+
 template<typename T, typename AllocatorT = DefaultAllocator>
 class Vector {
 public:
@@ -131,6 +213,16 @@ private:
     T* data_;
     int size_, capacity_;
 
+    // Grows the capacity geometrically, so that inserting elements one by one takes amortized
+    // constant time. Falls back to the exact capacity if there's not enough memory
+    bool grow(int n) {
+        if (n <= capacity_) {
+            return true;
+        }
+        const int c = capacity_ + capacity_ / 2;
+        return (c > n && realloc(c)) || realloc(n);
+    }
+
     template<PARTICLE_VECTOR_ENABLE_IF_TRIVIALLY_COPYABLE(T)>
     bool realloc(int n) {
         T* d = nullptr;
@@ -261,6 +353,193 @@ inline void spark::DefaultAllocator::free(void* ptr) {
     ::free(ptr);
 }
 
+// spark::PoolAllocator
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+typename spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::Block
+        spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::blocks_[BlockCount];
+
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+typename spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::Block*
+        spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::free_ = nullptr;
+
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+size_t spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::fresh_ = BlockCount;
+
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+size_t spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::used_ = 0;
+
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+LockT spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::lock_;
+
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+inline void* spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::malloc(size_t size) {
+    if (size == 0 || size > BlockSize) {
+        return FallbackT::malloc(size);
+    }
+    {
+        std::lock_guard<LockT> lock(lock_);
+        Block* b = free_;
+        if (b) {
+            free_ = b->next;
+        } else if (fresh_ > 0) {
+            b = &blocks_[BlockCount - fresh_];
+            --fresh_;
+        }
+        if (b) {
+            ++used_;
+            return b;
+        }
+    }
+    return FallbackT::malloc(size);
+}
+
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+inline void* spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::realloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return malloc(size);
+    }
+    if (!owns(ptr)) {
+        return FallbackT::realloc(ptr, size);
+    }
+    if (size <= BlockSize) {
+        return ptr;
+    }
+    void* const p = FallbackT::malloc(size);
+    if (p) {
+        memcpy(p, ptr, BlockSize);
+        free(ptr);
+    }
+    return p;
+}
+
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+inline void spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::free(void* ptr) {
+    if (!owns(ptr)) {
+        FallbackT::free(ptr);
+        return;
+    }
+    std::lock_guard<LockT> lock(lock_);
+    Block* const b = (Block*)ptr;
+    b->next = free_;
+    free_ = b;
+    --used_;
+}
+
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+inline bool spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::owns(const void* ptr) {
+    return ptr >= (const void*)blocks_ && ptr < (const void*)(blocks_ + BlockCount);
+}
+
+template<size_t BlockSize, size_t BlockCount, typename TagT, typename FallbackT, typename LockT>
+inline size_t spark::PoolAllocator<BlockSize, BlockCount, TagT, FallbackT, LockT>::usedBlocks() {
+    return used_;
+}
+
+// spark::ArenaAllocator
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+const size_t spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::ALIGNMENT;
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+const size_t spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::HEADER_SIZE;
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+typename spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::Storage spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::storage_;
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+size_t spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::offset_ = 0;
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+size_t spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::last_ = 0;
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+size_t spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::count_ = 0;
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+LockT spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::lock_;
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+inline void* spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::allocate(size_t size) {
+    const size_t n = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (size == 0 || n + HEADER_SIZE > Size - offset_) {
+        return nullptr;
+    }
+    last_ = offset_;
+    void* const p = storage_.data + offset_ + HEADER_SIZE;
+    header(p) = n;
+    offset_ += n + HEADER_SIZE;
+    ++count_;
+    return p;
+}
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+inline void* spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::malloc(size_t size) {
+    {
+        std::lock_guard<LockT> lock(lock_);
+        void* const p = allocate(size);
+        if (p) {
+            return p;
+        }
+    }
+    return FallbackT::malloc(size);
+}
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+inline void* spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::realloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return malloc(size);
+    }
+    if (!owns(ptr)) {
+        return FallbackT::realloc(ptr, size);
+    }
+    size_t oldSize = 0;
+    {
+        std::lock_guard<LockT> lock(lock_);
+        oldSize = header(ptr);
+        if (size <= oldSize) {
+            return ptr;
+        }
+        const size_t n = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if ((char*)ptr - HEADER_SIZE == storage_.data + last_ && n + HEADER_SIZE <= Size - last_) {
+            // Extend the most recent allocation in place
+            header(ptr) = n;
+            offset_ = last_ + HEADER_SIZE + n;
+            return ptr;
+        }
+    }
+    void* const p = malloc(size);
+    if (p) {
+        memcpy(p, ptr, oldSize);
+        free(ptr);
+    }
+    return p;
+}
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+inline void spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::free(void* ptr) {
+    if (!owns(ptr)) {
+        FallbackT::free(ptr);
+        return;
+    }
+    std::lock_guard<LockT> lock(lock_);
+    if (--count_ == 0) {
+        offset_ = 0;
+        last_ = 0;
+    } else if ((char*)ptr - HEADER_SIZE == storage_.data + last_) {
+        offset_ = last_;
+    }
+}
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+inline bool spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::owns(const void* ptr) {
+    return ptr >= (const void*)storage_.data && ptr < (const void*)(storage_.data + Size);
+}
+
+template<size_t Size, typename TagT, typename FallbackT, typename LockT>
+inline size_t spark::ArenaAllocator<Size, TagT, FallbackT, LockT>::usedSize() {
+    std::lock_guard<LockT> lock(lock_);
+    return offset_;
+}
+
 // spark::Vector
 template<typename T, typename AllocatorT>
 inline spark::Vector<T, AllocatorT>::Vector() :
@@ -363,7 +642,7 @@ inline bool spark::Vector<T, AllocatorT>::prepend(const Vector<T, AllocatorT> &v
 
 template<typename T, typename AllocatorT>
 inline bool spark::Vector<T, AllocatorT>::insert(int i, T value) {
-    if (size_ + 1 > capacity_ && !realloc(size_ + 1)) {
+    if (!grow(size_ + 1)) {
         return false;
     }
     T* const p = data_ + i;
@@ -375,7 +654,7 @@ inline bool spark::Vector<T, AllocatorT>::insert(int i, T value) {
 
 template<typename T, typename AllocatorT>
 inline bool spark::Vector<T, AllocatorT>::insert(int i, int n, const T& value) {
-    if (size_ + n > capacity_ && !realloc(size_ + n)) {
+    if (!grow(size_ + n)) {
         return false;
     }
     T* const p = data_ + i;
@@ -387,7 +666,7 @@ inline bool spark::Vector<T, AllocatorT>::insert(int i, int n, const T& value) {
 
 template<typename T, typename AllocatorT>
 inline bool spark::Vector<T, AllocatorT>::insert(int i, const T* values, int n) {
-    if (size_ + n > capacity_ && !realloc(size_ + n)) {
+    if (!grow(size_ + n)) {
         return false;
     }
     T* const p = data_ + i;
@@ -456,7 +735,7 @@ inline T spark::Vector<T, AllocatorT>::takeAt(int i) {
     p->~T();
     move(p, p + 1, data_ + size_);
     --size_;
-    return std::move(v);
+    return v;
 }
 
 template<typename T, typename AllocatorT>
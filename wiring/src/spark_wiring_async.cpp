@@ -1,24 +0,0 @@
-/*
- * Copyright (c) 2016 Particle Industries, Inc.  All rights reserved.
- *
- * This library is free software; you can redistribute it and/or
- * modify it under the terms of the GNU Lesser General Public
- * License as published by the Free Software Foundation, either
- * version 3 of the License, or (at your option) any later version.
- *
- * This library is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
- * Lesser General Public License for more details.
- *
- * You should have received a copy of the GNU Lesser General Public
- * License along with this library; if not, see <http://www.gnu.org/licenses/>.
- */
-
-#include "spark_wiring_async.h"
-
-void particle::detail::futureCallbackWrapper(void* data) {
-    auto callbackPtr = static_cast<const std::function<void()>*>(data);
-    (*callbackPtr)();
-    delete callbackPtr;
-}
@@ -29,6 +29,29 @@ int CloudClass::call_std_user_function(void* data, const char* param, void* rese
     return (*fn)(String(param));
 }
 
+namespace {
+
+// Older system firmware doesn't pass the argument length
+inline size_t function_arg_length(const char* param, void* reserved)
+{
+    const FunctionCallInfo* info = (const FunctionCallInfo*)reserved;
+    return info ? info->arg_length : strlen(param);
+}
+
+} // namespace
+
+int CloudClass::call_raw_user_function_cstr(void* data, const char* param, void* reserved)
+{
+    user_function_int_cstr_t* fn = (user_function_int_cstr_t*)(data);
+    return (*fn)(param, function_arg_length(param, reserved));
+}
+
+int CloudClass::call_std_user_function_cstr(void* data, const char* param, void* reserved)
+{
+    user_std_function_int_cstr_t* fn = (user_std_function_int_cstr_t*)(data);
+    return (*fn)(param, function_arg_length(param, reserved));
+}
+
 void CloudClass::call_wiring_event_handler(const void* handler_data, const char *event_name, const char *data)
 {
     wiring_event_handler_t* fn = (wiring_event_handler_t*)(handler_data);
@@ -16,28 +16,63 @@
  */
 
 #include "spark_wiring_json.h"
+#include "spark_wiring_stream.h"
 
 #include <algorithm>
+#include <new>
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstdarg>
+#include <cmath>
 
 namespace {
 
+// Returns number of tokens in the subtree of a token, including the token itself. After parsing,
+// the end offset of an array or object token is replaced with the size of its subtree (see
+// setTokenSpans()), since it's not used otherwise
+inline size_t tokenSpan(const jsmntok_t *t) {
+    return (t->type == JSMN_OBJECT || t->type == JSMN_ARRAY) ? t->end : 1;
+}
+
 // Skips token and all its children tokens if any
-const jsmntok_t* skipToken(const jsmntok_t *t) {
-    size_t n = 1;
-    do {
+inline const jsmntok_t* skipToken(const jsmntok_t *t) {
+    return t + tokenSpan(t);
+}
+
+// Stores subtree sizes in array and object tokens. Tokens are processed in reverse order, so that
+// sizes of the children subtrees are known by the time their parent is processed
+bool setTokenSpans(jsmntok_t *tokens, size_t count) {
+    for (size_t i = count; i > 0; --i) {
+        jsmntok_t* const t = tokens + i - 1;
+        size_t n = 0; // Number of children
         if (t->type == JSMN_OBJECT) {
-            n += t->size * 2; // Number of name and value tokens
+            n = t->size * 2; // Number of name and value tokens
         } else if (t->type == JSMN_ARRAY) {
-            n += t->size; // Number of value tokens
+            n = t->size; // Number of value tokens
+        } else {
+            continue;
         }
-        ++t;
-        --n;
-    } while (n);
-    return t;
+        size_t span = 1;
+        while (n) {
+            if (i - 1 + span >= count) {
+                return false; // Malformed object
+            }
+            span += tokenSpan(t + span);
+            --n;
+        }
+        t->end = span;
+    }
+    return true;
+}
+
+// FNV-1a hash
+uint32_t hashName(const char *name, size_t size) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return h;
 }
 
 bool hexToInt(const char *s, size_t size, uint32_t *val) {
@@ -62,28 +97,552 @@ bool hexToInt(const char *s, size_t size, uint32_t *val) {
     return true;
 }
 
+// Unescapes a JSON string in place. This function is shared by JSONValue and JSONStreamParser
+bool unescapeString(char *data, size_t *size) {
+    char *str = data; // Destination string
+    const char* const end = data + *size; // End of the source string
+    const char *s1 = str; // Beginning of an unescaped sequence
+    const char *s = s1;
+    while (s != end) {
+        if (*s == '\\') {
+            if (s != s1) {
+                const size_t n = s - s1;
+                memmove(str, s1, n); // Shift preceeding characters
+                str += n;
+                s1 = s;
+            }
+            ++s;
+            if (s == end) {
+                return false; // Unexpected end of string
+            }
+            if (*s == 'u') { // Arbitrary character, e.g. "\u001f"
+                ++s;
+                if (end - s < 4) {
+                    return false; // Unexpected end of string
+                }
+                uint32_t u = 0; // Unicode code point or UTF-16 surrogate pair
+                if (!hexToInt(s, 4, &u)) {
+                    return false; // Invalid escaped sequence
+                }
+                if (u <= 0x7f) { // Processing only code points within the basic latin block
+                    *str = u;
+                    ++str;
+                    s1 += 6; // Skip escaped sequence
+                }
+                s += 4;
+            } else {
+                switch (*s) {
+                case '"':
+                case '\\':
+                case '/':
+                    *str = *s;
+                    break;
+                case 'b': // Backspace
+                    *str = 0x08;
+                    break;
+                case 't': // Tab
+                    *str = 0x09;
+                    break;
+                case 'n': // Line feed
+                    *str = 0x0a;
+                    break;
+                case 'f': // Form feed
+                    *str = 0x0c;
+                    break;
+                case 'r': // Carriage return
+                    *str = 0x0d;
+                    break;
+                default:
+                    return false; // Invalid escaped sequence
+                }
+                ++str;
+                ++s;
+                s1 = s; // Skip escaped sequence
+            }
+        } else {
+            ++s;
+        }
+    }
+    if (s != s1) {
+        const size_t n = s - s1;
+        memmove(str, s1, n); // Shift remaining characters
+        str += n;
+    }
+    *size = str - data; // Update string length
+    return true;
+}
+
+// Returns number of tokens to allocate initially for a document of the given size. Typical
+// documents have one token per 8 or more characters, the token storage grows if necessary
+inline size_t initialTokenCount(size_t size) {
+    return size / 8 + 4;
+}
+
+// Parses JSON data in a single pass. jsmn_parse() preserves its state when it runs out of tokens,
+// so parsing continues from where it stopped once the token storage is grown by the callback.
+// Returns number of parsed tokens or 0 in case of an error
+template<typename GrowFn>
+size_t tokenize(const char *json, size_t size, jsmntok_t *tokens, size_t count, GrowFn grow) {
+    jsmn_parser parser;
+    parser.size = sizeof(jsmn_parser);
+    jsmn_init(&parser, nullptr);
+    for (;;) {
+        const int r = jsmn_parse(&parser, json, size, tokens, count, nullptr);
+        if (r >= 0) {
+            return parser.toknext;
+        }
+        if (r != JSMN_ERROR_NOMEM) {
+            return 0; // Parsing error
+        }
+        count *= 2;
+        tokens = grow(count);
+        if (!tokens) {
+            return 0;
+        }
+    }
+}
+
+// Parses JSON data into a heap-allocated array of tokens
+bool tokenize(const char *json, size_t size, jsmntok_t **tokens, size_t *count) {
+    size_t n = initialTokenCount(size);
+    jsmntok_t *t = (jsmntok_t*)malloc(n * sizeof(jsmntok_t));
+    if (!t) {
+        return false;
+    }
+    n = tokenize(json, size, t, n, [&t](size_t count) {
+        jsmntok_t* const t2 = (jsmntok_t*)realloc(t, count * sizeof(jsmntok_t));
+        if (t2) {
+            t = t2;
+        }
+        return t2;
+    });
+    if (!n) {
+        free(t);
+        return false;
+    }
+    jsmntok_t* const t2 = (jsmntok_t*)realloc(t, n * sizeof(jsmntok_t)); // Release unused tokens
+    *tokens = t2 ? t2 : t;
+    *count = n;
+    return true;
+}
+
+// Powers of 10 that are exactly representable as double
+const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16,
+        1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+const int MAX_POW10 = sizeof(POW10) / sizeof(POW10[0]) - 1;
+
+// Maximum precision supported by formatDouble()
+const int MAX_FAST_PRECISION = 9;
+
+// Writes decimal digits of a number to the buffer ending at the specified position. Returns
+// pointer to the first digit
+char* formatUnsigned(uint32_t val, char *end) {
+    do {
+        *--end = '0' + val % 10;
+        val /= 10;
+    } while (val);
+    return end;
+}
+
+// Multiplies a number by 10^exp using at most two roundings
+inline double scalePow10(double val, int exp) {
+    if (exp > MAX_POW10) {
+        return val * POW10[MAX_POW10] * POW10[exp - MAX_POW10];
+    } else if (exp >= 0) {
+        return val * POW10[exp];
+    } else if (exp >= -MAX_POW10) {
+        return val / POW10[-exp];
+    } else {
+        return val / POW10[MAX_POW10] / POW10[-exp - MAX_POW10];
+    }
+}
+
+// Formats a floating point number the same way printf() does for the "%.*g" format. The number
+// is scaled to an integer with the requested number of significant digits, which is exact enough
+// unless the discarded fraction is close to one half. Returns number of characters written to the
+// buffer, which needs to be at least 24 characters long, or 0 if the number needs to be formatted
+// with printf()
+size_t formatDouble(double val, int prec, char *buf) {
+    if (prec <= 0) {
+        prec = 1;
+    }
+    if (prec > MAX_FAST_PRECISION || !std::isfinite(val)) {
+        return 0;
+    }
+    char *s = buf;
+    if (std::signbit(val)) {
+        *s++ = '-';
+        val = -val;
+    }
+    if (val == 0.0) {
+        *s++ = '0';
+        return s - buf;
+    }
+    if (val < 1e-30 || val >= 1e30) {
+        return 0; // Scaling would need more than two roundings
+    }
+    // Estimate decimal exponent using the binary one
+    int exp = 0;
+    std::frexp(val, &exp);
+    exp = (int)std::floor((exp - 1) * 0.30102999566398120);
+    const double minVal = POW10[prec - 1];
+    const double maxVal = POW10[prec];
+    double v = scalePow10(val, prec - 1 - exp);
+    if (v >= maxVal) {
+        ++exp;
+        v = scalePow10(val, prec - 1 - exp);
+    } else if (v < minVal) {
+        --exp;
+        v = scalePow10(val, prec - 1 - exp);
+    }
+    const double f = v - std::floor(v);
+    if (f > 0.5 - 1e-6 && f < 0.5 + 1e-6) {
+        return 0; // Rounding depends on the exact decimal value
+    }
+    uint32_t m = (uint32_t)(v + 0.5);
+    if (m == (uint32_t)maxVal) {
+        m /= 10; // Rounded up to the next power of 10
+        ++exp;
+    } else if (m < (uint32_t)minVal || m > (uint32_t)maxVal) {
+        return 0;
+    }
+    char digits[MAX_FAST_PRECISION];
+    formatUnsigned(m, digits + prec);
+    int n = prec; // Number of significant digits without trailing zeros
+    while (n > 1 && digits[n - 1] == '0') {
+        --n;
+    }
+    if (exp < -4 || exp >= prec) {
+        // Exponential notation
+        *s++ = digits[0];
+        if (n > 1) {
+            *s++ = '.';
+            memcpy(s, digits + 1, n - 1);
+            s += n - 1;
+        }
+        *s++ = 'e';
+        if (exp < 0) {
+            *s++ = '-';
+            exp = -exp;
+        } else {
+            *s++ = '+';
+        }
+        *s++ = '0' + exp / 10; // Exponent is less than 100 and has at least 2 digits
+        *s++ = '0' + exp % 10;
+    } else if (exp >= 0) {
+        // Fixed notation, integer part is not zero
+        const int intDigits = exp + 1;
+        for (int i = 0; i < intDigits; ++i) {
+            *s++ = (i < n) ? digits[i] : '0';
+        }
+        if (n > intDigits) {
+            *s++ = '.';
+            memcpy(s, digits + intDigits, n - intDigits);
+            s += n - intDigits;
+        }
+    } else {
+        // Fixed notation, integer part is zero
+        *s++ = '0';
+        *s++ = '.';
+        for (int i = -1; i > exp; --i) {
+            *s++ = '0';
+        }
+        memcpy(s, digits, n);
+        s += n;
+    }
+    return s - buf;
+}
+
+// Parses a decimal number. The conversion is exact if the significand fits 53 bits and the power
+// of 10 is exactly representable, since the result is then rounded only once. Returns false if the
+// number needs to be parsed with strtod()
+bool parseDouble(const char *s, double *val) {
+    bool neg = false;
+    if (*s == '-') {
+        neg = true;
+        ++s;
+    }
+    uint64_t m = 0;
+    int digits = 0; // Number of significant digits
+    int exp = 0;
+    bool hasDigits = false;
+    for (; *s >= '0' && *s <= '9'; ++s) {
+        m = m * 10 + (*s - '0');
+        if (m && ++digits > 19) {
+            return false; // Too many digits
+        }
+        hasDigits = true;
+    }
+    if (*s == '.') {
+        ++s;
+        for (; *s >= '0' && *s <= '9'; ++s) {
+            m = m * 10 + (*s - '0');
+            if (m && ++digits > 19) {
+                return false;
+            }
+            --exp;
+            hasDigits = true;
+        }
+    }
+    if (!hasDigits) {
+        return false;
+    }
+    if (*s == 'e' || *s == 'E') {
+        ++s;
+        bool negExp = false;
+        if (*s == '-' || *s == '+') {
+            negExp = (*s == '-');
+            ++s;
+        }
+        if (*s < '0' || *s > '9') {
+            return false;
+        }
+        int e = 0;
+        for (; *s >= '0' && *s <= '9'; ++s) {
+            e = e * 10 + (*s - '0');
+            if (e > 1000) {
+                return false;
+            }
+        }
+        exp += negExp ? -e : e;
+    }
+    if (*s != '\0' || m > ((uint64_t)1 << 53) || exp > MAX_POW10 || exp < -MAX_POW10) {
+        return false;
+    }
+    double v = (double)m;
+    if (exp > 0) {
+        v *= POW10[exp];
+    } else if (exp < 0) {
+        v /= POW10[-exp];
+    }
+    *val = neg ? -v : v;
+    return true;
+}
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Returns true if the character can be a part of a number or a literal name
+inline bool isPrimitiveChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+bool isNumber(const char *s, size_t size) {
+    if (*s == '-') {
+        ++s;
+        --size;
+    }
+    if (!size || *s < '0' || *s > '9') {
+        return false;
+    }
+    for (size_t i = 1; i < size; ++i) {
+        const char c = s[i];
+        if ((c < '0' || c > '9') && c != '-' && c != '+' && c != '.' && c != 'e' && c != 'E') {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline size_t alignedSize(size_t size, size_t align) {
+    return (size + align - 1) / align * align;
+}
+
 } // namespace
 
+// Hash index of an object's properties
+struct JSONObjectIndex {
+    JSONObjectIndex *next;
+    const jsmntok_t *object;
+    uint16_t *slots; // Offsets of name tokens relative to the object token, 0 for empty slots
+    size_t mask; // Number of slots minus one
+};
+
 // spark::detail::JSONData
 struct spark::detail::JSONData {
     jsmntok_t *tokens;
     char *json;
+    JSONArena *arena; // Arena containing this structure
+    JSONObjectIndex *indices;
+    bool freeTokens;
     bool freeJson;
 
     JSONData() :
             tokens(nullptr),
             json(nullptr),
+            arena(nullptr),
+            indices(nullptr),
+            freeTokens(false),
             freeJson(false) {
     }
 
     ~JSONData() {
-        delete[] tokens;
+        while (indices) {
+            JSONObjectIndex* const next = indices->next;
+            free(indices);
+            indices = next;
+        }
+        if (freeTokens) {
+            free(tokens);
+        }
         if (freeJson) {
             delete[] json;
         }
     }
+
+    // Builds the hash indices of the large objects. They're built once, when the data is parsed,
+    // so that lookups don't modify data shared by the copies of a JSONValue
+    void buildIndices(size_t tokenCount);
+
+    const jsmntok_t* findProperty(const jsmntok_t *object, const char *name, size_t size) const;
+
+private:
+    const JSONObjectIndex* objectIndex(const jsmntok_t *object) const;
+    void buildIndex(const jsmntok_t *object);
+    bool isName(const jsmntok_t *t, const char *name, size_t size) const;
 };
 
+namespace {
+
+using spark::detail::JSONData;
+
+const size_t ARENA_ALIGNMENT = std::max(alignof(JSONData), alignof(jsmntok_t));
+
+// Offset of the tokens in the arena's memory, which starts with the JSONData structure
+const size_t ARENA_TOKENS_OFFSET = alignedSize(sizeof(JSONData), alignof(jsmntok_t));
+
+// Minimum number of properties an object should have for its hash index to be created
+const size_t OBJECT_INDEX_MIN_SIZE = 16;
+
+} // namespace
+
+void spark::detail::JSONData::buildIndices(size_t tokenCount) {
+    const jsmntok_t* const end = tokens + tokenCount;
+    for (const jsmntok_t *t = tokens; t != end; ++t) {
+        if (t->type == JSMN_OBJECT) {
+            buildIndex(t);
+        }
+    }
+}
+
+const jsmntok_t* spark::detail::JSONData::findProperty(const jsmntok_t *object, const char *name, size_t size) const {
+    const JSONObjectIndex* const index = objectIndex(object);
+    if (index) {
+        size_t i = hashName(name, size) & index->mask;
+        while (index->slots[i]) {
+            const jsmntok_t* const t = object + index->slots[i];
+            if (isName(t, name, size)) {
+                return t;
+            }
+            i = (i + 1) & index->mask;
+        }
+        return nullptr;
+    }
+    const jsmntok_t *t = object + 1; // First property's name
+    for (size_t n = object->size; n; --n) {
+        if (isName(t, name, size)) {
+            return t;
+        }
+        t = skipToken(t + 1); // Skip name and value
+    }
+    return nullptr;
+}
+
+const JSONObjectIndex* spark::detail::JSONData::objectIndex(const jsmntok_t *object) const {
+    if ((size_t)object->size < OBJECT_INDEX_MIN_SIZE) {
+        return nullptr;
+    }
+    for (const JSONObjectIndex *index = indices; index; index = index->next) {
+        if (index->object == object) {
+            return index;
+        }
+    }
+    return nullptr;
+}
+
+void spark::detail::JSONData::buildIndex(const jsmntok_t *object) {
+    if ((size_t)object->size < OBJECT_INDEX_MIN_SIZE || (size_t)object->end > 0xffff) {
+        return; // Small object, or the offsets don't fit the index's slots
+    }
+    // Build new index with a load factor of at most 0.5
+    size_t slotCount = OBJECT_INDEX_MIN_SIZE * 2;
+    while (slotCount < (size_t)object->size * 2) {
+        slotCount *= 2;
+    }
+    const size_t size = alignedSize(sizeof(JSONObjectIndex), alignof(uint16_t)) + slotCount * sizeof(uint16_t);
+    // Indices of data parsed using an arena are allocated in the arena's unused memory
+    JSONObjectIndex* const index = (JSONObjectIndex*)(arena ? arena->allocate(size) : malloc(size));
+    if (!index) {
+        return; // Fall back to linear search
+    }
+    index->object = object;
+    index->slots = (uint16_t*)((char*)index + alignedSize(sizeof(JSONObjectIndex), alignof(uint16_t)));
+    index->mask = slotCount - 1;
+    memset(index->slots, 0, slotCount * sizeof(uint16_t));
+    const jsmntok_t *t = object + 1;
+    for (size_t n = object->size; n; --n) {
+        // Duplicate names are inserted after the first occurrence, which is then found first
+        size_t i = hashName(json + t->start, t->end - t->start) & index->mask;
+        while (index->slots[i]) {
+            i = (i + 1) & index->mask;
+        }
+        index->slots[i] = t - object;
+        t = skipToken(t + 1);
+    }
+    index->next = indices;
+    indices = index;
+}
+
+inline bool spark::detail::JSONData::isName(const jsmntok_t *t, const char *name, size_t size) const {
+    return (size_t)(t->end - t->start) == size && memcmp(json + t->start, name, size) == 0;
+}
+
+// spark::JSONArena
+spark::JSONArena::JSONArena(char *buf, size_t size) :
+        buf_(nullptr),
+        size_(0),
+        used_(0),
+        alloc_(false) {
+    const size_t offs = alignedSize((uintptr_t)buf, ARENA_ALIGNMENT) - (uintptr_t)buf;
+    if (buf && size > offs) {
+        buf_ = buf + offs;
+        size_ = size - offs;
+    }
+}
+
+spark::JSONArena::~JSONArena() {
+    if (alloc_) {
+        free(buf_);
+    }
+}
+
+void* spark::JSONArena::allocate(size_t size) {
+    const size_t offs = alignedSize(used_, ARENA_ALIGNMENT);
+    if (offs > size_ || size > size_ - offs) {
+        return nullptr;
+    }
+    used_ = offs + size;
+    return buf_ + offs;
+}
+
+bool spark::JSONArena::reserve(size_t size) {
+    if (size <= size_) {
+        return true;
+    }
+    if (!alloc_) {
+        return false; // Fixed-size buffer
+    }
+    char* const buf = (char*)realloc(buf_, size);
+    if (!buf) {
+        return false;
+    }
+    buf_ = buf;
+    size_ = size;
+    return true;
+}
+
 // spark::JSONValue
 spark::JSONValue::JSONValue(const jsmntok_t *t, detail::JSONDataPtr d) :
         JSONValue() {
@@ -142,6 +701,10 @@ double spark::JSONValue::toDouble() const {
     case JSON_TYPE_NUMBER:
     case JSON_TYPE_STRING: {
         const char* const s = d_->json + t_->start;
+        double val = 0.0;
+        if (parseDouble(s, &val)) {
+            return val;
+        }
         return strtod(s, nullptr);
     }
     default:
@@ -149,6 +712,17 @@ double spark::JSONValue::toDouble() const {
     }
 }
 
+spark::JSONValue spark::JSONValue::get(const char *name, size_t size) const {
+    if (!t_ || t_->type != JSMN_OBJECT) {
+        return JSONValue();
+    }
+    const jsmntok_t* const t = d_->findProperty(t_, name, size);
+    if (!t) {
+        return JSONValue();
+    }
+    return JSONValue(t + 1, d_);
+}
+
 spark::JSONType spark::JSONValue::type() const {
     if (!t_) {
         return JSON_TYPE_INVALID;
@@ -185,6 +759,7 @@ spark::JSONValue spark::JSONValue::parse(char *json, size_t size) {
     if (!tokenize(json, size, &d->tokens, &tokenCount)) {
         return JSONValue();
     }
+    d->freeTokens = true;
     const jsmntok_t *t = d->tokens; // Root token
     if (t->type == JSMN_PRIMITIVE) {
         // RFC 7159 allows JSON document to consist of a single primitive value, such as a number.
@@ -199,9 +774,10 @@ spark::JSONValue spark::JSONValue::parse(char *json, size_t size) {
     } else {
         d->json = json;
     }
-    if (!stringize(d->tokens, tokenCount, d->json)) {
+    if (!stringize(d->tokens, tokenCount, d->json) || !setTokenSpans(d->tokens, tokenCount)) {
         return JSONValue();
     }
+    d->buildIndices(tokenCount);
     return JSONValue(t, d);
 }
 
@@ -214,37 +790,70 @@ spark::JSONValue spark::JSONValue::parseCopy(const char *json, size_t size) {
     if (!tokenize(json, size, &d->tokens, &tokenCount)) {
         return JSONValue();
     }
+    d->freeTokens = true;
     d->json = new(std::nothrow) char[size + 1];
     if (!d->json) {
         return JSONValue();
     }
     memcpy(d->json, json, size); // TODO: Copy only token data
     d->freeJson = true;
-    if (!stringize(d->tokens, tokenCount, d->json)) {
+    if (!stringize(d->tokens, tokenCount, d->json) || !setTokenSpans(d->tokens, tokenCount)) {
         return JSONValue();
     }
+    d->buildIndices(tokenCount);
     return JSONValue(d->tokens, d);
 }
 
-bool spark::JSONValue::tokenize(const char *json, size_t size, jsmntok_t **tokens, size_t *count) {
-    jsmn_parser parser;
-    parser.size = sizeof(jsmn_parser);
-    jsmn_init(&parser, nullptr);
-    const int n = jsmn_parse(&parser, json, size, nullptr, 0, nullptr); // Get number of tokens
-    if (n <= 0) {
-        return false; // Parsing error
+spark::JSONValue spark::JSONValue::parse(const char *json, size_t size, JSONArena &arena, bool copy) {
+    // The arena's memory contains the JSONData structure, tokens and, optionally, a copy of the
+    // source data. Tokens are parsed first, since the memory can be reallocated while it grows
+    arena.used_ = 0;
+    const size_t tokOffs = ARENA_TOKENS_OFFSET;
+    size_t tokCount = (arena.size_ > tokOffs) ? (arena.size_ - tokOffs) / sizeof(jsmntok_t) : 0;
+    if (!tokCount) {
+        tokCount = initialTokenCount(size);
+        if (!arena.reserve(tokOffs + tokCount * sizeof(jsmntok_t))) {
+            return JSONValue();
+        }
     }
-    std::unique_ptr<jsmntok_t[]> t(new(std::nothrow) jsmntok_t[n]);
-    if (!t) {
-        return false;
+    tokCount = tokenize(json, size, (jsmntok_t*)(arena.buf_ + tokOffs), tokCount, [&arena, tokOffs](size_t count) {
+        if (!arena.reserve(tokOffs + count * sizeof(jsmntok_t))) {
+            return (jsmntok_t*)nullptr;
+        }
+        return (jsmntok_t*)(arena.buf_ + tokOffs);
+    });
+    if (!tokCount) {
+        return JSONValue();
     }
-    jsmn_init(&parser, nullptr); // Reset parser
-    if (jsmn_parse(&parser, json, size, t.get(), n, nullptr) <= 0) {
-        return false;
+    const size_t jsonOffs = tokOffs + tokCount * sizeof(jsmntok_t);
+    size_t usedSize = jsonOffs;
+    jsmntok_t *t = (jsmntok_t*)(arena.buf_ + tokOffs); // Root token
+    if (t->type == JSMN_PRIMITIVE) {
+        copy = true; // See parse(char*, size_t)
     }
-    *tokens = t.release();
-    *count = n;
-    return true;
+    if (copy) {
+        usedSize += size + 1;
+        if (!arena.reserve(usedSize)) {
+            return JSONValue();
+        }
+        t = (jsmntok_t*)(arena.buf_ + tokOffs);
+    }
+    detail::JSONData* const d = new(arena.buf_) detail::JSONData;
+    d->tokens = t;
+    if (copy) {
+        d->json = arena.buf_ + jsonOffs;
+        memcpy(d->json, json, size);
+    } else {
+        d->json = const_cast<char*>(json);
+    }
+    if (!stringize(d->tokens, tokCount, d->json) || !setTokenSpans(d->tokens, tokCount)) {
+        return JSONValue();
+    }
+    d->arena = &arena;
+    arena.used_ = usedSize;
+    d->buildIndices(tokCount);
+    // The data is owned by the arena, so the pointer is created without a control block
+    return JSONValue(t, detail::JSONDataPtr(detail::JSONDataPtr(), d));
 }
 
 bool spark::JSONValue::stringize(jsmntok_t *t, size_t count, char *json) {
@@ -264,76 +873,11 @@ bool spark::JSONValue::stringize(jsmntok_t *t, size_t count, char *json) {
 }
 
 bool spark::JSONValue::unescape(jsmntok_t *t, char *json) {
-    char *str = json + t->start; // Destination string
-    const char* const end = json + t->end; // End of the source string
-    const char *s1 = str; // Beginning of an unescaped sequence
-    const char *s = s1;
-    while (s != end) {
-        if (*s == '\\') {
-            if (s != s1) {
-                const size_t n = s - s1;
-                memmove(str, s1, n); // Shift preceeding characters
-                str += n;
-                s1 = s;
-            }
-            ++s;
-            if (s == end) {
-                return false; // Unexpected end of string
-            }
-            if (*s == 'u') { // Arbitrary character, e.g. "\u001f"
-                ++s;
-                if (end - s < 4) {
-                    return false; // Unexpected end of string
-                }
-                uint32_t u = 0; // Unicode code point or UTF-16 surrogate pair
-                if (!hexToInt(s, 4, &u)) {
-                    return false; // Invalid escaped sequence
-                }
-                if (u <= 0x7f) { // Processing only code points within the basic latin block
-                    *str = u;
-                    ++str;
-                    s1 += 6; // Skip escaped sequence
-                }
-                s += 4;
-            } else {
-                switch (*s) {
-                case '"':
-                case '\\':
-                case '/':
-                    *str = *s;
-                    break;
-                case 'b': // Backspace
-                    *str = 0x08;
-                    break;
-                case 't': // Tab
-                    *str = 0x09;
-                    break;
-                case 'n': // Line feed
-                    *str = 0x0a;
-                    break;
-                case 'f': // Form feed
-                    *str = 0x0c;
-                    break;
-                case 'r': // Carriage return
-                    *str = 0x0d;
-                    break;
-                default:
-                    return false; // Invalid escaped sequence
-                }
-                ++str;
-                ++s;
-                s1 = s; // Skip escaped sequence
-            }
-        } else {
-            ++s;
-        }
-    }
-    if (s != s1) {
-        const size_t n = s - s1;
-        memmove(str, s1, n); // Shift remaining characters
-        str += n;
+    size_t size = t->end - t->start;
+    if (!unescapeString(json + t->start, &size)) {
+        return false;
     }
-    t->end = str - json; // Update string length
+    t->end = t->start + size; // Update string length
     return true;
 }
 
@@ -403,6 +947,238 @@ bool spark::JSONArrayIterator::next() {
     return true;
 }
 
+// spark::JSONStreamParser
+bool spark::JSONStreamParser::parse(const char *data, size_t size) {
+    process(data, size, false /* stopWhenDone */);
+    return state_ != FAILED;
+}
+
+bool spark::JSONStreamParser::parse(Stream &stream) {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    while (state_ != DONE && state_ != FAILED && (size = stream.peekBuffer(&data)) > 0) {
+        stream.readAvailable(nullptr, process((const char*)data, size, true /* stopWhenDone */));
+    }
+    // Streams that don't provide access to their buffer are read a character at a time, so that
+    // no data following the document is consumed
+    int c = 0;
+    while (state_ != DONE && state_ != FAILED && (c = stream.peek()) >= 0) {
+        const char ch = c;
+        if (process(&ch, 1, true /* stopWhenDone */)) {
+            stream.read();
+        }
+    }
+    return state_ != FAILED;
+}
+
+bool spark::JSONStreamParser::finish() {
+    if (state_ == PRIMITIVE && depth_ == 0) {
+        endPrimitive(); // Primitive root value is terminated by the end of the data
+    }
+    if (state_ != DONE) {
+        error();
+        return false;
+    }
+    return true;
+}
+
+void spark::JSONStreamParser::reset() {
+    n_ = 0;
+    stack_ = 0;
+    depth_ = 0;
+    state_ = bufSize_ ? VALUE : FAILED;
+    nameStr_ = false;
+    escape_ = false;
+}
+
+size_t spark::JSONStreamParser::process(const char *data, size_t size, bool stopWhenDone) {
+    const char* const end = data + size;
+    const char *s = data;
+    while (s != end && state_ != FAILED) {
+        if (state_ == STRING) {
+            // Copy characters up to the closing quote, escaped sequences are processed by endString()
+            const char *p = s;
+            while (p != end) {
+                if (escape_) {
+                    escape_ = false;
+                } else if (*p == '\\') {
+                    escape_ = true;
+                } else if (*p == '"') {
+                    break;
+                }
+                ++p;
+            }
+            if (!append(s, p - s)) {
+                break;
+            }
+            s = p;
+            if (p != end) {
+                ++s; // Skip closing quote
+                endString();
+            }
+            continue;
+        }
+        if (state_ == PRIMITIVE) {
+            const char *p = s;
+            while (p != end && isPrimitiveChar(*p)) {
+                ++p;
+            }
+            if (!append(s, p - s)) {
+                break;
+            }
+            s = p;
+            if (p != end) {
+                endPrimitive(); // The character following the value is processed on next iteration
+            }
+            continue;
+        }
+        if (state_ == DONE && stopWhenDone) {
+            break;
+        }
+        const char c = *s;
+        ++s;
+        if (isSpace(c)) {
+            continue;
+        }
+        switch (state_) {
+        case FIRST_VALUE:
+            if (c == ']') {
+                endContainer(false /* object */);
+                break;
+            }
+            // Fall through
+        case VALUE:
+            beginValue(c);
+            break;
+        case FIRST_NAME:
+            if (c == '}') {
+                endContainer(true /* object */);
+                break;
+            }
+            // Fall through
+        case NAME:
+            if (c == '"') {
+                nameStr_ = true;
+                state_ = STRING;
+            } else {
+                error();
+            }
+            break;
+        case COLON:
+            if (c == ':') {
+                state_ = VALUE;
+            } else {
+                error();
+            }
+            break;
+        case NEXT:
+            if (c == ',') {
+                state_ = (stack_ & 1) ? NAME : VALUE;
+            } else if (c == ']' || c == '}') {
+                endContainer(c == '}');
+            } else {
+                error();
+            }
+            break;
+        default: // DONE
+            error(); // Unexpected data after the end of the document
+            break;
+        }
+    }
+    return s - data;
+}
+
+void spark::JSONStreamParser::beginValue(char c) {
+    if (c == '{' || c == '[') {
+        if (depth_ == MAX_DEPTH) {
+            error();
+            return;
+        }
+        stack_ = (stack_ << 1) | (c == '{');
+        ++depth_;
+        if (c == '{') {
+            state_ = FIRST_NAME;
+            beginObject();
+        } else {
+            state_ = FIRST_VALUE;
+            beginArray();
+        }
+    } else if (c == '"') {
+        nameStr_ = false;
+        state_ = STRING;
+    } else if (isPrimitiveChar(c)) {
+        n_ = 0;
+        if (append(&c, 1)) {
+            state_ = PRIMITIVE;
+        }
+    } else {
+        error();
+    }
+}
+
+void spark::JSONStreamParser::endContainer(bool object) {
+    if (!depth_ || (bool)(stack_ & 1) != object) {
+        error(); // Mismatched bracket
+        return;
+    }
+    stack_ >>= 1;
+    --depth_;
+    if (object) {
+        endObject();
+    } else {
+        endArray();
+    }
+    endValue();
+}
+
+void spark::JSONStreamParser::endString() {
+    if (escape_ || !unescapeString(buf_, &n_)) {
+        error();
+        return;
+    }
+    buf_[n_] = '\0';
+    if (nameStr_) {
+        state_ = COLON;
+        name(buf_, n_);
+    } else {
+        endValue();
+        value(JSON_TYPE_STRING, buf_, n_);
+    }
+    n_ = 0;
+}
+
+void spark::JSONStreamParser::endPrimitive() {
+    buf_[n_] = '\0';
+    JSONType type = JSON_TYPE_INVALID;
+    if (strcmp(buf_, "true") == 0 || strcmp(buf_, "false") == 0) {
+        type = JSON_TYPE_BOOL;
+    } else if (strcmp(buf_, "null") == 0) {
+        type = JSON_TYPE_NULL;
+    } else if (isNumber(buf_, n_)) {
+        type = JSON_TYPE_NUMBER;
+    } else {
+        error();
+        return;
+    }
+    endValue();
+    value(type, buf_, n_);
+    n_ = 0;
+}
+
+void spark::JSONStreamParser::endValue() {
+    state_ = depth_ ? NEXT : DONE;
+}
+
+bool spark::JSONStreamParser::append(const char *data, size_t size) {
+    if (size >= bufSize_ - n_) { // Reserve space for term. null
+        error();
+        return false;
+    }
+    memcpy(buf_ + n_, data, size);
+    n_ += size;
+    return true;
+}
+
 // spark::JSONWriter
 spark::JSONWriter& spark::JSONWriter::beginArray() {
     writeSeparator();
@@ -450,21 +1226,36 @@ spark::JSONWriter& spark::JSONWriter::value(bool val) {
 
 spark::JSONWriter& spark::JSONWriter::value(int val) {
     writeSeparator();
-    printf("%d", val);
+    char buf[11];
+    char* const end = buf + sizeof(buf);
+    char *s = formatUnsigned((val < 0) ? -(unsigned)val : (unsigned)val, end);
+    if (val < 0) {
+        *--s = '-';
+    }
+    write(s, end - s);
     state_ = NEXT;
     return *this;
 }
 
 spark::JSONWriter& spark::JSONWriter::value(unsigned val) {
     writeSeparator();
-    printf("%u", val);
+    char buf[10];
+    char* const end = buf + sizeof(buf);
+    const char* const s = formatUnsigned(val, end);
+    write(s, end - s);
     state_ = NEXT;
     return *this;
 }
 
-spark::JSONWriter& spark::JSONWriter::value(double val) {
+spark::JSONWriter& spark::JSONWriter::value(double val, int precision) {
     writeSeparator();
-    printf("%g", val);
+    char buf[24];
+    const size_t n = formatDouble(val, precision, buf);
+    if (n) {
+        write(buf, n);
+    } else {
+        printf("%.*g", precision, val);
+    }
     state_ = NEXT;
     return *this;
 }
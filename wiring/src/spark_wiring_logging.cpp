@@ -367,7 +367,7 @@ struct spark::detail::LogFilter::Node {
     const char *name; // Subcategory name
     uint16_t size; // Name length
     int16_t level; // Logging level (-1 if not specified for this node)
-    Vector<Node> nodes; // Children nodes
+    Nodes nodes; // Children nodes
 
     Node(const char *name, uint16_t size) :
             name(name),
@@ -391,13 +391,13 @@ spark::detail::LogFilter::LogFilter(LogLevel level, LogCategoryFilters filters)
         cats.append(std::move(filter.cat_));
     }
     // Process category filters
-    Vector<Node> nodes;
+    Nodes nodes;
     for (int i = 0; i < cats.size(); ++i) {
         const char *category = cats.at(i).c_str();
         if (!category) {
             continue; // Invalid usage or string allocation error
         }
-        Vector<Node> *pNodes = &nodes; // Root nodes
+        Nodes *pNodes = &nodes; // Root nodes
         const char *name = nullptr; // Subcategory name
         size_t size = 0; // Name length
         while ((name = nextSubcategoryName(category, size))) {
@@ -425,7 +425,7 @@ spark::detail::LogFilter::~LogFilter() {
 LogLevel spark::detail::LogFilter::level(const char *category) const {
     LogLevel level = level_; // Default level
     if (!nodes_.isEmpty() && category) {
-        const Vector<Node> *pNodes = &nodes_; // Root nodes
+        const Nodes *pNodes = &nodes_; // Root nodes
         const char *name = nullptr; // Subcategory name
         size_t size = 0; // Name length
         while ((name = nextSubcategoryName(category, size))) {
@@ -444,7 +444,7 @@ LogLevel spark::detail::LogFilter::level(const char *category) const {
     return level;
 }
 
-int spark::detail::LogFilter::nodeIndex(const Vector<Node> &nodes, const char *name, size_t size, bool &found) {
+int spark::detail::LogFilter::nodeIndex(const Nodes &nodes, const char *name, size_t size, bool &found) {
     // Using binary search to find existent node or suitable position for new node
     return std::distance(nodes.begin(), std::lower_bound(nodes.begin(), nodes.end(), std::make_pair(name, size),
             [&found](const Node &node, const std::pair<const char*, size_t> &value) {
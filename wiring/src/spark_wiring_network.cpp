@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2017 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spark_wiring_network.h"
+#include "spark_wiring_tcpclient.h"
+#include "spark_wiring_udp.h"
+#include "spark_wiring_ticks.h"
+#include "socket_hal.h"
+#include "system_error.h"
+
+namespace {
+
+// Maximum number of sockets that can be waited on in one call
+const size_t MAX_WAIT_SOCKETS = 16;
+
+int pollSockets(sock_poll_t* fds, size_t count, system_tick_t timeout)
+{
+    const sock_result_t ret = socket_poll(fds, count, timeout, nullptr);
+    if (ret < 0) {
+        // -1 means that the timeout expired, any HAL error that isn't a system error
+        // code is reported as an I/O error
+        return (ret <= SYSTEM_ERROR_UNKNOWN) ? ret : SYSTEM_ERROR_IO;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (fds[i].revents) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+} // namespace
+
+namespace spark {
+
+int NetworkClass::waitReadable(TCPClient* const* clients, size_t count, system_tick_t timeout)
+{
+    if (count > MAX_WAIT_SOCKETS) {
+        return SYSTEM_ERROR_LIMIT_EXCEEDED;
+    }
+    // Data that is already buffered by a client doesn't need to be waited for
+    for (size_t i = 0; i < count; ++i) {
+        if (clients[i]->_total > clients[i]->_offset) {
+            return i;
+        }
+    }
+    sock_poll_t fds[MAX_WAIT_SOCKETS];
+    for (size_t i = 0; i < count; ++i) {
+        fds[i].sock = clients[i]->sock_handle();
+        fds[i].events = SOCKET_POLL_READ;
+    }
+    const int ret = pollSockets(fds, count, timeout);
+    if (ret != SYSTEM_ERROR_NOT_SUPPORTED) {
+        return ret;
+    }
+    // The HAL can't wait on sockets, check the clients periodically instead
+    const system_tick_t start = millis();
+    for (;;) {
+        for (size_t i = 0; i < count; ++i) {
+            if (clients[i]->available() > 0 || !clients[i]->status()) {
+                return i;
+            }
+        }
+        if (millis() - start >= timeout) {
+            return -1;
+        }
+        delay(1);
+    }
+}
+
+int NetworkClass::waitReadable(UDP* const* sockets, size_t count, system_tick_t timeout)
+{
+    if (count > MAX_WAIT_SOCKETS) {
+        return SYSTEM_ERROR_LIMIT_EXCEEDED;
+    }
+    // A packet that is already parsed doesn't need to be waited for
+    for (size_t i = 0; i < count; ++i) {
+        if (sockets[i]->available() > 0) {
+            return i;
+        }
+    }
+    sock_poll_t fds[MAX_WAIT_SOCKETS];
+    for (size_t i = 0; i < count; ++i) {
+        fds[i].sock = sockets[i]->_sock;
+        fds[i].events = SOCKET_POLL_READ;
+    }
+    const int ret = pollSockets(fds, count, timeout);
+    if (ret != SYSTEM_ERROR_NOT_SUPPORTED) {
+        return ret;
+    }
+    // The HAL can't wait on sockets, try to receive a packet on each socket periodically
+    const system_tick_t start = millis();
+    for (;;) {
+        for (size_t i = 0; i < count; ++i) {
+            if (sockets[i]->parsePacket() > 0) {
+                return i;
+            }
+        }
+        if (millis() - start >= timeout) {
+            return -1;
+        }
+        delay(1);
+    }
+}
+
+int NetworkClass::waitWritable(TCPClient* const* clients, size_t count, system_tick_t timeout)
+{
+    if (count > MAX_WAIT_SOCKETS) {
+        return SYSTEM_ERROR_LIMIT_EXCEEDED;
+    }
+    sock_poll_t fds[MAX_WAIT_SOCKETS];
+    for (size_t i = 0; i < count; ++i) {
+        fds[i].sock = clients[i]->sock_handle();
+        fds[i].events = SOCKET_POLL_WRITE;
+    }
+    const int ret = pollSockets(fds, count, timeout);
+    if (ret != SYSTEM_ERROR_NOT_SUPPORTED) {
+        return ret;
+    }
+    // Sends block until the data is accepted, so any connected client is writable
+    for (size_t i = 0; i < count; ++i) {
+        if (clients[i]->status()) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+} // namespace spark
@@ -27,6 +27,8 @@
 #include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include "spark_wiring_print.h"
 #include "spark_wiring_string.h"
 #include "spark_wiring_stream.h"
@@ -255,27 +257,445 @@ size_t Print::printFloat(double number, uint8_t digits)
 
 size_t Print::printf_impl(bool newline, const char* format, ...)
 {
-    const int bufsize = 20;
-    char test[bufsize];
-    va_list marker;
-    va_start(marker, format);
-    size_t n = vsnprintf(test, bufsize, format, marker);
-    va_end(marker);
-
-    if (n<bufsize)
-    {
-        n = print(test);
+    va_list args;
+    va_start(args, format);
+    const size_t n = vprintf_impl(newline, format, args);
+    va_end(args);
+    return n;
+}
+
+size_t Print::vprintf(const char* format, va_list args)
+{
+    return vprintf_impl(false, format, args);
+}
+
+namespace {
+
+// Collects formatted output and passes it to Print::write() in chunks
+class PrintBuffer
+{
+public:
+    explicit PrintBuffer(Print* print) :
+            print_(print),
+            size_(0),
+            count_(0),
+            written_(0) {
+    }
+
+    void put(char c) {
+        if (size_ == sizeof(buf_)) {
+            flush();
+        }
+        buf_[size_++] = c;
+        ++count_;
     }
-    else
-    {
-        char bigger[n+1];
-        va_start(marker, format);
-        n = vsnprintf(bigger, n+1, format, marker);
-        va_end(marker);
-        n = print(bigger);
+
+    void put(const char* data, size_t size) {
+        if (size > sizeof(buf_) - size_) {
+            flush();
+            if (size >= sizeof(buf_)) {
+                // Large blocks are written directly
+                written_ += print_->write((const uint8_t*)data, size);
+                count_ += size;
+                return;
+            }
+        }
+        memcpy(buf_ + size_, data, size);
+        size_ += size;
+        count_ += size;
     }
-    if (newline)
-        n += println();
-    return n;
+
+    void fill(char c, size_t count) {
+        while (count--) {
+            put(c);
+        }
+    }
+
+    size_t flush() {
+        if (size_) {
+            written_ += print_->write((const uint8_t*)buf_, size_);
+            size_ = 0;
+        }
+        return written_;
+    }
+
+    size_t count() const { // Number of characters produced so far
+        return count_;
+    }
+
+private:
+    Print* print_;
+    char buf_[64];
+    size_t size_, count_, written_;
+};
+
+enum FormatFlags {
+    FLAG_LEFT = 0x01, // '-'
+    FLAG_PLUS = 0x02, // '+'
+    FLAG_SPACE = 0x04, // ' '
+    FLAG_ALT = 0x08, // '#'
+    FLAG_ZERO = 0x10 // '0'
+};
+
+// Writes a formatted field: prefix (sign or base indicator), zeros and the field's text, padded to the given width
+void putField(PrintBuffer& out, const char* prefix, size_t prefixSize, size_t zeros, const char* data, size_t size,
+        int width, unsigned flags) {
+    size_t pad = 0;
+    const size_t n = prefixSize + zeros + size;
+    if (width > 0 && (size_t)width > n) {
+        pad = width - n;
+    }
+    if (pad && !(flags & FLAG_LEFT)) {
+        if (flags & FLAG_ZERO) {
+            zeros += pad; // Zero padding goes between the prefix and the digits
+        } else {
+            out.fill(' ', pad);
+        }
+        pad = 0;
+    }
+    out.put(prefix, prefixSize);
+    out.fill('0', zeros);
+    out.put(data, size);
+    out.fill(' ', pad);
+}
+
+void putInteger(PrintBuffer& out, unsigned long long val, bool neg, char conv, int width, int prec, unsigned flags) {
+    char buf[24]; // Enough for 64-bit values in octal
+    char* const end = buf + sizeof(buf);
+    char* s = end;
+    const unsigned base = (conv == 'o') ? 8 : ((conv == 'x' || conv == 'X' || conv == 'p') ? 16 : 10);
+    const char* const digits = (conv == 'X') ? "0123456789ABCDEF" : "0123456789abcdef";
+    if (base == 10 && val <= 0xffffffffu) {
+        unsigned long v = val; // 32-bit division is much cheaper on the target platforms
+        while (v) {
+            *--s = '0' + v % 10;
+            v /= 10;
+        }
+    } else {
+        while (val) {
+            *--s = digits[val % base];
+            val /= base;
+        }
+    }
+    size_t size = end - s;
+    size_t zeros = 0;
+    if (prec < 0) {
+        prec = 1;
+    } else {
+        flags &= ~FLAG_ZERO; // '0' flag is ignored if precision is specified
+    }
+    if (size < (size_t)prec) {
+        zeros = prec - size;
+    }
+    char prefix[2];
+    size_t prefixSize = 0;
+    if (neg) {
+        prefix[prefixSize++] = '-';
+    } else if ((flags & FLAG_PLUS) && (conv == 'd' || conv == 'i')) {
+        prefix[prefixSize++] = '+';
+    } else if ((flags & FLAG_SPACE) && (conv == 'd' || conv == 'i')) {
+        prefix[prefixSize++] = ' ';
+    } else if ((flags & FLAG_ALT) && size) {
+        if (base == 16) {
+            prefix[prefixSize++] = '0';
+            prefix[prefixSize++] = (conv == 'X') ? 'X' : 'x';
+        } else if (base == 8 && !zeros) {
+            zeros = 1;
+        }
+    } else if ((flags & FLAG_ALT) && base == 8 && !size && !zeros) {
+        zeros = 1; // "%#.0o" prints 0
+    }
+    putField(out, prefix, prefixSize, zeros, s, size, width, flags);
+}
+
+// Longest floating point conversion that is printed in full, enough for "%f" of any double
+// with the default precision. Longer conversions, e.g. with a large precision, are printed in
+// exponent form instead so that the stack use doesn't depend on the arguments
+const size_t MAX_FLOAT_CONVERSION = 320;
+
+// Rare case of a conversion that doesn't fit the buffer of putFloat(), kept out of line so
+// that the larger buffer is only on the stack when it's needed
+__attribute__((noinline)) void putLongFloat(PrintBuffer& out, const char* fmt, bool longDouble, long double ldval,
+        double dval, int width, unsigned flags) {
+    char buf[MAX_FLOAT_CONVERSION + 1];
+    int n = longDouble ? snprintf(buf, sizeof(buf), fmt, ldval) : snprintf(buf, sizeof(buf), fmt, dval);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n > MAX_FLOAT_CONVERSION) {
+        // Print "%e" with the same flags and the default precision rather than a cut off number
+        char efmt[8];
+        size_t size = 0;
+        const char* f = fmt;
+        efmt[size++] = *f++;
+        while (*f == '+' || *f == ' ' || *f == '#') {
+            efmt[size++] = *f++;
+        }
+        if (longDouble) {
+            efmt[size++] = 'L';
+        }
+        const char conv = fmt[strlen(fmt) - 1];
+        efmt[size++] = (conv >= 'A' && conv <= 'Z') ? 'E' : 'e';
+        efmt[size] = '\0';
+        n = longDouble ? snprintf(buf, sizeof(buf), efmt, ldval) : snprintf(buf, sizeof(buf), efmt, dval);
+        if (n < 0 || (size_t)n > MAX_FLOAT_CONVERSION) {
+            return;
+        }
+    }
+    putField(out, nullptr, 0, 0, buf, n, width, flags & ~FLAG_ZERO);
+}
+
+// Floating point conversions are done by vsnprintf() one at a time, with the field width applied
+// separately, so only the conversion itself needs to fit the buffer
+void putFloat(PrintBuffer& out, const char* spec, size_t specSize, bool longDouble, va_list* args, int width,
+        unsigned flags) {
+    char fmt[16];
+    if (specSize >= sizeof(fmt)) {
+        return;
+    }
+    memcpy(fmt, spec, specSize);
+    fmt[specSize] = '\0';
+    char buf[64];
+    int n = 0;
+    long double ldval = 0;
+    double dval = 0;
+    if (longDouble) {
+        ldval = va_arg(*args, long double);
+        n = snprintf(buf, sizeof(buf), fmt, ldval);
+    } else {
+        dval = va_arg(*args, double);
+        n = snprintf(buf, sizeof(buf), fmt, dval);
+    }
+    if (n < 0) {
+        return;
+    }
+    const char* s = buf;
+    if ((size_t)n >= sizeof(buf)) {
+        // Very long conversion, e.g. "%f" with a large value
+        putLongFloat(out, fmt, longDouble, ldval, dval, width, flags);
+        return;
+    }
+    size_t prefixSize = 0;
+    if (*s == '-' || *s == '+' || *s == ' ') {
+        prefixSize = 1;
+    }
+    if ((s[prefixSize] == '0') && (s[prefixSize + 1] == 'x' || s[prefixSize + 1] == 'X')) {
+        prefixSize += 2; // Hexadecimal floating point
+    }
+    if (!(s[prefixSize] >= '0' && s[prefixSize] <= '9')) {
+        flags &= ~FLAG_ZERO; // Infinity and NaN are padded with spaces
+    }
+    putField(out, s, prefixSize, 0, s + prefixSize, n - prefixSize, width, flags);
+}
+
+} // namespace
+
+size_t Print::vprintf_impl(bool newline, const char* format, va_list args)
+{
+    // Copy of the argument list, so that it can be passed by pointer to the helper functions
+    va_list ap;
+    va_copy(ap, args);
+    PrintBuffer out(this);
+    const char* f = format;
+    for (;;) {
+        // Literal text
+        const char* p = strchr(f, '%');
+        if (!p) {
+            out.put(f, strlen(f));
+            break;
+        }
+        out.put(f, p - f);
+        const char* const spec = p; // Beginning of the conversion specification
+        ++p;
+        // Flags
+        unsigned flags = 0;
+        for (;; ++p) {
+            if (*p == '-') {
+                flags |= FLAG_LEFT;
+            } else if (*p == '+') {
+                flags |= FLAG_PLUS;
+            } else if (*p == ' ') {
+                flags |= FLAG_SPACE;
+            } else if (*p == '#') {
+                flags |= FLAG_ALT;
+            } else if (*p == '0') {
+                flags |= FLAG_ZERO;
+            } else {
+                break;
+            }
+        }
+        // Field width
+        int width = 0;
+        if (*p == '*') {
+            width = va_arg(ap, int);
+            if (width < 0) {
+                flags |= FLAG_LEFT;
+                width = -width;
+            }
+            ++p;
+        } else {
+            for (; *p >= '0' && *p <= '9'; ++p) {
+                width = width * 10 + (*p - '0');
+            }
+        }
+        // Precision
+        int prec = -1;
+        if (*p == '.') {
+            ++p;
+            prec = 0;
+            if (*p == '*') {
+                prec = va_arg(ap, int); // Negative precision is treated as omitted
+                ++p;
+            } else {
+                for (; *p >= '0' && *p <= '9'; ++p) {
+                    prec = prec * 10 + (*p - '0');
+                }
+            }
+        }
+        // Length modifier
+        char len = 0; // 'H' for "hh", 'L' for "ll" and "L", 'l', 'h', 'j', 'z', 't'
+        if (*p == 'h') {
+            len = (p[1] == 'h') ? 'H' : 'h';
+            p += (len == 'H') ? 2 : 1;
+        } else if (*p == 'l') {
+            len = (p[1] == 'l') ? 'L' : 'l';
+            p += (len == 'L') ? 2 : 1;
+        } else if (*p == 'L' || *p == 'j' || *p == 'z' || *p == 't') {
+            len = *p++;
+        }
+        const char conv = *p;
+        if (!conv) {
+            out.put(spec, p - spec); // Incomplete specification
+            break;
+        }
+        f = p + 1;
+        switch (conv) {
+        case 'd':
+        case 'i': {
+            long long v = 0;
+            switch (len) {
+            case 'H': v = (signed char)va_arg(ap, int); break;
+            case 'h': v = (short)va_arg(ap, int); break;
+            case 'l': v = va_arg(ap, long); break;
+            case 'L': v = va_arg(ap, long long); break;
+            case 'j': v = va_arg(ap, intmax_t); break;
+            case 'z': v = va_arg(ap, ptrdiff_t); break; // Signed type corresponding to size_t
+            case 't': v = va_arg(ap, ptrdiff_t); break;
+            default: v = va_arg(ap, int); break;
+            }
+            const bool neg = v < 0;
+            putInteger(out, neg ? -(unsigned long long)v : v, neg, conv, width, prec, flags);
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X': {
+            unsigned long long v = 0;
+            switch (len) {
+            case 'H': v = (unsigned char)va_arg(ap, unsigned); break;
+            case 'h': v = (unsigned short)va_arg(ap, unsigned); break;
+            case 'l': v = va_arg(ap, unsigned long); break;
+            case 'L': v = va_arg(ap, unsigned long long); break;
+            case 'j': v = va_arg(ap, uintmax_t); break;
+            case 'z': v = va_arg(ap, size_t); break;
+            case 't': v = va_arg(ap, size_t); break;
+            default: v = va_arg(ap, unsigned); break;
+            }
+            putInteger(out, v, false, conv, width, prec, flags);
+            break;
+        }
+        case 'p': {
+            const uintptr_t v = (uintptr_t)va_arg(ap, void*);
+            putInteger(out, v, false, conv, width, -1, (flags & ~FLAG_ZERO) | FLAG_ALT);
+            break;
+        }
+        case 'c': {
+            const char c = va_arg(ap, int);
+            putField(out, nullptr, 0, 0, &c, 1, width, flags & ~FLAG_ZERO);
+            break;
+        }
+        case 's': {
+            const char* s = va_arg(ap, const char*);
+            if (!s) {
+                s = "(null)";
+            }
+            size_t n = 0;
+            if (prec >= 0) {
+                const char* const end = (const char*)memchr(s, 0, prec);
+                n = end ? end - s : prec;
+            } else {
+                n = strlen(s);
+            }
+            putField(out, nullptr, 0, 0, s, n, width, flags & ~FLAG_ZERO);
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A': {
+            // Field width is applied by putFloat(), precision is passed to vsnprintf()
+            char fs[16];
+            size_t n = 0;
+            fs[n++] = '%';
+            if (flags & FLAG_PLUS) {
+                fs[n++] = '+';
+            }
+            if (flags & FLAG_SPACE) {
+                fs[n++] = ' ';
+            }
+            if (flags & FLAG_ALT) {
+                fs[n++] = '#';
+            }
+            if (prec >= 0) {
+                fs[n++] = '.';
+                char digits[12];
+                char* const end = digits + sizeof(digits);
+                char* d = end;
+                do {
+                    *--d = '0' + prec % 10;
+                    prec /= 10;
+                } while (prec);
+                memcpy(fs + n, d, end - d);
+                n += end - d;
+            }
+            if (len == 'L') {
+                fs[n++] = 'L';
+            }
+            fs[n++] = conv;
+            putFloat(out, fs, n, len == 'L', &ap, width, flags);
+            break;
+        }
+        case 'n': {
+            const size_t count = out.count();
+            switch (len) {
+            case 'H': *va_arg(ap, signed char*) = count; break;
+            case 'h': *va_arg(ap, short*) = count; break;
+            case 'l': *va_arg(ap, long*) = count; break;
+            case 'L': *va_arg(ap, long long*) = count; break;
+            case 'j': *va_arg(ap, intmax_t*) = count; break;
+            case 'z': *va_arg(ap, size_t*) = count; break;
+            case 't': *va_arg(ap, ptrdiff_t*) = count; break;
+            default: *va_arg(ap, int*) = count; break;
+            }
+            break;
+        }
+        case '%':
+            out.put('%');
+            break;
+        default:
+            out.put(spec, f - spec); // Unknown conversion is printed as is
+            break;
+        }
+    }
+    va_end(ap);
+    if (newline) {
+        out.put("\r\n", 2);
+    }
+    return out.flush();
 }
 
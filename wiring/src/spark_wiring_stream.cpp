@@ -26,10 +26,146 @@
 
 #include "spark_wiring_stream.h"
 #include "spark_wiring.h"       // for millis())
+#include <string.h>
 
 #define PARSE_TIMEOUT 1000  // default number of milli-seconds to wait
 #define NO_SKIP_CHAR  1  // a magic char not found in a valid ASCII numeric field
 
+// Reads characters from a stream, scanning the data buffered by the stream where possible
+// instead of calling peek() and read() for every character. Characters the cursor has moved
+// past are removed from the stream when the cursor is committed or destroyed.
+class Stream::Cursor
+{
+public:
+  explicit Cursor(Stream* stream) :
+      stream_(stream),
+      data_(NULL),
+      size_(0),
+      pos_(0) {
+  }
+
+  ~Cursor() {
+    commit();
+  }
+
+  // returns the current character, waiting for it up to the stream timeout, or -1 on timeout
+  int peek() {
+    if (pos_ < size_) {
+      return data_[pos_];
+    }
+    if (span(NULL)) {
+      return data_[pos_];
+    }
+    return stream_->timedPeek();
+  }
+
+  // moves past the current character, which must have been peeked
+  void next() {
+    if (pos_ < size_) {
+      ++pos_;
+    } else {
+      stream_->read();
+    }
+  }
+
+  // returns the number of buffered characters starting at the current one, without waiting
+  size_t span(const uint8_t** data) {
+    if (pos_ == size_) {
+      commit();
+      size_ = stream_->peekBuffer(&data_);
+    }
+    if (data) {
+      *data = data_ + pos_;
+    }
+    return size_ - pos_;
+  }
+
+  // moves past count characters returned by span()
+  void skip(size_t count) {
+    pos_ += count;
+  }
+
+  // moves to the next buffered occurrence of either character, or past the buffered data
+  void skipTo(char c1, char c2) {
+    const size_t n = span(NULL);
+    if (n == 0) {
+      return;
+    }
+    const uint8_t* p = (const uint8_t*)memchr(data_ + pos_, c1, n);
+    if (c2 != c1) {
+      const uint8_t* p2 = (const uint8_t*)memchr(data_ + pos_, c2, p ? p - (data_ + pos_) : n);
+      if (p2) {
+        p = p2;
+      }
+    }
+    pos_ = p ? p - data_ : size_;
+  }
+
+  // skips characters up to the next digit or minus sign, returns it or -1 on timeout
+  int peekNextDigit() {
+    int c;
+    while ((c = peek()) >= 0 && c != '-' && (c < '0' || c > '9')) {
+      next();
+    }
+    return c;
+  }
+
+  void commit() {
+    if (pos_) {
+      stream_->readAvailable(NULL, pos_);
+    }
+    data_ = NULL;
+    size_ = 0;
+    pos_ = 0;
+  }
+
+private:
+  Stream* stream_;
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_;
+};
+
+namespace {
+
+// Incremental search for a string in a sequence of characters
+class Matcher
+{
+public:
+  Matcher(const char* str, size_t length) :
+      str_(str),
+      length_(length),
+      index_(0) {
+  }
+
+  // returns true when the last characters passed in match the string
+  bool update(char c) {
+    while (index_ > 0 && str_[index_] != c) {
+      // fall back to the longest matched suffix that is also a prefix of the string
+      size_t k = index_ - 1;
+      while (k > 0 && memcmp(str_, str_ + index_ - k, k) != 0) {
+        --k;
+      }
+      index_ = k;
+    }
+    if (str_[index_] == c) {
+      ++index_;
+    }
+    return index_ >= length_;
+  }
+
+  bool started() const {
+    return index_ > 0;
+  }
+
+private:
+  const char* str_;
+  size_t length_;
+  size_t index_;
+};
+
+} // namespace
+
 // private method to read stream with timeout
 int Stream::timedRead()
 {
@@ -58,22 +194,25 @@ int Stream::timedPeek()
 // discards non-numeric characters
 int Stream::peekNextDigit()
 {
-  int c = -1;
-  while (1) {
-    c = timedPeek();
-    // timeout
-    if ((c < 0) || (c == '-') || (c >= '0' && c <= '9'))
-    {
-        break;
-    }
-    read();  // discard non-numeric
-  }
-  return c;
+  Cursor cursor(this);
+  return cursor.peekNextDigit();
 }
 
 // Public Methods
 //////////////////////////////////////////////////////////////
 
+size_t Stream::readAvailable(uint8_t* buffer, size_t size)
+{
+  size_t count = 0;
+  while (count < size && available() > 0) {
+    const int c = read();
+    if (c < 0) break;
+    if (buffer) buffer[count] = c;
+    count++;
+  }
+  return count;
+}
+
 void Stream::setTimeout(system_tick_t timeout)  // sets the maximum number of milliseconds to wait
 {
   _timeout = timeout;
@@ -82,7 +221,7 @@ void Stream::setTimeout(system_tick_t timeout)  // sets the maximum number of mi
  // find returns true if the target string is found
 bool  Stream::find(char *target)
 {
-  return findUntil(target, NULL);
+  return findUntil(target, strlen(target), NULL, 0);
 }
 
 // reads data from the stream until the target string of given length is found
@@ -103,32 +242,28 @@ bool  Stream::findUntil(char *target, char *terminator)
 // returns true if target string is found, false if terminated or timed out
 bool Stream::findUntil(char *target, size_t targetLen, char *terminator, size_t termLen)
 {
-  size_t index = 0;  // maximum target string length is 64k bytes!
-  size_t termIndex = 0;
-  int c;
-
-  if( *target == 0)
+  if( *target == 0 || targetLen == 0)
     return true;   // return true if target is a null string
-  while( (c = timedRead()) > 0){
 
-    if(c != target[index])
-      index = 0; // reset index if any char does not match
-
-    if( c == target[index]){
-      //////Serial.print("found "); Serial.write(c); Serial.print("index now"); Serial.println(index+1);
-      if(++index >= targetLen){ // return true if all chars in the target match
-        return true;
-      }
+  Matcher targetMatcher(target, targetLen);
+  Matcher termMatcher(terminator, termLen);
+  Cursor cursor(this);
+  int c;
+  for (;;) {
+    if (!targetMatcher.started() && !termMatcher.started()) {
+      // skip buffered characters that can't start a match
+      cursor.skipTo(target[0], termLen > 0 ? terminator[0] : target[0]);
     }
+    if ((c = cursor.peek()) < 0)
+      return false;  // timeout
+    cursor.next();
 
-    if(termLen > 0 && c == terminator[termIndex]){
-      if(++termIndex >= termLen)
-        return false;       // return false if terminate string found before target string
-    }
-    else
-      termIndex = 0;
+    if (targetMatcher.update(c))
+      return true;   // return true if all chars in the target match
+
+    if (termLen > 0 && termMatcher.update(c))
+      return false;  // return false if terminate string found before target string
   }
-  return false;
 }
 
 
@@ -147,8 +282,9 @@ long Stream::parseInt(char skipChar)
   bool isNegative = false;
   long value = 0;
   int c;
+  Cursor cursor(this);
 
-  c = peekNextDigit();
+  c = cursor.peekNextDigit();
   // ignore non numeric leading characters
   if(c < 0)
     return 0; // zero returned if timeout
@@ -161,8 +297,8 @@ long Stream::parseInt(char skipChar)
     } else if(c >= '0' && c <= '9') {        // is c a digit?
       value = value * 10 + c - '0';
     }
-    read();  // consume the character we got with peek
-    c = timedPeek();
+    cursor.next();  // consume the character we got with peek
+    c = cursor.peek();
   }
   while( (c >= '0' && c <= '9') || c == skipChar );
 
@@ -186,8 +322,9 @@ float Stream::parseFloat(char skipChar){
   long value = 0;
   char c;
   float fraction = 1.0;
+  Cursor cursor(this);
 
-  c = peekNextDigit();
+  c = cursor.peekNextDigit();
     // ignore non numeric leading characters
   if(c < 0)
     return 0; // zero returned if timeout
@@ -204,8 +341,8 @@ float Stream::parseFloat(char skipChar){
       if(isFraction)
          fraction *= 0.1;
     }
-    read();  // consume the character we got with peek
-    c = timedPeek();
+    cursor.next();  // consume the character we got with peek
+    c = cursor.peek();
   }
   while( (c >= '0' && c <= '9')  || c == '.' || c == skipChar );
 
@@ -226,10 +363,15 @@ size_t Stream::readBytes(char *buffer, size_t length)
 {
   size_t count = 0;
   while (count < length) {
-    int c = timedRead();
-    if (c < 0) break;
-    *buffer++ = (char)c;
-    count++;
+    // take whatever is buffered, then wait for more
+    size_t n = readAvailable((uint8_t*)buffer + count, length - count);
+    if (n == 0) {
+      int c = timedRead();
+      if (c < 0) break;
+      buffer[count] = (char)c;
+      n = 1;
+    }
+    count += n;
   }
   return count;
 }
@@ -243,11 +385,26 @@ size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
 {
   if (length < 1) return 0;
   size_t index = 0;
+  Cursor cursor(this);
   while (index < length) {
-    int c = timedRead();
-    if (c < 0 || c == terminator) break;
-    *buffer++ = (char)c;
-    index++;
+    const uint8_t* data;
+    size_t n = cursor.span(&data);
+    if (n > 0) {
+      // copy the buffered characters up to the terminator
+      if (n > length - index) n = length - index;
+      const uint8_t* term = (const uint8_t*)memchr(data, terminator, n);
+      if (term) n = term - data;
+      memcpy(buffer + index, data, n);
+      index += n;
+      cursor.skip(term ? n + 1 : n);
+      if (term) break;
+      continue;
+    }
+    int c = cursor.peek();
+    if (c < 0) break;
+    cursor.next();
+    if (c == terminator) break;
+    buffer[index++] = (char)c;
   }
   return index; // return number of characters, not including null terminator
 }
@@ -255,11 +412,12 @@ size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
 String Stream::readString()
 {
   String ret;
-  int c = timedRead();
-  while (c >= 0)
+  Cursor cursor(this);
+  int c;
+  while ((c = cursor.peek()) >= 0)
   {
+    cursor.next();
     ret += (char)c;
-    c = timedRead();
   }
   return ret;
 }
@@ -267,11 +425,13 @@ String Stream::readString()
 String Stream::readStringUntil(char terminator)
 {
   String ret;
-  int c = timedRead();
-  while (c >= 0 && c != terminator)
+  Cursor cursor(this);
+  int c;
+  while ((c = cursor.peek()) >= 0)
   {
+    cursor.next();
+    if (c == terminator) break;
     ret += (char)c;
-    c = timedRead();
   }
   return ret;
 }
@@ -66,6 +66,19 @@ void dtoa (double val, unsigned char prec, char *sout) {
 /*  Constructors                             */
 /*********************************************/
 
+const unsigned int String::INLINE_CAPACITY;
+
+#if !SPARK_WIRING_STRING_INLINE
+// The layout shared with the other modules
+struct StringLayout {
+	char *buffer;
+	unsigned int capacity;
+	unsigned int len;
+	unsigned char flags;
+};
+static_assert(sizeof(String) == sizeof(StringLayout), "String layout must not change in modular firmware");
+#endif
+
 String::String(const char *cstr)
 {
 	init();
@@ -163,7 +176,7 @@ String::String(double value, int decimalPlaces)
 }
 String::~String()
 {
-	free(buffer);
+	if (!isInline()) free(buffer);
 }
 
 /*********************************************/
@@ -180,7 +193,7 @@ inline void String::init(void)
 
 void String::invalidate(void)
 {
-	if (buffer) free(buffer);
+	if (buffer && !isInline()) free(buffer);
 	buffer = NULL;
 	capacity = len = 0;
 }
@@ -197,6 +210,21 @@ unsigned char String::reserve(unsigned int size)
 
 unsigned char String::changeBuffer(unsigned int maxStrLen)
 {
+	if (!buffer || isInline()) {
+#if SPARK_WIRING_STRING_INLINE
+		if (maxStrLen <= INLINE_CAPACITY) {
+			buffer = inlineBuffer;
+			capacity = INLINE_CAPACITY;
+			return 1;
+		}
+#endif
+		char *newbuffer = (char *)malloc(maxStrLen + 1);
+		if (!newbuffer) return 0;
+		if (buffer) memcpy(newbuffer, buffer, len + 1);
+		buffer = newbuffer;
+		capacity = maxStrLen;
+		return 1;
+	}
 	char *newbuffer = (char *)realloc(buffer, maxStrLen + 1);
 	if (newbuffer) {
 		buffer = newbuffer;
@@ -206,6 +234,18 @@ unsigned char String::changeBuffer(unsigned int maxStrLen)
 	return 0;
 }
 
+// Same as reserve() but grows the buffer geometrically, so that appending to
+// a string repeatedly takes amortized linear time
+unsigned char String::grow(unsigned int maxStrLen)
+{
+	if (buffer && capacity >= maxStrLen) return 1;
+	if (buffer) {
+		unsigned int size = capacity + capacity / 2;
+		if (size > maxStrLen && changeBuffer(size)) return 1;
+	}
+	return reserve(maxStrLen);
+}
+
 /*********************************************/
 /*  Copy and Move                            */
 /*********************************************/
@@ -217,7 +257,7 @@ String & String::copy(const char *cstr, unsigned int length)
 		return *this;
 	}
 	len = length;
-	memcpy(buffer, cstr, length);
+	memmove(buffer, cstr, length);
 	buffer[len] = 0;
 	return *this;
 }
@@ -225,16 +265,17 @@ String & String::copy(const char *cstr, unsigned int length)
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
 void String::move(String &rhs)
 {
-	if (buffer) {
-		if (capacity >= rhs.len) {
-			strcpy(buffer, rhs.buffer);
-			len = rhs.len;
-			rhs.len = 0;
-			return;
-		} else {
-			free(buffer);
-		}
+	if (!rhs.buffer) {
+		invalidate();
+		return;
 	}
+	if (rhs.isInline() || (buffer && capacity >= rhs.len)) {
+		copy(rhs.buffer, rhs.len);
+		rhs.len = 0;
+		rhs.buffer[0] = 0;
+		return;
+	}
+	if (buffer && !isInline()) free(buffer);
 	buffer = rhs.buffer;
 	capacity = rhs.capacity;
 	len = rhs.len;
@@ -290,9 +331,17 @@ unsigned char String::concat(const char *cstr, unsigned int length)
 	unsigned int newlen = len + length;
 	if (!cstr) return 0;
 	if (length == 0) return 1;
-	if (!reserve(newlen)) return 0;
-	strcpy(buffer + len, cstr);
+	if (buffer && cstr >= buffer && cstr < buffer + len) {
+		// appending a part of this string to itself
+		const unsigned int offset = cstr - buffer;
+		if (!grow(newlen)) return 0;
+		cstr = buffer + offset;
+	} else if (!grow(newlen)) {
+		return 0;
+	}
+	memmove(buffer + len, cstr, length);
 	len = newlen;
+	buffer[len] = 0;
 	return 1;
 }
 
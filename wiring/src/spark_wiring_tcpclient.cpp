@@ -31,6 +31,9 @@
 #include "socket_hal.h"
 #include "inet_hal.h"
 #include "spark_macros.h"
+#include "spark_wiring_ticks.h"
+#include "spark_wiring_thread.h"
+#include <algorithm>
 
 
 using namespace spark;
@@ -42,6 +45,147 @@ static bool inline isOpen(sock_handle_t sd)
    return socket_handle_valid(sd);
 }
 
+#if PLATFORM_THREADING
+/**
+ * Guards the list of write buffers and their contents: a client can be written from any
+ * thread, while the expired buffers are flushed from the application thread.
+ */
+static RecursiveMutex writeBufferLock;
+#endif
+
+/**
+ * Outgoing data buffer shared by all copies of a TCPClient. Buffers with pending data
+ * are linked into a list so that they can be flushed after each iteration of loop().
+ */
+struct TCPClient::WriteBuffer
+{
+    uint8_t* data;
+    size_t size;
+    size_t count;
+    system_tick_t timeout;
+    system_tick_t start;
+    sock_handle_t sock;
+    WriteBuffer* next;
+
+    static WriteBuffer* first;
+
+    WriteBuffer(uint8_t* data, size_t size, system_tick_t timeout, sock_handle_t sock) :
+            data(data),
+            size(size),
+            count(0),
+            timeout(timeout),
+            start(0),
+            sock(sock),
+            next(nullptr)
+    {
+        WITH_LOCK(writeBufferLock) {
+            next = first;
+            first = this;
+        }
+    }
+
+    ~WriteBuffer()
+    {
+        WITH_LOCK(writeBufferLock) {
+            flush();
+            WriteBuffer** p = &first;
+            while (*p != this) {
+                p = &(*p)->next;
+            }
+            *p = next;
+        }
+        free(data);
+    }
+
+    bool expired() const
+    {
+        return count && (millis() - start >= timeout);
+    }
+
+    /**
+     * Sends the buffered data. Data that the socket did not accept is kept in the buffer.
+     */
+    int flush()
+    {
+        WITH_LOCK(writeBufferLock) {
+            return flushLocked();
+        }
+        return 0; // not reached
+    }
+
+    int write(sock_handle_t sd, const uint8_t* buf, size_t len)
+    {
+        WITH_LOCK(writeBufferLock) {
+            return writeLocked(sd, buf, len);
+        }
+        return 0; // not reached
+    }
+
+    static void flushExpired()
+    {
+        WITH_LOCK(writeBufferLock) {
+            for (WriteBuffer* buf = first; buf; buf = buf->next) {
+                if (buf->expired()) {
+                    buf->flushLocked();
+                }
+            }
+        }
+    }
+
+private:
+    int flushLocked()
+    {
+        if (!count) {
+            return 0;
+        }
+        if (!isOpen(sock)) {
+            count = 0;
+            return -1;
+        }
+        const sock_result_t ret = socket_send(sock, data, count);
+        if (ret < 0) {
+            count = 0;
+            return ret;
+        }
+        if ((size_t)ret < count) {
+            memmove(data, data + ret, count - ret);
+        }
+        count -= ret;
+        return ret;
+    }
+
+    int writeLocked(sock_handle_t sd, const uint8_t* buf, size_t len)
+    {
+        if (sock != sd) {
+            flushLocked();
+            sock = sd;
+        }
+        // Nothing to coalesce with, send large writes directly
+        if (!count && len >= size) {
+            return socket_send(sock, buf, len);
+        }
+        size_t written = 0;
+        while (written < len) {
+            if (count == size && (flushLocked() < 0 || count == size)) {
+                break;
+            }
+            if (!count) {
+                start = millis();
+            }
+            const size_t n = std::min(size - count, len - written);
+            memcpy(data + count, buf + written, n);
+            count += n;
+            written += n;
+        }
+        if (count == size || expired()) {
+            flushLocked();
+        }
+        return written ? (int)written : -1;
+    }
+};
+
+TCPClient::WriteBuffer* TCPClient::WriteBuffer::first = nullptr;
+
 TCPClient::TCPClient() : TCPClient(socket_handle_invalid())
 {
 }
@@ -116,7 +260,28 @@ size_t TCPClient::write(uint8_t b)
 
 size_t TCPClient::write(const uint8_t *buffer, size_t size)
 {
-        return status() ? socket_send(_sock, buffer, size) : -1;
+        if (!status())
+            return -1;
+        if (_writeBuffer)
+            return _writeBuffer->write(_sock, buffer, size);
+        return socket_send(_sock, buffer, size);
+}
+
+bool TCPClient::setWriteBuffer(size_t size, system_tick_t flushTimeout)
+{
+        _writeBuffer.reset();
+        if (!size)
+            return true;
+        uint8_t* data = (uint8_t*)malloc(size);
+        if (!data)
+            return false;
+        _writeBuffer = std::make_shared<WriteBuffer>(data, size, flushTimeout, _sock);
+        return true;
+}
+
+void TCPClient::flushExpiredWrites()
+{
+        WriteBuffer::flushExpired();
 }
 
 int TCPClient::bufferCount()
@@ -159,14 +324,33 @@ int TCPClient::read()
 
 int TCPClient::read(uint8_t *buffer, size_t size)
 {
-        int read = -1;
-        if (bufferCount() || available())
+        int read = 0;
+        if (bufferCount())
         {
           read = (size > (size_t) bufferCount()) ? bufferCount() : size;
           memcpy(buffer, &_buffer[_offset], read);
           _offset += read;
         }
-        return read;
+        // Large reads bypass the internal buffer and receive straight into the caller's buffer
+        if (size - read >= arraySize(_buffer))
+        {
+          if (Network.from(nif).ready() && isOpen(_sock))
+          {
+            int ret = socket_receive(_sock, buffer + read, size - read, 0);
+            if (ret > 0)
+            {
+              DEBUG("recv(=%d)",ret);
+              read += ret;
+            }
+          }
+        }
+        else if (!read && available())
+        {
+          read = (size > (size_t) bufferCount()) ? bufferCount() : size;
+          memcpy(buffer, &_buffer[_offset], read);
+          _offset += read;
+        }
+        return read ? read : -1;
 }
 
 int TCPClient::peek()
@@ -174,6 +358,32 @@ int TCPClient::peek()
   return  (bufferCount() || available()) ? _buffer[_offset] : -1;
 }
 
+size_t TCPClient::peekBuffer(const uint8_t** data)
+{
+  if (!bufferCount())
+    available();
+  *data = &_buffer[_offset];
+  return bufferCount();
+}
+
+size_t TCPClient::readAvailable(uint8_t* buffer, size_t size)
+{
+  if (buffer)
+  {
+    const int n = read(buffer, size);
+    return n > 0 ? n : 0;
+  }
+  // Discard buffered data, refilling the buffer while more is wanted
+  size_t count = 0;
+  while (count < size && (bufferCount() || available()))
+  {
+    const size_t n = std::min(size - count, (size_t)bufferCount());
+    _offset += n;
+    count += n;
+  }
+  return count;
+}
+
 void TCPClient::flush_buffer()
 {
   _offset = 0;
@@ -182,6 +392,8 @@ void TCPClient::flush_buffer()
 
 void TCPClient::flush()
 {
+  if (_writeBuffer)
+      _writeBuffer->flush();
 }
 
 
@@ -189,6 +401,7 @@ void TCPClient::stop()
 {
   DEBUG("_sock %d closesocket", _sock);
 
+  flush();
   if (isOpen(_sock))
       socket_close(_sock);
   _sock = socket_handle_invalid();
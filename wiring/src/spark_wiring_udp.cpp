@@ -34,11 +34,27 @@
 
 using namespace spark;
 
+// The number of packets passed to the HAL in one batch call
+static const size_t UDP_BATCH_SIZE = SOCKET_BATCH_SIZE;
+
 static bool inline isOpen(sock_handle_t sd)
 {
    return sd != socket_handle_invalid();
 }
 
+static void toSockAddr(const IPAddress& ip, uint16_t port, sockaddr_t& addr)
+{
+    addr.sa_family = AF_INET;
+
+    addr.sa_data[0] = (port & 0xFF00) >> 8;
+    addr.sa_data[1] = (port & 0x00FF);
+
+    addr.sa_data[2] = ip[0];
+    addr.sa_data[3] = ip[1];
+    addr.sa_data[4] = ip[2];
+    addr.sa_data[5] = ip[3];
+}
+
 UDP::UDP() : _sock(socket_handle_invalid()), _offset(0), _total(0), _buffer(0), _buffer_size(512)
 {
 }
@@ -147,15 +163,7 @@ int UDP::endPacket()
 int UDP::sendPacket(const uint8_t* buffer, size_t buffer_size, IPAddress remoteIP, uint16_t port)
 {
     sockaddr_t remoteSockAddr;
-    remoteSockAddr.sa_family = AF_INET;
-
-    remoteSockAddr.sa_data[0] = (port & 0xFF00) >> 8;
-    remoteSockAddr.sa_data[1] = (port & 0x00FF);
-
-    remoteSockAddr.sa_data[2] = remoteIP[0];
-    remoteSockAddr.sa_data[3] = remoteIP[1];
-    remoteSockAddr.sa_data[4] = remoteIP[2];
-    remoteSockAddr.sa_data[5] = remoteIP[3];
+    toSockAddr(remoteIP, port, remoteSockAddr);
 
     int rv = socket_sendto(_sock, buffer, buffer_size, 0, &remoteSockAddr, sizeof(remoteSockAddr));
     DEBUG("sendto(buffer=%lx, size=%d)=%d",buffer, buffer_size , rv);
@@ -211,6 +219,68 @@ int UDP::receivePacket(uint8_t* buffer, size_t size)
     return ret;
 }
 
+int UDP::sendPackets(UDPPacket* packets, size_t count)
+{
+    if (!isOpen(_sock))
+        return -1;
+    sock_msg_t msgs[UDP_BATCH_SIZE];
+    size_t sent = 0;
+    while (sent < count)
+    {
+        const size_t n = min(count - sent, UDP_BATCH_SIZE);
+        for (size_t i = 0; i < n; i++)
+        {
+            UDPPacket& p = packets[sent + i];
+            msgs[i].buffer = p.buffer;
+            msgs[i].len = p.size;
+            toSockAddr(p.remoteIP, p.remotePort, msgs[i].addr);
+        }
+        const int ret = socket_sendto_batch(_sock, msgs, n, 0, NULL);
+        if (ret < 0)
+            return sent ? sent : ret;
+        for (int i = 0; i < ret; i++)
+        {
+            packets[sent + i].result = msgs[i].result;
+        }
+        sent += ret;
+        if (size_t(ret) < n)
+            break;
+    }
+    DEBUG("sendPackets(count=%d)=%d", count, sent);
+    return sent;
+}
+
+int UDP::receivePackets(UDPPacket* packets, size_t count)
+{
+    if (!Network.from(_nif).ready() || !isOpen(_sock))
+        return -1;
+    sock_msg_t msgs[UDP_BATCH_SIZE];
+    size_t received = 0;
+    while (received < count)
+    {
+        const size_t n = min(count - received, UDP_BATCH_SIZE);
+        for (size_t i = 0; i < n; i++)
+        {
+            msgs[i].buffer = packets[received + i].buffer;
+            msgs[i].len = packets[received + i].size;
+        }
+        const int ret = socket_receivefrom_batch(_sock, msgs, n, 0, NULL);
+        if (ret < 0)
+            return received ? received : ret;
+        for (int i = 0; i < ret; i++)
+        {
+            UDPPacket& p = packets[received + i];
+            p.result = msgs[i].result;
+            p.remotePort = msgs[i].addr.sa_data[0] << 8 | msgs[i].addr.sa_data[1];
+            p.remoteIP = &msgs[i].addr.sa_data[2];
+        }
+        received += ret;
+        if (size_t(ret) < n)
+            break;
+    }
+    return received;
+}
+
 int UDP::read()
 {
   return available() ? _buffer[_offset++] : -1;
@@ -233,6 +303,23 @@ int UDP::peek()
     return available() ? _buffer[_offset] : -1;
 }
 
+size_t UDP::peekBuffer(const uint8_t** data)
+{
+    *data = _buffer + _offset;
+    return available();
+}
+
+size_t UDP::readAvailable(uint8_t* buffer, size_t size)
+{
+    const size_t n = min(size, size_t(available()));
+    if (buffer)
+    {
+        memcpy(buffer, &_buffer[_offset], n);
+    }
+    _offset += n;
+    return n;
+}
+
 void UDP::flush()
 {
 }
@@ -36,6 +36,14 @@ USARTSerial::USARTSerial(HAL_USART_Serial serial, Ring_Buffer *rx_buffer, Ring_B
   _blocking = true;
   HAL_USART_Init(serial, rx_buffer, tx_buffer);
 }
+
+USARTSerial::USARTSerial(HAL_USART_Serial serial, const HAL_USART_Buffer_Config& config)
+{
+  _serial = serial;
+  // Default is blocking mode
+  _blocking = true;
+  HAL_USART_Init_Ex(serial, &config, NULL);
+}
 // Public Methods //////////////////////////////////////////////////////////////
 
 void USARTSerial::begin(unsigned long baud)
@@ -99,6 +107,21 @@ size_t USARTSerial::write(uint8_t c)
   return 0;
 }
 
+size_t USARTSerial::write(const uint8_t *buffer, size_t size)
+{
+  return HAL_USART_Write_Bytes(_serial, buffer, size, _blocking);
+}
+
+size_t USARTSerial::peekBuffer(const uint8_t** data)
+{
+  return HAL_USART_Peek_Buffer(_serial, data);
+}
+
+size_t USARTSerial::readAvailable(uint8_t* buffer, size_t size)
+{
+  return HAL_USART_Read_Bytes(_serial, buffer, size);
+}
+
 size_t USARTSerial::write(uint16_t c)
 {
   return HAL_USART_Write_NineBitData(_serial, c);
@@ -120,16 +143,38 @@ bool USARTSerial::breakRx() {
   return (bool)HAL_USART_Break_Detected(_serial);
 }
 
+bool USARTSerial::rxOverrun() {
+  return (bool)HAL_USART_Rx_Overrun(_serial, NULL);
+}
+
 #ifndef SPARK_WIRING_NO_USART_SERIAL
 // Preinstantiate Objects //////////////////////////////////////////////////////
 static Ring_Buffer serial1_rx_buffer;
 static Ring_Buffer serial1_tx_buffer;
 
-USARTSerial& __fetch_global_Serial1()
+HAL_USART_Buffer_Config __attribute__((weak)) acquireSerial1Buffer()
 {
+	HAL_USART_Buffer_Config config = {};
+	config.size = sizeof(config);
+	return config;
+}
+
+static USARTSerial& __create_Serial1()
+{
+	const HAL_USART_Buffer_Config config = acquireSerial1Buffer();
+	if (config.rx_buffer && config.tx_buffer) {
+		static USARTSerial serial1(HAL_USART_SERIAL1, config);
+		return serial1;
+	}
 	static USARTSerial serial1(HAL_USART_SERIAL1, &serial1_rx_buffer, &serial1_tx_buffer);
 	return serial1;
 }
 
+USARTSerial& __fetch_global_Serial1()
+{
+	static USARTSerial& serial1 = __create_Serial1();
+	return serial1;
+}
+
 // optional Serial2 is instantiated from libraries/Serial2/Serial2.h
 #endif
@@ -68,6 +68,21 @@ int USBSerial::read()
 	return HAL_USB_USART_Receive_Data(_serial, false);
 }
 
+size_t USBSerial::readAvailable(uint8_t* buffer, size_t size)
+{
+	// The HAL doesn't expose its receive buffer, but this still saves a virtual
+	// call and an availability check per character
+	size_t count = 0;
+	int32_t avail = HAL_USB_USART_Available_Data(_serial);
+	while (count < size && avail-- > 0) {
+		const int32_t c = HAL_USB_USART_Receive_Data(_serial, false);
+		if (c < 0) break;
+		if (buffer) buffer[count] = c;
+		count++;
+	}
+	return count;
+}
+
 int USBSerial::availableForWrite()
 {
   return HAL_USB_USART_Available_Data_For_Write(_serial);
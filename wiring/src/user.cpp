@@ -30,6 +30,7 @@
 #include "spark_wiring_usartserial.h"
 #include "spark_wiring_watchdog.h"
 #include "spark_wiring_logging.h"
+#include "spark_wiring_tcpclient.h"
 #include "rng_hal.h"
 
 
@@ -91,6 +92,7 @@ void serialEvent5() __attribute__((weak));
 
 void _post_loop()
 {
+	TCPClient::flushExpiredWrites();
 	serialEventRun();
 	application_checkin();
 }